@@ -55,8 +55,19 @@ set(lwipcore_SRCS
     ${LWIP_DIR}/src/core/tcp_cong.c
     ${LWIP_DIR}/src/core/tcp_ca_reno.c
     ${LWIP_DIR}/src/core/tcp_ca_cubic.c
+    ${LWIP_DIR}/src/core/tcp_ca_bbr.c
+    ${LWIP_DIR}/src/core/tcp_ca_dctcp.c
     ${LWIP_DIR}/src/core/tcp_in.c
     ${LWIP_DIR}/src/core/tcp_out.c
+    ${LWIP_DIR}/src/core/tcp_rack.c
+    ${LWIP_DIR}/src/core/tcp_rate.c
+    ${LWIP_DIR}/src/core/tcp_req.c
+    ${LWIP_DIR}/src/core/tcp_tw.c
+    ${LWIP_DIR}/src/core/tcp_pacing.c
+    ${LWIP_DIR}/src/core/tcp_tso.c
+    ${LWIP_DIR}/src/core/tcp_gro.c
+    ${LWIP_DIR}/src/core/tcp_seg_tree.c
+    ${LWIP_DIR}/src/core/tcp_syncookie.c
     ${LWIP_DIR}/src/core/timeouts.c
     ${LWIP_DIR}/src/core/udp.c
 )
@@ -49,8 +49,19 @@ COREFILES=$(LWIPDIR)/core/init.c \
 	$(LWIPDIR)/core/tcp_cong.c \
 	$(LWIPDIR)/core/tcp_ca_reno.c \
 	$(LWIPDIR)/core/tcp_ca_cubic.c \
+	$(LWIPDIR)/core/tcp_ca_bbr.c \
+	$(LWIPDIR)/core/tcp_ca_dctcp.c \
 	$(LWIPDIR)/core/tcp_in.c \
 	$(LWIPDIR)/core/tcp_out.c \
+	$(LWIPDIR)/core/tcp_rack.c \
+	$(LWIPDIR)/core/tcp_rate.c \
+	$(LWIPDIR)/core/tcp_req.c \
+	$(LWIPDIR)/core/tcp_tw.c \
+	$(LWIPDIR)/core/tcp_pacing.c \
+	$(LWIPDIR)/core/tcp_tso.c \
+	$(LWIPDIR)/core/tcp_gro.c \
+	$(LWIPDIR)/core/tcp_seg_tree.c \
+	$(LWIPDIR)/core/tcp_syncookie.c \
 	$(LWIPDIR)/core/timeouts.c \
 	$(LWIPDIR)/core/udp.c
 
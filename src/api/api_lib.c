@@ -1150,6 +1150,45 @@ netconn_err(struct netconn *conn)
   return err;
 }
 
+#if LWIP_TCP && LWIP_TCP_ZEROCOPY
+/**
+ * @ingroup netconn_tcp
+ * Get the zero-copy writes (netconn_write() with NETCONN_ZEROCOPY) that have
+ * been ACKed since the last call. Their data is not referenced any more and
+ * may be changed. The writes of a connection are numbered from 0 and are
+ * done in order. If the connection is reset or aborted, all data has been
+ * released when netconn_err() reports that.
+ *
+ * @param conn the TCP netconn to check
+ * @param lo receives the id of the first write done
+ * @param hi receives the id of the last write done
+ * @return ERR_OK if the writes lo to hi are done,
+ *         ERR_WOULDBLOCK if no more writes have been done since the last call
+ */
+err_t
+netconn_zerocopy_completed(struct netconn *conn, u32_t *lo, u32_t *hi)
+{
+  u32_t acked;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  LWIP_ERROR("netconn_zerocopy_completed: invalid conn", (conn != NULL), return ERR_ARG;);
+  LWIP_ERROR("netconn_zerocopy_completed: invalid pointers", (lo != NULL) && (hi != NULL), return ERR_ARG;);
+  LWIP_ERROR("netconn_zerocopy_completed: invalid conn->type",
+             (NETCONNTYPE_GROUP(netconn_type(conn)) == NETCONN_TCP), return ERR_ARG;);
+
+  SYS_ARCH_PROTECT(lev);
+  acked = conn->zc_acked;
+  SYS_ARCH_UNPROTECT(lev);
+  if (acked == conn->zc_reported) {
+    return ERR_WOULDBLOCK;
+  }
+  *lo = conn->zc_reported;
+  *hi = acked - 1;
+  conn->zc_reported = acked;
+  return ERR_OK;
+}
+#endif /* LWIP_TCP && LWIP_TCP_ZEROCOPY */
+
 /**
  * @ingroup netconn_tcp
  * Shut down one or both sides of a TCP netconn (doesn't delete it).
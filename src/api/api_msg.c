@@ -387,6 +387,12 @@ poll_tcp(void *arg, struct tcp_pcb *pcb)
     }
   }
 
+  /* Nothing left to wait for: stop polling until a write needs it again */
+  if ((conn->pcb.tcp != NULL) && (conn->state != NETCONN_WRITE) &&
+      (conn->state != NETCONN_CLOSE) && !(conn->flags & NETCONN_FLAG_CHECK_WRITESPACE)) {
+    tcp_poll(conn->pcb.tcp, NULL, NETCONN_TCP_POLL_INTERVAL);
+  }
+
   return ERR_OK;
 }
 
@@ -424,6 +430,29 @@ sent_tcp(void *arg, struct tcp_pcb *pcb, u16_t len)
   return ERR_OK;
 }
 
+#if LWIP_TCP_ZEROCOPY
+/**
+ * Zero-copy callback function for TCP netconns.
+ * Records how many zero-copy writes are done for netconn_zerocopy_completed().
+ *
+ * @see tcp.h (struct tcp_pcb.zerocopy) for parameters and return value
+ */
+static err_t
+zerocopy_tcp(void *arg, struct tcp_pcb *pcb, u32_t id)
+{
+  struct netconn *conn = (struct netconn *)arg;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  LWIP_UNUSED_ARG(pcb);
+  LWIP_ASSERT("conn != NULL", (conn != NULL));
+
+  SYS_ARCH_PROTECT(lev);
+  conn->zc_acked = id + 1;
+  SYS_ARCH_UNPROTECT(lev);
+  return ERR_OK;
+}
+#endif /* LWIP_TCP_ZEROCOPY */
+
 /**
  * Error callback function for TCP netconns.
  * Signals conn->sem, posts to all conn mboxes and calls API_EVENT.
@@ -522,8 +551,12 @@ setup_tcp(struct netconn *conn)
   tcp_arg(pcb, conn);
   tcp_recv(pcb, recv_tcp);
   tcp_sent(pcb, sent_tcp);
-  tcp_poll(pcb, poll_tcp, NETCONN_TCP_POLL_INTERVAL);
+  /* poll_tcp is only installed while a write or close waits for it */
+  tcp_poll(pcb, NULL, NETCONN_TCP_POLL_INTERVAL);
   tcp_err(pcb, err_tcp);
+#if LWIP_TCP_ZEROCOPY
+  tcp_zerocopy(pcb, zerocopy_tcp);
+#endif /* LWIP_TCP_ZEROCOPY */
 }
 
 /**
@@ -586,6 +619,9 @@ accept_function(void *arg, struct tcp_pcb *newpcb, err_t err)
     tcp_sent(pcb, NULL);
     tcp_poll(pcb, NULL, 0);
     tcp_err(pcb, NULL);
+#if LWIP_TCP_ZEROCOPY
+    tcp_zerocopy(pcb, NULL);
+#endif /* LWIP_TCP_ZEROCOPY */
     /* remove reference from to the pcb from this netconn */
     newconn->pcb.tcp = NULL;
     /* no need to drain since we know the recvmbox is empty. */
@@ -767,6 +803,10 @@ netconn_alloc(enum netconn_type t, netconn_callback callback)
   conn->callback     = callback;
 #if LWIP_TCP
   conn->current_msg  = NULL;
+#if LWIP_TCP_ZEROCOPY
+  conn->zc_acked     = 0;
+  conn->zc_reported  = 0;
+#endif /* LWIP_TCP_ZEROCOPY */
 #endif /* LWIP_TCP */
 #if LWIP_SO_SNDTIMEO
   conn->send_timeout = 0;
@@ -974,6 +1014,9 @@ lwip_netconn_do_close_internal(struct netconn *conn  WRITE_DELAYED_PARAM)
     if (shut_close) {
       tcp_poll(tpcb, NULL, 0);
       tcp_err(tpcb, NULL);
+#if LWIP_TCP_ZEROCOPY
+      tcp_zerocopy(tpcb, NULL);
+#endif /* LWIP_TCP_ZEROCOPY */
     }
   }
   /* Try to close the connection */
@@ -1097,6 +1140,9 @@ lwip_netconn_do_close_internal(struct netconn *conn  WRITE_DELAYED_PARAM)
     /* when waiting for close, set up poll interval to 500ms */
     tcp_poll(tpcb, poll_tcp, 1);
     tcp_err(tpcb, err_tcp);
+#if LWIP_TCP_ZEROCOPY
+    tcp_zerocopy(tpcb, zerocopy_tcp);
+#endif /* LWIP_TCP_ZEROCOPY */
     tcp_arg(tpcb, conn);
     /* don't restore recv callback: we don't want to receive any more data */
   }
@@ -1784,10 +1830,21 @@ err_mem:
       write_finished = 1;
     }
   }
+  if (!write_finished || (conn->flags & NETCONN_FLAG_CHECK_WRITESPACE)) {
+    /* sent_tcp may not be called if nothing is in flight: poll to go on */
+    tcp_poll(conn->pcb.tcp, poll_tcp, NETCONN_TCP_POLL_INTERVAL);
+  }
   if (write_finished) {
     /* everything was written: set back connection state
        and back to application task */
     sys_sem_t *op_completed_sem = LWIP_API_MSG_SEM(conn->current_msg);
+#if LWIP_TCP_ZEROCOPY
+    if (apiflags & NETCONN_ZEROCOPY) {
+      /* one id per netconn_write, even if the last chunk had
+         TCP_WRITE_FLAG_MORE set or the write ended early */
+      tcp_zerocopy_end(conn->pcb.tcp);
+    }
+#endif /* LWIP_TCP_ZEROCOPY */
     conn->current_msg->err = err;
     conn->current_msg = NULL;
     conn->state = NETCONN_NONE;
@@ -243,6 +243,13 @@ static void sockaddr_to_ipaddr_port(const struct sockaddr *sockaddr, ip_addr_t *
 #define LWIP_SO_SNDRCVTIMEO_GET_MS(optval) ((((const struct timeval *)(optval))->tv_sec * 1000) + (((const struct timeval *)(optval))->tv_usec / 1000))
 #endif
 
+#if LWIP_TCP && LWIP_TCP_ZEROCOPY
+/** netconn_write flag telling how to take the data of a send call */
+#define LWIP_SOCK_WRITE_COPY(flags) (((flags) & MSG_ZEROCOPY) ? NETCONN_ZEROCOPY : NETCONN_COPY)
+#else /* LWIP_TCP && LWIP_TCP_ZEROCOPY */
+#define LWIP_SOCK_WRITE_COPY(flags) NETCONN_COPY
+#endif /* LWIP_TCP && LWIP_TCP_ZEROCOPY */
+
 
 /** A struct sockaddr replacement that has the same alignment as sockaddr_in/
  *  sockaddr_in6 if instantiated.
@@ -1315,6 +1322,68 @@ lwip_recv(int s, void *mem, size_t len, int flags)
   return lwip_recvfrom(s, mem, len, flags, NULL, NULL);
 }
 
+#if LWIP_TCP && LWIP_TCP_ZEROCOPY
+/* recvmsg(MSG_ERRQUEUE): report the MSG_ZEROCOPY sends that are done in a
+ * struct sock_extended_err cmsg. This never blocks and returns no data. */
+static ssize_t
+lwip_recvmsg_errqueue(int s, struct msghdr *message)
+{
+  struct lwip_sock *sock;
+  struct cmsghdr *chdr;
+  struct sock_extended_err *serr;
+  u32_t lo, hi;
+  err_t err;
+
+  sock = get_socket(s);
+  if (!sock) {
+    return -1;
+  }
+  if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) != NETCONN_TCP) {
+    /* nothing is ever queued for these */
+    set_errno(EAGAIN);
+    done_socket(sock);
+    return -1;
+  }
+  if ((message->msg_control == NULL) ||
+      (message->msg_controllen < CMSG_SPACE(sizeof(struct sock_extended_err)))) {
+    set_errno(EINVAL);
+    done_socket(sock);
+    return -1;
+  }
+
+  err = netconn_zerocopy_completed(sock->conn, &lo, &hi);
+  if (err != ERR_OK) {
+    set_errno(err_to_errno(err));
+    done_socket(sock);
+    return -1;
+  }
+
+  chdr = CMSG_FIRSTHDR(message);
+#if LWIP_IPV6
+  if (NETCONNTYPE_ISIPV6(netconn_type(sock->conn))) {
+    chdr->cmsg_level = IPPROTO_IPV6;
+    chdr->cmsg_type = IPV6_RECVERR;
+  } else
+#endif /* LWIP_IPV6 */
+  {
+    chdr->cmsg_level = IPPROTO_IP;
+    chdr->cmsg_type = IP_RECVERR;
+  }
+  chdr->cmsg_len = CMSG_LEN(sizeof(struct sock_extended_err));
+  serr = (struct sock_extended_err *)CMSG_DATA(chdr);
+  memset(serr, 0, sizeof(struct sock_extended_err));
+  serr->ee_origin = SO_EE_ORIGIN_ZEROCOPY;
+  serr->ee_info = lo;
+  serr->ee_data = hi;
+  message->msg_controllen = CMSG_SPACE(sizeof(struct sock_extended_err));
+  message->msg_flags = MSG_ERRQUEUE;
+
+  set_errno(0);
+  done_socket(sock);
+  return 0;
+}
+#endif /* LWIP_TCP && LWIP_TCP_ZEROCOPY */
+
 ssize_t
 lwip_recvmsg(int s, struct msghdr *message, int flags)
 {
@@ -1324,6 +1393,13 @@ lwip_recvmsg(int s, struct msghdr *message, int flags)
 
   LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recvmsg(%d, message=%p, flags=0x%x)\n", s, (void *)message, flags));
   LWIP_ERROR("lwip_recvmsg: invalid message pointer", message != NULL, return ERR_ARG;);
+#if LWIP_TCP && LWIP_TCP_ZEROCOPY
+  if (flags & MSG_ERRQUEUE) {
+    LWIP_ERROR("lwip_recvmsg: unsupported flags", (flags & ~(MSG_ERRQUEUE | MSG_DONTWAIT)) == 0,
+               set_errno(EOPNOTSUPP); return -1;);
+    return lwip_recvmsg_errqueue(s, message);
+  }
+#endif /* LWIP_TCP && LWIP_TCP_ZEROCOPY */
   LWIP_ERROR("lwip_recvmsg: unsupported flags", (flags & ~(MSG_PEEK|MSG_DONTWAIT)) == 0,
              set_errno(EOPNOTSUPP); return -1;);
 
@@ -1443,7 +1519,7 @@ lwip_send(int s, const void *data, size_t size, int flags)
 #endif /* (LWIP_UDP || LWIP_RAW) */
   }
 
-  write_flags = (u8_t)(NETCONN_COPY |
+  write_flags = (u8_t)(LWIP_SOCK_WRITE_COPY(flags) |
                        ((flags & MSG_MORE)     ? NETCONN_MORE      : 0) |
                        ((flags & MSG_DONTWAIT) ? NETCONN_DONTBLOCK : 0));
   written = 0;
@@ -1477,7 +1553,7 @@ lwip_sendmsg(int s, const struct msghdr *msg, int flags)
              set_errno(err_to_errno(ERR_ARG)); done_socket(sock); return -1;);
   LWIP_ERROR("lwip_sendmsg: maximum iovs exceeded", (msg->msg_iovlen > 0) && (msg->msg_iovlen <= IOV_MAX),
              set_errno(EMSGSIZE); done_socket(sock); return -1;);
-  LWIP_ERROR("lwip_sendmsg: unsupported flags", (flags & ~(MSG_DONTWAIT | MSG_MORE)) == 0,
+  LWIP_ERROR("lwip_sendmsg: unsupported flags", (flags & ~(MSG_DONTWAIT | MSG_MORE | MSG_ZEROCOPY)) == 0,
              set_errno(EOPNOTSUPP); done_socket(sock); return -1;);
 
   LWIP_UNUSED_ARG(msg->msg_control);
@@ -1486,7 +1562,7 @@ lwip_sendmsg(int s, const struct msghdr *msg, int flags)
 
   if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
 #if LWIP_TCP
-    write_flags = (u8_t)(NETCONN_COPY |
+    write_flags = (u8_t)(LWIP_SOCK_WRITE_COPY(flags) |
                          ((flags & MSG_MORE)     ? NETCONN_MORE      : 0) |
                          ((flags & MSG_DONTWAIT) ? NETCONN_DONTBLOCK : 0));
 
@@ -2914,6 +2990,10 @@ lwip_sockopt_to_ipopt(int optname)
     return SOF_KEEPALIVE;
   case SO_REUSEADDR:
     return SOF_REUSEADDR;
+#if LWIP_SO_REUSEPORT
+  case SO_REUSEPORT:
+    return SOF_REUSEPORT;
+#endif /* LWIP_SO_REUSEPORT */
   default:
     LWIP_ASSERT("Unknown socket option", 0);
     return 0;
@@ -2965,11 +3045,21 @@ lwip_getsockopt_impl(int s, int level, int optname, void *optval, socklen_t *opt
 #if SO_REUSE
         case SO_REUSEADDR:
 #endif /* SO_REUSE */
+#if LWIP_SO_REUSEPORT
+        case SO_REUSEPORT:
+#endif /* LWIP_SO_REUSEPORT */
           if ((optname == SO_BROADCAST) &&
               (NETCONNTYPE_GROUP(sock->conn->type) != NETCONN_UDP)) {
             done_socket(sock);
             return ENOPROTOOPT;
           }
+#if LWIP_SO_REUSEPORT
+          if ((optname == SO_REUSEPORT) &&
+              (NETCONNTYPE_GROUP(sock->conn->type) != NETCONN_TCP)) {
+            done_socket(sock);
+            return ENOPROTOOPT;
+          }
+#endif /* LWIP_SO_REUSEPORT */
 
           optname = lwip_sockopt_to_ipopt(optname);
 
@@ -3055,6 +3145,13 @@ lwip_getsockopt_impl(int s, int level, int optname, void *optval, socklen_t *opt
           *(int *)optval = udp_is_flag_set(sock->conn->pcb.udp, UDP_FLAGS_NOCHKSUM) ? 1 : 0;
           break;
 #endif /* LWIP_UDP*/
+#if LWIP_TCP && LWIP_TCP_ZEROCOPY
+        case SO_ZEROCOPY:
+          LWIP_SOCKOPT_CHECK_OPTLEN_CONN_PCB_TYPE(sock, *optlen, int, NETCONN_TCP);
+          /* MSG_ZEROCOPY is always allowed */
+          *(int *)optval = 1;
+          break;
+#endif /* LWIP_TCP && LWIP_TCP_ZEROCOPY */
         default:
           LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_getsockopt(%d, SOL_SOCKET, UNIMPL: optname=0x%x, ..)\n",
                                       s, optname));
@@ -3121,7 +3218,16 @@ lwip_getsockopt_impl(int s, int level, int optname, void *optval, socklen_t *opt
 #if LWIP_TCP
     /* Level: IPPROTO_TCP */
     case IPPROTO_TCP:
-      /* Special case: all IPPROTO_TCP option take an int */
+      if (optname == TCP_CONGESTION) {
+        /* a string, also valid for listening sockets */
+        LWIP_SOCKOPT_CHECK_OPTLEN_CONN_PCB_TYPE(sock, *optlen, char, NETCONN_TCP);
+        *optlen = LWIP_MIN(*optlen, TCP_CA_NAME_MAX);
+        strncpy((char *)optval, sock->conn->pcb.tcp->cong_ops->name, *optlen);
+        LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_getsockopt(%d, IPPROTO_TCP, TCP_CONGESTION) = %s\n",
+                                    s, sock->conn->pcb.tcp->cong_ops->name));
+        break;
+      }
+      /* Special case: all other IPPROTO_TCP options take an int */
       LWIP_SOCKOPT_CHECK_OPTLEN_CONN_PCB_TYPE(sock, *optlen, int, NETCONN_TCP);
       if (sock->conn->pcb.tcp->state == LISTEN) {
         done_socket(sock);
@@ -3138,6 +3244,16 @@ lwip_getsockopt_impl(int s, int level, int optname, void *optval, socklen_t *opt
           LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_getsockopt(%d, IPPROTO_TCP, TCP_KEEPALIVE) = %d\n",
                                       s, *(int *)optval));
           break;
+        case TCP_QUICKACK:
+          *(int *)optval = tcp_quickack_enabled(sock->conn->pcb.tcp) ? 1 : 0;
+          LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_getsockopt(%d, IPPROTO_TCP, TCP_QUICKACK) = %d\n",
+                                      s, *(int *)optval));
+          break;
+        case TCP_ACK_SEGS:
+          *(int *)optval = (int)tcp_get_ack_segs(sock->conn->pcb.tcp);
+          LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_getsockopt(%d, IPPROTO_TCP, TCP_ACK_SEGS) = %d\n",
+                                      s, *(int *)optval));
+          break;
 
 #if LWIP_TCP_KEEPALIVE
         case TCP_KEEPIDLE:
@@ -3373,11 +3489,21 @@ lwip_setsockopt_impl(int s, int level, int optname, const void *optval, socklen_
 #if SO_REUSE
         case SO_REUSEADDR:
 #endif /* SO_REUSE */
+#if LWIP_SO_REUSEPORT
+        case SO_REUSEPORT:
+#endif /* LWIP_SO_REUSEPORT */
           if ((optname == SO_BROADCAST) &&
               (NETCONNTYPE_GROUP(sock->conn->type) != NETCONN_UDP)) {
             done_socket(sock);
             return ENOPROTOOPT;
           }
+#if LWIP_SO_REUSEPORT
+          if ((optname == SO_REUSEPORT) &&
+              (NETCONNTYPE_GROUP(sock->conn->type) != NETCONN_TCP)) {
+            done_socket(sock);
+            return ENOPROTOOPT;
+          }
+#endif /* LWIP_SO_REUSEPORT */
 
           optname = lwip_sockopt_to_ipopt(optname);
 
@@ -3387,6 +3513,12 @@ lwip_setsockopt_impl(int s, int level, int optname, const void *optval, socklen_
           } else {
             ip_reset_option(sock->conn->pcb.ip, optname);
           }
+#if LWIP_TCP
+          if ((optname == SOF_KEEPALIVE) &&
+              (NETCONNTYPE_GROUP(sock->conn->type) == NETCONN_TCP)) {
+            tcp_keepalive_changed(sock->conn->pcb.tcp);
+          }
+#endif /* LWIP_TCP */
           LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, SOL_SOCKET, optname=0x%x, ..) -> %s\n",
                                       s, optname, (*(const int *)optval ? "on" : "off")));
           break;
@@ -3463,6 +3595,12 @@ lwip_setsockopt_impl(int s, int level, int optname, const void *optval, socklen_
           }
           break;
 #endif /* LWIP_UDP */
+#if LWIP_TCP && LWIP_TCP_ZEROCOPY
+        case SO_ZEROCOPY:
+          /* MSG_ZEROCOPY is always allowed, accepted for compatibility */
+          LWIP_SOCKOPT_CHECK_OPTLEN_CONN_PCB_TYPE(sock, optlen, int, NETCONN_TCP);
+          break;
+#endif /* LWIP_TCP && LWIP_TCP_ZEROCOPY */
         case SO_BINDTODEVICE: {
           const struct ifreq *iface;
           struct netif *n = NULL;
@@ -3594,7 +3732,23 @@ lwip_setsockopt_impl(int s, int level, int optname, const void *optval, socklen_
 #if LWIP_TCP
     /* Level: IPPROTO_TCP */
     case IPPROTO_TCP:
-      /* Special case: all IPPROTO_TCP option take an int */
+      if (optname == TCP_CONGESTION) {
+        char name[TCP_CA_NAME_MAX];
+        socklen_t len;
+
+        /* a string, also valid for listening sockets */
+        LWIP_SOCKOPT_CHECK_OPTLEN_CONN_PCB_TYPE(sock, optlen, char, NETCONN_TCP);
+        len = LWIP_MIN(optlen, TCP_CA_NAME_MAX - 1);
+        MEMCPY(name, optval, len);
+        name[len] = 0;
+        if (tcp_set_congestion_control(sock->conn->pcb.tcp, name) != ERR_OK) {
+          err = ENOENT;
+        }
+        LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, IPPROTO_TCP, TCP_CONGESTION) -> %s\n",
+                                    s, name));
+        break;
+      }
+      /* Special case: all other IPPROTO_TCP options take an int */
       LWIP_SOCKOPT_CHECK_OPTLEN_CONN_PCB_TYPE(sock, optlen, int, NETCONN_TCP);
       if (sock->conn->pcb.tcp->state == LISTEN) {
         done_socket(sock);
@@ -3612,23 +3766,41 @@ lwip_setsockopt_impl(int s, int level, int optname, const void *optval, socklen_
           break;
         case TCP_KEEPALIVE:
           sock->conn->pcb.tcp->keep_idle = (u32_t)(*(const int *)optval);
+          tcp_keepalive_changed(sock->conn->pcb.tcp);
           LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, IPPROTO_TCP, TCP_KEEPALIVE) -> %"U32_F"\n",
                                       s, sock->conn->pcb.tcp->keep_idle));
           break;
+        case TCP_QUICKACK:
+          tcp_quickack(sock->conn->pcb.tcp, (*(const int *)optval) ? 1 : 0);
+          LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, IPPROTO_TCP, TCP_QUICKACK) -> %s\n",
+                                      s, (*(const int *)optval) ? "on" : "off") );
+          break;
+        case TCP_ACK_SEGS:
+          if ((*(const int *)optval < 1) || (*(const int *)optval > TCP_ACK_SEGS_MAX)) {
+            err = EINVAL;
+            break;
+          }
+          tcp_set_ack_segs(sock->conn->pcb.tcp, (u16_t)*(const int *)optval);
+          LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, IPPROTO_TCP, TCP_ACK_SEGS) -> %d\n",
+                                      s, *(const int *)optval));
+          break;
 
 #if LWIP_TCP_KEEPALIVE
         case TCP_KEEPIDLE:
           sock->conn->pcb.tcp->keep_idle = 1000 * (u32_t)(*(const int *)optval);
+          tcp_keepalive_changed(sock->conn->pcb.tcp);
           LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, IPPROTO_TCP, TCP_KEEPIDLE) -> %"U32_F"\n",
                                       s, sock->conn->pcb.tcp->keep_idle));
           break;
         case TCP_KEEPINTVL:
           sock->conn->pcb.tcp->keep_intvl = 1000 * (u32_t)(*(const int *)optval);
+          tcp_keepalive_changed(sock->conn->pcb.tcp);
           LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, IPPROTO_TCP, TCP_KEEPINTVL) -> %"U32_F"\n",
                                       s, sock->conn->pcb.tcp->keep_intvl));
           break;
         case TCP_KEEPCNT:
           sock->conn->pcb.tcp->keep_cnt = (u32_t)(*(const int *)optval);
+          tcp_keepalive_changed(sock->conn->pcb.tcp);
           LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_setsockopt(%d, IPPROTO_TCP, TCP_KEEPCNT) -> %"U32_F"\n",
                                       s, sock->conn->pcb.tcp->keep_cnt));
           break;
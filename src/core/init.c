@@ -151,6 +151,12 @@ PACK_STRUCT_END
 #error "If you want to use TCP, TCP_WND must fit in an u16_t, so, you have to reduce it in your lwipopts.h (or enable window scaling)"
 #endif
 #endif /* LWIP_WND_SCALE */
+#if (LWIP_TCP && LWIP_TCP_RCV_AUTOTUNE && ((TCP_RCV_AUTOTUNE_INIT > TCP_WND) || (TCP_RCV_AUTOTUNE_INIT < TCP_MSS)))
+#error "TCP_RCV_AUTOTUNE_INIT must be between TCP_MSS and TCP_WND"
+#endif
+#if (LWIP_TCP && LWIP_TCP_RCV_AUTOTUNE && ((TCP_RCV_AUTOTUNE_INIT >> TCP_RCV_SCALE) == 0))
+#error "TCP_RCV_AUTOTUNE_INIT is too small for the configured TCP_RCV_SCALE (results in zero window)!"
+#endif
 #if (LWIP_TCP && (TCP_SND_QUEUELEN > 0xffff))
 #error "If you want to use TCP, TCP_SND_QUEUELEN must fit in an u16_t, so, you have to reduce it in your lwipopts.h"
 #endif
@@ -166,9 +172,75 @@ PACK_STRUCT_END
 #if (LWIP_TCP && LWIP_TCP_SACK_OUT && !TCP_QUEUE_OOSEQ)
 #error "To use LWIP_TCP_SACK_OUT, TCP_QUEUE_OOSEQ needs to be enabled"
 #endif
+#if (LWIP_TCP && TCP_OOSEQ_TREE && !TCP_QUEUE_OOSEQ)
+#error "To use TCP_OOSEQ_TREE, TCP_QUEUE_OOSEQ needs to be enabled"
+#endif
 #if (LWIP_TCP && LWIP_TCP_SACK_OUT && (LWIP_TCP_MAX_SACK_NUM < 1))
 #error "LWIP_TCP_MAX_SACK_NUM must be greater than 0"
 #endif
+#if (LWIP_TCP && LWIP_TCP_SACK_IN && !LWIP_TCP_SACK_OUT)
+#error "To use LWIP_TCP_SACK_IN, LWIP_TCP_SACK_OUT needs to be enabled"
+#endif
+#if (LWIP_TCP && LWIP_TCP_RATE_SAMPLE && !LWIP_TCP_RTT_MS)
+#error "To use LWIP_TCP_RATE_SAMPLE, LWIP_TCP_RTT_MS needs to be enabled"
+#endif
+#if (LWIP_TCP && LWIP_TCP_BBR && !LWIP_TCP_RATE_SAMPLE)
+#error "To use LWIP_TCP_BBR, LWIP_TCP_RATE_SAMPLE needs to be enabled"
+#endif
+#if (LWIP_TCP && LWIP_TCP_DCTCP && !LWIP_TCP_ECN)
+#error "To use LWIP_TCP_DCTCP, LWIP_TCP_ECN needs to be enabled"
+#endif
+#if (LWIP_TCP && ((TCP_CA_PRIV_SIZE < 60) || (LWIP_TCP_HYSTART_PP && (TCP_CA_PRIV_SIZE < 72)) || (LWIP_TCP_BBR && (TCP_CA_PRIV_SIZE < 76))))
+#error "TCP_CA_PRIV_SIZE is too small for the built-in congestion controls: cubic needs 60 (72 with LWIP_TCP_HYSTART_PP), BBR needs 76"
+#endif
+#if (LWIP_TCP && LWIP_TCP_PACING && !LWIP_TCP_RTT_MS)
+#error "To use LWIP_TCP_PACING, LWIP_TCP_RTT_MS needs to be enabled"
+#endif
+#if (LWIP_TCP && LWIP_TCP_TSO && LWIP_NETIF_TX_SINGLE_PBUF)
+#error "LWIP_TCP_TSO builds super-segments from pbuf chains and can't be used with LWIP_NETIF_TX_SINGLE_PBUF"
+#endif
+#if (LWIP_TCP && ((TCP_ACK_SEGS_DEFAULT < 1) || (TCP_ACK_SEGS_DEFAULT > TCP_ACK_SEGS_MAX) || (TCP_ACK_SEGS_MAX > 0xffff)))
+#error "TCP_ACK_SEGS_DEFAULT must be between 1 and TCP_ACK_SEGS_MAX, which must fit an u16_t"
+#endif
+#if (LWIP_TCP && (TCP_QUICKACK_SEGS > 0xff))
+#error "TCP_QUICKACK_SEGS must be below 256"
+#endif
+#if (LWIP_TCP && LWIP_TCP_ZEROCOPY && (!LWIP_CALLBACK_API || LWIP_NETIF_TX_SINGLE_PBUF))
+#error "LWIP_TCP_ZEROCOPY needs LWIP_CALLBACK_API and can't be used with LWIP_NETIF_TX_SINGLE_PBUF"
+#endif
+#if (LWIP_TCP && LWIP_TCP_RACK && (!LWIP_TCP_SACK_IN || !LWIP_TCP_RTT_MS || !LWIP_TIMERS || LWIP_TIMERS_CUSTOM))
+#error "To use LWIP_TCP_RACK, LWIP_TCP_SACK_IN, LWIP_TCP_RTT_MS and LWIP_TIMERS (without LWIP_TIMERS_CUSTOM) need to be enabled"
+#endif
+#if (LWIP_TCP && LWIP_TCP_PCB_HASH && ((TCP_PCB_HASH_SIZE < 1) || ((TCP_PCB_HASH_SIZE & (TCP_PCB_HASH_SIZE - 1)) != 0)))
+#error "TCP_PCB_HASH_SIZE must be a power of 2"
+#endif
+#if (LWIP_TCP && LWIP_TCP_PCB_HASH && ((TCP_LISTEN_HASH_SIZE < 1) || ((TCP_LISTEN_HASH_SIZE & (TCP_LISTEN_HASH_SIZE - 1)) != 0)))
+#error "TCP_LISTEN_HASH_SIZE must be a power of 2"
+#endif
+#if (LWIP_TIMERS && LWIP_TIMERS_HEAP && ((LWIP_TIMERS_HASH_SIZE < 1) || ((LWIP_TIMERS_HASH_SIZE & (LWIP_TIMERS_HASH_SIZE - 1)) != 0)))
+#error "LWIP_TIMERS_HASH_SIZE must be a power of 2"
+#endif
+#if (LWIP_TCP && LWIP_TCP_SYNCOOKIES && !defined LWIP_RAND)
+#error "If you want to use LWIP_TCP_SYNCOOKIES, you have to define LWIP_RAND=(random function) in your lwipopts.h or cc.h"
+#endif
+#if (LWIP_TCP && LWIP_TCP_REQ_TABLE && ((TCP_REQ_HASH_SIZE < 1) || ((TCP_REQ_HASH_SIZE & (TCP_REQ_HASH_SIZE - 1)) != 0)))
+#error "TCP_REQ_HASH_SIZE must be a power of 2"
+#endif
+#if (LWIP_TCP_REQ_TABLE && !LWIP_TCP)
+#error "If you want to use LWIP_TCP_REQ_TABLE, you have to define LWIP_TCP=1 in your lwipopts.h"
+#endif
+#if (LWIP_TCP && LWIP_TCP_TW_TABLE && ((TCP_TW_HASH_SIZE < 1) || ((TCP_TW_HASH_SIZE & (TCP_TW_HASH_SIZE - 1)) != 0)))
+#error "TCP_TW_HASH_SIZE must be a power of 2"
+#endif
+#if (LWIP_TCP_TW_TABLE && !LWIP_TCP)
+#error "If you want to use LWIP_TCP_TW_TABLE, you have to define LWIP_TCP=1 in your lwipopts.h"
+#endif
+#if (LWIP_TCP && LWIP_TCP_TIMER_WHEEL && ((TCP_TIMER_WHEEL_SIZE < 2) || ((TCP_TIMER_WHEEL_SIZE & (TCP_TIMER_WHEEL_SIZE - 1)) != 0)))
+#error "TCP_TIMER_WHEEL_SIZE must be a power of 2 (at least 2)"
+#endif
+#if (LWIP_SO_REUSEPORT && !(LWIP_TCP && LWIP_TCP_PCB_HASH))
+#error "If you want to use LWIP_SO_REUSEPORT, you have to define LWIP_TCP=1 and LWIP_TCP_PCB_HASH=1 in your lwipopts.h"
+#endif
 #if (LWIP_NETIF_API && (NO_SYS==1))
 #error "If you want to use NETIF API, you have to define NO_SYS=0 in your lwipopts.h"
 #endif
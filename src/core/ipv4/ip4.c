@@ -740,6 +740,12 @@ ip4_input(struct pbuf *p, struct netif *inp)
 #if LWIP_TCP
       case IP_PROTO_TCP:
         MIB2_STATS_INC(mib2.ipindelivers);
+#if LWIP_TCP_GRO
+        if (tcp_gro_receive(p, inp)) {
+          /* held back for merging, passed on by netif_gro_flush() */
+          break;
+        }
+#endif /* LWIP_TCP_GRO */
         tcp_input(p, inp);
         break;
 #endif /* LWIP_TCP */
@@ -966,6 +972,12 @@ ip4_output_if_opt_src(struct pbuf *p, const ip4_addr_t *src, const ip4_addr_t *d
     chk_sum += iphdr->_id;
 #endif /* CHECKSUM_GEN_IP_INLINE */
     ++ip_id;
+#if LWIP_TCP && LWIP_TCP_TSO
+    if (p->tso_segsz != 0) {
+      /* reserve an id for every frame the super-segment is split into */
+      ip_id = (u16_t)(ip_id + (p->tot_len - ip_hlen - 1) / p->tso_segsz);
+    }
+#endif /* LWIP_TCP && LWIP_TCP_TSO */
 
     if (src == NULL) {
       ip4_addr_copy(iphdr->src, *IP4_ADDR_ANY4);
@@ -1030,6 +1042,18 @@ ip4_output_if_opt_src(struct pbuf *p, const ip4_addr_t *src, const ip4_addr_t *d
   }
 #endif /* LWIP_MULTICAST_TX_OPTIONS */
 #endif /* ENABLE_LOOPBACK */
+#if LWIP_TCP && LWIP_TCP_TSO
+  if (p->tso_segsz != 0) {
+    if (!(netif->flags & NETIF_FLAG_TSO)) {
+      ip_addr_t gso_dest;
+      ip_addr_copy_from_ip4(gso_dest, *dest);
+      return tcp_gso_output(p, netif, &gso_dest);
+    }
+    /* the netif splits it into frames of p->tso_segsz */
+    LWIP_DEBUGF(IP_DEBUG, ("ip4_output_if: call netif->output() for TSO\n"));
+    return netif->output(netif, p, dest);
+  }
+#endif /* LWIP_TCP && LWIP_TCP_TSO */
 #if IP_FRAG
   /* don't fragment if interface has mtu set to 0 [loopif] */
   if (netif->mtu && (p->tot_len > netif->mtu)) {
@@ -1074,6 +1074,12 @@ options_done:
 #endif /* LWIP_UDP */
 #if LWIP_TCP
     case IP6_NEXTH_TCP:
+#if LWIP_TCP_GRO
+      if (tcp_gro_receive(p, inp)) {
+        /* held back for merging, passed on by netif_gro_flush() */
+        break;
+      }
+#endif /* LWIP_TCP_GRO */
       tcp_input(p, inp);
       break;
 #endif /* LWIP_TCP */
@@ -1258,6 +1264,18 @@ ip6_output_if_src(struct pbuf *p, const ip6_addr_t *src, const ip6_addr_t *dest,
   }
 #endif /* LWIP_MULTICAST_TX_OPTIONS */
 #endif /* ENABLE_LOOPBACK */
+#if LWIP_TCP && LWIP_TCP_TSO
+  if (p->tso_segsz != 0) {
+    if (!(netif->flags & NETIF_FLAG_TSO)) {
+      ip_addr_t gso_dest;
+      ip_addr_copy_from_ip6(gso_dest, *dest);
+      return tcp_gso_output(p, netif, &gso_dest);
+    }
+    /* the netif splits it into frames of p->tso_segsz */
+    LWIP_DEBUGF(IP6_DEBUG, ("netif->output_ip6() for TSO\n"));
+    return netif->output_ip6(netif, p, dest);
+  }
+#endif /* LWIP_TCP && LWIP_TCP_TSO */
 #if LWIP_IPV6_FRAG
   /* don't fragment if interface has mtu set to 0 [loopif] */
   if (netif_mtu6(netif) && (p->tot_len > nd6_get_destination_mtu(dest, netif))) {
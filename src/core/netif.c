@@ -240,6 +240,26 @@ netif_input(struct pbuf *p, struct netif *inp)
     return ip_input(p, inp);
 }
 
+#if LWIP_TCP_GRO
+/**
+ * @ingroup netif
+ * Pass the TCP segments GRO merged from the frames of the last receive burst
+ * on to TCP. Drivers of netifs with gro_max_size set call this after every
+ * burst of netif->input() calls, e.g. at the end of each poll of the rx ring.
+ *
+ * @param netif the netif the frames were received on
+ */
+void
+netif_gro_flush(struct netif *netif)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+
+  LWIP_ASSERT("netif_gro_flush: invalid netif", netif != NULL);
+
+  tcp_gro_flush(netif);
+}
+#endif /* LWIP_TCP_GRO */
+
 /**
  * @ingroup netif
  * Add a network interface to the list of lwIP netifs.
@@ -337,6 +357,12 @@ netif_add(struct netif *netif,
   NETIF_SET_CHECKSUM_CTRL(netif, NETIF_CHECKSUM_ENABLE_ALL);
   netif->mtu = 0;
   netif->flags = 0;
+#if LWIP_TCP_TSO
+  netif->gso_max_size = 0;
+#endif /* LWIP_TCP_TSO */
+#if LWIP_TCP_GRO
+  netif->gro_max_size = 0;
+#endif /* LWIP_TCP_GRO */
 #ifdef netif_get_client_data
   memset(netif->client_data, 0, sizeof(netif->client_data));
 #endif /* LWIP_NUM_NETIF_CLIENT_DATA */
@@ -773,6 +799,11 @@ netif_remove(struct netif *netif)
     return;
   }
 
+#if LWIP_TCP_GRO
+  /* GRO must not hold on to frames of a netif that is gone */
+  tcp_gro_flush(netif);
+#endif /* LWIP_TCP_GRO */
+
   netif_invoke_ext_callback(netif, LWIP_NSC_NETIF_REMOVED, NULL);
 
 #if LWIP_IPV4
@@ -108,6 +108,7 @@
 #include "lwip/priv/tcp_priv.h"
 #include "lwip/debug.h"
 #include "lwip/stats.h"
+#include "lwip/sys.h"
 #include "lwip/ip6.h"
 #include "lwip/ip6_addr.h"
 #include "lwip/nd6.h"
@@ -134,13 +135,6 @@
 #define TCP_KEEP_INTVL(pcb) TCP_KEEPINTVL_DEFAULT
 #endif /* LWIP_TCP_KEEPALIVE */
 
-/* As initial send MSS, we use TCP_MSS but limit it to 536. */
-#if TCP_MSS > 536
-#define INITIAL_MSS 536
-#else
-#define INITIAL_MSS TCP_MSS
-#endif
-
 static const char *const tcp_state_str[] = {
   "CLOSED",
   "LISTEN",
@@ -184,6 +178,33 @@ struct tcp_pcb **const tcp_pcb_lists[] = {&tcp_listen_pcbs.pcbs, &tcp_bound_pcbs
 
 u8_t tcp_active_pcbs_changed;
 
+#if LWIP_TCP_PCB_HASH
+/** 4-tuple demux table over tcp_active_pcbs and tcp_tw_pcbs */
+static struct tcp_pcb *tcp_pcb_hash_table[TCP_PCB_HASH_SIZE];
+/** Local port table over tcp_listen_pcbs */
+static struct tcp_pcb_listen *tcp_listen_hash_table[TCP_LISTEN_HASH_SIZE];
+#endif /* LWIP_TCP_PCB_HASH */
+
+#if LWIP_TCP_PCB_HASH || LWIP_TCP_REQ_TABLE || LWIP_TCP_TW_TABLE
+/** Per-boot seed of tcp_4tuple_hash() so that bucket placement cannot be
+ * predicted by peers */
+static u32_t tcp_4tuple_seed;
+#endif /* LWIP_TCP_PCB_HASH || LWIP_TCP_REQ_TABLE || LWIP_TCP_TW_TABLE */
+
+#if LWIP_TCP_TIMER_WHEEL
+/** Slow timer wheel over tcp_active_pcbs and tcp_tw_pcbs, one slot per tick */
+static struct tcp_pcb *tcp_timer_wheel[TCP_TIMER_WHEEL_SIZE];
+/** Pcbs taken off the wheel by the running tcp_slowtmr() */
+static struct tcp_pcb *tcp_timer_due_pcbs;
+/** Active pcbs with a delayed ACK, a pending FIN or refused data */
+static struct tcp_pcb *tcp_fast_pcbs;
+#endif /* LWIP_TCP_TIMER_WHEEL */
+
+#if LWIP_TCP_RCV_AUTOTUNE
+/** Bytes of TCP_RCV_AUTOTUNE_BUDGET given to the pcbs */
+static u32_t tcp_rcv_autotune_used;
+#endif /* LWIP_TCP_RCV_AUTOTUNE */
+
 /** Timer counter to handle calling slow-timer from tcp_tmr() */
 static u8_t tcp_timer;
 static u8_t tcp_timer_ctr;
@@ -202,7 +223,13 @@ tcp_init(void)
 {
 #ifdef LWIP_RAND
   tcp_port = TCP_ENSURE_LOCAL_PORT_RANGE(LWIP_RAND());
+#if LWIP_TCP_PCB_HASH || LWIP_TCP_REQ_TABLE || LWIP_TCP_TW_TABLE
+  tcp_4tuple_seed = LWIP_RAND();
+#endif /* LWIP_TCP_PCB_HASH || LWIP_TCP_REQ_TABLE || LWIP_TCP_TW_TABLE */
 #endif /* LWIP_RAND */
+#if LWIP_TCP_SYNCOOKIES
+  tcp_syncookie_init();
+#endif /* LWIP_TCP_SYNCOOKIES */
 }
 
 /** Free a tcp pcb */
@@ -213,6 +240,12 @@ tcp_free(struct tcp_pcb *pcb)
 #if LWIP_TCP_PCB_NUM_EXT_ARGS
   tcp_ext_arg_invoke_callbacks_destroyed(pcb->ext_args);
 #endif
+#if LWIP_TCP_RCV_AUTOTUNE
+  /* give back what the receive window grew by */
+  LWIP_ASSERT("tcp_free: rcv_wnd_max out of budget",
+              tcp_rcv_autotune_used >= pcb->rcv_wnd_max - TCP_RCV_AUTOTUNE_INIT);
+  tcp_rcv_autotune_used -= pcb->rcv_wnd_max - TCP_RCV_AUTOTUNE_INIT;
+#endif /* LWIP_TCP_RCV_AUTOTUNE */
   memp_free(MEMP_TCP_PCB, pcb);
 }
 
@@ -276,6 +309,9 @@ tcp_listen_closed(struct tcp_pcb *pcb)
     tcp_remove_listener(*tcp_pcb_lists[i], (struct tcp_pcb_listen *)pcb);
   }
 #endif
+#if LWIP_TCP_REQ_TABLE
+  tcp_req_listen_closed((struct tcp_pcb_listen *)pcb);
+#endif /* LWIP_TCP_REQ_TABLE */
   LWIP_UNUSED_ARG(pcb);
 }
 
@@ -326,6 +362,45 @@ tcp_backlog_accepted(struct tcp_pcb *pcb)
     }
   }
 }
+
+#if LWIP_TCP_SYNCOOKIES || LWIP_TCP_REQ_TABLE
+/**
+ * Make room in the backlog of a listener for a connection that completed
+ * the handshake with a SYN cookie: aborts the oldest connection of the
+ * listener that is still in SYN_RCVD. During a SYN flood, these are the
+ * ones the flood filled the backlog with.
+ *
+ * @param lpcb the listener with a full backlog
+ * @return 1 if a connection was aborted, 0 if there was none in SYN_RCVD
+ */
+u8_t
+tcp_backlog_reclaim(struct tcp_pcb_listen *lpcb)
+{
+  struct tcp_pcb *pcb, *inactive = NULL;
+  u32_t inactivity = 0;
+
+#if LWIP_TCP_REQ_TABLE
+  if (tcp_req_reclaim(lpcb)) {
+    return 1;
+  }
+#endif /* LWIP_TCP_REQ_TABLE */
+
+  for (pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
+    if ((pcb->state == SYN_RCVD) && (pcb->listener == lpcb) && (pcb->flags & TF_BACKLOGPEND) &&
+        ((u32_t)(tcp_ticks - pcb->tmr) >= inactivity)) {
+      inactivity = tcp_ticks - pcb->tmr;
+      inactive = pcb;
+    }
+  }
+  if (inactive == NULL) {
+    return 0;
+  }
+  LWIP_DEBUGF(TCP_DEBUG, ("tcp_backlog_reclaim: killing oldest SYN_RCVD PCB %p (%"S32_F")\n",
+                          (void *)inactive, inactivity));
+  tcp_abandon(inactive, 0);
+  return 1;
+}
+#endif /* LWIP_TCP_SYNCOOKIES || LWIP_TCP_REQ_TABLE */
 #endif /* TCP_LISTEN_BACKLOG */
 
 /**
@@ -399,6 +474,14 @@ tcp_close_shutdown(struct tcp_pcb *pcb, u8_t rst_on_unacked_data)
       tcp_free(pcb);
       MIB2_STATS_INC(mib2.tcpattemptfails);
       break;
+#if LWIP_TCP_TW_TABLE
+    case TIME_WAIT:
+      if (tcp_input_pcb != pcb) {
+        /* keep a record instead, tcp_input() does that for its own pcb */
+        tcp_tw_enter(pcb);
+      }
+      break;
+#endif /* LWIP_TCP_TW_TABLE */
     default:
       return tcp_close_shutdown_fin(pcb);
   }
@@ -449,6 +532,7 @@ tcp_close_shutdown_fin(struct tcp_pcb *pcb)
   } else if (err == ERR_MEM) {
     /* Mark this pcb for closing. Closing is retried from tcp_tmr. */
     tcp_set_flags(pcb, TF_CLOSEPEND);
+    TCP_FASTTMR_PENDING(pcb);
     /* We have to return ERR_OK from here to indicate to the callers that this
        pcb should not be used any more as it will be freed soon via tcp_tmr.
        This is OK here since sending FIN does not guarantee a time frime for
@@ -491,8 +575,15 @@ tcp_close(struct tcp_pcb *pcb)
   tcp_debug_print_state(pcb->state);
 
   if (pcb->state != LISTEN) {
+    /* FIN-WAIT-2 times out only once rx is closed */
+    TCP_TIMER_KICK(pcb);
     /* Set a flag not to receive any more data... */
     tcp_set_flags(pcb, TF_RXCLOSED);
+#if LWIP_TCP_TW_TABLE
+    /* ... note that the application is done with the pcb... */
+    tcp_set_flags(pcb, TF_APPCLOSED);
+#endif /* LWIP_TCP_TW_TABLE */
+    TCP_TIMER_UPDATE(pcb);
   }
   /* ... and close */
   return tcp_close_shutdown(pcb, 1);
@@ -522,10 +613,15 @@ tcp_shutdown(struct tcp_pcb *pcb, int shut_rx, int shut_tx)
     return ERR_CONN;
   }
   if (shut_rx) {
+    TCP_TIMER_KICK(pcb);
     /* shut down the receive side: set a flag not to receive any more data... */
     tcp_set_flags(pcb, TF_RXCLOSED);
+    TCP_TIMER_UPDATE(pcb);
     if (shut_tx) {
       /* shutting down the tx AND rx side is the same as closing for the raw API */
+#if LWIP_TCP_TW_TABLE
+      tcp_set_flags(pcb, TF_APPCLOSED);
+#endif /* LWIP_TCP_TW_TABLE */
       return tcp_close_shutdown(pcb, 1);
     }
     /* ... and free buffered data */
@@ -723,6 +819,11 @@ tcp_bind(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
           if (!ip_get_option(pcb, SOF_REUSEADDR) ||
               !ip_get_option(cpcb, SOF_REUSEADDR))
 #endif /* SO_REUSE */
+#if LWIP_SO_REUSEPORT
+          /* Same for REUSEPORT: all members of a group must have it set. */
+          if (!ip_get_option(pcb, SOF_REUSEPORT) ||
+              !ip_get_option(cpcb, SOF_REUSEPORT))
+#endif /* LWIP_SO_REUSEPORT */
           {
             /* @todo: check accept_any_ip_version */
             if ((IP_IS_V6(ipaddr) == IP_IS_V6_VAL(cpcb->local_ip)) &&
@@ -735,6 +836,13 @@ tcp_bind(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
         }
       }
     }
+#if LWIP_TCP_TW_TABLE
+    /* the connections in TIME_WAIT that are kept as records */
+    if ((max_pcb_list == NUM_TCP_PCB_LISTS) &&
+        tcp_tw_port_used(ipaddr, port, pcb->so_options)) {
+      return ERR_USE;
+    }
+#endif /* LWIP_TCP_TW_TABLE */
   }
 
   if (!ip_addr_isany(ipaddr)
@@ -870,6 +978,12 @@ tcp_listen_with_backlog_and_err(struct tcp_pcb *pcb, u8_t backlog, err_t *err)
        is declared (listen-/connection-pcb), we have to make sure now that
        this port is only used once for every local IP. */
     for (lpcb = tcp_listen_pcbs.listen_pcbs; lpcb != NULL; lpcb = lpcb->next) {
+#if LWIP_SO_REUSEPORT
+      if (ip_get_option(pcb, SOF_REUSEPORT) && ip_get_option(lpcb, SOF_REUSEPORT)) {
+        /* joining an SO_REUSEPORT group */
+        continue;
+      }
+#endif /* LWIP_SO_REUSEPORT */
       if ((lpcb->local_port == pcb->local_port) &&
           ip_addr_eq(&lpcb->local_ip, &pcb->local_ip)) {
         /* this address/port is already used */
@@ -889,6 +1003,7 @@ tcp_listen_with_backlog_and_err(struct tcp_pcb *pcb, u8_t backlog, err_t *err)
   lpcb->local_port = pcb->local_port;
   lpcb->state = LISTEN;
   lpcb->prio = pcb->prio;
+  lpcb->cong_ops = pcb->cong_ops;
   lpcb->so_options = pcb->so_options;
   lpcb->netif_idx = pcb->netif_idx;
   lpcb->ttl = pcb->ttl;
@@ -959,6 +1074,64 @@ tcp_update_rcv_ann_wnd(struct tcp_pcb *pcb)
   }
 }
 
+#if LWIP_TCP_RCV_AUTOTUNE
+/**
+ * Measure how fast the application reads and grow the receive window to
+ * twice the bytes read per round-trip time (dynamic right-sizing), within
+ * TCP_WND and what is left of TCP_RCV_AUTOTUNE_BUDGET. Called by tcp_recved().
+ *
+ * @param pcb the tcp_pcb for which data is read
+ * @param len the amount of bytes that have been read by the application
+ */
+static void
+tcp_rcv_autotune(struct tcp_pcb *pcb, u16_t len)
+{
+  u32_t now = sys_now();
+  u32_t rtt, elapsed, target;
+  tcpwnd_size_t limit, grow;
+
+  pcb->rcv_space += len;
+#if LWIP_TCP_RTT_MS
+  rtt = pcb->srtt >> 3;
+#else /* LWIP_TCP_RTT_MS */
+  rtt = (u32_t)(pcb->sa >> 3) * TCP_SLOW_INTERVAL;
+#endif /* LWIP_TCP_RTT_MS */
+  if (rtt == 0) {
+    /* no sample yet: measure per timer interval */
+    rtt = TCP_TMR_INTERVAL;
+  }
+  elapsed = now - pcb->rcv_space_stamp;
+  if (elapsed < rtt) {
+    return;
+  }
+  /* the rate per round-trip time, so that reading a burst after a pause
+     does not look like a fast reader */
+  target = (u32_t)(((u64_t)pcb->rcv_space * rtt * 2) / elapsed);
+  pcb->rcv_space = 0;
+  pcb->rcv_space_stamp = now;
+
+  limit = TCP_WND;
+#if LWIP_WND_SCALE
+  if (!(pcb->flags & TF_WND_SCALE)) {
+    limit = TCPWND16(TCP_WND);
+  }
+#endif /* LWIP_WND_SCALE */
+  if ((target <= pcb->rcv_wnd_max) || (pcb->rcv_wnd_max >= limit)) {
+    return;
+  }
+  grow = (tcpwnd_size_t)(LWIP_MIN(target, limit) - pcb->rcv_wnd_max);
+  grow = (tcpwnd_size_t)LWIP_MIN(grow, TCP_RCV_AUTOTUNE_BUDGET - tcp_rcv_autotune_used);
+  if (grow == 0) {
+    return;
+  }
+  tcp_rcv_autotune_used += grow;
+  pcb->rcv_wnd_max = (tcpwnd_size_t)(pcb->rcv_wnd_max + grow);
+  /* the new space is free at once */
+  pcb->rcv_wnd = (tcpwnd_size_t)(pcb->rcv_wnd + grow);
+  LWIP_DEBUGF(TCP_DEBUG, ("tcp_rcv_autotune: window grown to %"TCPWNDSIZE_F"\n", pcb->rcv_wnd_max));
+}
+#endif /* LWIP_TCP_RCV_AUTOTUNE */
+
 /**
  * @ingroup tcp_raw
  * This function should be called by the application when it has
@@ -982,6 +1155,10 @@ tcp_recved(struct tcp_pcb *pcb, u16_t len)
   LWIP_ASSERT("don't call tcp_recved for listen-pcbs",
               pcb->state != LISTEN);
 
+#if LWIP_TCP_RCV_AUTOTUNE
+  tcp_rcv_autotune(pcb, len);
+#endif /* LWIP_TCP_RCV_AUTOTUNE */
+
   rcv_wnd = (tcpwnd_size_t)(pcb->rcv_wnd + len);
   if ((rcv_wnd > TCP_WND_MAX(pcb)) || (rcv_wnd < pcb->rcv_wnd)) {
     /* window got too big or tcpwnd_size_t overflow */
@@ -1035,6 +1212,15 @@ again:
       }
     }
   }
+#if LWIP_TCP_TW_TABLE
+  if (tcp_tw_port_used(NULL, tcp_port, 0)) {
+    n++;
+    if (n > (TCP_LOCAL_PORT_RANGE_END - TCP_LOCAL_PORT_RANGE_START)) {
+      return 0;
+    }
+    goto again;
+  }
+#endif /* LWIP_TCP_TW_TABLE */
   return tcp_port;
 }
 
@@ -1123,10 +1309,10 @@ tcp_connect(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port,
       return ERR_BUF;
     }
   } else {
-#if SO_REUSE
-    if (ip_get_option(pcb, SOF_REUSEADDR)) {
-      /* Since SOF_REUSEADDR allows reusing a local address, we have to make sure
-         now that the 5-tuple is unique. */
+#if SO_REUSE || LWIP_SO_REUSEPORT
+    if (ip_get_option(pcb, SOF_REUSEADDR | SOF_REUSEPORT)) {
+      /* Since SOF_REUSEADDR (and SOF_REUSEPORT) allows reusing a local address,
+         we have to make sure now that the 5-tuple is unique. */
       struct tcp_pcb *cpcb;
       int i;
       /* Don't check listen- and bound-PCBs, check active- and TIME-WAIT PCBs. */
@@ -1141,8 +1327,13 @@ tcp_connect(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port,
           }
         }
       }
+#if LWIP_TCP_TW_TABLE
+      if (tcp_tw_lookup(&pcb->local_ip, pcb->local_port, ipaddr, port, NETIF_NO_INDEX) != NULL) {
+        return ERR_USE;
+      }
+#endif /* LWIP_TCP_TW_TABLE */
     }
-#endif /* SO_REUSE */
+#endif /* SO_REUSE || LWIP_SO_REUSEPORT */
   }
 
   iss = tcp_next_iss(pcb);
@@ -1153,7 +1344,7 @@ tcp_connect(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port,
   pcb->snd_lbb = iss - 1;
   /* Start with a window that does not need scaling. When window scaling is
      enabled and used, the window is enlarged when both sides agree on scaling. */
-  pcb->rcv_wnd = pcb->rcv_ann_wnd = TCPWND_MIN16(TCP_WND);
+  pcb->rcv_wnd = pcb->rcv_ann_wnd = TCPWND_MIN16(TCP_RCV_WND(pcb));
   pcb->rcv_ann_right_edge = pcb->rcv_nxt;
   pcb->snd_wnd = TCP_WND;
   /* As initial send MSS, we use TCP_MSS but limit it to 536.
@@ -1169,8 +1360,7 @@ tcp_connect(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port,
   LWIP_UNUSED_ARG(connected);
 #endif /* LWIP_CALLBACK_API */
 
-  if(pcb->cong_ops->init != NULL)
-    pcb->cong_ops->init(pcb);
+  tcp_init_congestion_control(pcb);
 
   /* Send a SYN together with the MSS option. */
   ret = tcp_enqueue_flags(pcb, TCP_SYN);
@@ -1188,6 +1378,420 @@ tcp_connect(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port,
   return ret;
 }
 
+#if LWIP_TCP_TIMER_WHEEL
+#define TCP_TIMER_WHEEL_SLOT(tick) (&tcp_timer_wheel[(tick) & (TCP_TIMER_WHEEL_SIZE - 1)])
+/* true if slow tick a is before slow tick b */
+#define TCP_TICK_BEFORE(a, b)      ((s32_t)((u32_t)(a) - (u32_t)(b)) < 0)
+/* pull 'due' forward to slow tick 'tick' if that is earlier */
+#define TCP_TIMER_DUE(due, tick)   do { u32_t tcp_tmp_due = (u32_t)(tick); \
+                                        if (TCP_TICK_BEFORE(tcp_tmp_due, due)) { (due) = tcp_tmp_due; } } while (0)
+/* work for tcp_fasttmr() */
+#if LWIP_TCP_PACING
+#define TCP_FASTTMR_WORK(pcb)      ((((pcb)->flags & (TF_ACK_DELAY | TF_CLOSEPEND)) != 0) || ((pcb)->refused_data != NULL) || \
+                                    (((pcb)->pacing_flags & TCP_PACING_TMR_ARMED) != 0))
+#else /* LWIP_TCP_PACING */
+#define TCP_FASTTMR_WORK(pcb)      ((((pcb)->flags & (TF_ACK_DELAY | TF_CLOSEPEND)) != 0) || ((pcb)->refused_data != NULL))
+#endif /* LWIP_TCP_PACING */
+
+#define TCP_TIMER_LINK(head, pcb, nxt, pprv) do { \
+    (pcb)->nxt = *(head);                         \
+    if ((pcb)->nxt != NULL) {                     \
+      (pcb)->nxt->pprv = &(pcb)->nxt;             \
+    }                                             \
+    *(head) = (pcb);                              \
+    (pcb)->pprv = (head);                         \
+  } while (0)
+#define TCP_TIMER_UNLINK(pcb, nxt, pprv) do {     \
+    if ((pcb)->pprv != NULL) {                    \
+      *(pcb)->pprv = (pcb)->nxt;                  \
+      if ((pcb)->nxt != NULL) {                   \
+        (pcb)->nxt->pprv = (pcb)->pprv;           \
+      }                                           \
+      (pcb)->nxt = NULL;                          \
+      (pcb)->pprv = NULL;                         \
+    }                                             \
+  } while (0)
+
+/** Put a pcb on the wheel slot of slow tick 'due' */
+static void
+tcp_timer_wheel_arm(struct tcp_pcb *pcb, u32_t due)
+{
+  TCP_TIMER_UNLINK(pcb, wheel_next, wheel_pprev);
+  pcb->wheel_due = due;
+  TCP_TIMER_LINK(TCP_TIMER_WHEEL_SLOT(due), pcb, wheel_next, wheel_pprev);
+}
+
+/**
+ * Brings the tick counters of a pcb up to slow tick 'now' as if tcp_slowtmr()
+ * had visited it on every tick since it last did. The pcb was not due in
+ * between, so none of these counters can have reached its limit.
+ */
+static void
+tcp_timer_settle(struct tcp_pcb *pcb, u32_t now)
+{
+  u32_t elapsed = now - pcb->wheel_last;
+
+  if ((s32_t)elapsed <= 0) {
+    return;
+  }
+  pcb->wheel_last = now;
+  if (pcb->state == TIME_WAIT) {
+    return;
+  }
+  /* polltmr is incremented once more before it is compared, keep it from wrapping */
+  pcb->polltmr = (u8_t)LWIP_MIN((u32_t)pcb->polltmr + elapsed, 0xFE);
+  if (pcb->persist_backoff > 0) {
+    u8_t backoff_cnt = tcp_persist_backoff[pcb->persist_backoff - 1];
+    if (pcb->persist_cnt < backoff_cnt) {
+      pcb->persist_cnt = (u8_t)LWIP_MIN((u32_t)pcb->persist_cnt + elapsed, backoff_cnt);
+    }
+  } else if (pcb->rtime >= 0) {
+    pcb->rtime = (s16_t)LWIP_MIN((u32_t)pcb->rtime + elapsed, 0x7FFF);
+  }
+}
+
+/**
+ * Calculates the slow tick at which tcp_slowtmr() has to visit a pcb next.
+ * Pcbs without a running timer come back after one wheel revolution, which
+ * also picks up options the application changed directly on the pcb.
+ */
+static u32_t
+tcp_timer_next_due(struct tcp_pcb *pcb)
+{
+  u32_t due = tcp_ticks + TCP_TIMER_WHEEL_SIZE;
+
+  if (pcb->state == TIME_WAIT) {
+    TCP_TIMER_DUE(due, pcb->tmr + 2 * TCP_MSL / TCP_SLOW_INTERVAL + 1);
+  } else if (((pcb->state == SYN_SENT) && (pcb->nrtx >= TCP_SYNMAXRTX)) ||
+             (pcb->nrtx >= TCP_MAXRTX) ||
+             ((pcb->persist_backoff > 0) && (pcb->persist_probe >= TCP_MAXRTX))) {
+    /* to be removed */
+    due = tcp_ticks + 1;
+  } else {
+    if (pcb->persist_backoff > 0) {
+      TCP_TIMER_DUE(due, tcp_ticks + tcp_persist_backoff[pcb->persist_backoff - 1] - pcb->persist_cnt);
+    } else if (pcb->rtime >= 0) {
+      TCP_TIMER_DUE(due, tcp_ticks + pcb->rto - pcb->rtime);
+    }
+    /* polling only matters if there is a callback or something to output */
+#if LWIP_CALLBACK_API
+    if ((pcb->poll != NULL) || (pcb->unsent != NULL) || (pcb->flags & TF_ACK_NOW))
+#endif /* LWIP_CALLBACK_API */
+    {
+      TCP_TIMER_DUE(due, tcp_ticks + pcb->pollinterval - pcb->polltmr);
+    }
+    if ((pcb->state == FIN_WAIT_2) && (pcb->flags & TF_RXCLOSED)) {
+      TCP_TIMER_DUE(due, pcb->tmr + TCP_FIN_WAIT_TIMEOUT / TCP_SLOW_INTERVAL + 1);
+    }
+    if (ip_get_option(pcb, SOF_KEEPALIVE) &&
+        ((pcb->state == ESTABLISHED) || (pcb->state == CLOSE_WAIT))) {
+      TCP_TIMER_DUE(due, pcb->tmr + (pcb->keep_idle + pcb->keep_cnt_sent * TCP_KEEP_INTVL(pcb))
+                    / TCP_SLOW_INTERVAL + 1);
+    }
+#if TCP_QUEUE_OOSEQ
+    if (pcb->ooseq != NULL) {
+      TCP_TIMER_DUE(due, pcb->tmr + (u32_t)pcb->rto * TCP_OOSEQ_TIMEOUT);
+    }
+#endif /* TCP_QUEUE_OOSEQ */
+    if (pcb->state == SYN_RCVD) {
+      TCP_TIMER_DUE(due, pcb->tmr + TCP_SYN_RCVD_TIMEOUT / TCP_SLOW_INTERVAL + 1);
+    }
+    if (pcb->state == LAST_ACK) {
+      TCP_TIMER_DUE(due, pcb->tmr + 2 * TCP_MSL / TCP_SLOW_INTERVAL + 1);
+    }
+  }
+  if (!TCP_TICK_BEFORE(tcp_ticks, due)) {
+    due = tcp_ticks + 1;
+  }
+  return due;
+}
+
+/** Moves the pcbs due in the current slow tick from their slot to tcp_timer_due_pcbs */
+static void
+tcp_timer_wheel_expire(void)
+{
+  struct tcp_pcb *pcb = *TCP_TIMER_WHEEL_SLOT(tcp_ticks);
+
+  while (pcb != NULL) {
+    struct tcp_pcb *next = pcb->wheel_next;
+    if (!TCP_TICK_BEFORE(tcp_ticks, pcb->wheel_due)) {
+      TCP_TIMER_UNLINK(pcb, wheel_next, wheel_pprev);
+      TCP_TIMER_LINK(&tcp_timer_due_pcbs, pcb, wheel_next, wheel_pprev);
+    }
+    pcb = next;
+  }
+}
+
+/** Called by TCP_REG for tcp_active_pcbs and tcp_tw_pcbs */
+void
+tcp_timer_wheel_insert(struct tcp_pcb *pcb)
+{
+  pcb->wheel_last = tcp_ticks;
+  tcp_timer_wheel_arm(pcb, tcp_ticks + 1);
+}
+
+/** Called by TCP_RMV for tcp_active_pcbs and tcp_tw_pcbs */
+void
+tcp_timer_wheel_remove(struct tcp_pcb *pcb)
+{
+  TCP_TIMER_UNLINK(pcb, wheel_next, wheel_pprev);
+  TCP_TIMER_UNLINK(pcb, fast_next, fast_pprev);
+}
+
+/**
+ * Settles the tick counters of a pcb. This must be called before changing
+ * its timer state (rtime, persist, polltmr, tmr, ...) from outside
+ * tcp_slowtmr(), and tcp_timer_update() after it.
+ */
+void
+tcp_timer_kick(struct tcp_pcb *pcb)
+{
+  if (pcb->wheel_pprev == NULL) {
+    /* not in tcp_active_pcbs or tcp_tw_pcbs */
+    return;
+  }
+  if (!TCP_TICK_BEFORE(tcp_ticks, pcb->wheel_due)) {
+    /* due in the running tcp_slowtmr() which still has to process this tick */
+    tcp_timer_settle(pcb, tcp_ticks - 1);
+    return;
+  }
+  tcp_timer_settle(pcb, tcp_ticks);
+}
+
+/**
+ * Moves a pcb to an earlier wheel slot if its timer state now makes it due
+ * before the tick it is armed for. A pcb whose timers moved later stays
+ * where it is: tcp_slowtmr() finds nothing to do when it gets there and
+ * arms it again, which costs one visit instead of a move per segment.
+ */
+void
+tcp_timer_update(struct tcp_pcb *pcb)
+{
+  u32_t due;
+
+  if ((pcb->wheel_pprev == NULL) || !TCP_TICK_BEFORE(tcp_ticks, pcb->wheel_due)) {
+    /* not on the wheel, or due in the running tcp_slowtmr() anyway */
+    return;
+  }
+  tcp_timer_settle(pcb, tcp_ticks);
+  due = tcp_timer_next_due(pcb);
+  if (TCP_TICK_BEFORE(due, pcb->wheel_due)) {
+    tcp_timer_wheel_arm(pcb, due);
+  }
+}
+
+/** Puts an active pcb on the tcp_fasttmr() list if it has work pending there */
+void
+tcp_fasttmr_pending(struct tcp_pcb *pcb)
+{
+  if ((pcb->fast_pprev == NULL) && (pcb->wheel_pprev != NULL) &&
+      (pcb->state != TIME_WAIT) && TCP_FASTTMR_WORK(pcb)) {
+    TCP_TIMER_LINK(&tcp_fast_pcbs, pcb, fast_next, fast_pprev);
+  }
+}
+#endif /* LWIP_TCP_TIMER_WHEEL */
+
+#if LWIP_TCP_RTT_MS
+/**
+ * Calculates the retransmission timeout from the RTT estimate (RFC 6298,
+ * section 2), rounded up to ticks of TCP_SLOW_INTERVAL.
+ *
+ * @param pcb the tcp_pcb to calculate the retransmission timeout for
+ * @return the retransmission timeout without backoff
+ */
+s16_t
+tcp_rto_calc(const struct tcp_pcb *pcb)
+{
+  u32_t rto;
+
+  if (pcb->srtt == 0) {
+    /* no RTT sample yet */
+    rto = LWIP_TCP_RTO_TIME;
+  } else {
+    /* the clock granularity of sys_now() is one millisecond */
+    rto = (pcb->srtt >> 3) + LWIP_MAX(pcb->rttvar, 1);
+    rto = LWIP_MAX(rto, LWIP_TCP_RTO_MIN);
+  }
+  rto = (rto + TCP_SLOW_INTERVAL - 1) / TCP_SLOW_INTERVAL;
+  return (s16_t)LWIP_MIN(rto, 0x7FFF);
+}
+#endif /* LWIP_TCP_RTT_MS */
+
+/**
+ * Runs the slow timers of an active pcb for one tick: retransmission,
+ * persist, keepalive, out-of-sequence data and the timeouts of the
+ * closing states.
+ *
+ * @param pcb the active pcb
+ * @param pcb_reset set to 1 if a RST should be sent when removing the pcb
+ * @return != 0 if the pcb has to be removed
+ */
+static u8_t
+tcp_slowtmr_pcb(struct tcp_pcb *pcb, u8_t *pcb_reset)
+{
+  u8_t pcb_remove = 0;
+  err_t err;
+
+  if (pcb->state == SYN_SENT && pcb->nrtx >= TCP_SYNMAXRTX) {
+    ++pcb_remove;
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: max SYN retries reached\n"));
+  } else if (pcb->nrtx >= TCP_MAXRTX) {
+    ++pcb_remove;
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: max DATA retries reached\n"));
+  } else {
+    if (pcb->persist_backoff > 0) {
+      LWIP_ASSERT("tcp_slowtimr: persist ticking with in-flight data", pcb->unacked == NULL);
+      LWIP_ASSERT("tcp_slowtimr: persist ticking with empty send buffer", pcb->unsent != NULL);
+      if (pcb->persist_probe >= TCP_MAXRTX) {
+        ++pcb_remove; /* max probes reached */
+      } else {
+        u8_t backoff_cnt = tcp_persist_backoff[pcb->persist_backoff - 1];
+        if (pcb->persist_cnt < backoff_cnt) {
+          pcb->persist_cnt++;
+        }
+        if (pcb->persist_cnt >= backoff_cnt) {
+          int next_slot = 1; /* increment timer to next slot */
+          /* If snd_wnd is zero, send 1 byte probes */
+          if (pcb->snd_wnd == 0) {
+            if (tcp_zero_window_probe(pcb) != ERR_OK) {
+              next_slot = 0; /* try probe again with current slot */
+            }
+            /* snd_wnd not fully closed, split unsent head and fill window */
+          } else {
+            if (tcp_split_unsent_seg(pcb, (u16_t)pcb->snd_wnd) == ERR_OK) {
+              if (tcp_output(pcb) == ERR_OK) {
+                /* sending will cancel persist timer, else retry with current slot */
+                next_slot = 0;
+              }
+            }
+          }
+          if (next_slot) {
+            pcb->persist_cnt = 0;
+            if (pcb->persist_backoff < sizeof(tcp_persist_backoff)) {
+              pcb->persist_backoff++;
+            }
+          }
+        }
+      }
+    } else {
+      /* Increase the retransmission timer if it is running */
+      if ((pcb->rtime >= 0) && (pcb->rtime < 0x7FFF)) {
+        ++pcb->rtime;
+      }
+
+      if (pcb->rtime >= pcb->rto) {
+        /* Time for a retransmission. */
+        LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_slowtmr: rtime %"S16_F
+                                    " pcb->rto %"S16_F"\n",
+                                    pcb->rtime, pcb->rto));
+        /* If prepare phase fails but we have unsent data but no unacked data,
+           still execute the backoff calculations below, as this means we somehow
+           failed to send segment. */
+        if ((tcp_rexmit_rto_prepare(pcb) == ERR_OK) || ((pcb->unacked == NULL) && (pcb->unsent != NULL))) {
+          /* Double retransmission time-out unless we are trying to
+           * connect to somebody (i.e., we are in SYN_SENT). */
+          if (pcb->state != SYN_SENT) {
+            u8_t backoff_idx = LWIP_MIN(pcb->nrtx, sizeof(tcp_backoff) - 1);
+            int calc_rto = TCP_RTO_BASE(pcb) << tcp_backoff[backoff_idx];
+            pcb->rto = (s16_t)LWIP_MIN(calc_rto, 0x7FFF);
+          }
+
+          /* Reset the retransmission timer. */
+          pcb->rtime = 0;
+
+          /* Reduce congestion window and ssthresh. */
+          /* eff_wnd = LWIP_MIN(pcb->cwnd, pcb->snd_wnd);
+          pcb->ssthresh = eff_wnd >> 1;
+          if (pcb->sssthresh < (tcpwnd_size_t)(pcb->mss << 1)) {
+            pcb->ssthresh = (tcpwnd_size_t)(pcb->mss << 1);
+          } */
+#if LWIP_TCP_UNDO
+          tcp_undo_init(pcb, 1);
+#endif /* LWIP_TCP_UNDO */
+          pcb->ssthresh = pcb->cong_ops->ssthresh(pcb);
+          pcb->cwnd = pcb->mss;
+          if (pcb->cong_ops->cwnd_event != NULL) {
+            pcb->cong_ops->cwnd_event(pcb, CA_EVENT_LOSS);
+          }
+          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: cwnd %"TCPWNDSIZE_F
+                                       " ssthresh %"TCPWNDSIZE_F"\n",
+                                       pcb->cwnd, pcb->ssthresh));
+          pcb->bytes_acked = 0;
+
+          /* The following needs to be called AFTER cwnd is set to one
+             mss - STJ */
+          tcp_rexmit_rto_commit(pcb);
+        }
+      }
+    }
+  }
+  /* Check if this PCB has stayed too long in FIN-WAIT-2 */
+  if (pcb->state == FIN_WAIT_2) {
+    /* If this PCB is in FIN_WAIT_2 because of SHUT_WR don't let it time out. */
+    if (pcb->flags & TF_RXCLOSED) {
+      /* PCB was fully closed (either through close() or SHUT_RDWR):
+         normal FIN-WAIT timeout handling. */
+      if ((u32_t)(tcp_ticks - pcb->tmr) >
+          TCP_FIN_WAIT_TIMEOUT / TCP_SLOW_INTERVAL) {
+        ++pcb_remove;
+        LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: removing pcb stuck in FIN-WAIT-2\n"));
+      }
+    }
+  }
+
+  /* Check if KEEPALIVE should be sent */
+  if (ip_get_option(pcb, SOF_KEEPALIVE) &&
+      ((pcb->state == ESTABLISHED) ||
+       (pcb->state == CLOSE_WAIT))) {
+    if ((u32_t)(tcp_ticks - pcb->tmr) >
+        (pcb->keep_idle + TCP_KEEP_DUR(pcb)) / TCP_SLOW_INTERVAL) {
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: KEEPALIVE timeout. Aborting connection to "));
+      ip_addr_debug_print_val(TCP_DEBUG, pcb->remote_ip);
+      LWIP_DEBUGF(TCP_DEBUG, ("\n"));
+
+      ++pcb_remove;
+      *pcb_reset = 1;
+    } else if ((u32_t)(tcp_ticks - pcb->tmr) >
+               (pcb->keep_idle + pcb->keep_cnt_sent * TCP_KEEP_INTVL(pcb))
+               / TCP_SLOW_INTERVAL) {
+      err = tcp_keepalive(pcb);
+      if (err == ERR_OK) {
+        pcb->keep_cnt_sent++;
+      }
+    }
+  }
+
+  /* If this PCB has queued out of sequence data, but has been
+     inactive for too long, will drop the data (it will eventually
+     be retransmitted). */
+#if TCP_QUEUE_OOSEQ
+  if (pcb->ooseq != NULL &&
+      (tcp_ticks - pcb->tmr >= (u32_t)pcb->rto * TCP_OOSEQ_TIMEOUT)) {
+    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: dropping OOSEQ queued data\n"));
+    tcp_free_ooseq(pcb);
+  }
+#endif /* TCP_QUEUE_OOSEQ */
+
+  /* Check if this PCB has stayed too long in SYN-RCVD */
+  if (pcb->state == SYN_RCVD) {
+    if ((u32_t)(tcp_ticks - pcb->tmr) >
+        TCP_SYN_RCVD_TIMEOUT / TCP_SLOW_INTERVAL) {
+      ++pcb_remove;
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: removing pcb stuck in SYN-RCVD\n"));
+    }
+  }
+
+  /* Check if this PCB has stayed too long in LAST-ACK */
+  if (pcb->state == LAST_ACK) {
+    if ((u32_t)(tcp_ticks - pcb->tmr) > 2 * TCP_MSL / TCP_SLOW_INTERVAL) {
+      ++pcb_remove;
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: removing pcb stuck in LAST-ACK\n"));
+    }
+  }
+
+  return pcb_remove;
+}
+
 /**
  * Called every 500 ms and implements the retransmission timer and the timer that
  * removes PCBs that have been in TIME-WAIT for enough time. It also increments
@@ -1198,7 +1802,10 @@ tcp_connect(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port,
 void
 tcp_slowtmr(void)
 {
-  struct tcp_pcb *pcb, *prev;
+  struct tcp_pcb *pcb;
+#if !LWIP_TCP_TIMER_WHEEL
+  struct tcp_pcb *prev;
+#endif /* !LWIP_TCP_TIMER_WHEEL */
   u8_t pcb_remove;      /* flag if a PCB should be removed */
   u8_t pcb_reset;       /* flag if a RST should be sent when removing */
   err_t err;
@@ -1208,6 +1815,77 @@ tcp_slowtmr(void)
   ++tcp_ticks;
   ++tcp_timer_ctr;
 
+#if LWIP_TCP_TIMER_WHEEL
+  /* Only visit the active and TIME-WAIT PCBs that are due in this tick. */
+  tcp_timer_wheel_expire();
+  while ((pcb = tcp_timer_due_pcbs) != NULL) {
+    if (pcb->last_timer == tcp_timer_ctr) {
+      /* already processed, left here by an application callback */
+      tcp_timer_wheel_arm(pcb, tcp_timer_next_due(pcb));
+      continue;
+    }
+    pcb->last_timer = tcp_timer_ctr;
+    tcp_timer_settle(pcb, tcp_ticks - 1);
+    pcb->wheel_last = tcp_ticks;
+
+    if (pcb->state == TIME_WAIT) {
+      /* Check if this PCB has stayed long enough in TIME-WAIT */
+      if ((u32_t)(tcp_ticks - pcb->tmr) > 2 * TCP_MSL / TCP_SLOW_INTERVAL) {
+        tcp_pcb_purge(pcb);
+        TCP_RMV(&tcp_tw_pcbs, pcb);
+        tcp_free(pcb);
+      } else {
+        tcp_timer_wheel_arm(pcb, tcp_timer_next_due(pcb));
+      }
+      continue;
+    }
+    LWIP_ASSERT("tcp_slowtmr: active pcb->state != CLOSED", pcb->state != CLOSED);
+    LWIP_ASSERT("tcp_slowtmr: active pcb->state != LISTEN", pcb->state != LISTEN);
+
+    pcb_reset = 0;
+    pcb_remove = tcp_slowtmr_pcb(pcb, &pcb_reset);
+
+    /* If the PCB should be removed, do it. */
+    if (pcb_remove) {
+#if LWIP_CALLBACK_API
+      tcp_err_fn err_fn = pcb->errf;
+#endif /* LWIP_CALLBACK_API */
+      void *err_arg;
+      enum tcp_state last_state;
+      tcp_pcb_purge(pcb);
+      TCP_RMV(&tcp_active_pcbs, pcb);
+
+      if (pcb_reset) {
+        tcp_rst(pcb, pcb->snd_nxt, pcb->rcv_nxt, &pcb->local_ip, &pcb->remote_ip,
+                pcb->local_port, pcb->remote_port);
+      }
+
+      err_arg = pcb->callback_arg;
+      last_state = pcb->state;
+      tcp_free(pcb);
+
+      TCP_EVENT_ERR(last_state, err_fn, err_arg, ERR_ABRT);
+      continue;
+    }
+
+    /* We check if we should poll the connection. */
+    ++pcb->polltmr;
+    if (pcb->polltmr >= pcb->pollinterval) {
+      pcb->polltmr = 0;
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: polling application\n"));
+      tcp_active_pcbs_changed = 0;
+      TCP_EVENT_POLL(pcb, err);
+      if (tcp_active_pcbs_changed || (err == ERR_ABRT)) {
+        /* the pcb may be gone, if not it is re-armed above */
+        continue;
+      }
+      if (err == ERR_OK) {
+        tcp_output(pcb);
+      }
+    }
+    tcp_timer_wheel_arm(pcb, tcp_timer_next_due(pcb));
+  }
+#else /* LWIP_TCP_TIMER_WHEEL */
 tcp_slowtmr_start:
   /* Steps through all of the active PCBs. */
   prev = NULL;
@@ -1228,162 +1906,8 @@ tcp_slowtmr_start:
     }
     pcb->last_timer = tcp_timer_ctr;
 
-    pcb_remove = 0;
     pcb_reset = 0;
-
-    if (pcb->state == SYN_SENT && pcb->nrtx >= TCP_SYNMAXRTX) {
-      ++pcb_remove;
-      LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: max SYN retries reached\n"));
-    } else if (pcb->nrtx >= TCP_MAXRTX) {
-      ++pcb_remove;
-      LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: max DATA retries reached\n"));
-    } else {
-      if (pcb->persist_backoff > 0) {
-        LWIP_ASSERT("tcp_slowtimr: persist ticking with in-flight data", pcb->unacked == NULL);
-        LWIP_ASSERT("tcp_slowtimr: persist ticking with empty send buffer", pcb->unsent != NULL);
-        if (pcb->persist_probe >= TCP_MAXRTX) {
-          ++pcb_remove; /* max probes reached */
-        } else {
-          u8_t backoff_cnt = tcp_persist_backoff[pcb->persist_backoff - 1];
-          if (pcb->persist_cnt < backoff_cnt) {
-            pcb->persist_cnt++;
-          }
-          if (pcb->persist_cnt >= backoff_cnt) {
-            int next_slot = 1; /* increment timer to next slot */
-            /* If snd_wnd is zero, send 1 byte probes */
-            if (pcb->snd_wnd == 0) {
-              if (tcp_zero_window_probe(pcb) != ERR_OK) {
-                next_slot = 0; /* try probe again with current slot */
-              }
-              /* snd_wnd not fully closed, split unsent head and fill window */
-            } else {
-              if (tcp_split_unsent_seg(pcb, (u16_t)pcb->snd_wnd) == ERR_OK) {
-                if (tcp_output(pcb) == ERR_OK) {
-                  /* sending will cancel persist timer, else retry with current slot */
-                  next_slot = 0;
-                }
-              }
-            }
-            if (next_slot) {
-              pcb->persist_cnt = 0;
-              if (pcb->persist_backoff < sizeof(tcp_persist_backoff)) {
-                pcb->persist_backoff++;
-              }
-            }
-          }
-        }
-      } else {
-        /* Increase the retransmission timer if it is running */
-        if ((pcb->rtime >= 0) && (pcb->rtime < 0x7FFF)) {
-          ++pcb->rtime;
-        }
-
-        if (pcb->rtime >= pcb->rto) {
-          /* Time for a retransmission. */
-          LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_slowtmr: rtime %"S16_F
-                                      " pcb->rto %"S16_F"\n",
-                                      pcb->rtime, pcb->rto));
-          /* If prepare phase fails but we have unsent data but no unacked data,
-             still execute the backoff calculations below, as this means we somehow
-             failed to send segment. */
-          if ((tcp_rexmit_rto_prepare(pcb) == ERR_OK) || ((pcb->unacked == NULL) && (pcb->unsent != NULL))) {
-            /* Double retransmission time-out unless we are trying to
-             * connect to somebody (i.e., we are in SYN_SENT). */
-            if (pcb->state != SYN_SENT) {
-              u8_t backoff_idx = LWIP_MIN(pcb->nrtx, sizeof(tcp_backoff) - 1);
-              int calc_rto = ((pcb->sa >> 3) + pcb->sv) << tcp_backoff[backoff_idx];
-              pcb->rto = (s16_t)LWIP_MIN(calc_rto, 0x7FFF);
-            }
-
-            /* Reset the retransmission timer. */
-            pcb->rtime = 0;
-
-            /* Reduce congestion window and ssthresh. */
-            /* eff_wnd = LWIP_MIN(pcb->cwnd, pcb->snd_wnd);
-            pcb->ssthresh = eff_wnd >> 1;
-            if (pcb->sssthresh < (tcpwnd_size_t)(pcb->mss << 1)) {
-              pcb->ssthresh = (tcpwnd_size_t)(pcb->mss << 1);
-            } */
-            pcb->ssthresh = pcb->cong_ops->ssthresh(pcb);
-            pcb->cwnd = pcb->mss;
-            if (pcb->cong_ops->cwnd_event != NULL) {
-              pcb->cong_ops->cwnd_event(pcb, CA_EVENT_LOSS);
-            }
-            LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: cwnd %"TCPWNDSIZE_F
-                                         " ssthresh %"TCPWNDSIZE_F"\n",
-                                         pcb->cwnd, pcb->ssthresh));
-            pcb->bytes_acked = 0;
-
-            /* The following needs to be called AFTER cwnd is set to one
-               mss - STJ */
-            tcp_rexmit_rto_commit(pcb);
-          }
-        }
-      }
-    }
-    /* Check if this PCB has stayed too long in FIN-WAIT-2 */
-    if (pcb->state == FIN_WAIT_2) {
-      /* If this PCB is in FIN_WAIT_2 because of SHUT_WR don't let it time out. */
-      if (pcb->flags & TF_RXCLOSED) {
-        /* PCB was fully closed (either through close() or SHUT_RDWR):
-           normal FIN-WAIT timeout handling. */
-        if ((u32_t)(tcp_ticks - pcb->tmr) >
-            TCP_FIN_WAIT_TIMEOUT / TCP_SLOW_INTERVAL) {
-          ++pcb_remove;
-          LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: removing pcb stuck in FIN-WAIT-2\n"));
-        }
-      }
-    }
-
-    /* Check if KEEPALIVE should be sent */
-    if (ip_get_option(pcb, SOF_KEEPALIVE) &&
-        ((pcb->state == ESTABLISHED) ||
-         (pcb->state == CLOSE_WAIT))) {
-      if ((u32_t)(tcp_ticks - pcb->tmr) >
-          (pcb->keep_idle + TCP_KEEP_DUR(pcb)) / TCP_SLOW_INTERVAL) {
-        LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: KEEPALIVE timeout. Aborting connection to "));
-        ip_addr_debug_print_val(TCP_DEBUG, pcb->remote_ip);
-        LWIP_DEBUGF(TCP_DEBUG, ("\n"));
-
-        ++pcb_remove;
-        ++pcb_reset;
-      } else if ((u32_t)(tcp_ticks - pcb->tmr) >
-                 (pcb->keep_idle + pcb->keep_cnt_sent * TCP_KEEP_INTVL(pcb))
-                 / TCP_SLOW_INTERVAL) {
-        err = tcp_keepalive(pcb);
-        if (err == ERR_OK) {
-          pcb->keep_cnt_sent++;
-        }
-      }
-    }
-
-    /* If this PCB has queued out of sequence data, but has been
-       inactive for too long, will drop the data (it will eventually
-       be retransmitted). */
-#if TCP_QUEUE_OOSEQ
-    if (pcb->ooseq != NULL &&
-        (tcp_ticks - pcb->tmr >= (u32_t)pcb->rto * TCP_OOSEQ_TIMEOUT)) {
-      LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: dropping OOSEQ queued data\n"));
-      tcp_free_ooseq(pcb);
-    }
-#endif /* TCP_QUEUE_OOSEQ */
-
-    /* Check if this PCB has stayed too long in SYN-RCVD */
-    if (pcb->state == SYN_RCVD) {
-      if ((u32_t)(tcp_ticks - pcb->tmr) >
-          TCP_SYN_RCVD_TIMEOUT / TCP_SLOW_INTERVAL) {
-        ++pcb_remove;
-        LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: removing pcb stuck in SYN-RCVD\n"));
-      }
-    }
-
-    /* Check if this PCB has stayed too long in LAST-ACK */
-    if (pcb->state == LAST_ACK) {
-      if ((u32_t)(tcp_ticks - pcb->tmr) > 2 * TCP_MSL / TCP_SLOW_INTERVAL) {
-        ++pcb_remove;
-        LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: removing pcb stuck in LAST-ACK\n"));
-      }
-    }
+    pcb_remove = tcp_slowtmr_pcb(pcb, &pcb_reset);
 
     /* If the PCB should be removed, do it. */
     if (pcb_remove) {
@@ -1394,6 +1918,9 @@ tcp_slowtmr_start:
       void *err_arg;
       enum tcp_state last_state;
       tcp_pcb_purge(pcb);
+#if LWIP_TCP_PCB_HASH
+      tcp_pcb_hash_remove(pcb);
+#endif /* LWIP_TCP_PCB_HASH */
       /* Remove PCB from tcp_active_pcbs list. */
       if (prev != NULL) {
         LWIP_ASSERT("tcp_slowtmr: middle tcp != tcp_active_pcbs", pcb != tcp_active_pcbs);
@@ -1460,6 +1987,9 @@ tcp_slowtmr_start:
     if (pcb_remove) {
       struct tcp_pcb *pcb2;
       tcp_pcb_purge(pcb);
+#if LWIP_TCP_PCB_HASH
+      tcp_pcb_hash_remove(pcb);
+#endif /* LWIP_TCP_PCB_HASH */
       /* Remove PCB from tcp_tw_pcbs list. */
       if (prev != NULL) {
         LWIP_ASSERT("tcp_slowtmr: middle tcp != tcp_tw_pcbs", pcb != tcp_tw_pcbs);
@@ -1477,6 +2007,16 @@ tcp_slowtmr_start:
       pcb = pcb->next;
     }
   }
+#endif /* LWIP_TCP_TIMER_WHEEL */
+
+#if LWIP_TCP_REQ_TABLE
+  /* Retransmit the SYN|ACKs of the connection requests or give up on them */
+  tcp_req_tmr();
+#endif /* LWIP_TCP_REQ_TABLE */
+#if LWIP_TCP_TW_TABLE
+  /* Drop the TIME_WAIT records that have expired */
+  tcp_tw_tmr();
+#endif /* LWIP_TCP_TW_TABLE */
 }
 
 /**
@@ -1493,7 +2033,11 @@ tcp_fasttmr(void)
   ++tcp_timer_ctr;
 
 tcp_fasttmr_start:
+#if LWIP_TCP_TIMER_WHEEL
+  pcb = tcp_fast_pcbs;
+#else /* LWIP_TCP_TIMER_WHEEL */
   pcb = tcp_active_pcbs;
+#endif /* LWIP_TCP_TIMER_WHEEL */
 
   while (pcb != NULL) {
     if (pcb->last_timer != tcp_timer_ctr) {
@@ -1512,8 +2056,16 @@ tcp_fasttmr_start:
         tcp_clear_flags(pcb, TF_CLOSEPEND);
         tcp_close_shutdown_fin(pcb);
       }
-
+#if LWIP_TCP_PACING
+      /* a pacing timer that could not be armed */
+      tcp_pacing_fasttmr(pcb);
+#endif /* LWIP_TCP_PACING */
+
+#if LWIP_TCP_TIMER_WHEEL
+      next = pcb->fast_next;
+#else /* LWIP_TCP_TIMER_WHEEL */
       next = pcb->next;
+#endif /* LWIP_TCP_TIMER_WHEEL */
 
       /* If there is data which was previously "refused" by upper layer */
       if (pcb->refused_data != NULL) {
@@ -1524,9 +2076,18 @@ tcp_fasttmr_start:
           goto tcp_fasttmr_start;
         }
       }
+#if LWIP_TCP_TIMER_WHEEL
+      if (!TCP_FASTTMR_WORK(pcb)) {
+        TCP_TIMER_UNLINK(pcb, fast_next, fast_pprev);
+      }
+#endif /* LWIP_TCP_TIMER_WHEEL */
       pcb = next;
     } else {
+#if LWIP_TCP_TIMER_WHEEL
+      pcb = pcb->fast_next;
+#else /* LWIP_TCP_TIMER_WHEEL */
       pcb = pcb->next;
+#endif /* LWIP_TCP_TIMER_WHEEL */
     }
   }
 }
@@ -1603,6 +2164,7 @@ tcp_process_refused_data(struct tcp_pcb *pcb)
       }
 #endif /* TCP_QUEUE_OOSEQ && LWIP_WND_SCALE */
       pcb->refused_data = refused_data;
+      TCP_FASTTMR_PENDING(pcb);
       return ERR_INPROGRESS;
     }
   }
@@ -1660,6 +2222,76 @@ tcp_setprio(struct tcp_pcb *pcb, u8_t prio)
   pcb->prio = prio;
 }
 
+/**
+ * @ingroup tcp_raw
+ * Sets after how many full-sized segments received data is ACKed at once
+ * instead of by the delayed ACK timer (@see TCP_ACK_SEGS_DEFAULT). Quick-ACK
+ * mode and tcp_quickack() still ACK every segment.
+ *
+ * @param pcb the tcp_pcb to manipulate
+ * @param segs number of segments, 1 to TCP_ACK_SEGS_MAX
+ * @return ERR_OK or ERR_VAL if segs is out of range
+ */
+err_t
+tcp_set_ack_segs(struct tcp_pcb *pcb, u16_t segs)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+
+  LWIP_ERROR("tcp_set_ack_segs: invalid pcb", pcb != NULL, return ERR_ARG);
+
+  if ((segs == 0) || (segs > TCP_ACK_SEGS_MAX)) {
+    return ERR_VAL;
+  }
+  pcb->ack_segs = segs;
+  return ERR_OK;
+}
+
+/**
+ * @ingroup tcp_raw
+ * Turns on or off ACKing every data segment at once, e.g. for request/response
+ * traffic where a delayed ACK adds latency. Unlike TCP_QUICKACK on Linux,
+ * this stays on until it is turned off. An ACK delayed already is sent now.
+ *
+ * @param pcb the tcp_pcb to manipulate
+ * @param enable 1 to ACK every segment at once, 0 to delay ACKs again
+ */
+void
+tcp_quickack(struct tcp_pcb *pcb, u8_t enable)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+
+  LWIP_ERROR("tcp_quickack: invalid pcb", pcb != NULL, return);
+
+  if (!enable) {
+    tcp_clear_flags(pcb, TF_QUICKACK);
+    return;
+  }
+  tcp_set_flags(pcb, TF_QUICKACK);
+  if (pcb->flags & TF_ACK_DELAY) {
+    tcp_ack_now(pcb);
+    tcp_output(pcb);
+  }
+}
+
+/**
+ * @ingroup tcp_raw
+ * Tells TCP that SOF_KEEPALIVE, keep_idle, keep_intvl or keep_cnt of a pcb
+ * have been changed, so a keepalive that is now due earlier is sent in time.
+ *
+ * @param pcb the tcp_pcb whose keepalive settings changed
+ */
+void
+tcp_keepalive_changed(struct tcp_pcb *pcb)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+
+  LWIP_ERROR("tcp_keepalive_changed: invalid pcb", pcb != NULL, return);
+
+  if (pcb->state != LISTEN) {
+    TCP_TIMER_UPDATE(pcb);
+  }
+}
+
 #if TCP_QUEUE_OOSEQ
 /**
  * Returns a copy of the given TCP segment.
@@ -1902,8 +2534,13 @@ tcp_alloc(u8_t prio)
     pcb->snd_buf = TCP_SND_BUF;
     /* Start with a window that does not need scaling. When window scaling is
        enabled and used, the window is enlarged when both sides agree on scaling. */
-    pcb->rcv_wnd = pcb->rcv_ann_wnd = TCPWND_MIN16(TCP_WND);
+#if LWIP_TCP_RCV_AUTOTUNE
+    pcb->rcv_wnd_max = TCP_RCV_AUTOTUNE_INIT;
+#endif /* LWIP_TCP_RCV_AUTOTUNE */
+    pcb->rcv_wnd = pcb->rcv_ann_wnd = TCPWND_MIN16(TCP_RCV_WND(pcb));
     pcb->ttl = TCP_TTL;
+    pcb->ack_segs = TCP_ACK_SEGS_DEFAULT;
+    pcb->quickack = TCP_QUICKACK_SEGS;
     /* As initial send MSS, we use TCP_MSS but limit it to 536.
        The send MSS is updated when an MSS option is received. */
     pcb->mss = INITIAL_MSS;
@@ -1923,7 +2560,7 @@ tcp_alloc(u8_t prio)
     connection is established. To avoid these complications, we set ssthresh to the
     largest effective cwnd (amount of in-flight data) that the sender can have. */
     pcb->ssthresh = TCP_SND_BUF;
-    pcb->cong_ops = &tcp_ca_cubic;
+    pcb->cong_ops = tcp_ca_default;
 
 #if LWIP_CALLBACK_API
     pcb->recv = tcp_recv_null;
@@ -2078,6 +2715,31 @@ tcp_err(struct tcp_pcb *pcb, tcp_err_fn err)
   }
 }
 
+#if LWIP_TCP_ZEROCOPY
+/**
+ * @ingroup tcp_raw
+ * Used to specify the function that should be called when the data of
+ * zero-copy writes (@see tcp_write() with TCP_WRITE_FLAG_ZEROCOPY) has been
+ * ACKed by the remote host.
+ *
+ * If the connection is reset or aborted, the data is not referenced any more
+ * when the err callback is called, without this callback being called.
+ *
+ * @param pcb tcp_pcb to set the zero-copy callback
+ * @param zerocopy callback function to call for this pcb when zero-copy
+ *        writes are done
+ */
+void
+tcp_zerocopy(struct tcp_pcb *pcb, tcp_zerocopy_fn zerocopy)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+  if (pcb != NULL) {
+    LWIP_ASSERT("invalid socket state for zerocopy callback", pcb->state != LISTEN);
+    pcb->zerocopy = zerocopy;
+  }
+}
+#endif /* LWIP_TCP_ZEROCOPY */
+
 /**
  * @ingroup tcp_raw
  * Used for specifying the function that should be called when a
@@ -2125,12 +2787,14 @@ tcp_poll(struct tcp_pcb *pcb, tcp_poll_fn poll, u8_t interval)
   LWIP_ERROR("tcp_poll: invalid pcb", pcb != NULL, return);
   LWIP_ASSERT("invalid socket state for poll", pcb->state != LISTEN);
 
+  TCP_TIMER_KICK(pcb);
 #if LWIP_CALLBACK_API
   pcb->poll = poll;
 #else /* LWIP_CALLBACK_API */
   LWIP_UNUSED_ARG(poll);
 #endif /* LWIP_CALLBACK_API */
   pcb->pollinterval = interval;
+  TCP_TIMER_UPDATE(pcb);
 }
 
 /**
@@ -2152,6 +2816,13 @@ tcp_pcb_purge(struct tcp_pcb *pcb)
 
     tcp_backlog_accepted(pcb);
 
+#if LWIP_TCP_RACK
+    tcp_rack_purge(pcb);
+#endif /* LWIP_TCP_RACK */
+#if LWIP_TCP_PACING
+    tcp_pacing_purge(pcb);
+#endif /* LWIP_TCP_PACING */
+
     if (pcb->refused_data != NULL) {
       LWIP_DEBUGF(TCP_DEBUG, ("tcp_pcb_purge: data left on ->refused_data\n"));
       pbuf_free(pcb->refused_data);
@@ -2177,6 +2848,8 @@ tcp_pcb_purge(struct tcp_pcb *pcb)
     tcp_segs_free(pcb->unsent);
     tcp_segs_free(pcb->unacked);
     pcb->unacked = pcb->unsent = NULL;
+    pcb->last_unacked = pcb->last_unsent = NULL;
+    TCP_UNACKED_CLEAR(pcb);
 #if TCP_OVERSIZE
     pcb->unsent_oversize = 0;
 #endif /* TCP_OVERSIZE */
@@ -2222,6 +2895,264 @@ tcp_pcb_remove(struct tcp_pcb **pcblist, struct tcp_pcb *pcb)
   LWIP_ASSERT("tcp_pcb_remove: tcp_pcbs_sane()", tcp_pcbs_sane());
 }
 
+#if LWIP_TCP_PCB_HASH || LWIP_TCP_REQ_TABLE || LWIP_TCP_TW_TABLE
+static u32_t
+tcp_4tuple_hash_addr(const ip_addr_t *addr)
+{
+#if LWIP_IPV6
+  if (IP_IS_V6(addr)) {
+    const ip6_addr_t *ip6 = ip_2_ip6(addr);
+    return ip6->addr[0] ^ ip6->addr[1] ^ ip6->addr[2] ^ ip6->addr[3];
+  }
+#endif /* LWIP_IPV6 */
+#if LWIP_IPV4
+  return ip4_addr_get_u32(ip_2_ip4(addr));
+#else /* LWIP_IPV4 */
+  return 0;
+#endif /* LWIP_IPV4 */
+}
+
+/**
+ * Calculates the hash of a 4-tuple, used for the bucket in the pcb demux,
+ * connection request and TIME_WAIT tables and to pick a listener out of an
+ * SO_REUSEPORT group.
+ * The mixing steps make sure that connections differing only in a few
+ * bits of the port or address still end up in different buckets.
+ */
+u32_t
+tcp_4tuple_hash(const ip_addr_t *local_ip, u16_t local_port,
+                const ip_addr_t *remote_ip, u16_t remote_port)
+{
+  u32_t h = tcp_4tuple_seed;
+
+  h ^= tcp_4tuple_hash_addr(local_ip);
+  h = (h ^ (h >> 16)) * 0x85ebca6bUL;
+  h ^= tcp_4tuple_hash_addr(remote_ip);
+  h = (h ^ (h >> 13)) * 0xc2b2ae35UL;
+  h ^= ((u32_t)local_port << 16) | remote_port;
+  h = (h ^ (h >> 16)) * 0x85ebca6bUL;
+  h ^= h >> 13;
+
+  return h;
+}
+#endif /* LWIP_TCP_PCB_HASH || LWIP_TCP_REQ_TABLE || LWIP_TCP_TW_TABLE */
+
+#if LWIP_TCP_PCB_HASH
+#define TCP_PCB_HASH_BUCKET(lip, lport, rip, rport) \
+  (tcp_4tuple_hash(lip, lport, rip, rport) & (TCP_PCB_HASH_SIZE - 1))
+#define TCP_LISTEN_HASH_BUCKET(lport) ((lport) & (TCP_LISTEN_HASH_SIZE - 1))
+
+/**
+ * Adds a pcb to the 4-tuple demux table. Called from TCP_REG when a pcb
+ * enters tcp_active_pcbs or tcp_tw_pcbs, so the addresses and ports of
+ * the pcb must be final at that point.
+ *
+ * @param pcb the tcp_pcb to add
+ */
+void
+tcp_pcb_hash_insert(struct tcp_pcb *pcb)
+{
+  struct tcp_pcb **bucket;
+
+  LWIP_ASSERT("tcp_pcb_hash_insert: already hashed", pcb->hash_pprev == NULL);
+
+  bucket = &tcp_pcb_hash_table[TCP_PCB_HASH_BUCKET(&pcb->local_ip, pcb->local_port,
+                                                   &pcb->remote_ip, pcb->remote_port)];
+  pcb->hash_next = *bucket;
+  if (pcb->hash_next != NULL) {
+    pcb->hash_next->hash_pprev = &pcb->hash_next;
+  }
+  pcb->hash_pprev = bucket;
+  *bucket = pcb;
+}
+
+/**
+ * Removes a pcb from the 4-tuple demux table (if it is in there).
+ *
+ * @param pcb the tcp_pcb to remove
+ */
+void
+tcp_pcb_hash_remove(struct tcp_pcb *pcb)
+{
+  if (pcb->hash_pprev != NULL) {
+    *pcb->hash_pprev = pcb->hash_next;
+    if (pcb->hash_next != NULL) {
+      pcb->hash_next->hash_pprev = pcb->hash_pprev;
+    }
+    pcb->hash_next = NULL;
+    pcb->hash_pprev = NULL;
+  }
+}
+
+/**
+ * Finds the active or TIME-WAIT pcb for a 4-tuple.
+ *
+ * @param local_ip local ip address of the connection
+ * @param local_port local port of the connection (host byte order)
+ * @param remote_ip remote ip address of the connection
+ * @param remote_port remote port of the connection (host byte order)
+ * @param netif_idx index of the netif the segment was received on; pcbs bound
+ *        to a different netif are skipped
+ * @return the matching pcb or NULL if there is none
+ */
+struct tcp_pcb *
+tcp_pcb_hash_lookup(const ip_addr_t *local_ip, u16_t local_port,
+                    const ip_addr_t *remote_ip, u16_t remote_port,
+                    u8_t netif_idx)
+{
+  struct tcp_pcb *pcb;
+
+  pcb = tcp_pcb_hash_table[TCP_PCB_HASH_BUCKET(local_ip, local_port, remote_ip, remote_port)];
+  for (; pcb != NULL; pcb = pcb->hash_next) {
+    /* check if PCB is bound to specific netif */
+    if ((pcb->netif_idx != NETIF_NO_INDEX) && (pcb->netif_idx != netif_idx)) {
+      continue;
+    }
+    if ((pcb->remote_port == remote_port) &&
+        (pcb->local_port == local_port) &&
+        ip_addr_eq(&pcb->remote_ip, remote_ip) &&
+        ip_addr_eq(&pcb->local_ip, local_ip)) {
+      return pcb;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Adds a listening pcb to the local port table. Called from TCP_REG.
+ *
+ * @param lpcb the tcp_pcb_listen to add
+ */
+void
+tcp_listen_hash_insert(struct tcp_pcb_listen *lpcb)
+{
+  struct tcp_pcb_listen **bucket = &tcp_listen_hash_table[TCP_LISTEN_HASH_BUCKET(lpcb->local_port)];
+
+  lpcb->hash_next = *bucket;
+  if (lpcb->hash_next != NULL) {
+    lpcb->hash_next->hash_pprev = &lpcb->hash_next;
+  }
+  lpcb->hash_pprev = bucket;
+  *bucket = lpcb;
+}
+
+/**
+ * Removes a listening pcb from the local port table (if it is in there).
+ *
+ * @param lpcb the tcp_pcb_listen to remove
+ */
+void
+tcp_listen_hash_remove(struct tcp_pcb_listen *lpcb)
+{
+  if (lpcb->hash_pprev != NULL) {
+    *lpcb->hash_pprev = lpcb->hash_next;
+    if (lpcb->hash_next != NULL) {
+      lpcb->hash_next->hash_pprev = lpcb->hash_pprev;
+    }
+    lpcb->hash_next = NULL;
+    lpcb->hash_pprev = NULL;
+  }
+}
+
+#if LWIP_SO_REUSEPORT
+/**
+ * Picks one listener out of the SO_REUSEPORT group 'lpcb' belongs to.
+ * The group consists of all listeners on the same local address and port
+ * (and netif binding) that have SOF_REUSEPORT set. The choice only depends
+ * on the connection's 4-tuple, so retransmitted SYNs go to the same listener
+ * as long as the group does not change.
+ */
+static struct tcp_pcb_listen *
+tcp_listen_reuseport_select(struct tcp_pcb_listen *lpcb, const ip_addr_t *local_ip,
+                            const ip_addr_t *remote_ip, u16_t remote_port)
+{
+  struct tcp_pcb_listen *cpcb;
+  u32_t num = 0;
+  u32_t idx;
+
+  for (cpcb = tcp_listen_hash_table[TCP_LISTEN_HASH_BUCKET(lpcb->local_port)]; cpcb != NULL; cpcb = cpcb->hash_next) {
+    if ((cpcb->local_port == lpcb->local_port) &&
+        (cpcb->netif_idx == lpcb->netif_idx) &&
+        ip_get_option(cpcb, SOF_REUSEPORT) &&
+        ip_addr_eq(&cpcb->local_ip, &lpcb->local_ip)) {
+      num++;
+    }
+  }
+  if (num <= 1) {
+    return lpcb;
+  }
+  idx = tcp_4tuple_hash(local_ip, lpcb->local_port, remote_ip, remote_port) % num;
+  for (cpcb = tcp_listen_hash_table[TCP_LISTEN_HASH_BUCKET(lpcb->local_port)]; cpcb != NULL; cpcb = cpcb->hash_next) {
+    if ((cpcb->local_port == lpcb->local_port) &&
+        (cpcb->netif_idx == lpcb->netif_idx) &&
+        ip_get_option(cpcb, SOF_REUSEPORT) &&
+        ip_addr_eq(&cpcb->local_ip, &lpcb->local_ip)) {
+      if (idx == 0) {
+        return cpcb;
+      }
+      idx--;
+    }
+  }
+  return lpcb;
+}
+#endif /* LWIP_SO_REUSEPORT */
+
+/**
+ * Finds the listening pcb for an incoming connection request. A listener
+ * bound to the exact local address is preferred over one bound to ANY.
+ *
+ * @param local_ip local (destination) ip address of the segment
+ * @param local_port local (destination) port of the segment
+ * @param remote_ip remote (source) ip address of the segment
+ * @param remote_port remote (source) port of the segment
+ * @param netif_idx index of the netif the segment was received on; pcbs bound
+ *        to a different netif are skipped
+ * @return the matching listening pcb or NULL if there is none
+ */
+struct tcp_pcb_listen *
+tcp_listen_hash_lookup(const ip_addr_t *local_ip, u16_t local_port,
+                       const ip_addr_t *remote_ip, u16_t remote_port,
+                       u8_t netif_idx)
+{
+  struct tcp_pcb_listen *lpcb;
+  struct tcp_pcb_listen *lpcb_any = NULL;
+
+  for (lpcb = tcp_listen_hash_table[TCP_LISTEN_HASH_BUCKET(local_port)]; lpcb != NULL; lpcb = lpcb->hash_next) {
+    /* check if PCB is bound to specific netif */
+    if ((lpcb->netif_idx != NETIF_NO_INDEX) && (lpcb->netif_idx != netif_idx)) {
+      continue;
+    }
+    if (lpcb->local_port == local_port) {
+      if (IP_IS_ANY_TYPE_VAL(lpcb->local_ip)) {
+        /* found an ANY TYPE (IPv4/IPv6) match */
+        lpcb_any = lpcb;
+      } else if (IP_ADDR_PCB_VERSION_MATCH_EXACT(lpcb, local_ip)) {
+        if (ip_addr_eq(&lpcb->local_ip, local_ip)) {
+          /* found an exact match */
+          break;
+        } else if (ip_addr_isany(&lpcb->local_ip)) {
+          /* found an ANY-match */
+          lpcb_any = lpcb;
+        }
+      }
+    }
+  }
+  if (lpcb == NULL) {
+    /* only pass to ANY if no specific local IP has been found */
+    lpcb = lpcb_any;
+  }
+#if LWIP_SO_REUSEPORT
+  if ((lpcb != NULL) && ip_get_option(lpcb, SOF_REUSEPORT)) {
+    lpcb = tcp_listen_reuseport_select(lpcb, local_ip, remote_ip, remote_port);
+  }
+#else /* LWIP_SO_REUSEPORT */
+  LWIP_UNUSED_ARG(remote_ip);
+  LWIP_UNUSED_ARG(remote_port);
+#endif /* LWIP_SO_REUSEPORT */
+  return lpcb;
+}
+#endif /* LWIP_TCP_PCB_HASH */
+
 /**
  * Calculates a new initial sequence number for new connections.
  *
@@ -2230,14 +3161,29 @@ tcp_pcb_remove(struct tcp_pcb **pcblist, struct tcp_pcb *pcb)
 u32_t
 tcp_next_iss(struct tcp_pcb *pcb)
 {
-#ifdef LWIP_HOOK_TCP_ISN
   LWIP_ASSERT("tcp_next_iss: invalid pcb", pcb != NULL);
-  return LWIP_HOOK_TCP_ISN(&pcb->local_ip, pcb->local_port, &pcb->remote_ip, pcb->remote_port);
+  return tcp_next_iss_addr(&pcb->local_ip, pcb->local_port, &pcb->remote_ip, pcb->remote_port);
+}
+
+/**
+ * Calculates a new initial sequence number for a connection that has no
+ * pcb yet.
+ *
+ * @return u32_t pseudo random sequence number
+ */
+u32_t
+tcp_next_iss_addr(const ip_addr_t *local_ip, u16_t local_port,
+                  const ip_addr_t *remote_ip, u16_t remote_port)
+{
+#ifdef LWIP_HOOK_TCP_ISN
+  return LWIP_HOOK_TCP_ISN(local_ip, local_port, remote_ip, remote_port);
 #else /* LWIP_HOOK_TCP_ISN */
   static u32_t iss = 6510;
 
-  LWIP_ASSERT("tcp_next_iss: invalid pcb", pcb != NULL);
-  LWIP_UNUSED_ARG(pcb);
+  LWIP_UNUSED_ARG(local_ip);
+  LWIP_UNUSED_ARG(local_port);
+  LWIP_UNUSED_ARG(remote_ip);
+  LWIP_UNUSED_ARG(remote_port);
 
   iss += tcp_ticks;       /* XXX */
   return iss;
@@ -2404,6 +3350,7 @@ tcp_free_ooseq(struct tcp_pcb *pcb)
   if (pcb->ooseq) {
     tcp_segs_free(pcb->ooseq);
     pcb->ooseq = NULL;
+    TCP_OOSEQ_CLEAR(pcb);
 #if LWIP_TCP_SACK_OUT
     memset(pcb->rcv_sacks, 0, sizeof(pcb->rcv_sacks));
 #endif /* LWIP_TCP_SACK_OUT */
@@ -2537,9 +3484,21 @@ tcp_pcbs_sane(void)
     LWIP_ASSERT("tcp_pcbs_sane: active pcb->state != CLOSED", pcb->state != CLOSED);
     LWIP_ASSERT("tcp_pcbs_sane: active pcb->state != LISTEN", pcb->state != LISTEN);
     LWIP_ASSERT("tcp_pcbs_sane: active pcb->state != TIME-WAIT", pcb->state != TIME_WAIT);
+#if LWIP_TCP_PCB_HASH
+    LWIP_ASSERT("tcp_pcbs_sane: active pcb hashed", pcb->hash_pprev != NULL);
+#endif /* LWIP_TCP_PCB_HASH */
+#if LWIP_TCP_TIMER_WHEEL
+    LWIP_ASSERT("tcp_pcbs_sane: active pcb on timer wheel", pcb->wheel_pprev != NULL);
+#endif /* LWIP_TCP_TIMER_WHEEL */
   }
   for (pcb = tcp_tw_pcbs; pcb != NULL; pcb = pcb->next) {
     LWIP_ASSERT("tcp_pcbs_sane: tw pcb->state == TIME-WAIT", pcb->state == TIME_WAIT);
+#if LWIP_TCP_PCB_HASH
+    LWIP_ASSERT("tcp_pcbs_sane: tw pcb hashed", pcb->hash_pprev != NULL);
+#endif /* LWIP_TCP_PCB_HASH */
+#if LWIP_TCP_TIMER_WHEEL
+    LWIP_ASSERT("tcp_pcbs_sane: tw pcb on timer wheel", pcb->wheel_pprev != NULL);
+#endif /* LWIP_TCP_TIMER_WHEEL */
   }
   return 1;
 }
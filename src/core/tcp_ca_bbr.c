@@ -0,0 +1,765 @@
+#include "lwip/opt.h"
+
+#if LWIP_TCP && LWIP_TCP_BBR /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/tcp.h"
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/sys.h"
+#include <string.h>
+
+/*
+ * BBR congestion control, ported from the Linux implementation (BBR v1,
+ * Cardwell et al., "BBR: Congestion-Based Congestion Control").
+ *
+ * BBR keeps a model of the path: the maximum delivery rate over the last ten
+ * rounds (the bottleneck bandwidth) and the minimum RTT over the last ten
+ * seconds. It sets pacing_rate to a gain times the bandwidth and caps cwnd at
+ * a small multiple of the bandwidth-delay product, instead of filling the
+ * bottleneck queue until a packet is dropped.
+ *
+ * Differences to Linux:
+ *  - bandwidth is in bytes per ms (scaled by BW_UNIT), times are sys_now()
+ *    milliseconds and cwnd is in bytes
+ *  - the long-term (policer) bandwidth and the ACK aggregation estimates
+ *    are not implemented
+ *  - without LWIP_TCP_PACING, lwIP does not pace, so DRAIN caps cwnd at one
+ *    BDP instead of relying on a pacing rate below the bandwidth to empty
+ *    the queue
+ */
+
+#define BW_SCALE 8	/* bandwidth in bytes per ms is scaled by 2^BW_SCALE */
+#define BW_UNIT (1 << BW_SCALE)
+
+#define BBR_SCALE 8	/* gains are fractions of BBR_UNIT */
+#define BBR_UNIT (1 << BBR_SCALE)
+
+#define CYCLE_LEN	8	/* number of phases in a pacing gain cycle */
+
+/* BBR has the following modes for deciding how fast to send: */
+enum bbr_mode {
+	BBR_STARTUP,	/* ramp up sending rate rapidly to fill pipe */
+	BBR_DRAIN,	/* drain any queue created during startup */
+	BBR_PROBE_BW,	/* discover, share bw: pace around estimated bw */
+	BBR_PROBE_RTT	/* cut inflight to min to probe min_rtt */
+};
+
+/* loss recovery state, derived from the pcb flags */
+enum bbr_ca_state {
+	BBR_CA_OPEN,
+	BBR_CA_RECOVERY,	/* fast retransmit (TF_INFR) */
+	BBR_CA_LOSS		/* retransmission timeout (TF_RTO) */
+};
+
+/* windowed max filter over the last three samples (lib/win_minmax.c) */
+struct bbr_minmax_sample {
+	u32_t	t;	/* time the measurement was taken */
+	u32_t	v;	/* value measured */
+};
+
+struct bbr_minmax {
+	struct bbr_minmax_sample s[3];
+};
+
+struct bbr {
+	u32_t	min_rtt;		/* min RTT in bbr_min_rtt_win window (ms) */
+	u32_t	min_rtt_stamp;		/* timestamp of min_rtt */
+	u32_t	probe_rtt_done_stamp;	/* end time for BBR_PROBE_RTT mode */
+	struct bbr_minmax bw;		/* max recent delivery rate */
+	u32_t	rtt_cnt;		/* count of packet-timed rounds elapsed */
+	u32_t	next_rtt_delivered;	/* pcb->delivered at end of round */
+	u32_t	cycle_stamp;		/* time of this cycle phase start */
+	u32_t	prior_cwnd;		/* prior cwnd upon entering loss recovery */
+	u32_t	full_bw;		/* recent bw, to estimate if pipe is full */
+	u16_t	pacing_gain;		/* current gain for setting pacing rate */
+	u16_t	cwnd_gain;		/* current gain for setting cwnd */
+	u8_t	mode;			/* current bbr_mode in state machine */
+	u8_t	prev_ca_state;		/* ca state on previous ACK */
+	u8_t	packet_conservation;	/* use packet conservation? */
+	u8_t	round_start;		/* start of packet-timed tx->ack round? */
+	u8_t	idle_restart;		/* restarting after idle? */
+	u8_t	probe_rtt_round_done;	/* a BBR_PROBE_RTT round at 4 pkts? */
+	u8_t	full_bw_reached;	/* reached full bw in Startup? */
+	u8_t	full_bw_cnt;		/* number of rounds without large bw gains */
+	u8_t	cycle_idx;		/* current index in pacing_gain cycle array */
+	u8_t	has_seen_rtt;		/* have we seen an RTT sample yet? */
+};
+
+/* Window length of bw filter (in rounds): */
+static const u32_t bbr_bw_rtts = CYCLE_LEN + 2;
+/* Window length of min_rtt filter (in ms): */
+static const u32_t bbr_min_rtt_win = 10000;
+/* Minimum time (in ms) spent at bbr_cwnd_min_target in BBR_PROBE_RTT mode: */
+static const u32_t bbr_probe_rtt_mode_ms = 200;
+/* Pace at ~1% below estimated bw, on average, to reduce queue at bottleneck. */
+static const u32_t bbr_pacing_margin_percent = 1;
+
+/* We use a high_gain value of 2/ln(2) because it's the smallest pacing gain
+ * that will allow a smoothly increasing pacing rate that will double each RTT
+ * and send the same number of packets per RTT that an un-paced, slow-starting
+ * Reno or CUBIC flow would:
+ */
+static const u32_t bbr_high_gain  = BBR_UNIT * 2885 / 1000 + 1;
+/* The pacing gain of 1/high_gain in BBR_DRAIN is calculated to typically drain
+ * the queue created in BBR_STARTUP in a single round:
+ */
+static const u32_t bbr_drain_gain = BBR_UNIT * 1000 / 2885;
+/* The gain for deriving steady-state cwnd tolerates delayed/stretched ACKs: */
+static const u32_t bbr_cwnd_gain  = BBR_UNIT * 2;
+/* The pacing_gain values for the PROBE_BW gain cycle, to discover/share bw: */
+static const u16_t bbr_pacing_gain[CYCLE_LEN] = {
+	BBR_UNIT * 5 / 4,	/* probe for more available bw */
+	BBR_UNIT * 3 / 4,	/* drain queue and/or yield bw to other flows */
+	BBR_UNIT, BBR_UNIT, BBR_UNIT,	/* cruise at 1.0*bw to utilize pipe, */
+	BBR_UNIT, BBR_UNIT, BBR_UNIT	/* without creating excess queue... */
+};
+/* Randomize the starting gain cycling phase over N phases: */
+static const u32_t bbr_cycle_rand = 7;
+
+/* Try to keep at least this many segments in flight, if things go smoothly. */
+static const u32_t bbr_cwnd_min_target = 4;
+
+/* If bw has increased significantly (1.25x), there may be more bw available: */
+static const u32_t bbr_full_bw_thresh = BBR_UNIT * 5 / 4;
+/* But after 3 rounds w/o significant bw growth, estimate pipe is full: */
+static const u32_t bbr_full_bw_cnt = 3;
+
+static u32_t bbr_minmax_reset(struct bbr_minmax *m, u32_t t, u32_t meas)
+{
+	m->s[2].t = m->s[1].t = m->s[0].t = t;
+	m->s[2].v = m->s[1].v = m->s[0].v = meas;
+	return m->s[0].v;
+}
+
+/* As time advances, update the 1st, 2nd, and 3rd choices. */
+static u32_t bbr_minmax_subwin_update(struct bbr_minmax *m, u32_t win,
+				      const struct bbr_minmax_sample *val)
+{
+	u32_t dt = val->t - m->s[0].t;
+
+	if (dt > win) {
+		/* Passed entire window without a new val so make 2nd
+		 * choice the new val & 3rd choice the new 2nd choice.
+		 * we may have to iterate this since our 2nd choice
+		 * may also be outside the window (we checked on entry
+		 * that the third choice was in the window).
+		 */
+		m->s[0] = m->s[1];
+		m->s[1] = m->s[2];
+		m->s[2] = *val;
+		if (val->t - m->s[0].t > win) {
+			m->s[0] = m->s[1];
+			m->s[1] = m->s[2];
+			m->s[2] = *val;
+		}
+	} else if ((m->s[1].t == m->s[0].t) && (dt > win / 4)) {
+		/* We've passed a quarter of the window without a new val
+		 * so take a 2nd choice from the 2nd quarter of the window.
+		 */
+		m->s[2] = m->s[1] = *val;
+	} else if ((m->s[2].t == m->s[1].t) && (dt > win / 2)) {
+		/* We've passed half the window without finding a new val
+		 * so take a 3rd choice from the last half of the window
+		 */
+		m->s[2] = *val;
+	}
+	return m->s[0].v;
+}
+
+/* Check if new measurement updates the 1st, 2nd or 3rd choice max. */
+static u32_t bbr_minmax_running_max(struct bbr_minmax *m, u32_t win, u32_t t, u32_t meas)
+{
+	struct bbr_minmax_sample val;
+
+	val.t = t;
+	val.v = meas;
+	if ((val.v >= m->s[0].v) ||	/* found new max? */
+	    (val.t - m->s[2].t > win))	/* nothing left in window? */
+		return bbr_minmax_reset(m, t, meas);	/* forget earlier samples */
+
+	if (val.v >= m->s[1].v)
+		m->s[2] = m->s[1] = val;
+	else if (val.v >= m->s[2].v)
+		m->s[2] = val;
+
+	return bbr_minmax_subwin_update(m, win, &val);
+}
+
+static u8_t bbr_ca_state(const struct tcp_pcb *pcb)
+{
+	if (pcb->flags & TF_RTO)
+		return BBR_CA_LOSS;
+	if (pcb->flags & TF_INFR)
+		return BBR_CA_RECOVERY;
+	return BBR_CA_OPEN;
+}
+
+/* Do we estimate that STARTUP filled the pipe? */
+static u8_t bbr_full_bw_reached(const struct tcp_pcb *pcb)
+{
+	const struct bbr *bbr = (const struct bbr *)pcb->tcp_congestion_priv;
+
+	return bbr->full_bw_reached;
+}
+
+/* Return the windowed max recent bandwidth sample, in bytes/ms << BW_SCALE. */
+static u32_t bbr_max_bw(const struct tcp_pcb *pcb)
+{
+	const struct bbr *bbr = (const struct bbr *)pcb->tcp_congestion_priv;
+
+	return bbr->bw.s[0].v;
+}
+
+/* Return the estimated bandwidth of the path, in bytes/ms << BW_SCALE. */
+static u32_t bbr_bw(const struct tcp_pcb *pcb)
+{
+	return bbr_max_bw(pcb);
+}
+
+/* Convert a BBR bw and gain factor to a pacing rate in bytes per second,
+ * pacing bbr_pacing_margin_percent below the rate to drain queues.
+ */
+static u32_t bbr_rate_bytes_per_sec(u64_t rate, u32_t gain)
+{
+	rate *= gain;
+	rate >>= BBR_SCALE;
+	rate *= 1000 / 100 * (100 - bbr_pacing_margin_percent);
+	rate >>= BW_SCALE;
+	return (u32_t)LWIP_MIN(rate, 0xFFFFFFFFUL);
+}
+
+/* Initialize pacing rate to: high_gain * init_cwnd / RTT. */
+static void bbr_init_pacing_rate_from_rtt(struct tcp_pcb *pcb)
+{
+	struct bbr *bbr = (struct bbr *)pcb->tcp_congestion_priv;
+	u64_t bw;
+	u32_t rtt_ms;
+
+	if (pcb->srtt != 0) {	/* any RTT sample yet? */
+		rtt_ms = LWIP_MAX(pcb->srtt >> 3, 1U);
+		bbr->has_seen_rtt = 1;
+	} else {		/* no RTT sample yet */
+		rtt_ms = 1;	/* use nominal default RTT */
+	}
+	bw = (u64_t)pcb->cwnd * BW_UNIT / rtt_ms;
+	pcb->pacing_rate = bbr_rate_bytes_per_sec(bw, bbr_high_gain);
+}
+
+/* Pace using current bw estimate and a gain factor. */
+static void bbr_set_pacing_rate(struct tcp_pcb *pcb, u32_t bw, u32_t gain)
+{
+	struct bbr *bbr = (struct bbr *)pcb->tcp_congestion_priv;
+	u32_t rate = bbr_rate_bytes_per_sec(bw, gain);
+
+	if (!bbr->has_seen_rtt && pcb->srtt != 0)
+		bbr_init_pacing_rate_from_rtt(pcb);
+	if (bbr_full_bw_reached(pcb) || rate > pcb->pacing_rate)
+		pcb->pacing_rate = rate;
+}
+
+static void bbr_cwnd_event(struct tcp_pcb *pcb, u8_t event)
+{
+	struct bbr *bbr = (struct bbr *)pcb->tcp_congestion_priv;
+
+	switch (event) {
+		case CA_EVENT_TX_START:
+			if (!pcb->app_limited)
+				return;
+			bbr->idle_restart = 1;
+			/* Avoid pointless buffer overflows: pace at est. bw if we don't
+			 * need more speed (we're restarting from idle and app-limited).
+			 */
+			if (bbr->mode == BBR_PROBE_BW)
+				bbr_set_pacing_rate(pcb, bbr_bw(pcb), BBR_UNIT);
+			return;
+		case CA_EVENT_LOSS:
+			bbr->prev_ca_state = BBR_CA_LOSS;
+			bbr->full_bw = 0;
+			bbr->round_start = 1;	/* treat RTO like end of a round */
+			return;
+		default:
+			return;
+	}
+}
+
+/* Calculate bdp based on min RTT and the estimated bottleneck bandwidth:
+ *
+ * bdp = ceil(bw * min_rtt * gain)
+ *
+ * The key factor, gain, controls the amount of queue. While a small gain
+ * builds a smaller queue, it becomes more vulnerable to noise in RTT
+ * measurements (e.g., delayed ACKs or other ACK compression effects).
+ */
+static u32_t bbr_bdp(const struct tcp_pcb *pcb, u32_t bw, u32_t gain)
+{
+	const struct bbr *bbr = (const struct bbr *)pcb->tcp_congestion_priv;
+	u64_t w;
+
+	/* If we've never had a valid RTT sample, cap cwnd at the initial
+	 * default. This should only happen when the connection is not using TCP
+	 * timestamps and has retransmitted all of the SYN/SYNACK/data packets
+	 * ACKed so far. In this case, an RTO can cut cwnd to 1, in which
+	 * case we need to slow-start up toward something safe: initial cwnd.
+	 */
+	if (bbr->min_rtt == ~0U)	 /* no valid RTT samples yet? */
+		return LWIP_TCP_CALC_INITIAL_CWND(pcb->mss);
+
+	w = (u64_t)bw * bbr->min_rtt;
+
+	/* Apply a gain to the given value, remove the BW_SCALE shift, and
+	 * round the value up to avoid a negative feedback loop.
+	 */
+	return (u32_t)((((w * gain) >> BBR_SCALE) + BW_UNIT - 1) / BW_UNIT);
+}
+
+/* To achieve full performance in high-speed paths, we budget enough cwnd to
+ * fit full-sized segments in flight on both end hosts:
+ *   - one segment in the sending host's queue
+ *   - one segment in flight that was just sent
+ *   - one segment in the receiver, held back for a delayed ACK
+ * In PROBE_BW phase 0 two more are added, so the probe actually grows
+ * inflight on small-BDP paths.
+ */
+static u32_t bbr_quantization_budget(const struct tcp_pcb *pcb, u32_t cwnd)
+{
+	const struct bbr *bbr = (const struct bbr *)pcb->tcp_congestion_priv;
+
+	cwnd += 3U * pcb->mss;
+
+	/* Ensure gain cycling gets inflight above BDP even for small BDPs. */
+	if (bbr->mode == BBR_PROBE_BW && bbr->cycle_idx == 0)
+		cwnd += 2U * pcb->mss;
+
+	return cwnd;
+}
+
+/* Find inflight based on min RTT and the estimated bottleneck bandwidth. */
+static u32_t bbr_inflight(const struct tcp_pcb *pcb, u32_t bw, u32_t gain)
+{
+	return bbr_quantization_budget(pcb, bbr_bdp(pcb, bw, gain));
+}
+
+static void bbr_save_cwnd(struct tcp_pcb *pcb)
+{
+	struct bbr *bbr = (struct bbr *)pcb->tcp_congestion_priv;
+
+	if (bbr->prev_ca_state < BBR_CA_RECOVERY && bbr->mode != BBR_PROBE_RTT)
+		bbr->prior_cwnd = pcb->cwnd;  /* this cwnd is good enough */
+	else  /* loss recovery or BBR_PROBE_RTT have temporarily cut cwnd */
+		bbr->prior_cwnd = LWIP_MAX(bbr->prior_cwnd, (u32_t)pcb->cwnd);
+}
+
+/* An optimization in BBR to reduce losses: On the first round of recovery, we
+ * follow the packet conservation principle: send P packets per P packets acked.
+ * After that, we slow-start and send at most 2*P packets per P packets acked.
+ * After recovery finishes, or upon undo, we restore the cwnd we had when
+ * recovery started (capped by the target cwnd based on estimated BDP).
+ */
+static u8_t bbr_set_cwnd_to_recover_or_restore(struct tcp_pcb *pcb,
+					       const struct tcp_rate_sample *rs,
+					       u32_t acked, u32_t *new_cwnd)
+{
+	struct bbr *bbr = (struct bbr *)pcb->tcp_congestion_priv;
+	u8_t prev_state = bbr->prev_ca_state, state = bbr_ca_state(pcb);
+	u32_t cwnd = pcb->cwnd;
+
+	LWIP_UNUSED_ARG(rs);
+
+	if (state == BBR_CA_RECOVERY && prev_state != BBR_CA_RECOVERY) {
+		/* Starting 1st round of Recovery, so do packet conservation. */
+		bbr->packet_conservation = 1;
+		bbr->next_rtt_delivered = pcb->delivered;  /* start round now */
+		/* Cut unused cwnd from app behavior, TSQ, or TSO deferral: */
+		cwnd = TCP_BYTES_IN_FLIGHT(pcb) + acked;
+	} else if (prev_state >= BBR_CA_RECOVERY && state < BBR_CA_RECOVERY) {
+		/* Exiting loss recovery; restore cwnd saved before recovery. */
+		cwnd = LWIP_MAX(cwnd, bbr->prior_cwnd);
+		bbr->packet_conservation = 0;
+	}
+	bbr->prev_ca_state = state;
+
+	if (bbr->packet_conservation) {
+		*new_cwnd = LWIP_MAX(cwnd, TCP_BYTES_IN_FLIGHT(pcb) + acked);
+		return 1;	/* yes, using packet conservation */
+	}
+	*new_cwnd = cwnd;
+	return 0;
+}
+
+/* Slow-start up toward target cwnd (if bw estimate is growing, or packet loss
+ * has drawn us down below target), or snap down to target if we're above it.
+ */
+static void bbr_set_cwnd(struct tcp_pcb *pcb, const struct tcp_rate_sample *rs,
+			 u32_t acked, u32_t bw, u32_t gain)
+{
+	struct bbr *bbr = (struct bbr *)pcb->tcp_congestion_priv;
+	u32_t cwnd = pcb->cwnd, target_cwnd = 0;
+
+	if (!acked)
+		goto done;  /* no packet fully ACKed; just apply caps */
+
+	if (bbr_set_cwnd_to_recover_or_restore(pcb, rs, acked, &cwnd))
+		goto done;
+
+	/* If we're below target cwnd, slow start cwnd toward target cwnd. */
+	target_cwnd = bbr_bdp(pcb, bw, gain);
+	target_cwnd = bbr_quantization_budget(pcb, target_cwnd);
+	if (bbr_full_bw_reached(pcb))  /* only cut cwnd if we filled the pipe */
+		cwnd = LWIP_MIN(cwnd + acked, target_cwnd);
+	else if (cwnd < target_cwnd || pcb->delivered < LWIP_TCP_CALC_INITIAL_CWND(pcb->mss))
+		cwnd = cwnd + acked;
+	cwnd = LWIP_MAX(cwnd, bbr_cwnd_min_target * pcb->mss);
+
+done:
+	if (bbr->mode == BBR_PROBE_RTT)  /* drain queue, refresh min_rtt */
+		cwnd = LWIP_MIN(cwnd, bbr_cwnd_min_target * pcb->mss);
+	pcb->cwnd = (tcpwnd_size_t)LWIP_MIN(cwnd, TCPWND_MAX);
+}
+
+/* End cycle phase if it's time and/or we hit the phase's in-flight target. */
+static u8_t bbr_is_next_cycle_phase(struct tcp_pcb *pcb,
+				    const struct tcp_rate_sample *rs)
+{
+	struct bbr *bbr = (struct bbr *)pcb->tcp_congestion_priv;
+	u8_t is_full_length =
+		(u32_t)(pcb->delivered_time - bbr->cycle_stamp) > bbr->min_rtt;
+	u32_t inflight, bw;
+
+	/* The pacing_gain of 1.0 paces at the estimated bw to try to fully
+	 * use the pipe without increasing the queue.
+	 */
+	if (bbr->pacing_gain == BBR_UNIT)
+		return is_full_length;		/* just use wall clock time */
+
+	inflight = rs->prior_in_flight;
+	bw = bbr_max_bw(pcb);
+
+	/* A pacing_gain > 1.0 probes for bw by trying to raise inflight to at
+	 * least pacing_gain*BDP; this may take more than min_rtt if min_rtt is
+	 * small (e.g. on a LAN). We do not persist if packets are lost, since
+	 * a path with small buffers may not hold that much.
+	 */
+	if (bbr->pacing_gain > BBR_UNIT)
+		return is_full_length &&
+			(bbr_ca_state(pcb) != BBR_CA_OPEN ||  /* perhaps pacing_gain*BDP won't fit */
+			 inflight >= bbr_inflight(pcb, bw, bbr->pacing_gain));
+
+	/* A pacing_gain < 1.0 tries to drain extra queue we added if bw
+	 * probing didn't find more bw. If inflight falls to match BDP then we
+	 * estimate queue is drained; persisting would underutilize the pipe.
+	 */
+	return is_full_length ||
+		inflight <= bbr_inflight(pcb, bw, BBR_UNIT);
+}
+
+static void bbr_advance_cycle_phase(struct tcp_pcb *pcb)
+{
+	struct bbr *bbr = (struct bbr *)pcb->tcp_congestion_priv;
+
+	bbr->cycle_idx = (bbr->cycle_idx + 1) & (CYCLE_LEN - 1);
+	bbr->cycle_stamp = pcb->delivered_time;
+}
+
+/* Gain cycling: cycle pacing gain to converge to fair share of available bw. */
+static void bbr_update_cycle_phase(struct tcp_pcb *pcb,
+				   const struct tcp_rate_sample *rs)
+{
+	struct bbr *bbr = (struct bbr *)pcb->tcp_congestion_priv;
+
+	if (bbr->mode == BBR_PROBE_BW && bbr_is_next_cycle_phase(pcb, rs))
+		bbr_advance_cycle_phase(pcb);
+}
+
+static void bbr_reset_startup_mode(struct tcp_pcb *pcb)
+{
+	struct bbr *bbr = (struct bbr *)pcb->tcp_congestion_priv;
+
+	bbr->mode = BBR_STARTUP;
+}
+
+static void bbr_reset_probe_bw_mode(struct tcp_pcb *pcb)
+{
+	struct bbr *bbr = (struct bbr *)pcb->tcp_congestion_priv;
+
+	bbr->mode = BBR_PROBE_BW;
+#ifdef LWIP_RAND
+	bbr->cycle_idx = (u8_t)(CYCLE_LEN - 1 - ((u32_t)LWIP_RAND() % bbr_cycle_rand));
+#else /* LWIP_RAND */
+	bbr->cycle_idx = (u8_t)(CYCLE_LEN - 1 - (pcb->delivered_time % bbr_cycle_rand));
+#endif /* LWIP_RAND */
+	bbr_advance_cycle_phase(pcb);	/* flip to next phase of gain cycle */
+}
+
+static void bbr_reset_mode(struct tcp_pcb *pcb)
+{
+	if (!bbr_full_bw_reached(pcb))
+		bbr_reset_startup_mode(pcb);
+	else
+		bbr_reset_probe_bw_mode(pcb);
+}
+
+/* Estimate the bandwidth based on how fast packets are delivered */
+static void bbr_update_bw(struct tcp_pcb *pcb, const struct tcp_rate_sample *rs)
+{
+	struct bbr *bbr = (struct bbr *)pcb->tcp_congestion_priv;
+	u64_t bw;
+
+	bbr->round_start = 0;
+	if (rs->delivered < 0 || rs->interval <= 0)
+		return; /* Not a valid observation */
+
+	/* See if we've reached the next RTT */
+	if (TCP_SEQ_GEQ(rs->prior_delivered, bbr->next_rtt_delivered)) {
+		bbr->next_rtt_delivered = pcb->delivered;
+		bbr->rtt_cnt++;
+		bbr->round_start = 1;
+		bbr->packet_conservation = 0;
+	}
+
+	/* Divide delivered by the interval to find a (lower bound) bottleneck
+	 * bandwidth sample. Delivered is in bytes and interval is in ms and
+	 * the ratio will usually be much smaller than 1. So scale delivered
+	 * by BW_UNIT to get a useful bw in fixed point.
+	 */
+	bw = (u64_t)rs->delivered * BW_UNIT / (u32_t)rs->interval;
+	if (bw > 0xFFFFFFFFUL)
+		bw = 0xFFFFFFFFUL;
+
+	/* If this sample is application-limited, it is likely to have a very
+	 * low delivered count that represents application behavior rather than
+	 * the available network rate. Such a sample could drag down estimated
+	 * bw, causing needless slow-down. Thus, to continue to send at the
+	 * last measured network rate, we filter out app-limited samples unless
+	 * they describe the path bw at least as well as our bw model.
+	 */
+	if (!rs->is_app_limited || bw >= bbr_max_bw(pcb)) {
+		/* Incorporate new sample into our max bw filter. */
+		bbr_minmax_running_max(&bbr->bw, bbr_bw_rtts, bbr->rtt_cnt, (u32_t)bw);
+	}
+}
+
+/* Estimate when the pipe is full, using the change in delivery rate: BBR
+ * estimates that STARTUP filled the pipe if the estimated bw hasn't changed by
+ * at least bbr_full_bw_thresh (25%) after bbr_full_bw_cnt (3) non-app-limited
+ * rounds.
+ */
+static void bbr_check_full_bw_reached(struct tcp_pcb *pcb,
+				      const struct tcp_rate_sample *rs)
+{
+	struct bbr *bbr = (struct bbr *)pcb->tcp_congestion_priv;
+	u32_t bw_thresh;
+
+	if (bbr_full_bw_reached(pcb) || !bbr->round_start || rs->is_app_limited)
+		return;
+
+	bw_thresh = (u32_t)(((u64_t)bbr->full_bw * bbr_full_bw_thresh) >> BBR_SCALE);
+	if (bbr_max_bw(pcb) >= bw_thresh) {
+		bbr->full_bw = bbr_max_bw(pcb);
+		bbr->full_bw_cnt = 0;
+		return;
+	}
+	++bbr->full_bw_cnt;
+	bbr->full_bw_reached = bbr->full_bw_cnt >= bbr_full_bw_cnt;
+}
+
+/* If pipe is probably full, drain the queue and then enter steady-state. */
+static void bbr_check_drain(struct tcp_pcb *pcb)
+{
+	struct bbr *bbr = (struct bbr *)pcb->tcp_congestion_priv;
+
+	if (bbr->mode == BBR_STARTUP && bbr_full_bw_reached(pcb)) {
+		bbr->mode = BBR_DRAIN;	/* drain queue we created */
+		pcb->ssthresh = (tcpwnd_size_t)LWIP_MIN(
+			bbr_inflight(pcb, bbr_max_bw(pcb), BBR_UNIT), TCPWND_MAX);
+	}	/* fall through to check if in-flight is already small: */
+	if (bbr->mode == BBR_DRAIN &&
+	    TCP_BYTES_IN_FLIGHT(pcb) <= bbr_inflight(pcb, bbr_max_bw(pcb), BBR_UNIT))
+		bbr_reset_probe_bw_mode(pcb);  /* we estimate queue is drained */
+}
+
+static void bbr_check_probe_rtt_done(struct tcp_pcb *pcb)
+{
+	struct bbr *bbr = (struct bbr *)pcb->tcp_congestion_priv;
+	u32_t now = sys_now();
+
+	if (!(bbr->probe_rtt_done_stamp &&
+	      (s32_t)(now - bbr->probe_rtt_done_stamp) > 0))
+		return;
+
+	bbr->min_rtt_stamp = now;  /* wait a while until PROBE_RTT */
+	pcb->cwnd = (tcpwnd_size_t)LWIP_MIN(LWIP_MAX((u32_t)pcb->cwnd, bbr->prior_cwnd), TCPWND_MAX);
+	bbr_reset_mode(pcb);
+}
+
+/* The goal of PROBE_RTT mode is to have BBR flows cooperatively and
+ * periodically drain the bottleneck queue, to converge to measure the true
+ * min_rtt (unloaded propagation delay). This allows the flows to keep queues
+ * small (reducing queuing delay and packet loss) and achieve fairness among
+ * BBR flows.
+ *
+ * The min_rtt filter window is 10 seconds. When the min_rtt estimate expires,
+ * we enter PROBE_RTT mode and cap the cwnd at bbr_cwnd_min_target=4 packets.
+ * After at least bbr_probe_rtt_mode_ms=200ms and at least one packet-timed
+ * round trip elapsed with that flight size <= 4, we leave PROBE_RTT mode and
+ * re-enter the previous mode.
+ */
+static void bbr_update_min_rtt(struct tcp_pcb *pcb, const struct tcp_rate_sample *rs)
+{
+	struct bbr *bbr = (struct bbr *)pcb->tcp_congestion_priv;
+	u32_t now = sys_now();
+	u8_t filter_expired;
+
+	/* Track min RTT seen in the min_rtt_win ms filter window: */
+	filter_expired = (s32_t)(now - (bbr->min_rtt_stamp + bbr_min_rtt_win)) > 0;
+	if (rs->rtt >= 0 &&
+	    ((u32_t)LWIP_MAX(rs->rtt, 1) < bbr->min_rtt || filter_expired)) {
+		bbr->min_rtt = (u32_t)LWIP_MAX(rs->rtt, 1);
+		bbr->min_rtt_stamp = now;
+	}
+
+	if (bbr_probe_rtt_mode_ms > 0 && filter_expired &&
+	    !bbr->idle_restart && bbr->mode != BBR_PROBE_RTT) {
+		bbr->mode = BBR_PROBE_RTT;  /* dip, drain queue */
+		bbr_save_cwnd(pcb);  /* note cwnd so we can restore it */
+		bbr->probe_rtt_done_stamp = 0;
+	}
+
+	if (bbr->mode == BBR_PROBE_RTT) {
+		/* Ignore low rate samples during this mode. */
+		pcb->app_limited = pcb->delivered + TCP_BYTES_IN_FLIGHT(pcb);
+		if (pcb->app_limited == 0)
+			pcb->app_limited = 1;
+		/* Maintain min packets in flight for max(200 ms, 1 round). */
+		if (!bbr->probe_rtt_done_stamp &&
+		    TCP_BYTES_IN_FLIGHT(pcb) <= bbr_cwnd_min_target * pcb->mss) {
+			bbr->probe_rtt_done_stamp = now + bbr_probe_rtt_mode_ms;
+			if (bbr->probe_rtt_done_stamp == 0)
+				bbr->probe_rtt_done_stamp = 1;
+			bbr->probe_rtt_round_done = 0;
+			bbr->next_rtt_delivered = pcb->delivered;
+		} else if (bbr->probe_rtt_done_stamp) {
+			if (bbr->round_start)
+				bbr->probe_rtt_round_done = 1;
+			if (bbr->probe_rtt_round_done)
+				bbr_check_probe_rtt_done(pcb);
+		}
+	}
+	/* Restart after idle ends only once we process a new S/ACK for data */
+	if (rs->delivered > 0)
+		bbr->idle_restart = 0;
+}
+
+static void bbr_update_gains(struct tcp_pcb *pcb)
+{
+	struct bbr *bbr = (struct bbr *)pcb->tcp_congestion_priv;
+
+	switch (bbr->mode) {
+	case BBR_STARTUP:
+		bbr->pacing_gain = bbr_high_gain;
+		bbr->cwnd_gain	 = bbr_high_gain;
+		break;
+	case BBR_DRAIN:
+		bbr->pacing_gain = bbr_drain_gain;	/* slow, to drain */
+#if LWIP_TCP_PACING
+		bbr->cwnd_gain	 = bbr_high_gain;	/* keep cwnd */
+#else /* LWIP_TCP_PACING */
+		/* without a pacer the queue only drains if cwnd does not
+		 * exceed one BDP (Linux keeps bbr_high_gain here) */
+		bbr->cwnd_gain	 = BBR_UNIT;
+#endif /* LWIP_TCP_PACING */
+		break;
+	case BBR_PROBE_BW:
+		bbr->pacing_gain = bbr_pacing_gain[bbr->cycle_idx];
+		bbr->cwnd_gain	 = bbr_cwnd_gain;
+		break;
+	case BBR_PROBE_RTT:
+		bbr->pacing_gain = BBR_UNIT;
+		bbr->cwnd_gain	 = BBR_UNIT;
+		break;
+	default:
+		LWIP_ASSERT("BBR bad mode", 0);
+		break;
+	}
+}
+
+static void bbr_update_model(struct tcp_pcb *pcb, const struct tcp_rate_sample *rs)
+{
+	bbr_update_bw(pcb, rs);
+	bbr_update_cycle_phase(pcb, rs);
+	bbr_check_full_bw_reached(pcb, rs);
+	bbr_check_drain(pcb);
+	bbr_update_min_rtt(pcb, rs);
+	bbr_update_gains(pcb);
+}
+
+static void bbr_main(struct tcp_pcb *pcb, const struct tcp_rate_sample *rs)
+{
+	struct bbr *bbr = (struct bbr *)pcb->tcp_congestion_priv;
+	u32_t bw;
+
+	bbr_update_model(pcb, rs);
+
+	bw = bbr_bw(pcb);
+	bbr_set_pacing_rate(pcb, bw, bbr->pacing_gain);
+	bbr_set_cwnd(pcb, rs, rs->acked_sacked, bw, bbr->cwnd_gain);
+}
+
+static void bbr_init(struct tcp_pcb *pcb)
+{
+	struct bbr *bbr = (struct bbr *)pcb->tcp_congestion_priv;
+
+	bbr->next_rtt_delivered = pcb->delivered;
+	bbr->prev_ca_state = BBR_CA_OPEN;
+
+	bbr->min_rtt = (pcb->min_rtt != 0) ? pcb->min_rtt : ~0U;
+	bbr->min_rtt_stamp = sys_now();
+
+	bbr_minmax_reset(&bbr->bw, bbr->rtt_cnt, 0);  /* init max bw to 0 */
+
+	bbr_init_pacing_rate_from_rtt(pcb);
+#if LWIP_TCP_PACING
+	if (!(pcb->pacing_flags & TCP_PACING_ON)) {
+		tcp_set_pacing(pcb, 1);
+		/* turned off again when BBR is replaced */
+		pcb->pacing_flags |= TCP_PACING_CA;
+	}
+#endif /* LWIP_TCP_PACING */
+
+	bbr_reset_startup_mode(pcb);
+	bbr_update_gains(pcb);
+}
+
+/* Entering loss recovery, so save cwnd for when we exit or undo recovery.
+ * BBR does not reduce cwnd on loss, the packet conservation in
+ * bbr_set_cwnd_to_recover_or_restore() does.
+ */
+static tcpwnd_size_t bbr_ssthresh(struct tcp_pcb *pcb)
+{
+	bbr_save_cwnd(pcb);
+	return pcb->ssthresh;
+}
+
+/* cwnd is set by bbr_main() from the rate sample of every ACK */
+static void bbr_cong_avoid(struct tcp_pcb *pcb, u32_t acked)
+{
+	LWIP_UNUSED_ARG(pcb);
+	LWIP_UNUSED_ARG(acked);
+}
+
+struct tcp_congestion_ops tcp_ca_bbr = {
+	bbr_ssthresh,
+	bbr_cong_avoid,
+	bbr_cwnd_event,
+	NULL,
+	"bbr",
+	bbr_init,
+	sizeof(struct bbr),
+	bbr_main,
+#if LWIP_TCP_ECN
+	NULL,	/* BBR v1 does not react to ECN */
+#endif /* LWIP_TCP_ECN */
+#if LWIP_TCP_UNDO
+	NULL,	/* cwnd follows the model, not the losses */
+#endif /* LWIP_TCP_UNDO */
+};
+
+#endif /* LWIP_TCP && LWIP_TCP_BBR */
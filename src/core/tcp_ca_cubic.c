@@ -18,6 +18,26 @@
 #define HYSTART_DELAY_MAX	(16U)	/* 16 ms */
 #define HYSTART_DELAY_THRESH(x)	LWIP_MIN(LWIP_MAX(x, HYSTART_DELAY_MIN), HYSTART_DELAY_MAX)
 
+#if LWIP_TCP_HYSTART_PP
+/*
+ * HyStart++ (RFC 9406) replaces HyStart in the cubic_hspp variant. It only
+ * looks at the minimum RTT of each round: once it has risen by a clamped
+ * 1/8, slow start goes on at a quarter of its pace (Conservative Slow Start)
+ * for CSS_ROUNDS rounds before ssthresh is set, unless the RTT falls back
+ * below where CSS started. The RTT thresholds and the number of samples are
+ * the HyStart ones above. It only runs in the initial slow start.
+ */
+#define HSPP_OFF	0	/* classic HyStart */
+#define HSPP_SS		1	/* standard slow start */
+#define HSPP_CSS	2	/* conservative slow start */
+#define HSPP_DONE	3	/* the initial slow start is over */
+
+#define HSPP_CSS_GROWTH_DIVISOR	4
+#define HSPP_CSS_ROUNDS		5
+/* cwnd grows by at most this many segments per ACK unless paced */
+#define HSPP_L			8
+#endif /* LWIP_TCP_HYSTART_PP */
+
 static u32_t fast_convergence = 1;
 static u32_t beta = 717;	/* = 717/1024 (BICTCP_BETA_SCALE) */
 static u32_t cubic_scale = 41;
@@ -55,6 +75,14 @@ struct cubictcp {
 	u32_t	end_seq;	/* end_seq of the round */
 	u32_t	last_ack;	/* last time when the ACK spacing is close */
 	u32_t	curr_rtt;	/* the minimum rtt of current round */
+
+#if LWIP_TCP_HYSTART_PP
+	/* for HyStart++, rounds are tracked with the hystart fields */
+	u32_t	last_rtt;	/* the minimum rtt of the last round */
+	u32_t	css_baseline_rtt;	/* curr_rtt when CSS was entered */
+	u8_t	hspp;		/* HSPP_* state */
+	u8_t	css_rounds;	/* rounds started in CSS */
+#endif /* LWIP_TCP_HYSTART_PP */
 };
 
 static inline void cubictcp_reset(struct cubictcp *ca)
@@ -88,6 +116,18 @@ static void tcp_cubic_init(struct tcp_pcb *pcb)
 
 }
 
+#if LWIP_TCP_HYSTART_PP
+static void tcp_cubic_hspp_init(struct tcp_pcb *pcb)
+{
+	struct cubictcp *ca = (struct cubictcp *)pcb->tcp_congestion_priv;
+
+	tcp_cubic_init(pcb);
+	cubictcp_hystart_reset(pcb);
+	ca->last_rtt = ~0U;
+	ca->hspp = HSPP_SS;
+}
+#endif /* LWIP_TCP_HYSTART_PP */
+
 static void tcp_cubic_cwnd_event(struct tcp_pcb *pcb, u8_t event)
 {
 	struct cubictcp *ca = (struct cubictcp *)pcb->tcp_congestion_priv;
@@ -307,6 +347,21 @@ static u32_t tcp_cubic_slow_start(struct tcp_pcb *pcb, u32_t acked)
 
 	acked -= delta;
 
+#if LWIP_TCP_HYSTART_PP
+	{
+		struct cubictcp *ca = (struct cubictcp *)pcb->tcp_congestion_priv;
+
+		if (ca->hspp == HSPP_SS || ca->hspp == HSPP_CSS) {
+#if LWIP_TCP_PACING
+			if (!(pcb->pacing_flags & TCP_PACING_ON))
+#endif /* LWIP_TCP_PACING */
+				delta = LWIP_MIN(delta, HSPP_L * (u32_t)pcb->mss);
+			if (ca->hspp == HSPP_CSS)
+				delta /= HSPP_CSS_GROWTH_DIVISOR;
+		}
+	}
+#endif /* LWIP_TCP_HYSTART_PP */
+
 	TCP_WND_INC(pcb->cwnd, delta);
   LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: slow start cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
 
@@ -337,6 +392,11 @@ static tcpwnd_size_t tcp_cubic_ssthresh(struct tcp_pcb *pcb)
 	u32_t cwnd = pcb->cwnd / pcb->mss; /* convert cwnd in byte to cwnd in segment*/
 
   ca->epoch_start = 0;	/* end of epoch */
+#if LWIP_TCP_HYSTART_PP
+	/* later slow starts end at the ssthresh found now */
+	if (ca->hspp != HSPP_OFF)
+		ca->hspp = HSPP_DONE;
+#endif /* LWIP_TCP_HYSTART_PP */
 
   if (cwnd < ca->last_max_cwnd && fast_convergence)
 		ca->last_max_cwnd = (cwnd * (CUBICTCP_BETA_SCALE + beta))
@@ -347,6 +407,18 @@ static tcpwnd_size_t tcp_cubic_ssthresh(struct tcp_pcb *pcb)
 	return LWIP_MAX((cwnd * beta) / CUBICTCP_BETA_SCALE, 2) * pcb->mss;
 }
 
+#if LWIP_TCP_UNDO
+/* The loss was spurious: resume the cubic curve below the window before it */
+static tcpwnd_size_t tcp_cubic_undo_cwnd(struct tcp_pcb *pcb)
+{
+	struct cubictcp *ca = (struct cubictcp *)pcb->tcp_congestion_priv;
+
+	ca->last_max_cwnd = LWIP_MAX(ca->last_max_cwnd, pcb->prior_cwnd / pcb->mss);
+	ca->epoch_start = 0;
+	return LWIP_MAX(pcb->cwnd, pcb->prior_cwnd);
+}
+#endif /* LWIP_TCP_UNDO */
+
 static void hystart_update(struct tcp_pcb *pcb, u32_t delay)
 {
 	struct cubictcp *ca = (struct cubictcp *)pcb->tcp_congestion_priv;
@@ -387,6 +459,44 @@ static void hystart_update(struct tcp_pcb *pcb, u32_t delay)
 	}
 }
 
+#if LWIP_TCP_HYSTART_PP
+static void hspp_update(struct tcp_pcb *pcb, u32_t delay)
+{
+	struct cubictcp *ca = (struct cubictcp *)pcb->tcp_congestion_priv;
+
+	if (TCP_SEQ_GT(pcb->lastack + 1, ca->end_seq)) {
+		/* a new round */
+		if (ca->hspp == HSPP_CSS && ++ca->css_rounds > HSPP_CSS_ROUNDS) {
+			ca->hspp = HSPP_DONE;
+			pcb->ssthresh = pcb->cwnd;
+			return;
+		}
+		ca->last_rtt = ca->curr_rtt;
+		cubictcp_hystart_reset(pcb);
+	}
+
+	if (ca->curr_rtt > delay)
+		ca->curr_rtt = delay;
+	if (ca->sample_cnt < HYSTART_MIN_SAMPLES)
+		ca->sample_cnt++;
+	if (ca->sample_cnt < HYSTART_MIN_SAMPLES)
+		return;
+
+	if (ca->hspp == HSPP_SS) {
+		if (ca->last_rtt != ~0U &&
+		    ca->curr_rtt >= ca->last_rtt + HYSTART_DELAY_THRESH(ca->last_rtt >> 3)) {
+			/* the partial round counts as the first CSS round */
+			ca->css_baseline_rtt = ca->curr_rtt;
+			ca->css_rounds = 1;
+			ca->hspp = HSPP_CSS;
+		}
+	} else if (ca->curr_rtt < ca->css_baseline_rtt) {
+		/* the delay increase was spurious, back to slow start */
+		ca->hspp = HSPP_SS;
+	}
+}
+#endif /* LWIP_TCP_HYSTART_PP */
+
 static void tcp_cubic_acked(struct tcp_pcb *pcb, u32_t rtt_ms)
 {
 	struct cubictcp *ca = (struct cubictcp *)pcb->tcp_congestion_priv;
@@ -404,6 +514,14 @@ static void tcp_cubic_acked(struct tcp_pcb *pcb, u32_t rtt_ms)
 	if (ca->delay_min == 0 || ca->delay_min > delay)
 		ca->delay_min = delay;
 
+#if LWIP_TCP_HYSTART_PP
+	if (ca->hspp != HSPP_OFF) {
+		if ((ca->hspp == HSPP_SS || ca->hspp == HSPP_CSS) && tcp_in_slow_start(pcb))
+			hspp_update(pcb, delay);
+		return;
+	}
+#endif /* LWIP_TCP_HYSTART_PP */
+
 	/* hystart triggers when cwnd is larger than some threshold */
 	if (!ca->found && tcp_in_slow_start(pcb) && hystart &&
 	    pcb->cwnd >= hystart_low_window * pcb->mss)
@@ -416,5 +534,37 @@ struct tcp_congestion_ops tcp_ca_cubic = {
   tcp_cubic_cwnd_event,
 	tcp_cubic_acked,
   "cubic",
-  tcp_cubic_init
+  tcp_cubic_init,
+  sizeof(struct cubictcp),
+#if LWIP_TCP_RATE_SAMPLE
+  NULL,
+#endif /* LWIP_TCP_RATE_SAMPLE */
+#if LWIP_TCP_ECN
+  NULL,
+#endif /* LWIP_TCP_ECN */
+#if LWIP_TCP_UNDO
+  tcp_cubic_undo_cwnd,
+#endif /* LWIP_TCP_UNDO */
+};
+
+#if LWIP_TCP_HYSTART_PP
+/* CUBIC with HyStart++ instead of HyStart */
+struct tcp_congestion_ops tcp_ca_cubic_hspp = {
+	tcp_cubic_ssthresh,
+	tcp_cubic_cong_avoid,
+  tcp_cubic_cwnd_event,
+	tcp_cubic_acked,
+  "cubic_hspp",
+  tcp_cubic_hspp_init,
+  sizeof(struct cubictcp),
+#if LWIP_TCP_RATE_SAMPLE
+  NULL,
+#endif /* LWIP_TCP_RATE_SAMPLE */
+#if LWIP_TCP_ECN
+  NULL,
+#endif /* LWIP_TCP_ECN */
+#if LWIP_TCP_UNDO
+  tcp_cubic_undo_cwnd,
+#endif /* LWIP_TCP_UNDO */
 };
+#endif /* LWIP_TCP_HYSTART_PP */
@@ -0,0 +1,168 @@
+#include "lwip/opt.h"
+
+#if LWIP_TCP && LWIP_TCP_DCTCP /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/tcp.h"
+#include "lwip/priv/tcp_priv.h"
+
+/*
+ * DCTCP congestion control, ported from the Linux implementation
+ * (RFC 8257, Alizadeh et al., "Data Center TCP").
+ *
+ * The receiver echoes the CE state of every data segment exactly instead of
+ * latching ECE until CWR. The sender keeps alpha, a moving average of the
+ * fraction of bytes that were CE marked, and on an ECE reduces cwnd by
+ * alpha/2 instead of by half. With switches marking at a low queue threshold
+ * this keeps the queue short without giving up throughput.
+ *
+ * Differences to Linux:
+ *  - alpha is updated from the bytes passed to in_ack_event() instead of the
+ *    delivered and delivered_ce counters of the stack
+ *  - there is no fallback to Reno when ECN is not negotiated: without ECE,
+ *    ssthresh halves cwnd like Reno anyway
+ */
+
+#define DCTCP_MAX_ALPHA	1024U
+
+/* alpha += g * (F - alpha) with g = 1/2^dctcp_shift_g */
+static const u32_t dctcp_shift_g = 4;
+static const u32_t dctcp_alpha_on_init = DCTCP_MAX_ALPHA;
+
+struct dctcp {
+	u32_t	acked_bytes_ecn;	/* bytes ACKed with ECE in this window */
+	u32_t	acked_bytes_total;	/* bytes ACKed in this window */
+	u32_t	next_seq;		/* end of the window alpha is updated for */
+	u32_t	dctcp_alpha;		/* fraction of marked bytes, scaled by 1024 */
+	u8_t	ce_state;		/* CE state of the last data segment received */
+};
+
+static void dctcp_reset(struct tcp_pcb *pcb, struct dctcp *ca)
+{
+	ca->next_seq = pcb->snd_nxt;
+	ca->acked_bytes_ecn = 0;
+	ca->acked_bytes_total = 0;
+}
+
+static void dctcp_init(struct tcp_pcb *pcb)
+{
+	struct dctcp *ca = (struct dctcp *)pcb->tcp_congestion_priv;
+
+	ca->dctcp_alpha = dctcp_alpha_on_init;
+	ca->ce_state = 0;
+	dctcp_reset(pcb, ca);
+}
+
+static tcpwnd_size_t dctcp_ssthresh(struct tcp_pcb *pcb)
+{
+	struct dctcp *ca = (struct dctcp *)pcb->tcp_congestion_priv;
+	u32_t cwnd = pcb->cwnd;
+	u32_t reduce;
+
+	if (!(pcb->ecn_flags & TCP_ECN_REDUCE)) {
+		/* loss is handled like in Reno (RFC 8257, section 3.5) */
+		return LWIP_MAX(cwnd >> 1U, 2U * pcb->mss);
+	}
+	/* cwnd * alpha / 2, split up so it cannot overflow */
+	reduce = (cwnd >> 11U) * ca->dctcp_alpha +
+		 (((cwnd & 0x7ffU) * ca->dctcp_alpha) >> 11U);
+	return (tcpwnd_size_t)LWIP_MAX(cwnd - reduce, 2U * pcb->mss);
+}
+
+static void dctcp_cong_avoid(struct tcp_pcb *pcb, u32_t acked)
+{
+	tcp_ca_reno.cong_avoid(pcb, acked);
+}
+
+static void dctcp_in_ack_event(struct tcp_pcb *pcb, u32_t acked, u8_t flags)
+{
+	struct dctcp *ca = (struct dctcp *)pcb->tcp_congestion_priv;
+
+	ca->acked_bytes_total += acked;
+	if (flags & CA_ACK_ECE)
+		ca->acked_bytes_ecn += acked;
+
+	/* Expired RTT */
+	if (!TCP_SEQ_LT(pcb->lastack, ca->next_seq)) {
+		u32_t bytes_ecn = ca->acked_bytes_ecn;
+		u32_t alpha = ca->dctcp_alpha;
+
+		/* alpha = (1 - g) * alpha + g * F */
+		if (alpha >> dctcp_shift_g)
+			alpha -= alpha >> dctcp_shift_g;
+		else
+			alpha = 0;	/* min_not_zero() in Linux */
+		if (bytes_ecn) {
+			/* bytes_ecn <= acked_bytes_total, so the shift only
+			   overflows for windows above 64 MB */
+			bytes_ecn = (bytes_ecn << (10U - dctcp_shift_g)) /
+				    LWIP_MAX(1U, ca->acked_bytes_total);
+			alpha = LWIP_MIN(alpha + bytes_ecn, DCTCP_MAX_ALPHA);
+		}
+		ca->dctcp_alpha = alpha;
+		LWIP_DEBUGF(TCP_CWND_DEBUG, ("dctcp: alpha %"U32_F"\n", alpha));
+		dctcp_reset(pcb, ca);
+	}
+}
+
+/* Echo the CE state of every data segment: ECE on all ACKs while segments
+ * arrive CE marked, and none as soon as they stop being marked.
+ */
+static void dctcp_ece_ack_update(struct tcp_pcb *pcb, u8_t event)
+{
+	struct dctcp *ca = (struct dctcp *)pcb->tcp_congestion_priv;
+	u8_t new_ce_state = (event == CA_EVENT_ECN_IS_CE) ? 1 : 0;
+
+	if (ca->ce_state != new_ce_state) {
+		/* CE state has changed, force an immediate ACK to
+		 * reflect the new CE state. If an ACK was delayed,
+		 * send that first to reflect the prior CE state.
+		 * This runs before the segment is accepted, so that
+		 * ACK covers exactly the data received before it.
+		 */
+		if (pcb->flags & TF_ACK_DELAY) {
+			if (ca->ce_state)
+				pcb->ecn_flags |= TCP_ECN_DEMAND_CWR;
+			else
+				pcb->ecn_flags &= (u8_t)~TCP_ECN_DEMAND_CWR;
+			tcp_send_empty_ack(pcb);
+		}
+		tcp_ack_now(pcb);
+	}
+	ca->ce_state = new_ce_state;
+	if (new_ce_state)
+		pcb->ecn_flags |= TCP_ECN_DEMAND_CWR;
+	else
+		pcb->ecn_flags &= (u8_t)~TCP_ECN_DEMAND_CWR;
+}
+
+static void dctcp_cwnd_event(struct tcp_pcb *pcb, u8_t event)
+{
+	switch (event) {
+	case CA_EVENT_ECN_IS_CE:
+	case CA_EVENT_ECN_NO_CE:
+		dctcp_ece_ack_update(pcb, event);
+		break;
+	default:
+		/* Don't care for the rest. */
+		break;
+	}
+}
+
+struct tcp_congestion_ops tcp_ca_dctcp = {
+	dctcp_ssthresh,
+	dctcp_cong_avoid,
+	dctcp_cwnd_event,
+	NULL,
+	"dctcp",
+	dctcp_init,
+	sizeof(struct dctcp),
+#if LWIP_TCP_RATE_SAMPLE
+	NULL,
+#endif /* LWIP_TCP_RATE_SAMPLE */
+	dctcp_in_ack_event,
+#if LWIP_TCP_UNDO
+	NULL,
+#endif /* LWIP_TCP_UNDO */
+};
+
+#endif /* LWIP_TCP && LWIP_TCP_DCTCP */
@@ -39,11 +39,29 @@ static tcpwnd_size_t tcp_reno_ssthresh(struct tcp_pcb *pcb)
 	return LWIP_MAX(pcb->cwnd >> 1U, 2 * pcb->mss);
 }
 
+#if LWIP_TCP_UNDO
+/* After a spurious retransmission, at least the cwnd before it */
+static tcpwnd_size_t tcp_reno_undo_cwnd(struct tcp_pcb *pcb)
+{
+	return LWIP_MAX(pcb->cwnd, pcb->prior_cwnd);
+}
+#endif /* LWIP_TCP_UNDO */
+
 struct tcp_congestion_ops tcp_ca_reno = {
 	tcp_reno_ssthresh,
 	tcp_reno_cong_avoid,
   NULL,
   NULL,
   "reno",
-  NULL
+  NULL,
+  0,
+#if LWIP_TCP_RATE_SAMPLE
+  NULL,
+#endif /* LWIP_TCP_RATE_SAMPLE */
+#if LWIP_TCP_ECN
+  NULL,
+#endif /* LWIP_TCP_ECN */
+#if LWIP_TCP_UNDO
+  tcp_reno_undo_cwnd,
+#endif /* LWIP_TCP_UNDO */
 };
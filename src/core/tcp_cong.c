@@ -1,13 +1,220 @@
 #include "lwip/tcp.h"
 #include "lwip/priv/tcp_priv.h"
 
-/* struct tcp_congestion_ops const tcp_ca_lists[] = {};
+#include <string.h>
 
+/* The built-in congestion controls, selectable by name */
+static struct tcp_congestion_ops *const tcp_ca_builtin[] = {
+	&tcp_ca_cubic,
+	&tcp_ca_reno,
+#if LWIP_TCP_HYSTART_PP
+	&tcp_ca_cubic_hspp,
+#endif /* LWIP_TCP_HYSTART_PP */
+#if LWIP_TCP_BBR
+	&tcp_ca_bbr,
+#endif /* LWIP_TCP_BBR */
+#if LWIP_TCP_DCTCP
+	&tcp_ca_dctcp,
+#endif /* LWIP_TCP_DCTCP */
+};
+
+#if TCP_CA_NUM_EXTRA
+/* Added by the application with tcp_register_congestion_control() */
+static struct tcp_congestion_ops *tcp_ca_extra[TCP_CA_NUM_EXTRA];
+#endif /* TCP_CA_NUM_EXTRA */
+
+/* Congestion control of new connections */
+struct tcp_congestion_ops *tcp_ca_default = &TCP_CA_DEFAULT;
+
+/**
+ * @ingroup tcp_raw
+ * Look up a congestion control by name.
+ *
+ * @param name name of the congestion control, e.g. "cubic"
+ * @return the congestion control or NULL if there is none by that name
+ */
+struct tcp_congestion_ops *tcp_ca_find(const char *name)
+{
+	size_t i;
+
+	LWIP_ERROR("tcp_ca_find: invalid name", name != NULL, return NULL);
+
+	for (i = 0; i < LWIP_ARRAYSIZE(tcp_ca_builtin); i++) {
+		if (strncmp(tcp_ca_builtin[i]->name, name, TCP_CA_NAME_MAX) == 0)
+			return tcp_ca_builtin[i];
+	}
+#if TCP_CA_NUM_EXTRA
+	for (i = 0; i < TCP_CA_NUM_EXTRA; i++) {
+		if (tcp_ca_extra[i] != NULL &&
+		    strncmp(tcp_ca_extra[i]->name, name, TCP_CA_NAME_MAX) == 0)
+			return tcp_ca_extra[i];
+	}
+#endif /* TCP_CA_NUM_EXTRA */
+	return NULL;
+}
+
+/**
+ * @ingroup tcp_raw
+ * Add a congestion control, so that it can be selected by its name.
+ * The ops are referenced, not copied, and must stay valid.
+ *
+ * @param ops the congestion control to add
+ * @return ERR_OK, ERR_ARG if a required op or the name is missing or
+ *         priv_size exceeds TCP_CA_PRIV_SIZE,
+ *         ERR_VAL if the name is taken or ERR_MEM if TCP_CA_NUM_EXTRA
+ *         congestion controls have been added already
+ */
+err_t tcp_register_congestion_control(struct tcp_congestion_ops *ops)
+{
+	LWIP_ASSERT_CORE_LOCKED();
+
+	LWIP_ERROR("tcp_register_congestion_control: invalid ops",
+		   ops != NULL && ops->ssthresh != NULL && ops->cong_avoid != NULL &&
+		   ops->name[0] != 0, return ERR_ARG);
+
+	if (ops->priv_size > sizeof(((struct tcp_pcb *)0)->tcp_congestion_priv))
+		return ERR_ARG;
+	if (memchr(ops->name, 0, TCP_CA_NAME_MAX) == NULL)
+		return ERR_ARG;
+	if (tcp_ca_find(ops->name) != NULL)
+		return ERR_VAL;
+#if TCP_CA_NUM_EXTRA
+	{
+		size_t i;
+
+		for (i = 0; i < TCP_CA_NUM_EXTRA; i++) {
+			if (tcp_ca_extra[i] == NULL) {
+				tcp_ca_extra[i] = ops;
+				return ERR_OK;
+			}
+		}
+	}
+#endif /* TCP_CA_NUM_EXTRA */
+	return ERR_MEM;
+}
+
+/**
+ * @ingroup tcp_raw
+ * Remove a congestion control added with tcp_register_congestion_control().
+ * No connection may use it any more. If it is the default, the default
+ * goes back to TCP_CA_DEFAULT.
+ *
+ * @param ops the congestion control to remove
+ * @return ERR_OK or ERR_VAL if it has not been added
+ */
+err_t tcp_unregister_congestion_control(struct tcp_congestion_ops *ops)
+{
+	LWIP_ASSERT_CORE_LOCKED();
+
+#if TCP_CA_NUM_EXTRA
+	{
+		size_t i;
+
+		for (i = 0; i < TCP_CA_NUM_EXTRA; i++) {
+			if (tcp_ca_extra[i] == ops && ops != NULL) {
+				tcp_ca_extra[i] = NULL;
+				if (tcp_ca_default == ops)
+					tcp_ca_default = &TCP_CA_DEFAULT;
+				return ERR_OK;
+			}
+		}
+	}
+#else /* TCP_CA_NUM_EXTRA */
+	LWIP_UNUSED_ARG(ops);
+#endif /* TCP_CA_NUM_EXTRA */
+	return ERR_VAL;
+}
+
+/**
+ * @ingroup tcp_raw
+ * Set the congestion control of connections created from now on.
+ *
+ * @param name name of the congestion control
+ * @return ERR_OK or ERR_VAL if there is no congestion control by that name
+ *         or its priv_size exceeds TCP_CA_PRIV_SIZE
+ */
+err_t tcp_set_default_congestion_control(const char *name)
+{
+	struct tcp_congestion_ops *ops;
+
+	LWIP_ASSERT_CORE_LOCKED();
+
+	ops = tcp_ca_find(name);
+	if (ops == NULL || ops->priv_size > sizeof(((struct tcp_pcb *)0)->tcp_congestion_priv))
+		return ERR_VAL;
+	tcp_ca_default = ops;
+	return ERR_OK;
+}
+
+/**
+ * @ingroup tcp_raw
+ * Get the name of the congestion control new connections start with.
+ */
+const char *tcp_get_default_congestion_control(void)
+{
+	return tcp_ca_default->name;
+}
+
+/**
+ * @ingroup tcp_raw
+ * Select the congestion control of a connection. On a listening pcb, this
+ * selects it for the connections it accepts. On a connection that is open
+ * already, the new congestion control starts over from the current cwnd
+ * and ssthresh.
+ *
+ * @param pcb the tcp_pcb to configure
+ * @param name name of the congestion control
+ * @return ERR_OK or ERR_VAL if there is no congestion control by that name
+ *         or its priv_size exceeds TCP_CA_PRIV_SIZE
+ */
+err_t tcp_set_congestion_control(struct tcp_pcb *pcb, const char *name)
+{
+	struct tcp_congestion_ops *ops;
+#if LWIP_TCP_RATE_SAMPLE
+	struct tcp_congestion_ops *old_ops;
+#endif /* LWIP_TCP_RATE_SAMPLE */
+
+	LWIP_ASSERT_CORE_LOCKED();
+
+	LWIP_ERROR("tcp_set_congestion_control: invalid pcb", pcb != NULL, return ERR_ARG);
+
+	ops = tcp_ca_find(name);
+	if (ops == NULL || ops->priv_size > sizeof(pcb->tcp_congestion_priv))
+		return ERR_VAL;
+	if (ops == pcb->cong_ops)
+		return ERR_OK;
+#if LWIP_TCP_RATE_SAMPLE
+	old_ops = pcb->cong_ops;
+#endif /* LWIP_TCP_RATE_SAMPLE */
+	/* only the members common to listening pcbs may be touched for those */
+	pcb->cong_ops = ops;
+	if (pcb->state != CLOSED && pcb->state != LISTEN) {
+#if LWIP_TCP_RATE_SAMPLE
+		if (old_ops->cong_control != NULL) {
+			/* the pacing rate was set by the old congestion control */
+#if LWIP_TCP_PACING
+			tcp_pacing_ca_release(pcb);
+#else /* LWIP_TCP_PACING */
+			pcb->pacing_rate = 0;
+#endif /* LWIP_TCP_PACING */
+		}
+#endif /* LWIP_TCP_RATE_SAMPLE */
+		/* tcp_connect() or tcp_listen_input() initialize it otherwise */
+		tcp_init_congestion_control(pcb);
+	}
+	return ERR_OK;
+}
+
+/* Start the congestion control of a connection with zeroed private state */
 void tcp_init_congestion_control(struct tcp_pcb *pcb)
 {
-    if(pcb->cong_ops->init)
-	    pcb->cong_ops->init(pcb);
-} */
+	LWIP_ASSERT("congestion control state does not fit TCP_CA_PRIV_SIZE",
+		    pcb->cong_ops->priv_size <= sizeof(pcb->tcp_congestion_priv));
+
+	memset(pcb->tcp_congestion_priv, 0, pcb->cong_ops->priv_size);
+	if (pcb->cong_ops->init != NULL)
+		pcb->cong_ops->init(pcb);
+}
 
 /* In theory this is tp->snd_cwnd += 1 / tp->snd_cwnd (or alternative w),
  * for every packet that was ACKed.
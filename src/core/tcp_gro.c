@@ -0,0 +1,283 @@
+/**
+ * @file
+ * Generic receive offload for TCP
+ *
+ * A bulk transfer arrives as a burst of MSS-sized frames, and every one of
+ * them goes through tcp_input(), tcp_receive(), the recv callback and
+ * possibly an ACK on its own. With GRO, ip4_input() and ip6_input() pass TCP
+ * frames to tcp_gro_receive() first. It holds back the first data segment of
+ * a connection and appends the payload of the following in-order segments
+ * of that connection to it, so that one segment with one header goes to
+ * tcp_input() when the driver calls netif_gro_flush() at the end of the
+ * burst. Every frame has been through IP input processing (statistics,
+ * hooks, raw pcbs) already, so the merged segment goes to tcp_input()
+ * directly.
+ *
+ * Only frames that TCP would process the same way are merged: same
+ * addresses, ports, IP TOS and TTL, same ACK number, window and options,
+ * no flags but ACK and PSH and contiguous sequence numbers. Everything else
+ * passes through, after the segment held for that connection, so TCP still
+ * sees all segments in the order they arrived.
+ */
+
+#include "lwip/opt.h"
+
+#if LWIP_TCP && LWIP_TCP_GRO /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/netif.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/prot/ip4.h"
+#include "lwip/prot/ip6.h"
+
+#include <string.h>
+
+/** A segment held back for merging */
+struct tcp_gro_flow {
+  /** the merged segment, p->payload points to the IP header */
+  struct pbuf *p;
+  /** the netif the frames were received on */
+  struct netif *netif;
+  /** ip_data of the first frame, for tcp_input() */
+  struct ip_globals ip_data;
+  /** sequence number the next frame has to start with */
+  u32_t next_seq;
+  /** payload length of the first frame, later ones may not be longer */
+  u16_t segsz;
+  /** number of frames merged */
+  u16_t segs;
+  /** length of the IP header */
+  u16_t hlen;
+};
+
+static struct tcp_gro_flow tcp_gro_flows[TCP_GRO_MAX_FLOWS];
+
+/** Pass a held segment on to tcp_input() */
+static void
+tcp_gro_deliver(struct tcp_gro_flow *flow)
+{
+  struct ip_globals ip_data_saved;
+  struct pbuf *p = flow->p;
+
+  flow->p = NULL;
+  /* this may run from within ip_input() for the frame that ended the run */
+  ip_data_saved = ip_data;
+  ip_data = flow->ip_data;
+  pbuf_remove_header(p, flow->hlen);
+  tcp_input(p, flow->netif);
+  ip_data = ip_data_saved;
+}
+
+/** Check if the current frame belongs to the connection of a held segment */
+static u8_t
+tcp_gro_same_flow(const struct tcp_gro_flow *flow, const struct tcp_hdr *tcphdr)
+{
+  const u8_t *held = (const u8_t *)flow->p->payload;
+  const struct tcp_hdr *th = (const struct tcp_hdr *)(held + flow->hlen);
+
+  if ((th->src != tcphdr->src) || (th->dest != tcphdr->dest)) {
+    return 0;
+  }
+#if LWIP_IPV6
+  if (ip_current_is_v6()) {
+    const struct ip6_hdr *ip6hdr = ip6_current_header();
+    return (IP6H_V((const struct ip6_hdr *)held) == 6) &&
+           (memcmp(&((const struct ip6_hdr *)held)->src, &ip6hdr->src, 2 * sizeof(ip6_addr_p_t)) == 0);
+  }
+#endif /* LWIP_IPV6 */
+#if LWIP_IPV4
+  {
+    const struct ip_hdr *iphdr = ip4_current_header();
+    return (IPH_V((const struct ip_hdr *)held) == 4) &&
+           (((const struct ip_hdr *)held)->src.addr == iphdr->src.addr) &&
+           (((const struct ip_hdr *)held)->dest.addr == iphdr->dest.addr);
+  }
+#else /* LWIP_IPV4 */
+  return 0;
+#endif /* LWIP_IPV4 */
+}
+
+/** Check if the current frame can be appended to the segment held for its
+ * connection: it has to continue it and carry the same headers */
+static u8_t
+tcp_gro_can_merge(const struct tcp_gro_flow *flow, const struct tcp_hdr *tcphdr,
+                  u16_t tcphlen, u16_t len)
+{
+  const u8_t *held = (const u8_t *)flow->p->payload;
+  const struct tcp_hdr *th = (const struct tcp_hdr *)(held + flow->hlen);
+
+  if ((lwip_ntohl(tcphdr->seqno) != flow->next_seq) || (len > flow->segsz) ||
+      (flow->segs >= TCP_GRO_MAX_SEGS) ||
+      ((u32_t)flow->p->tot_len + len > flow->netif->gro_max_size)) {
+    return 0;
+  }
+  /* the frames of a merged segment have to be processed the same way */
+  if ((th->ackno != tcphdr->ackno) || (th->wnd != tcphdr->wnd) ||
+      ((th->_hdrlen_rsvd_flags ^ tcphdr->_hdrlen_rsvd_flags) & ~PP_HTONS(TCP_PSH)) ||
+      (memcmp(th + 1, tcphdr + 1, tcphlen - TCP_HLEN) != 0)) {
+    return 0;
+  }
+#if LWIP_IPV6
+  if (ip_current_is_v6()) {
+    const struct ip6_hdr *ip6hdr = ip6_current_header();
+    /* the traffic class holds the ECN bits */
+    return (((const struct ip6_hdr *)held)->_v_tc_fl == ip6hdr->_v_tc_fl) &&
+           (IP6H_HOPLIM((const struct ip6_hdr *)held) == IP6H_HOPLIM(ip6hdr));
+  }
+#endif /* LWIP_IPV6 */
+#if LWIP_IPV4
+  {
+    const struct ip_hdr *iphdr = ip4_current_header();
+    /* the TOS holds the ECN bits */
+    return (IPH_TOS((const struct ip_hdr *)held) == IPH_TOS(iphdr)) &&
+           (IPH_TTL((const struct ip_hdr *)held) == IPH_TTL(iphdr));
+  }
+#else /* LWIP_IPV4 */
+  return 0;
+#endif /* LWIP_IPV4 */
+}
+
+/** Append the payload of the current frame to the segment held for its
+ * connection and fix up the lengths in the held headers */
+static void
+tcp_gro_merge(struct tcp_gro_flow *flow, struct pbuf *p, u16_t tcphlen, u16_t len)
+{
+  u8_t *held = (u8_t *)flow->p->payload;
+  struct tcp_hdr *th = (struct tcp_hdr *)(held + flow->hlen);
+
+  if (TCPH_FLAGS((struct tcp_hdr *)p->payload) & TCP_PSH) {
+    TCPH_SET_FLAG(th, TCP_PSH);
+  }
+  pbuf_cat(flow->p, pbuf_free_header(p, tcphlen));
+  flow->next_seq += len;
+  flow->segs++;
+
+#if LWIP_IPV6
+  if (IP6H_V((struct ip6_hdr *)held) == 6) {
+    IP6H_PLEN_SET((struct ip6_hdr *)held, (u16_t)(flow->p->tot_len - IP6_HLEN));
+  } else
+#endif /* LWIP_IPV6 */
+  {
+#if LWIP_IPV4
+    struct ip_hdr *iphdr = (struct ip_hdr *)held;
+
+    IPH_LEN_SET(iphdr, lwip_htons(flow->p->tot_len));
+    IPH_CHKSUM_SET(iphdr, 0);
+#if CHECKSUM_CHECK_IP
+    IF__NETIF_CHECKSUM_ENABLED(flow->netif, NETIF_CHECKSUM_CHECK_IP) {
+      IPH_CHKSUM_SET(iphdr, inet_chksum(iphdr, flow->hlen));
+    }
+#endif /* CHECKSUM_CHECK_IP */
+#endif /* LWIP_IPV4 */
+  }
+}
+
+/**
+ * Called by ip4_input() and ip6_input() for every TCP frame. Merges the
+ * frame into the segment held for its connection or holds it back to merge
+ * the next ones into it.
+ *
+ * @param p the received frame, p->payload points to the TCP header
+ * @param inp the netif the frame was received on
+ * @return 1 if the frame has been taken, 0 if it has to go to tcp_input()
+ */
+u8_t
+tcp_gro_receive(struct pbuf *p, struct netif *inp)
+{
+  struct tcp_gro_flow *flow = NULL, *free_flow = NULL;
+  struct tcp_hdr *tcphdr;
+  u16_t hlen, tcphlen, len;
+  u8_t mergeable;
+  int i;
+
+  if ((inp->gro_max_size == 0) || (p->len < TCP_HLEN)) {
+    return 0;
+  }
+  tcphdr = (struct tcp_hdr *)p->payload;
+  tcphlen = TCPH_HDRLEN_BYTES(tcphdr);
+  if ((tcphlen < TCP_HLEN) || (tcphlen > p->len)) {
+    /* tcp_input() drops this */
+    return 0;
+  }
+  hlen = ip_current_header_tot_len();
+  len = (u16_t)(p->tot_len - tcphlen);
+
+  for (i = 0; i < TCP_GRO_MAX_FLOWS; i++) {
+    if (tcp_gro_flows[i].p == NULL) {
+      if (free_flow == NULL) {
+        free_flow = &tcp_gro_flows[i];
+      }
+    } else if ((tcp_gro_flows[i].netif == inp) && tcp_gro_same_flow(&tcp_gro_flows[i], tcphdr)) {
+      flow = &tcp_gro_flows[i];
+      break;
+    }
+  }
+
+  /* only data segments without options in the IP header are merged */
+  mergeable = (len > 0) && ((TCPH_FLAGS(tcphdr) & ~(TCP_ACK | TCP_PSH)) == 0) &&
+              (TCPH_FLAGS(tcphdr) & TCP_ACK) &&
+              (hlen == (ip_current_is_v6() ? IP6_HLEN : IP_HLEN));
+#if CHECKSUM_CHECK_TCP
+  if (mergeable) {
+    IF__NETIF_CHECKSUM_ENABLED(inp, NETIF_CHECKSUM_CHECK_TCP) {
+      /* the checksum of the merged segment is not valid: check it now */
+      if (ip_chksum_pseudo(p, IP_PROTO_TCP, p->tot_len,
+                           ip_current_src_addr(), ip_current_dest_addr()) != 0) {
+        /* tcp_input() drops this */
+        mergeable = 0;
+      } else {
+        p->flags |= PBUF_FLAG_TCP_CHKSUM_OK;
+      }
+    }
+  }
+#endif /* CHECKSUM_CHECK_TCP */
+
+  if (flow != NULL) {
+    if (mergeable && tcp_gro_can_merge(flow, tcphdr, tcphlen, len)) {
+      u8_t last = (TCPH_FLAGS(tcphdr) & TCP_PSH) || (len < flow->segsz);
+
+      tcp_gro_merge(flow, p, tcphlen, len);
+      if (last) {
+        /* nothing can follow a short or pushed segment */
+        tcp_gro_deliver(flow);
+      }
+      return 1;
+    }
+    /* keep the order: the held segment goes first */
+    tcp_gro_deliver(flow);
+    free_flow = flow;
+  }
+  if (!mergeable || (free_flow == NULL) || (TCPH_FLAGS(tcphdr) & TCP_PSH)) {
+    return 0;
+  }
+  if (pbuf_add_header(p, hlen)) {
+    return 0;
+  }
+  free_flow->p = p;
+  free_flow->netif = inp;
+  free_flow->ip_data = ip_data;
+  free_flow->next_seq = lwip_ntohl(tcphdr->seqno) + len;
+  free_flow->segsz = len;
+  free_flow->segs = 1;
+  free_flow->hlen = hlen;
+  return 1;
+}
+
+/**
+ * Pass the segments held for a netif on to TCP.
+ *
+ * @param netif the netif the segments were received on
+ */
+void
+tcp_gro_flush(struct netif *netif)
+{
+  int i;
+
+  for (i = 0; i < TCP_GRO_MAX_FLOWS; i++) {
+    if ((tcp_gro_flows[i].p != NULL) && (tcp_gro_flows[i].netif == netif)) {
+      tcp_gro_deliver(&tcp_gro_flows[i]);
+    }
+  }
+}
+
+#endif /* LWIP_TCP && LWIP_TCP_GRO */
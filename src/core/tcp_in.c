@@ -65,9 +65,6 @@
 #include LWIP_HOOK_FILENAME
 #endif
 
-/** Initial CWND calculation as defined RFC 2581 */
-#define LWIP_TCP_CALC_INITIAL_CWND(mss) ((tcpwnd_size_t)LWIP_MIN((4U * (mss)), LWIP_MAX((2U * (mss)), 4380U)))
-
 /* These variables are global to all functions involved in the input
    processing of TCP segments. They are set by the tcp_input()
    function. */
@@ -79,10 +76,48 @@ static u8_t *tcphdr_opt2;
 static u16_t tcp_optidx;
 static u32_t seqno, ackno;
 static tcpwnd_size_t recv_acked;
+#if LWIP_TCP_ZEROCOPY
+/* set if zero-copy writes up to recv_zc_id have been ACKed */
+static u8_t recv_zc_acked;
+static u32_t recv_zc_id;
+#endif /* LWIP_TCP_ZEROCOPY */
 static u16_t tcplen;
 static u8_t flags;
 static u32_t rtt_ms;
 
+#if LWIP_TCP_SACK_IN
+/** Loss recovery is driven by the SACK scoreboard */
+#define TCP_SACK_RECOVERY(pcb)  ((pcb)->flags & TF_SACK)
+/** More than (DupThresh - 1) * SMSS bytes above snd_una have been SACKed (RFC 6675 IsLost) */
+#define TCP_SACK_HEAD_LOST(pcb) (TCP_SACK_RECOVERY(pcb) && ((pcb)->sacked > 2U * (pcb)->mss))
+/** Bytes on the unacked queue SACKed by the remote host */
+#define TCP_SACKED(pcb)         ((pcb)->sacked)
+/** A SACK option carries at most 4 blocks in 40 bytes of options */
+#define TCP_SACK_IN_MAX_BLOCKS 4
+/* SACK blocks of the current input segment, filled by tcp_parseopt() */
+static struct tcp_sack_range sack_blocks[TCP_SACK_IN_MAX_BLOCKS];
+static u8_t sack_num;
+#else /* LWIP_TCP_SACK_IN */
+#define TCP_SACK_RECOVERY(pcb)  0
+#define TCP_SACK_HEAD_LOST(pcb) 0
+#define TCP_SACKED(pcb)         0
+#endif /* LWIP_TCP_SACK_IN */
+
+#if LWIP_TCP_RATE_SAMPLE
+/* delivery rate sample of the ACK being processed */
+static struct tcp_rate_sample rate_sample;
+/** The congestion control sets cwnd itself from the rate sample */
+#define TCP_CA_CONG_CONTROL(pcb) ((pcb)->cong_ops->cong_control != NULL)
+#else /* LWIP_TCP_RATE_SAMPLE */
+#define TCP_CA_CONG_CONTROL(pcb) 0
+#endif /* LWIP_TCP_RATE_SAMPLE */
+
+#if LWIP_TCP_UNDO && LWIP_TCP_TIMESTAMPS
+/* Timestamp echo reply of the current input segment, filled by tcp_parseopt() */
+static u32_t ts_ecr;
+static u8_t ts_ecr_valid;
+#endif /* LWIP_TCP_UNDO && LWIP_TCP_TIMESTAMPS */
+
 static u8_t recv_flags;
 static struct pbuf *recv_data;
 
@@ -93,8 +128,14 @@ static err_t tcp_process(struct tcp_pcb *pcb);
 static void tcp_receive(struct tcp_pcb *pcb);
 static void tcp_parseopt(struct tcp_pcb *pcb);
 
-static void tcp_listen_input(struct tcp_pcb_listen *pcb);
+static struct tcp_pcb *tcp_listen_input(struct tcp_pcb_listen *pcb);
 static void tcp_timewait_input(struct tcp_pcb *pcb);
+#if LWIP_TCP_TW_TABLE
+static void tcp_tw_input(struct tcp_tw *tw);
+#endif /* LWIP_TCP_TW_TABLE */
+#if LWIP_TCP_SYNCOOKIES || LWIP_TCP_REQ_TABLE
+static void tcp_handshake_parseopt(struct tcp_handshake *hs);
+#endif /* LWIP_TCP_SYNCOOKIES || LWIP_TCP_REQ_TABLE */
 
 static int tcp_input_delayed_close(struct tcp_pcb *pcb);
 
@@ -104,7 +145,13 @@ static void tcp_remove_sacks_lt(struct tcp_pcb *pcb, u32_t seq);
 #if defined(TCP_OOSEQ_BYTES_LIMIT) || defined(TCP_OOSEQ_PBUFS_LIMIT)
 static void tcp_remove_sacks_gt(struct tcp_pcb *pcb, u32_t seq);
 #endif /* TCP_OOSEQ_BYTES_LIMIT || TCP_OOSEQ_PBUFS_LIMIT */
+#if TCP_QUEUE_OOSEQ && TCP_OOSEQ_TREE
+static void tcp_ooseq_sack_range(struct tcp_pcb *pcb, struct tcp_seg *seg, u32_t *left, u32_t *right);
+#endif /* TCP_QUEUE_OOSEQ && TCP_OOSEQ_TREE */
 #endif /* LWIP_TCP_SACK_OUT */
+#if LWIP_TCP_SACK_IN
+static u8_t tcp_sack_update(struct tcp_pcb *pcb);
+#endif /* LWIP_TCP_SACK_IN */
 
 /**
  * The initial input processing of TCP. It verifies the TCP header, demultiplexes
@@ -120,10 +167,13 @@ tcp_input(struct pbuf *p, struct netif *inp)
 {
   struct tcp_pcb *pcb, *prev;
   struct tcp_pcb_listen *lpcb;
-#if SO_REUSE
+#if SO_REUSE && !LWIP_TCP_PCB_HASH
   struct tcp_pcb *lpcb_prev = NULL;
   struct tcp_pcb_listen *lpcb_any = NULL;
-#endif /* SO_REUSE */
+#endif /* SO_REUSE && !LWIP_TCP_PCB_HASH */
+#if LWIP_TCP_TW_TABLE
+  struct tcp_tw *tw;
+#endif /* LWIP_TCP_TW_TABLE */
   u8_t hdrlen_bytes;
   err_t err;
 
@@ -158,6 +208,10 @@ tcp_input(struct pbuf *p, struct netif *inp)
   }
 
 #if CHECKSUM_CHECK_TCP
+#if LWIP_TCP_GRO
+  /* GRO has checked the frames of a merged segment already */
+  if (!(p->flags & PBUF_FLAG_TCP_CHKSUM_OK))
+#endif /* LWIP_TCP_GRO */
   IF__NETIF_CHECKSUM_ENABLED(inp, NETIF_CHECKSUM_CHECK_TCP) {
     /* Verify TCP checksum. */
     u16_t chksum = ip_chksum_pseudo(p, IP_PROTO_TCP, p->tot_len,
@@ -248,6 +302,17 @@ tcp_input(struct pbuf *p, struct netif *inp)
      for an active connection. */
   prev = NULL;
 
+#if LWIP_TCP_PCB_HASH
+  /* The hash table holds active and TIME-WAIT pcbs, the latter are
+     handled below. */
+  pcb = tcp_pcb_hash_lookup(ip_current_dest_addr(), tcphdr->dest,
+                            ip_current_src_addr(), tcphdr->src,
+                            netif_get_index(ip_data.current_input_netif));
+  if ((pcb != NULL) && (pcb->state == TIME_WAIT)) {
+    prev = pcb;
+    pcb = NULL;
+  }
+#else /* LWIP_TCP_PCB_HASH */
   for (pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
     LWIP_ASSERT("tcp_input: active pcb->state != CLOSED", pcb->state != CLOSED);
     LWIP_ASSERT("tcp_input: active pcb->state != TIME-WAIT", pcb->state != TIME_WAIT);
@@ -269,9 +334,14 @@ tcp_input(struct pbuf *p, struct netif *inp)
          arrivals). */
       LWIP_ASSERT("tcp_input: pcb->next != pcb (before cache)", pcb->next != pcb);
       if (prev != NULL) {
+#if LWIP_TCP_TIMER_WHEEL
+        TCP_LIST_REMOVE(&tcp_active_pcbs, pcb);
+        TCP_LIST_INSERT(&tcp_active_pcbs, pcb);
+#else /* LWIP_TCP_TIMER_WHEEL */
         prev->next = pcb->next;
         pcb->next = tcp_active_pcbs;
         tcp_active_pcbs = pcb;
+#endif /* LWIP_TCP_TIMER_WHEEL */
       } else {
         TCP_STATS_INC(tcp.cachehit);
       }
@@ -280,10 +350,14 @@ tcp_input(struct pbuf *p, struct netif *inp)
     }
     prev = pcb;
   }
+#endif /* LWIP_TCP_PCB_HASH */
 
   if (pcb == NULL) {
     /* If it did not go to an active connection, we check the connections
        in the TIME-WAIT state. */
+#if LWIP_TCP_PCB_HASH
+    pcb = prev;
+#else /* LWIP_TCP_PCB_HASH */
     for (pcb = tcp_tw_pcbs; pcb != NULL; pcb = pcb->next) {
       LWIP_ASSERT("tcp_input: TIME-WAIT pcb->state == TIME-WAIT", pcb->state == TIME_WAIT);
 
@@ -300,21 +374,42 @@ tcp_input(struct pbuf *p, struct netif *inp)
         /* We don't really care enough to move this PCB to the front
            of the list since we are not very likely to receive that
            many segments for connections in TIME-WAIT. */
-        LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_input: packed for TIME_WAITing connection.\n"));
+        break;
+      }
+    }
+#endif /* LWIP_TCP_PCB_HASH */
+    if (pcb != NULL) {
+      LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_input: packed for TIME_WAITing connection.\n"));
 #ifdef LWIP_HOOK_TCP_INPACKET_PCB
-        if (LWIP_HOOK_TCP_INPACKET_PCB(pcb, tcphdr, tcphdr_optlen, tcphdr_opt1len,
-                                       tcphdr_opt2, p) == ERR_OK)
+      if (LWIP_HOOK_TCP_INPACKET_PCB(pcb, tcphdr, tcphdr_optlen, tcphdr_opt1len,
+                                     tcphdr_opt2, p) == ERR_OK)
 #endif
-        {
-          tcp_timewait_input(pcb);
-        }
-        pbuf_free(p);
-        return;
+      {
+        tcp_timewait_input(pcb);
       }
+      pbuf_free(p);
+      return;
+    }
+#if LWIP_TCP_TW_TABLE
+    tw = tcp_tw_lookup(ip_current_dest_addr(), tcphdr->dest,
+                       ip_current_src_addr(), tcphdr->src,
+                       netif_get_index(ip_data.current_input_netif));
+    if (tw != NULL) {
+      LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_input: packed for TIME_WAIT record.\n"));
+      tcp_tw_input(tw);
+      pbuf_free(p);
+      return;
     }
+#endif /* LWIP_TCP_TW_TABLE */
 
     /* Finally, if we still did not get a match, we check all PCBs that
        are LISTENing for incoming connections. */
+#if LWIP_TCP_PCB_HASH
+    lpcb = tcp_listen_hash_lookup(ip_current_dest_addr(), tcphdr->dest,
+                                  ip_current_src_addr(), tcphdr->src,
+                                  netif_get_index(ip_data.current_input_netif));
+    if (lpcb != NULL) {
+#else /* LWIP_TCP_PCB_HASH */
     prev = NULL;
     for (lpcb = tcp_listen_pcbs.listen_pcbs; lpcb != NULL; lpcb = lpcb->next) {
       /* check if PCB is bound to specific netif */
@@ -363,14 +458,20 @@ tcp_input(struct pbuf *p, struct netif *inp)
          lookups will be faster (we exploit locality in TCP segment
          arrivals). */
       if (prev != NULL) {
+#if LWIP_TCP_TIMER_WHEEL
+        TCP_LIST_REMOVE(&tcp_listen_pcbs.pcbs, (struct tcp_pcb *)lpcb);
+        TCP_LIST_INSERT(&tcp_listen_pcbs.pcbs, (struct tcp_pcb *)lpcb);
+#else /* LWIP_TCP_TIMER_WHEEL */
         ((struct tcp_pcb_listen *)prev)->next = lpcb->next;
         /* our successor is the remainder of the listening list */
         lpcb->next = tcp_listen_pcbs.listen_pcbs;
         /* put this listening pcb at the head of the listening list */
         tcp_listen_pcbs.listen_pcbs = lpcb;
+#endif /* LWIP_TCP_TIMER_WHEEL */
       } else {
         TCP_STATS_INC(tcp.cachehit);
       }
+#endif /* LWIP_TCP_PCB_HASH */
 
       LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_input: packed for LISTENing connection.\n"));
 #ifdef LWIP_HOOK_TCP_INPACKET_PCB
@@ -378,10 +479,14 @@ tcp_input(struct pbuf *p, struct netif *inp)
                                      tcphdr_opt1len, tcphdr_opt2, p) == ERR_OK)
 #endif
       {
-        tcp_listen_input(lpcb);
+        pcb = tcp_listen_input(lpcb);
       }
-      pbuf_free(p);
-      return;
+      if (pcb == NULL) {
+        pbuf_free(p);
+        return;
+      }
+      /* the handshake has been completed with a SYN cookie or for a
+         connection request, the segment goes on to the new pcb */
     }
   }
 
@@ -401,6 +506,7 @@ tcp_input(struct pbuf *p, struct netif *inp)
 #endif
   if (pcb != NULL) {
     /* The incoming segment belongs to a connection. */
+    TCP_TIMER_KICK(pcb);
 #if TCP_INPUT_DEBUG
     tcp_debug_print_state(pcb->state);
 #endif /* TCP_INPUT_DEBUG */
@@ -414,6 +520,9 @@ tcp_input(struct pbuf *p, struct netif *inp)
     recv_data = NULL;
     recv_flags = 0;
     recv_acked = 0;
+#if LWIP_TCP_ZEROCOPY
+    recv_zc_acked = 0;
+#endif /* LWIP_TCP_ZEROCOPY */
 
     if (flags & TCP_PSH) {
       p->flags |= PBUF_FLAG_PUSH;
@@ -450,6 +559,16 @@ tcp_input(struct pbuf *p, struct netif *inp)
         tcp_free(pcb);
       } else {
         err = ERR_OK;
+#if LWIP_TCP_ZEROCOPY
+        if (recv_zc_acked) {
+          /* first tell the application which buffers it has back */
+          recv_zc_acked = 0;
+          TCP_EVENT_ZEROCOPY(pcb, recv_zc_id, err);
+          if (err == ERR_ABRT) {
+            goto aborted;
+          }
+        }
+#endif /* LWIP_TCP_ZEROCOPY */
         /* If the application has registered a "sent" function to be
            called when new send buffer space is available, we call it
            now. */
@@ -552,11 +671,21 @@ tcp_input(struct pbuf *p, struct netif *inp)
         }
         /* Try to send something out. */
         tcp_output(pcb);
+        /* Delayed ACK or refused data left for tcp_fasttmr() */
+        TCP_FASTTMR_PENDING(pcb);
+        /* Timers the segment armed or pulled in */
+        TCP_TIMER_UPDATE(pcb);
 #if TCP_INPUT_DEBUG
 #if TCP_DEBUG
         tcp_debug_print_state(pcb->state);
 #endif /* TCP_DEBUG */
 #endif /* TCP_INPUT_DEBUG */
+#if LWIP_TCP_TW_TABLE
+        if ((pcb->state == TIME_WAIT) && (pcb->flags & TF_APPCLOSED)) {
+          /* nothing refers to the pcb any more, keep a record instead */
+          tcp_tw_enter(pcb);
+        }
+#endif /* LWIP_TCP_TW_TABLE */
       }
     }
     /* Jump target if pcb has been aborted in a callback (by calling tcp_abort()).
@@ -618,32 +747,299 @@ tcp_input_delayed_close(struct tcp_pcb *pcb)
   return 0;
 }
 
+/**
+ * Set up a pcb for a connection request received by a listening pcb.
+ * The initial sequence numbers of the pcb are left to the caller.
+ *
+ * @param pcb the tcp_pcb_listen that received the request
+ * @param npcb the new pcb
+ * @param irs the initial sequence number of the remote host
+ */
+static void
+tcp_listen_setup_pcb(struct tcp_pcb_listen *pcb, struct tcp_pcb *npcb, u32_t irs)
+{
+  ip_addr_copy(npcb->local_ip, *ip_current_dest_addr());
+  ip_addr_copy(npcb->remote_ip, *ip_current_src_addr());
+  npcb->local_port = pcb->local_port;
+  npcb->remote_port = tcphdr->src;
+  npcb->state = SYN_RCVD;
+  npcb->rcv_nxt = irs + 1;
+  npcb->rcv_ann_right_edge = npcb->rcv_nxt;
+  npcb->snd_wl1 = irs - 1;/* initialise to irs-1 to force window update */
+  npcb->callback_arg = pcb->callback_arg;
+#if LWIP_CALLBACK_API || TCP_LISTEN_BACKLOG
+  npcb->listener = pcb;
+#endif /* LWIP_CALLBACK_API || TCP_LISTEN_BACKLOG */
+#if LWIP_VLAN_PCP
+  npcb->netif_hints.tci = pcb->netif_hints.tci;
+#endif /* LWIP_VLAN_PCP */
+  /* inherit socket options */
+  npcb->so_options = pcb->so_options & SOF_INHERITED;
+  npcb->netif_idx = pcb->netif_idx;
+  npcb->cong_ops = pcb->cong_ops;
+}
+
+#if LWIP_TCP_SYNCOOKIES
+/**
+ * Answer the SYN in the global variables with a SYN cookie instead of
+ * setting up a pcb for it.
+ *
+ * @param pcb the tcp_pcb_listen that received the SYN
+ */
+static void
+tcp_listen_syncookie_synack(struct tcp_pcb_listen *pcb)
+{
+  struct tcp_handshake ck;
+
+  ck.irs = seqno;
+  tcp_handshake_parseopt(&ck);
+#if LWIP_TCP_ECN
+  /* ECN-setup SYN */
+  ck.ecn = (TCPH_ECN_FLAGS(tcphdr) & (TCP_ECE | TCP_CWR)) == (TCP_ECE | TCP_CWR);
+#endif /* LWIP_TCP_ECN */
+  tcp_syncookie_make(&ck, ip_current_dest_addr(), pcb->local_port,
+                     ip_current_src_addr(), tcphdr->src);
+  LWIP_DEBUGF(TCP_DEBUG, ("tcp_listen_input: sending SYN cookie to port %"U16_F"\n", tcphdr->src));
+  tcp_synack_netif(ip_data.current_input_netif, &ck, ip_current_dest_addr(),
+                   ip_current_src_addr(), pcb->local_port, tcphdr->src);
+}
+#endif /* LWIP_TCP_SYNCOOKIES */
+
+#if LWIP_TCP_SYNCOOKIES || LWIP_TCP_REQ_TABLE
+/**
+ * Set up the pcb of a connection whose handshake has been completed by
+ * an ACK with a valid SYN cookie or for a request in the request table.
+ * The caller has checked that the backlog has room for it.
+ *
+ * @param pcb the tcp_pcb_listen that received the ACK
+ * @param hs the connection request
+ * @return the new pcb in SYN_RCVD, or NULL if none could be allocated
+ */
+static struct tcp_pcb *
+tcp_listen_handshake_pcb(struct tcp_pcb_listen *pcb, const struct tcp_handshake *hs)
+{
+  struct tcp_pcb *npcb;
+
+  npcb = tcp_alloc(pcb->prio);
+#if TCP_LISTEN_BACKLOG && !LWIP_TCP_REQ_TABLE
+  /* without the request table, half-open connections hold a pcb */
+  if ((npcb == NULL) && tcp_backlog_reclaim(pcb)) {
+    npcb = tcp_alloc(pcb->prio);
+  }
+#endif /* TCP_LISTEN_BACKLOG && !LWIP_TCP_REQ_TABLE */
+  if (npcb == NULL) {
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_listen_input: could not allocate PCB\n"));
+    TCP_STATS_INC(tcp.memerr);
+    return NULL;
+  }
+#if TCP_LISTEN_BACKLOG
+  pcb->accepts_pending++;
+  tcp_set_flags(npcb, TF_BACKLOGPEND);
+#endif /* TCP_LISTEN_BACKLOG */
+  tcp_listen_setup_pcb(pcb, npcb, hs->irs);
+  /* our SYN|ACK has been acknowledged */
+  npcb->snd_wl2 = hs->iss;
+  npcb->lastack = hs->iss;
+  npcb->snd_nxt = hs->iss + 1;
+  npcb->snd_lbb = hs->iss + 1;
+  TCP_REG_ACTIVE(npcb);
+
+  /* restore the options of the SYN */
+  npcb->mss = hs->mss;
+#if LWIP_WND_SCALE
+  if (hs->optflags & TF_SEG_OPTS_WND_SCALE) {
+    npcb->snd_scale = hs->snd_scale;
+    npcb->rcv_scale = TCP_RCV_SCALE;
+    tcp_set_flags(npcb, TF_WND_SCALE);
+    npcb->rcv_wnd = npcb->rcv_ann_wnd = TCP_RCV_WND(npcb);
+  }
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK_OUT
+  if (hs->optflags & TF_SEG_OPTS_SACK_PERM) {
+    tcp_set_flags(npcb, TF_SACK);
+  }
+#endif /* LWIP_TCP_SACK_OUT */
+#if LWIP_TCP_TIMESTAMPS
+  if (hs->optflags & TF_SEG_OPTS_TS) {
+    tcp_set_flags(npcb, TF_TIMESTAMP);
+    npcb->ts_recent = hs->ts_recent;
+    npcb->ts_lastacksent = npcb->rcv_nxt;
+  }
+#endif /* LWIP_TCP_TIMESTAMPS */
+#if LWIP_TCP_ECN
+  if (hs->ecn) {
+    npcb->ecn_flags = TCP_ECN_OK;
+  }
+#endif /* LWIP_TCP_ECN */
+  npcb->snd_wnd = SND_WND_SCALE(npcb, tcphdr->wnd);
+  npcb->snd_wnd_max = npcb->snd_wnd;
+
+#if TCP_CALCULATE_EFF_SEND_MSS
+  npcb->mss = tcp_eff_send_mss(npcb->mss, &npcb->local_ip, &npcb->remote_ip);
+#endif /* TCP_CALCULATE_EFF_SEND_MSS */
+
+  MIB2_STATS_INC(mib2.tcppassiveopens);
+
+  tcp_init_congestion_control(npcb);
+
+#if LWIP_TCP_PCB_NUM_EXT_ARGS
+  if (tcp_ext_arg_invoke_callbacks_passive_open(pcb, npcb) != ERR_OK) {
+    tcp_abandon(npcb, 0);
+    return NULL;
+  }
+#endif
+  return npcb;
+}
+#endif /* LWIP_TCP_SYNCOOKIES || LWIP_TCP_REQ_TABLE */
+
+#if LWIP_TCP_REQ_TABLE
+/**
+ * Answer the SYN in the global variables with a SYN|ACK and keep the
+ * connection request in the request table.
+ *
+ * @param pcb the tcp_pcb_listen that received the SYN
+ */
+static void
+tcp_listen_req_syn(struct tcp_pcb_listen *pcb)
+{
+  struct tcp_req *req;
+
+  req = tcp_req_alloc(pcb, ip_current_dest_addr(), ip_current_src_addr(), tcphdr->src,
+                      netif_get_index(ip_data.current_input_netif));
+  if (req == NULL) {
+    err_t err;
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_listen_input: could not allocate request\n"));
+    TCP_STATS_INC(tcp.memerr);
+#if LWIP_TCP_SYNCOOKIES
+    /* not an error for the application: the request is kept in a cookie */
+    tcp_listen_syncookie_synack(pcb);
+    LWIP_UNUSED_ARG(err);
+#else /* LWIP_TCP_SYNCOOKIES */
+    TCP_EVENT_ACCEPT(pcb, NULL, pcb->callback_arg, ERR_MEM, err);
+    LWIP_UNUSED_ARG(err); /* err not useful here */
+#endif /* LWIP_TCP_SYNCOOKIES */
+    return;
+  }
+  req->hs.irs = seqno;
+  tcp_handshake_parseopt(&req->hs);
+  req->hs.optflags |= TF_SEG_OPTS_MSS;
+#if LWIP_TCP_ECN
+  /* ECN-setup SYN */
+  req->hs.ecn = (TCPH_ECN_FLAGS(tcphdr) & (TCP_ECE | TCP_CWR)) == (TCP_ECE | TCP_CWR);
+#endif /* LWIP_TCP_ECN */
+  req->hs.iss = tcp_next_iss_addr(&req->local_ip, req->local_port, &req->remote_ip, req->remote_port);
+  tcp_req_synack(req);
+}
+
+/**
+ * Called by tcp_listen_input() when a segment arrives for a connection
+ * request in the request table.
+ *
+ * @param pcb the tcp_pcb_listen for which a segment arrived
+ * @param req the connection request
+ * @return the pcb the request has been promoted to, to pass the segment on
+ *         to, NULL if the segment has been handled
+ */
+static struct tcp_pcb *
+tcp_listen_req_input(struct tcp_pcb_listen *pcb, struct tcp_req *req)
+{
+  struct tcp_pcb *npcb;
+
+  if (flags & TCP_RST) {
+    /* a reset in SYN_RCVD returns to LISTEN, only accept the exact
+       sequence number as tcp_process() does */
+    if (seqno == req->hs.irs + 1) {
+      LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_listen_input: connection request reset\n"));
+      tcp_req_free(req);
+    }
+  } else if (flags & TCP_SYN) {
+    if (seqno == req->hs.irs) {
+      /* Looks like another copy of the SYN - retransmit our SYN-ACK */
+      tcp_req_synack(req);
+    }
+  } else if (flags & TCP_ACK) {
+    if (ackno != req->hs.iss + 1) {
+      /* not the ACK of our SYN: send a RST as tcp_process() does in SYN_RCVD */
+      LWIP_DEBUGF(TCP_RST_DEBUG, ("tcp_listen_input: unacceptable ACK in SYN_RCVD, sending reset\n"));
+      tcp_rst_netif(ip_data.current_input_netif, ackno, seqno + tcplen, ip_current_dest_addr(),
+                    ip_current_src_addr(), tcphdr->dest, tcphdr->src);
+      return NULL;
+    }
+    /* the handshake is complete: the pcb takes over the backlog slot of the
+       request. If there is no pcb, keep the request and drop the ACK: the
+       SYN|ACK is retransmitted and the next ACK tries again. */
+    npcb = tcp_listen_handshake_pcb(pcb, &req->hs);
+    if (npcb != NULL) {
+      tcp_req_free(req);
+    }
+    return npcb;
+  }
+  return NULL;
+}
+#endif /* LWIP_TCP_REQ_TABLE */
+
 /**
  * Called by tcp_input() when a segment arrives for a listening
  * connection (from tcp_input()).
  *
  * @param pcb the tcp_pcb_listen for which a segment arrived
  *
+ * @return the pcb of a connection set up from a SYN cookie, to pass the
+ *         segment on to, NULL if the segment has been handled
+ *
  * @note the segment which arrived is saved in global variables, therefore only the pcb
  *       involved is passed as a parameter to this function
  */
-static void
+static struct tcp_pcb *
 tcp_listen_input(struct tcp_pcb_listen *pcb)
 {
+#if LWIP_TCP_REQ_TABLE
+  struct tcp_req *req;
+#else /* LWIP_TCP_REQ_TABLE */
   struct tcp_pcb *npcb;
   u32_t iss;
   err_t rc;
+#endif /* LWIP_TCP_REQ_TABLE */
+
+  LWIP_ASSERT("tcp_listen_input: invalid pcb", pcb != NULL);
+
+#if LWIP_TCP_REQ_TABLE
+  /* a segment for a connection in SYN_RCVD? */
+  req = tcp_req_lookup(pcb, ip_current_dest_addr(), ip_current_src_addr(), tcphdr->src);
+  if (req != NULL) {
+    return tcp_listen_req_input(pcb, req);
+  }
+#endif /* LWIP_TCP_REQ_TABLE */
 
   if (flags & TCP_RST) {
     /* An incoming RST should be ignored. Return. */
-    return;
+    return NULL;
   }
 
-  LWIP_ASSERT("tcp_listen_input: invalid pcb", pcb != NULL);
-
   /* In the LISTEN state, we check for incoming SYN segments,
      creates a new PCB, and responds with a SYN|ACK. */
   if (flags & TCP_ACK) {
+#if LWIP_TCP_SYNCOOKIES
+    struct tcp_handshake ck;
+
+    /* the final ACK of a handshake answered with a SYN cookie? */
+    ck.iss = ackno - 1;
+    ck.irs = seqno - 1;
+    tcp_handshake_parseopt(&ck);
+    if (!(flags & TCP_SYN) &&
+        tcp_syncookie_check(&ck, ip_current_dest_addr(), pcb->local_port,
+                            ip_current_src_addr(), tcphdr->src)) {
+#if TCP_LISTEN_BACKLOG
+      /* the remote host considers the connection established: make room for
+         it at the expense of a half-open one */
+      if ((pcb->accepts_pending >= pcb->backlog) && !tcp_backlog_reclaim(pcb)) {
+        LWIP_DEBUGF(TCP_DEBUG, ("tcp_listen_input: listen backlog exceeded for port %"U16_F"\n", tcphdr->dest));
+        return NULL;
+      }
+#endif /* TCP_LISTEN_BACKLOG */
+      return tcp_listen_handshake_pcb(pcb, &ck);
+    }
+#endif /* LWIP_TCP_SYNCOOKIES */
     /* For incoming segments with the ACK flag set, respond with a
        RST. */
     LWIP_DEBUGF(TCP_RST_DEBUG, ("tcp_listen_input: ACK in LISTEN, sending reset\n"));
@@ -654,9 +1050,15 @@ tcp_listen_input(struct tcp_pcb_listen *pcb)
 #if TCP_LISTEN_BACKLOG
     if (pcb->accepts_pending >= pcb->backlog) {
       LWIP_DEBUGF(TCP_DEBUG, ("tcp_listen_input: listen backlog exceeded for port %"U16_F"\n", tcphdr->dest));
-      return;
+#if LWIP_TCP_SYNCOOKIES
+      tcp_listen_syncookie_synack(pcb);
+#endif /* LWIP_TCP_SYNCOOKIES */
+      return NULL;
     }
 #endif /* TCP_LISTEN_BACKLOG */
+#if LWIP_TCP_REQ_TABLE
+    tcp_listen_req_syn(pcb);
+#else /* LWIP_TCP_REQ_TABLE */
     npcb = tcp_alloc(pcb->prio);
     /* If a new PCB could not be created (probably due to lack of memory),
        we don't do anything, but rely on the sender will retransmit the
@@ -665,44 +1067,38 @@ tcp_listen_input(struct tcp_pcb_listen *pcb)
       err_t err;
       LWIP_DEBUGF(TCP_DEBUG, ("tcp_listen_input: could not allocate PCB\n"));
       TCP_STATS_INC(tcp.memerr);
+#if LWIP_TCP_SYNCOOKIES
+      /* not an error for the application: the request is kept in a cookie */
+      tcp_listen_syncookie_synack(pcb);
+      LWIP_UNUSED_ARG(err);
+#else /* LWIP_TCP_SYNCOOKIES */
       TCP_EVENT_ACCEPT(pcb, NULL, pcb->callback_arg, ERR_MEM, err);
       LWIP_UNUSED_ARG(err); /* err not useful here */
-      return;
+#endif /* LWIP_TCP_SYNCOOKIES */
+      return NULL;
     }
 #if TCP_LISTEN_BACKLOG
     pcb->accepts_pending++;
     tcp_set_flags(npcb, TF_BACKLOGPEND);
 #endif /* TCP_LISTEN_BACKLOG */
-    /* Set up the new PCB. */
-    ip_addr_copy(npcb->local_ip, *ip_current_dest_addr());
-    ip_addr_copy(npcb->remote_ip, *ip_current_src_addr());
-    npcb->local_port = pcb->local_port;
-    npcb->remote_port = tcphdr->src;
-    npcb->state = SYN_RCVD;
-    npcb->rcv_nxt = seqno + 1;
-    npcb->rcv_ann_right_edge = npcb->rcv_nxt;
+    tcp_listen_setup_pcb(pcb, npcb, seqno);
     iss = tcp_next_iss(npcb);
     npcb->snd_wl2 = iss;
     npcb->snd_nxt = iss;
     npcb->lastack = iss;
     npcb->snd_lbb = iss;
-    npcb->snd_wl1 = seqno - 1;/* initialise to seqno-1 to force window update */
-    npcb->callback_arg = pcb->callback_arg;
-#if LWIP_CALLBACK_API || TCP_LISTEN_BACKLOG
-    npcb->listener = pcb;
-#endif /* LWIP_CALLBACK_API || TCP_LISTEN_BACKLOG */
-#if LWIP_VLAN_PCP
-    npcb->netif_hints.tci = pcb->netif_hints.tci;
-#endif /* LWIP_VLAN_PCP */
-    /* inherit socket options */
-    npcb->so_options = pcb->so_options & SOF_INHERITED;
-    npcb->netif_idx = pcb->netif_idx;
     /* Register the new PCB so that we can begin receiving segments
        for it. */
     TCP_REG_ACTIVE(npcb);
 
     /* Parse any options in the SYN. */
     tcp_parseopt(npcb);
+#if LWIP_TCP_ECN
+    if ((TCPH_ECN_FLAGS(tcphdr) & (TCP_ECE | TCP_CWR)) == (TCP_ECE | TCP_CWR)) {
+      /* ECN-setup SYN: agree to use ECN */
+      npcb->ecn_flags = TCP_ECN_OK;
+    }
+#endif /* LWIP_TCP_ECN */
     npcb->snd_wnd = tcphdr->wnd;
     npcb->snd_wnd_max = npcb->snd_wnd;
 
@@ -712,13 +1108,12 @@ tcp_listen_input(struct tcp_pcb_listen *pcb)
 
     MIB2_STATS_INC(mib2.tcppassiveopens);
 
-    if(npcb->cong_ops->init != NULL)
-      npcb->cong_ops->init(npcb);
+    tcp_init_congestion_control(npcb);
 
 #if LWIP_TCP_PCB_NUM_EXT_ARGS
     if (tcp_ext_arg_invoke_callbacks_passive_open(pcb, npcb) != ERR_OK) {
       tcp_abandon(npcb, 0);
-      return;
+      return NULL;
     }
 #endif
 
@@ -726,11 +1121,12 @@ tcp_listen_input(struct tcp_pcb_listen *pcb)
     rc = tcp_enqueue_flags(npcb, TCP_SYN | TCP_ACK);
     if (rc != ERR_OK) {
       tcp_abandon(npcb, 0);
-      return;
+      return NULL;
     }
     tcp_output(npcb);
+#endif /* LWIP_TCP_REQ_TABLE */
   }
-  return;
+  return NULL;
 }
 
 /**
@@ -780,6 +1176,40 @@ tcp_timewait_input(struct tcp_pcb *pcb)
   return;
 }
 
+#if LWIP_TCP_TW_TABLE
+/**
+ * Called by tcp_input() when a segment arrives for a connection in
+ * TIME_WAIT that is kept in a record. Does the same as tcp_timewait_input().
+ *
+ * @param tw the TIME_WAIT record for which a segment arrived
+ */
+static void
+tcp_tw_input(struct tcp_tw *tw)
+{
+  if (flags & TCP_RST) {
+    return;
+  }
+
+  if (flags & TCP_SYN) {
+    if (TCP_SEQ_BETWEEN(seqno, tw->rcv_nxt, tw->rcv_nxt + tw->rcv_wnd)) {
+      /* If the SYN is in the window it is an error, send a reset */
+      tcp_rst_netif(ip_data.current_input_netif, ackno, seqno + tcplen,
+                    ip_current_dest_addr(), ip_current_src_addr(),
+                    tcphdr->dest, tcphdr->src);
+      return;
+    }
+  } else if (flags & TCP_FIN) {
+    /* Restart the 2 MSL time-wait timeout */
+    tcp_tw_restart(tw);
+  }
+
+  if (tcplen > 0) {
+    /* Acknowledge data, FIN or out-of-window SYN */
+    tcp_tw_ack(tw);
+  }
+}
+#endif /* LWIP_TCP_TW_TABLE */
+
 /**
  * Implements the TCP state machine. Called by tcp_input. In some
  * states tcp_receive() is called to receive data. The tcp_seg
@@ -879,6 +1309,12 @@ tcp_process(struct tcp_pcb *pcb)
         pcb->snd_wnd_max = pcb->snd_wnd;
         pcb->snd_wl1 = seqno - 1; /* initialise to seqno - 1 to force window update */
         pcb->state = ESTABLISHED;
+#if LWIP_TCP_ECN
+        if ((TCPH_ECN_FLAGS(tcphdr) & (TCP_ECE | TCP_CWR)) == TCP_ECE) {
+          /* ECN-setup SYN-ACK: the remote host agreed to use ECN */
+          pcb->ecn_flags = TCP_ECN_OK;
+        }
+#endif /* LWIP_TCP_ECN */
 
 #if TCP_CALCULATE_EFF_SEND_MSS
         pcb->mss = tcp_eff_send_mss(pcb->mss, &pcb->local_ip, &pcb->remote_ip);
@@ -898,8 +1334,15 @@ tcp_process(struct tcp_pcb *pcb)
           rseg = pcb->unsent;
           LWIP_ASSERT("no segment to free", rseg != NULL);
           pcb->unsent = rseg->next;
+          if (pcb->unsent == NULL) {
+            pcb->last_unsent = NULL;
+          }
         } else {
+          TCP_UNACKED_UNLINK(pcb, rseg);
           pcb->unacked = rseg->next;
+          if (pcb->unacked == NULL) {
+            pcb->last_unacked = NULL;
+          }
         }
         tcp_seg_free(rseg);
 
@@ -1065,14 +1508,18 @@ tcp_process(struct tcp_pcb *pcb)
  * Called from tcp_receive()
  */
 static void
-tcp_oos_insert_segment(struct tcp_seg *cseg, struct tcp_seg *next)
+tcp_oos_insert_segment(struct tcp_pcb *pcb, struct tcp_seg *cseg, struct tcp_seg *next)
 {
   struct tcp_seg *old_seg;
 
   LWIP_ASSERT("tcp_oos_insert_segment: invalid cseg", cseg != NULL);
+  LWIP_UNUSED_ARG(pcb); /* only used with TCP_OOSEQ_TREE */
 
   if (TCPH_FLAGS(cseg->tcphdr) & TCP_FIN) {
     /* received segment overlaps all following segments */
+    for (old_seg = next; old_seg != NULL; old_seg = old_seg->next) {
+      TCP_OOSEQ_UNLINK(pcb, old_seg);
+    }
     tcp_segs_free(next);
     next = NULL;
   } else {
@@ -1087,6 +1534,7 @@ tcp_oos_insert_segment(struct tcp_seg *cseg, struct tcp_seg *next)
       }
       old_seg = next;
       next = next->next;
+      TCP_OOSEQ_UNLINK(pcb, old_seg);
       tcp_seg_free(old_seg);
     }
     if (next &&
@@ -1107,6 +1555,10 @@ tcp_free_acked_segments(struct tcp_pcb *pcb, struct tcp_seg *seg_list, const cha
 {
   struct tcp_seg *next;
   u16_t clen;
+#if TCP_UNACKED_TREE
+  /* called for pcb->unacked and pcb->unsent, which are not the same */
+  u8_t unacked = (seg_list == pcb->unacked);
+#endif /* TCP_UNACKED_TREE */
 
   LWIP_UNUSED_ARG(dbg_list_name);
   LWIP_UNUSED_ARG(dbg_other_seg_list);
@@ -1129,7 +1581,36 @@ tcp_free_acked_segments(struct tcp_pcb *pcb, struct tcp_seg *seg_list, const cha
 
     pcb->snd_queuelen = (u16_t)(pcb->snd_queuelen - clen);
     recv_acked = (tcpwnd_size_t)(recv_acked + next->len);
-    rtt_ms = LWIP_MIN(pcb->lacktime - next->snd_timestamp, rtt_ms);
+#if LWIP_TCP_SACK_IN
+    if (next->flags & TF_SEG_SACKED) {
+      pcb->sacked = (tcpwnd_size_t)(pcb->sacked - TCP_TCPLEN(next));
+    } else
+#endif /* LWIP_TCP_SACK_IN */
+    {
+#if LWIP_TCP_RATE_SAMPLE
+      /* SACKed segments have been counted as delivered already */
+      tcp_rate_seg_delivered(pcb, next, &rate_sample);
+#endif /* LWIP_TCP_RATE_SAMPLE */
+    }
+#if LWIP_TCP_RTT_MS
+    /* Karn's algorithm: an ACK for a retransmitted segment is ambiguous */
+    if (next->snd_time == 1)
+#endif /* LWIP_TCP_RTT_MS */
+    {
+      rtt_ms = LWIP_MIN(pcb->lacktime - next->snd_timestamp, rtt_ms);
+    }
+#if LWIP_TCP_ZEROCOPY
+    if (next->zc_end) {
+      /* segments are ACKed in order, so this covers all earlier writes */
+      recv_zc_acked = 1;
+      recv_zc_id = next->zc_id;
+    }
+#endif /* LWIP_TCP_ZEROCOPY */
+#if TCP_UNACKED_TREE
+    if (unacked) {
+      TCP_UNACKED_UNLINK(pcb, next);
+    }
+#endif /* TCP_UNACKED_TREE */
     tcp_seg_free(next);
 
     LWIP_DEBUGF(TCP_QLEN_DEBUG, ("%"TCPWNDSIZE_F" (after freeing %s)\n",
@@ -1143,6 +1624,274 @@ tcp_free_acked_segments(struct tcp_pcb *pcb, struct tcp_seg *seg_list, const cha
   return seg_list;
 }
 
+#if LWIP_TCP_RTT_MS
+/**
+ * Feeds an RTT sample into the smoothed RTT, the RTT variation and the
+ * minimum RTT and updates the retransmission timeout (RFC 6298, section 2).
+ *
+ * @param pcb the tcp_pcb for which an ACK was received
+ * @param rtt the RTT sample in milliseconds
+ */
+static void
+tcp_rtt_sample(struct tcp_pcb *pcb, u32_t rtt)
+{
+  s32_t m;
+  u32_t now = sys_now();
+
+  /* srtt == 0 means "no sample yet" */
+  rtt = LWIP_MAX(rtt, 1);
+  if (pcb->srtt == 0) {
+    pcb->srtt = rtt << 3;
+    pcb->rttvar = rtt << 1;
+  } else {
+    /* srtt = 7/8 srtt + 1/8 rtt, rttvar = 3/4 rttvar + 1/4 |srtt - rtt| */
+    m = (s32_t)(rtt - (pcb->srtt >> 3));
+    pcb->srtt = (u32_t)((s32_t)pcb->srtt + m);
+    if (m < 0) {
+      m = -m;
+    }
+    m = m - (s32_t)(pcb->rttvar >> 2);
+    pcb->rttvar = (u32_t)((s32_t)pcb->rttvar + m);
+  }
+  if ((pcb->min_rtt == 0) || (rtt <= pcb->min_rtt) ||
+      ((u32_t)(now - pcb->min_rtt_stamp) > TCP_MIN_RTT_WLEN)) {
+    pcb->min_rtt = rtt;
+    pcb->min_rtt_stamp = now;
+  }
+  pcb->rto = tcp_rto_calc(pcb);
+
+  LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_receive: rtt %"U32_F" srtt %"U32_F" rttvar %"U32_F
+                              " min_rtt %"U32_F" msec, RTO %"S16_F" ticks\n",
+                              rtt, pcb->srtt >> 3, pcb->rttvar >> 2, pcb->min_rtt, pcb->rto));
+}
+#endif /* LWIP_TCP_RTT_MS */
+
+#if LWIP_TCP_ECN
+/**
+ * Receiver side of ECN: echo CE marks of incoming data segments with ECE
+ * until the remote host confirms with CWR (RFC 3168, section 6.1.3).
+ *
+ * @param pcb the tcp_pcb which received a data segment
+ */
+static void
+tcp_ecn_check_ce(struct tcp_pcb *pcb)
+{
+  if (TCPH_ECN_FLAGS(tcphdr) & TCP_CWR) {
+    pcb->ecn_flags &= (u8_t)~TCP_ECN_DEMAND_CWR;
+  }
+  switch (ip_current_header_tos() & IP_ECN_MASK) {
+    case IP_ECN_CE:
+      if (pcb->cong_ops->cwnd_event != NULL) {
+        pcb->cong_ops->cwnd_event(pcb, CA_EVENT_ECN_IS_CE);
+      }
+      if (!(pcb->ecn_flags & TCP_ECN_DEMAND_CWR)) {
+        /* tell the sender right away instead of after the delayed ACK timeout */
+        pcb->ecn_flags |= TCP_ECN_DEMAND_CWR;
+        tcp_ack_now(pcb);
+      }
+      break;
+    case IP_ECN_ECT0:
+    case IP_ECN_ECT1:
+      if (pcb->cong_ops->cwnd_event != NULL) {
+        pcb->cong_ops->cwnd_event(pcb, CA_EVENT_ECN_NO_CE);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * Sender side of ECN: reduce cwnd when an ACK echoes a congestion mark, at
+ * most once per window of data, and announce the reduction with CWR on the
+ * next new data segment (RFC 3168, section 6.1.2).
+ *
+ * @param pcb the tcp_pcb which received an ACK
+ */
+static void
+tcp_ecn_ack(struct tcp_pcb *pcb)
+{
+  u8_t ece = (TCPH_ECN_FLAGS(tcphdr) & TCP_ECE) ? 1 : 0;
+
+  if (pcb->cong_ops->in_ack_event != NULL) {
+    pcb->cong_ops->in_ack_event(pcb, recv_acked, ece ? CA_ACK_ECE : 0);
+  }
+  /* ECE on ACKs up to ecn_recover still echoes marks from before the reduction */
+  if ((pcb->ecn_flags & TCP_ECN_IN_CWR) && TCP_SEQ_GT(ackno, pcb->ecn_recover)) {
+    pcb->ecn_flags &= (u8_t)~TCP_ECN_IN_CWR;
+  }
+  if (!ece || (pcb->ecn_flags & TCP_ECN_IN_CWR)) {
+    return;
+  }
+  /* fast retransmit and RTO recovery have already reduced cwnd for this window */
+  if (!(pcb->flags & (TF_INFR | TF_RTO)) && !TCP_CA_CONG_CONTROL(pcb)) {
+    pcb->ecn_flags |= TCP_ECN_REDUCE;
+    pcb->ssthresh = pcb->cong_ops->ssthresh(pcb);
+    pcb->ecn_flags &= (u8_t)~TCP_ECN_REDUCE;
+    pcb->cwnd = pcb->ssthresh;
+    pcb->bytes_acked = 0;
+    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_ecn_ack: ECE, cwnd %"TCPWNDSIZE_F" ssthresh %"TCPWNDSIZE_F"\n",
+                                 pcb->cwnd, pcb->ssthresh));
+  }
+  /* the sender must set CWR even if it did not reduce (e.g. BBR) or the
+     receiver would keep echoing ECE */
+  pcb->ecn_recover = pcb->snd_nxt;
+  pcb->ecn_flags |= TCP_ECN_IN_CWR | TCP_ECN_QUEUE_CWR;
+}
+#endif /* LWIP_TCP_ECN */
+
+/**
+ * Acknowledge data received in order: at once in quick-ACK mode, when
+ * pcb->ack_segs full-sized segments or half of the window are unacknowledged,
+ * otherwise by the delayed ACK timer.
+ *
+ * @param pcb the tcp_pcb which received data
+ * @param len length of the data
+ */
+static void
+tcp_ack(struct tcp_pcb *pcb, tcpwnd_size_t len)
+{
+  if (!(pcb->flags & TF_ACK_DELAY)) {
+    /* everything received before has been ACKed */
+    pcb->rcv_unacked = 0;
+  }
+  pcb->rcv_unacked += len;
+
+  if ((pcb->flags & TF_QUICKACK) || (pcb->quickack > 0) ||
+      (pcb->rcv_unacked >= (u32_t)pcb->ack_segs * pcb->mss) ||
+      (pcb->rcv_unacked >= TCP_WND_MAX(pcb) / 2)) {
+    if (pcb->quickack > 0) {
+      pcb->quickack--;
+    }
+    tcp_clear_flags(pcb, TF_ACK_DELAY);
+    tcp_ack_now(pcb);
+  } else {
+    tcp_set_flags(pcb, TF_ACK_DELAY);
+  }
+}
+
+#if LWIP_TCP_PRR
+/**
+ * Account the data delivered by an ACK in fast recovery, or by the ACK that
+ * enters it, for Proportional Rate Reduction (RFC 6937). Without SACK, a
+ * duplicate ACK stands for one MSS.
+ *
+ * @param pcb the tcp_pcb that received the ACK
+ * @param delivered the bytes newly ACKed or SACKed (DeliveredData)
+ */
+static void
+tcp_prr_ack(struct tcp_pcb *pcb, u32_t delivered)
+{
+  if (!(pcb->flags & TF_INFR)) {
+    pcb->prr_delivered = 0;
+  }
+  pcb->prr_delivered += delivered;
+  pcb->prr_acked = delivered;
+}
+#endif /* LWIP_TCP_PRR */
+
+#if LWIP_TCP_UNDO
+/**
+ * Go back to the cwnd and ssthresh saved by tcp_undo_init() after a spurious
+ * retransmission: the congestion control chooses the cwnd. Fast recovery or
+ * RTO recovery ends; after a timeout, the segments not retransmitted yet go
+ * back on the unacked queue instead of being sent again.
+ *
+ * @param pcb the tcp_pcb whose retransmission was spurious
+ */
+static void
+tcp_undo(struct tcp_pcb *pcb)
+{
+  if (pcb->cong_ops->undo_cwnd != NULL) {
+    pcb->cwnd = pcb->cong_ops->undo_cwnd(pcb);
+    if (pcb->prior_ssthresh > pcb->ssthresh) {
+      pcb->ssthresh = pcb->prior_ssthresh;
+    }
+    pcb->bytes_acked = 0;
+  }
+  LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_undo: spurious retransmission, cwnd %"TCPWNDSIZE_F" ssthresh %"TCPWNDSIZE_F"\n",
+                               pcb->cwnd, pcb->ssthresh));
+  if (pcb->flags & TF_RTO) {
+    tcp_rexmit_rto_cancel(pcb);
+  }
+  tcp_clear_flags(pcb, TF_INFR | TF_RTO);
+  pcb->dupacks = 0;
+  pcb->undo_flags = 0;
+}
+
+/**
+ * Check an ACK for signs that the retransmissions since cwnd was reduced were
+ * spurious, and run F-RTO after a timeout (RFC 5682). Called by tcp_receive()
+ * while pcb->undo_flags is set, before the ACK is processed otherwise.
+ *
+ * @param pcb the tcp_pcb for which an ACK was received
+ */
+static void
+tcp_undo_ack(struct tcp_pcb *pcb)
+{
+  struct tcp_seg *seg;
+  u8_t dupack = (ackno == pcb->lastack) && (tcplen == 0);
+  u8_t newack = TCP_SEQ_BETWEEN(ackno, pcb->lastack + 1, pcb->snd_nxt);
+
+#if LWIP_TCP_SACK_IN
+  /* a D-SACK (RFC 2883) for data retransmitted in this episode */
+  if ((sack_num > 0) && TCP_SEQ_LEQ(sack_blocks[0].right, ackno) &&
+      TCP_SEQ_GEQ(sack_blocks[0].left, pcb->undo_marker) &&
+      TCP_SEQ_LEQ(sack_blocks[0].right, pcb->undo_high) && (pcb->undo_retrans > 0)) {
+    pcb->undo_retrans -= LWIP_MIN(sack_blocks[0].right - sack_blocks[0].left, pcb->undo_retrans);
+    if (pcb->undo_retrans == 0) {
+      /* every retransmitted byte arrived twice (RFC 3708) */
+      tcp_undo(pcb);
+      return;
+    }
+  }
+#endif /* LWIP_TCP_SACK_IN */
+
+#if LWIP_TCP_TIMESTAMPS
+  if ((pcb->undo_flags & TCP_UNDO_EIFEL) && newack) {
+    pcb->undo_flags &= (u8_t)~TCP_UNDO_EIFEL;
+    if (ts_ecr_valid && ((s32_t)(ts_ecr - pcb->retrans_stamp) < 0)) {
+      /* the first ACK for new data echoes an original transmission (RFC 3522) */
+      tcp_undo(pcb);
+      return;
+    }
+  }
+#endif /* LWIP_TCP_TIMESTAMPS */
+
+  if (!(pcb->undo_flags & (TCP_FRTO_STEP2 | TCP_FRTO_STEP3)) || !(dupack || newack)) {
+    return;
+  }
+  if (pcb->undo_flags & TCP_FRTO_STEP3) {
+    pcb->undo_flags &= (u8_t)~TCP_FRTO_STEP3;
+    if (newack) {
+      /* data that was not retransmitted arrived: spurious timeout (step 3b) */
+      tcp_undo(pcb);
+    } else {
+      /* the original segments were lost: retransmit them in slow start (step 3a) */
+      pcb->cwnd = LWIP_MIN(pcb->cwnd, 3U * pcb->mss);
+      tcp_rexmit_rto_prepare(pcb);
+    }
+    return;
+  }
+  pcb->undo_flags &= (u8_t)~TCP_FRTO_STEP2;
+  /* the ACK must cover the retransmitted segment but not all that was
+     outstanding at the timeout, and there must be new data the remote
+     host has room for; otherwise go on with RTO recovery (step 2a) */
+  if (!newack || !TCP_SEQ_LT(ackno, pcb->undo_high) || (pcb->unacked == NULL) ||
+      TCP_SEQ_LT(ackno, lwip_ntohl(pcb->unacked->tcphdr->seqno) + TCP_TCPLEN(pcb->unacked))) {
+    return;
+  }
+  for (seg = pcb->unsent; (seg != NULL) &&
+       TCP_SEQ_LT(lwip_ntohl(seg->tcphdr->seqno), pcb->undo_high); seg = seg->next);
+  if ((seg == NULL) || (lwip_ntohl(seg->tcphdr->seqno) + seg->len - ackno > pcb->snd_wnd)) {
+    return;
+  }
+  /* send new data instead of retransmitting (step 2b) */
+  tcp_rexmit_rto_cancel(pcb);
+  pcb->undo_flags |= TCP_FRTO_STEP3;
+}
+#endif /* LWIP_TCP_UNDO */
+
 /**
  * Called by tcp_process. Checks if the given segment is an ACK for outstanding
  * data, and if so frees the memory of the buffered data. Next, it places the
@@ -1158,8 +1907,17 @@ tcp_free_acked_segments(struct tcp_pcb *pcb, struct tcp_seg *seg_list, const cha
 static void
 tcp_receive(struct tcp_pcb *pcb)
 {
+#if !LWIP_TCP_RTT_MS
   s16_t m;
+#endif /* !LWIP_TCP_RTT_MS */
   u32_t right_wnd_edge;
+  u8_t sack_dupack = 0, rack_lost = 0;
+#if LWIP_TCP_RACK
+  u8_t dsack;
+#endif /* LWIP_TCP_RACK */
+#if LWIP_TCP_PRR
+  tcpwnd_size_t prior_sacked = 0;
+#endif /* LWIP_TCP_PRR */
 
   LWIP_ASSERT("tcp_receive: invalid pcb", pcb != NULL);
   LWIP_ASSERT("tcp_receive: wrong state", pcb->state >= ESTABLISHED);
@@ -1191,6 +1949,35 @@ tcp_receive(struct tcp_pcb *pcb)
 #endif /* TCP_WND_DEBUG */
     }
 
+#if LWIP_TCP_RATE_SAMPLE
+    memset(&rate_sample, 0, sizeof(rate_sample));
+    rate_sample.prior_in_flight = TCP_BYTES_IN_FLIGHT(pcb);
+    rtt_ms = (u32_t)-1;
+#endif /* LWIP_TCP_RATE_SAMPLE */
+
+#if LWIP_TCP_UNDO
+    /* before tcp_sack_update() consumes the SACK blocks */
+    if (pcb->undo_flags != 0) {
+      tcp_undo_ack(pcb);
+    }
+#endif /* LWIP_TCP_UNDO */
+
+#if LWIP_TCP_SACK_IN
+    /* An ACK that SACKs new data is a duplicate ACK even if it carries
+       data or updates the window (RFC 6675, section 2) */
+#if LWIP_TCP_RACK
+    /* a first block at or below the cumulative ACK reports a duplicate (RFC 2883) */
+    dsack = (sack_num > 0) && TCP_SEQ_LEQ(sack_blocks[0].right, ackno);
+#endif /* LWIP_TCP_RACK */
+#if LWIP_TCP_PRR
+    prior_sacked = TCP_SACKED(pcb);
+#endif /* LWIP_TCP_PRR */
+    sack_dupack = tcp_sack_update(pcb);
+#endif /* LWIP_TCP_SACK_IN */
+#if LWIP_TCP_RACK
+    rack_lost = tcp_rack_ack(pcb, ackno, dsack);
+#endif /* LWIP_TCP_RACK */
+
     /* (From Stevens TCP/IP Illustrated Vol II, p970.) Its only a
      * duplicate ack if:
      * 1) It doesn't ACK new data
@@ -1214,9 +2001,9 @@ tcp_receive(struct tcp_pcb *pcb)
     /* Clause 1 */
     if (TCP_SEQ_LEQ(ackno, pcb->lastack)) {
       /* Clause 2 */
-      if (tcplen == 0) {
+      if (tcplen == 0 || sack_dupack) {
         /* Clause 3 */
-        if (pcb->snd_wl2 + pcb->snd_wnd == right_wnd_edge) {
+        if (pcb->snd_wl2 + pcb->snd_wnd == right_wnd_edge || sack_dupack) {
           /* Clause 4 */
           if (pcb->rtime >= 0) {
             /* Clause 5 */
@@ -1224,11 +2011,17 @@ tcp_receive(struct tcp_pcb *pcb)
               if ((u8_t)(pcb->dupacks + 1) > pcb->dupacks) {
                 ++pcb->dupacks;
               }
-              if (pcb->dupacks > 3) {
+#if !LWIP_TCP_PRR
+              if (pcb->dupacks > 3 && !TCP_SACK_RECOVERY(pcb)) {
                 /* Inflate the congestion window */
                 TCP_WND_INC(pcb->cwnd, pcb->mss);
               }
-              if (pcb->dupacks >= 3) {
+#endif /* !LWIP_TCP_PRR */
+              if (pcb->dupacks >= 3 || TCP_SACK_HEAD_LOST(pcb) || rack_lost) {
+#if LWIP_TCP_PRR
+                tcp_prr_ack(pcb, TCP_SACK_RECOVERY(pcb) ?
+                            (u32_t)(TCP_SACKED(pcb) - prior_sacked) : pcb->mss);
+#endif /* LWIP_TCP_PRR */
                 /* Do fast retransmit (checked via TF_INFR, not via dupacks count) */
                 tcp_rexmit_fast(pcb);
               }
@@ -1244,16 +2037,23 @@ tcp_receive(struct tcp_pcb *pcb)
          in fast retransmit. Also reset the congestion window to the
          slow start threshold. */
       if (pcb->flags & TF_INFR) {
-        tcp_clear_flags(pcb, TF_INFR);
-        pcb->cwnd = pcb->ssthresh;
-        pcb->bytes_acked = 0;
+#if LWIP_TCP_SACK_IN
+        /* With SACK, recovery only ends once everything outstanding
+           at its start has been acknowledged (RFC 6675, section 5) */
+        if (!TCP_SACK_RECOVERY(pcb) || !TCP_SEQ_LT(ackno, pcb->recover))
+#endif /* LWIP_TCP_SACK_IN */
+        {
+          tcp_clear_flags(pcb, TF_INFR);
+          pcb->cwnd = pcb->ssthresh;
+          pcb->bytes_acked = 0;
+        }
       }
 
       /* Reset the number of retransmissions. */
       pcb->nrtx = 0;
 
       /* Reset the retransmission time-out. */
-      pcb->rto = (s16_t)((pcb->sa >> 3) + pcb->sv);
+      pcb->rto = (s16_t)TCP_RTO_BASE(pcb);
 
       /* Record how much data this ACK acks */
       acked = (tcpwnd_size_t)(ackno - pcb->lastack);
@@ -1264,7 +2064,7 @@ tcp_receive(struct tcp_pcb *pcb)
 
       /* Update the congestion control variables (cwnd and
          ssthresh). */
-      if (pcb->state >= ESTABLISHED) {
+      if (pcb->state >= ESTABLISHED && !(pcb->flags & TF_INFR) && !TCP_CA_CONG_CONTROL(pcb)) {
          /* if (pcb->cwnd < pcb->ssthresh) {
           tcpwnd_size_t increase;
           u8_t num_seg = (pcb->flags & TF_RTO) ? 1 : 2;
@@ -1300,10 +2100,25 @@ tcp_receive(struct tcp_pcb *pcb)
          ->unsent list after a retransmission, so these segments may
          in fact have been sent once. */
       pcb->unsent = tcp_free_acked_segments(pcb, pcb->unsent, "unsent", pcb->unacked);
+      if (pcb->unacked == NULL) {
+        pcb->last_unacked = NULL;
+      }
+      if (pcb->unsent == NULL) {
+        pcb->last_unsent = NULL;
+      }
 
+#if LWIP_TCP_RTT_MS
+      if (rtt_ms != (u32_t)-1) {
+        tcp_rtt_sample(pcb, rtt_ms);
+        if (pcb->cong_ops->pkts_acked != NULL) {
+          pcb->cong_ops->pkts_acked(pcb, rtt_ms);
+        }
+      }
+#else /* LWIP_TCP_RTT_MS */
       if (pcb->cong_ops->pkts_acked != NULL) {
         pcb->cong_ops->pkts_acked(pcb, rtt_ms);
       }
+#endif /* LWIP_TCP_RTT_MS */
       /* If there's nothing left to acknowledge, stop the retransmit
          timer, otherwise reset it to start again */
       if (pcb->unacked == NULL) {
@@ -1314,6 +2129,25 @@ tcp_receive(struct tcp_pcb *pcb)
 
       pcb->polltmr = 0;
 
+#if LWIP_TCP_SACK_IN
+#if LWIP_TCP_PRR
+      if ((pcb->flags & TF_INFR) || rack_lost) {
+        /* SACKed bytes that were ACKed now have been counted already */
+        tcp_prr_ack(pcb, (u32_t)(acked + pcb->sacked - prior_sacked));
+      }
+#endif /* LWIP_TCP_PRR */
+      if (pcb->flags & TF_INFR) {
+        /* Partial ACK: the new first unacked segment is presumed lost too */
+        tcp_rexmit_sack(pcb, 1);
+      } else if (rack_lost) {
+        /* RACK found a loss without three duplicate ACKs */
+        tcp_rexmit_fast(pcb);
+      }
+#endif /* LWIP_TCP_SACK_IN */
+#if LWIP_TCP_RACK
+      tcp_rack_arm_pto(pcb);
+#endif /* LWIP_TCP_RACK */
+
 #if TCP_OVERSIZE
       if (pcb->unsent == NULL) {
         pcb->unsent_oversize = 0;
@@ -1349,6 +2183,23 @@ tcp_receive(struct tcp_pcb *pcb)
       tcp_send_empty_ack(pcb);
     }
 
+#if LWIP_TCP_ECN
+    if ((pcb->ecn_flags & TCP_ECN_OK) && TCP_SEQ_LEQ(ackno, pcb->snd_nxt)) {
+      tcp_ecn_ack(pcb);
+    }
+#endif /* LWIP_TCP_ECN */
+
+#if LWIP_TCP_RATE_SAMPLE
+    tcp_rate_gen(pcb, &rate_sample, rtt_ms);
+    if (TCP_CA_CONG_CONTROL(pcb)) {
+      pcb->cong_ops->cong_control(pcb, &rate_sample);
+    }
+#endif /* LWIP_TCP_RATE_SAMPLE */
+#if LWIP_TCP_PACING
+    tcp_pacing_update(pcb);
+#endif /* LWIP_TCP_PACING */
+
+#if !LWIP_TCP_RTT_MS
     LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_receive: pcb->rttest %"U32_F" rtseq %"U32_F" ackno %"U32_F"\n",
                                 pcb->rttest, pcb->rtseq, ackno));
 
@@ -1378,6 +2229,7 @@ tcp_receive(struct tcp_pcb *pcb)
 
       pcb->rttest = 0;
     }
+#endif /* !LWIP_TCP_RTT_MS */
   }
 
   /* If the incoming segment contains data, we must process it
@@ -1385,6 +2237,11 @@ tcp_receive(struct tcp_pcb *pcb)
      (RFC 793, chapter 3.9, "SEGMENT ARRIVES" in states CLOSE-WAIT, CLOSING,
      LAST-ACK and TIME-WAIT: "Ignore the segment text.") */
   if ((tcplen > 0) && (pcb->state < CLOSE_WAIT)) {
+#if LWIP_TCP_ECN
+    if (pcb->ecn_flags & TCP_ECN_OK) {
+      tcp_ecn_check_ce(pcb);
+    }
+#endif /* LWIP_TCP_ECN */
     /* This code basically does three things:
 
     +) If the incoming segment contains data that is the next
@@ -1513,6 +2370,7 @@ tcp_receive(struct tcp_pcb *pcb)
               pcb->ooseq = pcb->ooseq->next;
               tcp_seg_free(old_ooseq);
             }
+            TCP_OOSEQ_CLEAR(pcb);
           } else {
             struct tcp_seg *next = pcb->ooseq;
             /* Remove all segments on ooseq that are covered by inseg already.
@@ -1529,6 +2387,7 @@ tcp_receive(struct tcp_pcb *pcb)
               }
               tmp = next;
               next = next->next;
+              TCP_OOSEQ_UNLINK(pcb, tmp);
               tcp_seg_free(tmp);
             }
             /* Now trim right side of inseg if it overlaps with the first
@@ -1618,6 +2477,7 @@ tcp_receive(struct tcp_pcb *pcb)
           }
 
           pcb->ooseq = cseg->next;
+          TCP_OOSEQ_UNLINK(pcb, cseg);
           tcp_seg_free(cseg);
         }
 #if LWIP_TCP_SACK_OUT
@@ -1636,7 +2496,7 @@ tcp_receive(struct tcp_pcb *pcb)
 
 
         /* Acknowledge the segment(s). */
-        tcp_ack(pcb);
+        tcp_ack(pcb, tcplen);
 
 #if LWIP_TCP_SACK_OUT
         if (LWIP_TCP_SACK_VALID(pcb, 0)) {
@@ -1658,10 +2518,16 @@ tcp_receive(struct tcp_pcb *pcb)
       } else {
         /* We get here if the incoming segment is out-of-sequence. */
 
+        /* ACK at once until the hole is filled and the sender has recovered */
+        pcb->quickack = TCP_QUICKACK_SEGS;
+
 #if TCP_QUEUE_OOSEQ
         /* We queue the segment on the ->ooseq queue. */
         if (pcb->ooseq == NULL) {
           pcb->ooseq = tcp_seg_copy(&inseg);
+          if (pcb->ooseq != NULL) {
+            TCP_OOSEQ_LINK(pcb, pcb->ooseq);
+          }
 #if LWIP_TCP_SACK_OUT
           if (pcb->flags & TF_SACK) {
             /* All the SACKs should be invalid, so we can simply store the most recent one: */
@@ -1688,7 +2554,19 @@ tcp_receive(struct tcp_pcb *pcb)
           u32_t sackbeg = TCP_SEQ_LT(seqno, pcb->ooseq->tcphdr->seqno) ? seqno : pcb->ooseq->tcphdr->seqno;
 #endif /* LWIP_TCP_SACK_OUT */
           struct tcp_seg *next, *prev = NULL;
-          for (next = pcb->ooseq; next != NULL; next = next->next) {
+#if TCP_OOSEQ_TREE
+          /* Start at the last segment that does not start after the incoming
+             one instead of walking the queue from its beginning. */
+          next = tcp_seg_tree_find(pcb->ooseq_tree, seqno);
+          if (next != NULL) {
+            prev = tcp_seg_tree_prev(next);
+          } else {
+            next = pcb->ooseq;
+          }
+#else /* TCP_OOSEQ_TREE */
+          next = pcb->ooseq;
+#endif /* TCP_OOSEQ_TREE */
+          for (; next != NULL; next = next->next) {
             if (seqno == next->tcphdr->seqno) {
               /* The sequence number of the incoming segment is the
                  same as the sequence number of the segment on
@@ -1705,7 +2583,8 @@ tcp_receive(struct tcp_pcb *pcb)
                   } else {
                     pcb->ooseq = cseg;
                   }
-                  tcp_oos_insert_segment(cseg, next);
+                  tcp_oos_insert_segment(pcb, cseg, next);
+                  TCP_OOSEQ_LINK(pcb, cseg);
                 }
                 break;
               } else {
@@ -1724,7 +2603,8 @@ tcp_receive(struct tcp_pcb *pcb)
                   struct tcp_seg *cseg = tcp_seg_copy(&inseg);
                   if (cseg != NULL) {
                     pcb->ooseq = cseg;
-                    tcp_oos_insert_segment(cseg, next);
+                    tcp_oos_insert_segment(pcb, cseg, next);
+                    TCP_OOSEQ_LINK(pcb, cseg);
                   }
                   break;
                 }
@@ -1745,7 +2625,8 @@ tcp_receive(struct tcp_pcb *pcb)
                       pbuf_realloc(prev->p, prev->len);
                     }
                     prev->next = cseg;
-                    tcp_oos_insert_segment(cseg, next);
+                    tcp_oos_insert_segment(pcb, cseg, next);
+                    TCP_OOSEQ_LINK(pcb, cseg);
                   }
                   break;
                 }
@@ -1775,6 +2656,7 @@ tcp_receive(struct tcp_pcb *pcb)
                 }
                 next->next = tcp_seg_copy(&inseg);
                 if (next->next != NULL) {
+                  TCP_OOSEQ_LINK(pcb, next->next);
                   if (TCP_SEQ_GT(next->tcphdr->seqno + next->len, seqno)) {
                     /* We need to trim the last segment. */
                     next->len = (u16_t)(seqno - next->tcphdr->seqno);
@@ -1806,6 +2688,15 @@ tcp_receive(struct tcp_pcb *pcb)
 
 #if LWIP_TCP_SACK_OUT
           if (pcb->flags & TF_SACK) {
+#if TCP_OOSEQ_TREE
+            /* sackbeg has not been tracked from the beginning of the queue */
+            next = (prev == NULL) ? pcb->ooseq : prev->next;
+            if (next != NULL) {
+              u32_t sackend;
+              tcp_ooseq_sack_range(pcb, next, &sackbeg, &sackend);
+              tcp_add_sack(pcb, sackbeg, sackend);
+            }
+#else /* TCP_OOSEQ_TREE */
             if (prev == NULL) {
               /* The new segment is at the beginning. sackbeg should already be set properly.
                  We need to find the right edge. */
@@ -1827,6 +2718,7 @@ tcp_receive(struct tcp_pcb *pcb)
               }
               tcp_add_sack(pcb, sackbeg, sackend);
             }
+#endif /* TCP_OOSEQ_TREE */
           }
 #endif /* LWIP_TCP_SACK_OUT */
         }
@@ -1866,6 +2758,14 @@ tcp_receive(struct tcp_pcb *pcb)
               }
 #endif /* LWIP_TCP_SACK_OUT */
               /* too much ooseq data, dump this and everything after it */
+#if TCP_OOSEQ_TREE
+              {
+                struct tcp_seg *dump;
+                for (dump = next; dump != NULL; dump = dump->next) {
+                  TCP_OOSEQ_UNLINK(pcb, dump);
+                }
+              }
+#endif /* TCP_OOSEQ_TREE */
               tcp_segs_free(next);
               if (prev == NULL) {
                 /* first ooseq segment is too much, dump the whole queue */
@@ -1930,6 +2830,13 @@ tcp_parseopt(struct tcp_pcb *pcb)
 
   LWIP_ASSERT("tcp_parseopt: invalid pcb", pcb != NULL);
 
+#if LWIP_TCP_SACK_IN
+  sack_num = 0;
+#endif /* LWIP_TCP_SACK_IN */
+#if LWIP_TCP_UNDO && LWIP_TCP_TIMESTAMPS
+  ts_ecr_valid = 0;
+#endif /* LWIP_TCP_UNDO && LWIP_TCP_TIMESTAMPS */
+
   /* Parse the TCP MSS option, if present. */
   if (tcphdr_optlen != 0) {
     for (tcp_optidx = 0; tcp_optidx < tcphdr_optlen; ) {
@@ -1976,9 +2883,9 @@ tcp_parseopt(struct tcp_pcb *pcb)
             pcb->rcv_scale = TCP_RCV_SCALE;
             tcp_set_flags(pcb, TF_WND_SCALE);
             /* window scaling is enabled, we can use the full receive window */
-            LWIP_ASSERT("window not at default value", pcb->rcv_wnd == TCPWND_MIN16(TCP_WND));
-            LWIP_ASSERT("window not at default value", pcb->rcv_ann_wnd == TCPWND_MIN16(TCP_WND));
-            pcb->rcv_wnd = pcb->rcv_ann_wnd = TCP_WND;
+            LWIP_ASSERT("window not at default value", pcb->rcv_wnd == TCPWND_MIN16(TCP_RCV_WND(pcb)));
+            LWIP_ASSERT("window not at default value", pcb->rcv_ann_wnd == TCPWND_MIN16(TCP_RCV_WND(pcb)));
+            pcb->rcv_wnd = pcb->rcv_ann_wnd = TCP_RCV_WND(pcb);
           }
           break;
 #endif /* LWIP_WND_SCALE */
@@ -1991,10 +2898,10 @@ tcp_parseopt(struct tcp_pcb *pcb)
             return;
           }
           /* TCP timestamp option with valid length */
-          tsval = tcp_get_next_optbyte();
-          tsval |= (tcp_get_next_optbyte() << 8);
-          tsval |= (tcp_get_next_optbyte() << 16);
-          tsval |= (tcp_get_next_optbyte() << 24);
+          tsval = (u32_t)tcp_get_next_optbyte();
+          tsval |= (u32_t)tcp_get_next_optbyte() << 8;
+          tsval |= (u32_t)tcp_get_next_optbyte() << 16;
+          tsval |= (u32_t)tcp_get_next_optbyte() << 24;
           if (flags & TCP_SYN) {
             pcb->ts_recent = lwip_ntohl(tsval);
             /* Enable sending timestamps in every segment now that we know
@@ -2003,8 +2910,19 @@ tcp_parseopt(struct tcp_pcb *pcb)
           } else if (TCP_SEQ_BETWEEN(pcb->ts_lastacksent, seqno, seqno + tcplen)) {
             pcb->ts_recent = lwip_ntohl(tsval);
           }
+#if LWIP_TCP_UNDO
+          ts_ecr = (u32_t)tcp_get_next_optbyte();
+          ts_ecr |= (u32_t)tcp_get_next_optbyte() << 8;
+          ts_ecr |= (u32_t)tcp_get_next_optbyte() << 16;
+          ts_ecr |= (u32_t)tcp_get_next_optbyte() << 24;
+          ts_ecr = lwip_ntohl(ts_ecr);
+          ts_ecr_valid = 1;
+          /* Advance to next option (10 bytes already read) */
+          tcp_optidx += LWIP_TCP_OPT_LEN_TS - 10;
+#else /* LWIP_TCP_UNDO */
           /* Advance to next option (6 bytes already read) */
           tcp_optidx += LWIP_TCP_OPT_LEN_TS - 6;
+#endif /* LWIP_TCP_UNDO */
           break;
 #endif /* LWIP_TCP_TIMESTAMPS */
 #if LWIP_TCP_SACK_OUT
@@ -2022,6 +2940,34 @@ tcp_parseopt(struct tcp_pcb *pcb)
           }
           break;
 #endif /* LWIP_TCP_SACK_OUT */
+#if LWIP_TCP_SACK_IN
+        case LWIP_TCP_OPT_SACK:
+          LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: SACK\n"));
+          data = tcp_get_next_optbyte();
+          if (data < 10 || ((data - 2) & 7) != 0 || (tcp_optidx - 2 + data) > tcphdr_optlen) {
+            /* Bad length */
+            LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: bad length\n"));
+            return;
+          }
+          /* TCP SACK option with valid length: only used if SACK was negotiated */
+          for (data = (u8_t)(data - 2); data != 0; data = (u8_t)(data - 8)) {
+            u32_t left, right;
+            left = (u32_t)tcp_get_next_optbyte() << 24;
+            left |= (u32_t)tcp_get_next_optbyte() << 16;
+            left |= (u32_t)tcp_get_next_optbyte() << 8;
+            left |= tcp_get_next_optbyte();
+            right = (u32_t)tcp_get_next_optbyte() << 24;
+            right |= (u32_t)tcp_get_next_optbyte() << 16;
+            right |= (u32_t)tcp_get_next_optbyte() << 8;
+            right |= tcp_get_next_optbyte();
+            if ((pcb->flags & TF_SACK) && !(flags & TCP_SYN) && (sack_num < TCP_SACK_IN_MAX_BLOCKS)) {
+              sack_blocks[sack_num].left = left;
+              sack_blocks[sack_num].right = right;
+              sack_num++;
+            }
+          }
+          break;
+#endif /* LWIP_TCP_SACK_IN */
         default:
           LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: other\n"));
           data = tcp_get_next_optbyte();
@@ -2039,6 +2985,136 @@ tcp_parseopt(struct tcp_pcb *pcb)
   }
 }
 
+#if LWIP_TCP_SYNCOOKIES || LWIP_TCP_REQ_TABLE
+#if LWIP_TCP_TIMESTAMPS
+static u32_t
+tcp_get_next_optbyte_u32(void)
+{
+  u32_t val = (u32_t)tcp_get_next_optbyte() << 24;
+  val |= (u32_t)tcp_get_next_optbyte() << 16;
+  val |= (u32_t)tcp_get_next_optbyte() << 8;
+  return val | tcp_get_next_optbyte();
+}
+#endif /* LWIP_TCP_TIMESTAMPS */
+
+/**
+ * Parses the options of a segment for a listening pcb into the state of a
+ * handshake: the options of a SYN, or the timestamps of the ACK that
+ * returns a SYN cookie.
+ *
+ * @param hs the tcp_handshake to fill in
+ */
+static void
+tcp_handshake_parseopt(struct tcp_handshake *hs)
+{
+  u8_t opt, len;
+  u16_t mss;
+
+  hs->mss = INITIAL_MSS;
+  hs->optflags = 0;
+  hs->snd_scale = 0;
+  hs->ecn = 0;
+
+  for (tcp_optidx = 0; tcp_optidx < tcphdr_optlen; ) {
+    opt = tcp_get_next_optbyte();
+    if (opt == LWIP_TCP_OPT_EOL) {
+      return;
+    } else if (opt == LWIP_TCP_OPT_NOP) {
+      continue;
+    }
+    len = tcp_get_next_optbyte();
+    if ((len < 2) || (tcp_optidx - 2 + len > tcphdr_optlen)) {
+      /* malformed options */
+      return;
+    }
+    if ((opt == LWIP_TCP_OPT_MSS) && (len == LWIP_TCP_OPT_LEN_MSS)) {
+      mss = (u16_t)(tcp_get_next_optbyte() << 8);
+      mss |= tcp_get_next_optbyte();
+      hs->mss = ((mss > TCP_MSS) || (mss == 0)) ? TCP_MSS : mss;
+#if LWIP_WND_SCALE
+    } else if ((opt == LWIP_TCP_OPT_WS) && (len == LWIP_TCP_OPT_LEN_WS)) {
+      hs->snd_scale = tcp_get_next_optbyte();
+      if (hs->snd_scale > 14U) {
+        hs->snd_scale = 14U;
+      }
+      hs->optflags |= TF_SEG_OPTS_WND_SCALE;
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK_OUT
+    } else if ((opt == LWIP_TCP_OPT_SACK_PERM) && (len == LWIP_TCP_OPT_LEN_SACK_PERM)) {
+      hs->optflags |= TF_SEG_OPTS_SACK_PERM;
+#endif /* LWIP_TCP_SACK_OUT */
+#if LWIP_TCP_TIMESTAMPS
+    } else if ((opt == LWIP_TCP_OPT_TS) && (len == LWIP_TCP_OPT_LEN_TS)) {
+      hs->ts_recent = tcp_get_next_optbyte_u32();
+      hs->ts_val = tcp_get_next_optbyte_u32();
+      hs->optflags |= TF_SEG_OPTS_TS;
+#endif /* LWIP_TCP_TIMESTAMPS */
+    } else {
+      tcp_optidx += len - 2;
+    }
+  }
+}
+#endif /* LWIP_TCP_SYNCOOKIES || LWIP_TCP_REQ_TABLE */
+
+#if LWIP_TCP_SACK_IN
+/**
+ * Called by tcp_receive() to mark the segments on the unacked queue that are
+ * covered by the SACK blocks of the current input segment.
+ *
+ * Blocks at or below the cumulative ACK (D-SACK) or beyond snd_nxt are ignored.
+ * Segments are only marked when they are covered completely.
+ *
+ * @param pcb the tcp_pcb for which a segment was received
+ * @return 1 if data was SACKed that had not been SACKed before, 0 otherwise
+ */
+static u8_t
+tcp_sack_update(struct tcp_pcb *pcb)
+{
+  struct tcp_seg *seg;
+  u32_t seq, end;
+  u8_t i, newly_sacked = 0;
+
+  for (i = 0; i < sack_num; i++) {
+    const struct tcp_sack_range *blk = &sack_blocks[i];
+    if (!TCP_SEQ_LT(blk->left, blk->right) || TCP_SEQ_LEQ(blk->right, ackno) ||
+        TCP_SEQ_GT(blk->right, pcb->snd_nxt)) {
+      continue;
+    }
+#if TCP_UNACKED_TREE
+    /* skip the segments below the block */
+    seg = tcp_seg_tree_find(pcb->unacked_tree, blk->left);
+    if (seg == NULL) {
+      seg = pcb->unacked;
+    }
+#else /* TCP_UNACKED_TREE */
+    seg = pcb->unacked;
+#endif /* TCP_UNACKED_TREE */
+    for (; seg != NULL; seg = seg->next) {
+      seq = lwip_ntohl(seg->tcphdr->seqno);
+      end = seq + TCP_TCPLEN(seg);
+      if (TCP_SEQ_GEQ(seq, blk->right)) {
+        /* unacked is sorted, nothing further up is covered */
+        break;
+      }
+      if (!(seg->flags & TF_SEG_SACKED) &&
+          TCP_SEQ_GEQ(seq, blk->left) && TCP_SEQ_LEQ(end, blk->right)) {
+        seg->flags |= TF_SEG_SACKED;
+        pcb->sacked = (tcpwnd_size_t)(pcb->sacked + (end - seq));
+        newly_sacked = 1;
+#if LWIP_TCP_RACK
+        tcp_rack_update(pcb, seg, sys_now());
+#endif /* LWIP_TCP_RACK */
+#if LWIP_TCP_RATE_SAMPLE
+        tcp_rate_seg_delivered(pcb, seg, &rate_sample);
+#endif /* LWIP_TCP_RATE_SAMPLE */
+      }
+    }
+  }
+  sack_num = 0;
+  return newly_sacked;
+}
+#endif /* LWIP_TCP_SACK_IN */
+
 void
 tcp_trigger_input_pcb_close(void)
 {
@@ -2187,6 +3263,61 @@ tcp_remove_sacks_gt(struct tcp_pcb *pcb, u32_t seq)
 }
 #endif /* TCP_OOSEQ_BYTES_LIMIT || TCP_OOSEQ_PBUFS_LIMIT */
 
+#if TCP_QUEUE_OOSEQ && TCP_OOSEQ_TREE
+/**
+ * Called by tcp_receive() to find the contiguous range of data on ooseq
+ * around a segment that has just been queued, so that it can be SACKed.
+ *
+ * A range already in rcv_sacks[] is never shorter than the data on ooseq
+ * it describes, so one that ends (or starts) where the walk is ends it:
+ * a run of in-window segments after a single loss is not walked again
+ * for every new segment.
+ *
+ * @param pcb the tcp_pcb for which a segment arrived
+ * @param seg the segment on ooseq
+ * @param left returns the first sequence number of the range
+ * @param right returns the first sequence number past the range
+ */
+static void
+tcp_ooseq_sack_range(struct tcp_pcb *pcb, struct tcp_seg *seg, u32_t *left, u32_t *right)
+{
+  struct tcp_seg *next;
+  u8_t i;
+
+  *left = seg->tcphdr->seqno;
+  for (next = tcp_seg_tree_prev(seg);
+       (next != NULL) && (next->tcphdr->seqno + next->len == *left);
+       next = tcp_seg_tree_prev(next)) {
+    for (i = 0; (i < LWIP_TCP_MAX_SACK_NUM) && LWIP_TCP_SACK_VALID(pcb, i); ++i) {
+      if ((pcb->rcv_sacks[i].right == *left) &&
+          TCP_SEQ_LEQ(pcb->rcv_sacks[i].left, next->tcphdr->seqno)) {
+        break;
+      }
+    }
+    if ((i < LWIP_TCP_MAX_SACK_NUM) && LWIP_TCP_SACK_VALID(pcb, i)) {
+      *left = pcb->rcv_sacks[i].left;
+      break;
+    }
+    *left = next->tcphdr->seqno;
+  }
+
+  *right = seg->tcphdr->seqno + seg->len;
+  for (next = seg->next; (next != NULL) && (next->tcphdr->seqno == *right); next = next->next) {
+    for (i = 0; (i < LWIP_TCP_MAX_SACK_NUM) && LWIP_TCP_SACK_VALID(pcb, i); ++i) {
+      if ((pcb->rcv_sacks[i].left == *right) &&
+          TCP_SEQ_GEQ(pcb->rcv_sacks[i].right, *right + next->len)) {
+        break;
+      }
+    }
+    if ((i < LWIP_TCP_MAX_SACK_NUM) && LWIP_TCP_SACK_VALID(pcb, i)) {
+      *right = pcb->rcv_sacks[i].right;
+      break;
+    }
+    *right += next->len;
+  }
+}
+#endif /* TCP_QUEUE_OOSEQ && TCP_OOSEQ_TREE */
+
 #endif /* LWIP_TCP_SACK_OUT */
 
 #endif /* LWIP_TCP */
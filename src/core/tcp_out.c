@@ -125,10 +125,13 @@
 #endif
 
 /* Forward declarations.*/
-static err_t tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif);
+static err_t tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif, u16_t tso_segs);
 static err_t tcp_output_control_segment_netif(const struct tcp_pcb *pcb, struct pbuf *p,
                                               const ip_addr_t *src, const ip_addr_t *dst,
                                               struct netif *netif);
+#if LWIP_TCP_ZEROCOPY
+static void tcp_zerocopy_tag(struct tcp_pcb *pcb, struct tcp_seg *last);
+#endif /* LWIP_TCP_ZEROCOPY */
 
 /* tcp_route: common code that returns a fixed bound netif or calls ip_route */
 static struct netif *
@@ -183,6 +186,10 @@ tcp_create_segment(const struct tcp_pcb *pcb, struct pbuf *p, u8_t hdrflags, u32
 #if TCP_OVERSIZE_DBGCHECK
   seg->oversize_left = 0;
 #endif /* TCP_OVERSIZE_DBGCHECK */
+#if LWIP_TCP_ZEROCOPY
+  seg->zc_end = 0;
+  seg->zc_id = 0;
+#endif /* LWIP_TCP_ZEROCOPY */
 #if TCP_CHECKSUM_ON_COPY
   seg->chksum = 0;
   seg->chksum_swapped = 0;
@@ -371,6 +378,12 @@ tcp_write_checks(struct tcp_pcb *pcb, u16_t len)
  * - TCP_WRITE_FLAG_MORE: indicates that more data follows. If this is omitted,
  *   the PSH flag is set in the last segment created by this call to tcp_write.
  *   If this flag is given, the PSH flag is not set.
+ * - TCP_WRITE_FLAG_ZEROCOPY: like omitting TCP_WRITE_FLAG_COPY, but the
+ *   application is told when the data has been ACKed by the zerocopy
+ *   callback (@see tcp_zerocopy()). Zero-copy writes are numbered, starting
+ *   at 0 for every connection. A write with TCP_WRITE_FLAG_MORE shares its id
+ *   with the zero-copy writes that follow, up to the first one without
+ *   TCP_WRITE_FLAG_MORE or a call to tcp_zerocopy_end().
  *
  * The tcp_write() function will fail and return ERR_MEM if the length
  * of the data exceeds the current send buffer size or if the length of
@@ -389,6 +402,7 @@ tcp_write_checks(struct tcp_pcb *pcb, u16_t len)
  * @param apiflags combination of following flags :
  * - TCP_WRITE_FLAG_COPY (0x01) data will be copied into memory belonging to the stack
  * - TCP_WRITE_FLAG_MORE (0x02) for TCP connection, PSH flag will not be set on last segment sent,
+ * - TCP_WRITE_FLAG_ZEROCOPY (0x20) data is referenced and reported as done when ACKed
  * @return ERR_OK if enqueued, another err_t on error
  */
 err_t
@@ -415,6 +429,14 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
 #endif /* TCP_CHECKSUM_ON_COPY */
   err_t err;
   u16_t mss_local;
+  /* type of the pbufs referencing data that is not copied */
+#if LWIP_TCP_ZEROCOPY
+  /* zero-copy data may change once the write is done: PBUF_REF makes
+     anything that queues it longer than TCP copy it */
+  pbuf_type ref_type = (apiflags & TCP_WRITE_FLAG_ZEROCOPY) ? PBUF_REF : PBUF_ROM;
+#else /* LWIP_TCP_ZEROCOPY */
+  pbuf_type ref_type = PBUF_ROM;
+#endif /* LWIP_TCP_ZEROCOPY */
 
   LWIP_ERROR("tcp_write: invalid pcb", pcb != NULL, return ERR_ARG);
 
@@ -486,9 +508,9 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
     u16_t space;
     u16_t unsent_optlen;
 
-    /* @todo: this could be sped up by keeping last_unsent in the pcb */
-    for (last_unsent = pcb->unsent; last_unsent->next != NULL;
-         last_unsent = last_unsent->next);
+    last_unsent = pcb->last_unsent;
+    LWIP_ASSERT("tcp_write: last_unsent is not the tail",
+                (last_unsent != NULL) && (last_unsent->next == NULL));
 
     /* Usable space at the end of the last unsent segment */
     unsent_optlen = LWIP_TCP_OPT_LENGTH_SEGMENT(last_unsent->flags, pcb);
@@ -562,15 +584,15 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
         queuelen += pbuf_clen(concat_p);
       } else {
         /* Data is not copied */
-        /* If the last unsent pbuf is of type PBUF_ROM, try to extend it. */
+        /* If the last unsent pbuf references data the same way, try to extend it. */
         struct pbuf *p;
         for (p = last_unsent->p; p->next != NULL; p = p->next);
-        if (((p->type_internal & (PBUF_TYPE_FLAG_STRUCT_DATA_CONTIGUOUS | PBUF_TYPE_FLAG_DATA_VOLATILE)) == 0) &&
+        if ((p->type_internal == (u8_t)ref_type) && ((p->flags & PBUF_FLAG_IS_CUSTOM) == 0) &&
             (const u8_t *)p->payload + p->len == (const u8_t *)arg) {
           LWIP_ASSERT("tcp_write: ROM pbufs cannot be oversized", pos == 0);
           extendlen = seglen;
         } else {
-          if ((concat_p = pbuf_alloc(PBUF_RAW, seglen, PBUF_ROM)) == NULL) {
+          if ((concat_p = pbuf_alloc(PBUF_RAW, seglen, ref_type)) == NULL) {
             LWIP_DEBUGF(TCP_OUTPUT_DEBUG | LWIP_DBG_LEVEL_SERIOUS,
                         ("tcp_write: could not allocate memory for zero-copy pbuf\n"));
             goto memerr;
@@ -633,7 +655,7 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
 #if TCP_OVERSIZE
       LWIP_ASSERT("oversize == 0", oversize == 0);
 #endif /* TCP_OVERSIZE */
-      if ((p2 = pbuf_alloc(PBUF_TRANSPORT, seglen, PBUF_ROM)) == NULL) {
+      if ((p2 = pbuf_alloc(PBUF_TRANSPORT, seglen, ref_type)) == NULL) {
         LWIP_DEBUGF(TCP_OUTPUT_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("tcp_write: could not allocate memory for zero-copy pbuf\n"));
         goto memerr;
       }
@@ -781,6 +803,9 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
   } else {
     last_unsent->next = queue;
   }
+  if (queue != NULL) {
+    pcb->last_unsent = prev_seg;
+  }
 
   /*
    * Finally update the pcb state.
@@ -801,6 +826,15 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
     TCPH_SET_FLAG(seg->tcphdr, TCP_PSH);
   }
 
+#if LWIP_TCP_ZEROCOPY
+  if (apiflags & TCP_WRITE_FLAG_ZEROCOPY) {
+    pcb->zc_open = 1;
+    if ((apiflags & TCP_WRITE_FLAG_MORE) == 0) {
+      tcp_zerocopy_tag(pcb, seg);
+    }
+  }
+#endif /* LWIP_TCP_ZEROCOPY */
+
   return ERR_OK;
 memerr:
   tcp_set_flags(pcb, TF_NAGLEMEMERR);
@@ -820,6 +854,57 @@ memerr:
   return ERR_MEM;
 }
 
+#if LWIP_TCP_ZEROCOPY
+/**
+ * End the current zero-copy write: it is done when the last segment queued
+ * now is ACKed. The next zero-copy write gets a new id.
+ *
+ * @param pcb the tcp_pcb to end the zero-copy write for
+ * @param last the last segment on pcb->unsent or pcb->unacked
+ */
+static void
+tcp_zerocopy_tag(struct tcp_pcb *pcb, struct tcp_seg *last)
+{
+  pcb->zc_open = 0;
+  if (last != NULL) {
+    /* a later write ending in the same segment includes this one */
+    last->zc_end = 1;
+    last->zc_id = pcb->zc_id++;
+  } else {
+    /* everything written has been ACKed already */
+    err_t err;
+    TCP_EVENT_ZEROCOPY(pcb, pcb->zc_id++, err);
+    LWIP_UNUSED_ARG(err);
+  }
+}
+
+/**
+ * @ingroup tcp_raw
+ * End the current zero-copy write, so that the next one gets a new id.
+ * This is needed if the last write had TCP_WRITE_FLAG_MORE set but no more
+ * data follows. Nothing is done if no data has been written with the
+ * current id. If all data has been ACKed already, the zerocopy callback is
+ * called from here, so it must not call tcp_abort() in that case.
+ *
+ * @param pcb the tcp_pcb to end the zero-copy write for
+ */
+void
+tcp_zerocopy_end(struct tcp_pcb *pcb)
+{
+  struct tcp_seg *last;
+
+  LWIP_ASSERT_CORE_LOCKED();
+
+  LWIP_ERROR("tcp_zerocopy_end: invalid pcb", pcb != NULL, return);
+
+  if (pcb->zc_open) {
+    /* unsent data follows all unacked data */
+    last = (pcb->unsent != NULL) ? pcb->last_unsent : pcb->last_unacked;
+    tcp_zerocopy_tag(pcb, last);
+  }
+}
+#endif /* LWIP_TCP_ZEROCOPY */
+
 /**
  * Split segment on the head of the unsent queue.  If return is not
  * ERR_OK, existing head remains intact
@@ -933,6 +1018,12 @@ tcp_split_unsent_seg(struct tcp_pcb *pcb, u16_t split)
   seg->chksum_swapped = chksum_swapped;
   seg->flags |= TF_SEG_DATA_CHECKSUMMED;
 #endif /* TCP_CHECKSUM_ON_COPY */
+#if LWIP_TCP_ZEROCOPY
+  /* a zero-copy write ending in the segment ends in the remainder */
+  seg->zc_end = useg->zc_end;
+  seg->zc_id = useg->zc_id;
+  useg->zc_end = 0;
+#endif /* LWIP_TCP_ZEROCOPY */
 
   /* Remove this segment from the queue since trimming it may free pbufs */
   pcb->snd_queuelen -= pbuf_clen(useg->p);
@@ -978,6 +1069,9 @@ tcp_split_unsent_seg(struct tcp_pcb *pcb, u16_t split)
   /* Finally insert remainder into queue after split (which stays head) */
   seg->next = useg->next;
   useg->next = seg;
+  if (seg->next == NULL) {
+    pcb->last_unsent = seg;
+  }
 
 #if TCP_OVERSIZE
   /* If remainder is last segment on the unsent, ensure we clear the oversize amount
@@ -1014,9 +1108,7 @@ tcp_send_fin(struct tcp_pcb *pcb)
 
   /* first, try to add the fin to the last unsent segment */
   if (pcb->unsent != NULL) {
-    struct tcp_seg *last_unsent;
-    for (last_unsent = pcb->unsent; last_unsent->next != NULL;
-         last_unsent = last_unsent->next);
+    struct tcp_seg *last_unsent = pcb->last_unsent;
 
     if ((TCPH_FLAGS(last_unsent->tcphdr) & (TCP_SYN | TCP_FIN | TCP_RST)) == 0) {
       /* no SYN/FIN/RST flag in the header, we can add the FIN flag */
@@ -1072,6 +1164,15 @@ tcp_enqueue_flags(struct tcp_pcb *pcb, u8_t flags)
       optflags |= TF_SEG_OPTS_SACK_PERM;
     }
 #endif /* LWIP_TCP_SACK_OUT */
+#if LWIP_TCP_ECN
+    if (pcb->state != SYN_RCVD) {
+      /* ECN-setup SYN (RFC 3168 section 6.1.1) */
+      flags |= TCP_ECE | TCP_CWR;
+    } else if (pcb->ecn_flags & TCP_ECN_OK) {
+      /* ECN-setup SYN-ACK */
+      flags |= TCP_ECE;
+    }
+#endif /* LWIP_TCP_ECN */
   }
 #if LWIP_TCP_TIMESTAMPS
   if ((pcb->flags & TF_TIMESTAMP) || ((flags & TCP_SYN) && (pcb->state != SYN_RCVD))) {
@@ -1110,10 +1211,9 @@ tcp_enqueue_flags(struct tcp_pcb *pcb, u8_t flags)
   if (pcb->unsent == NULL) {
     pcb->unsent = seg;
   } else {
-    struct tcp_seg *useg;
-    for (useg = pcb->unsent; useg->next != NULL; useg = useg->next);
-    useg->next = seg;
+    pcb->last_unsent->next = seg;
   }
+  pcb->last_unsent = seg;
 #if TCP_OVERSIZE
   /* The new unsent tail has no space */
   pcb->unsent_oversize = 0;
@@ -1236,40 +1336,43 @@ tcp_build_wnd_scale_option(u32_t *opts)
 #endif
 
 /**
- * @ingroup tcp_raw
- * Find out what we can send and send it
+ * Does the work of tcp_output() once its timer state is settled
  *
  * @param pcb Protocol control block for the TCP connection to send data
  * @return ERR_OK if data has been sent or nothing to send
  *         another err_t on error
  */
-err_t
-tcp_output(struct tcp_pcb *pcb)
+static err_t
+tcp_output_unsent(struct tcp_pcb *pcb)
 {
-  struct tcp_seg *seg, *useg;
+  struct tcp_seg *seg;
   u32_t wnd, snd_nxt;
   err_t err;
   struct netif *netif;
+  u16_t tso_left = 0;
+#if LWIP_TCP_RACK
+  u8_t sent_new = 0;
+#endif /* LWIP_TCP_RACK */
 #if TCP_CWND_DEBUG
   s16_t i = 0;
 #endif /* TCP_CWND_DEBUG */
 
-  LWIP_ASSERT_CORE_LOCKED();
-
-  LWIP_ASSERT("tcp_output: invalid pcb", pcb != NULL);
-  /* pcb->state LISTEN not allowed here */
-  LWIP_ASSERT("don't call tcp_output for listen-pcbs",
-              pcb->state != LISTEN);
-
-  /* First, check if we are invoked by the TCP input processing
-     code. If so, we do not output anything. Instead, we rely on the
-     input processing code to call us when input processing is done
-     with. */
-  if (tcp_input_pcb == pcb) {
-    return ERR_OK;
-  }
+#if LWIP_TCP_RATE_SAMPLE
+  tcp_rate_check_app_limited(pcb);
+#endif /* LWIP_TCP_RATE_SAMPLE */
 
+#if LWIP_TCP_SACK_IN
+  /* SACKed bytes have left the network and don't count against cwnd */
+  wnd = LWIP_MIN(pcb->snd_wnd, (u32_t)pcb->cwnd + pcb->sacked);
+#else /* LWIP_TCP_SACK_IN */
   wnd = LWIP_MIN(pcb->snd_wnd, pcb->cwnd);
+#endif /* LWIP_TCP_SACK_IN */
+#if LWIP_TCP_UNDO
+  if (pcb->undo_flags & TCP_FRTO_STEP3) {
+    /* F-RTO sends up to two new segments whatever cwnd (RFC 5682, step 2b) */
+    wnd = LWIP_MAX(wnd, LWIP_MIN(pcb->snd_wnd, pcb->undo_high - pcb->lastack + 2U * pcb->mss));
+  }
+#endif /* LWIP_TCP_UNDO */
 
   seg = pcb->unsent;
 
@@ -1333,11 +1436,6 @@ tcp_output(struct tcp_pcb *pcb)
   /* Stop persist timer, above conditions are not active */
   pcb->persist_backoff = 0;
 
-  /* useg should point to last segment on unacked queue */
-  useg = pcb->unacked;
-  if (useg != NULL) {
-    for (; useg->next != NULL; useg = useg->next);
-  }
   /* data available and window allows it to be sent? */
   while (seg != NULL &&
          lwip_ntohl(seg->tcphdr->seqno) - pcb->lastack + seg->len <= wnd) {
@@ -1349,11 +1447,21 @@ tcp_output(struct tcp_pcb *pcb)
      * - if FIN was already enqueued for this PCB (SYN is always alone in a segment -
      *   either seg->next != NULL or pcb->unacked == NULL;
      *   RST is no sent using tcp_write/tcp_output.
+     * - for segments sent as part of a super-segment already
      */
-    if ((tcp_do_output_nagle(pcb) == 0) &&
+    if ((tso_left == 0) && (tcp_do_output_nagle(pcb) == 0) &&
         ((pcb->flags & (TF_NAGLEMEMERR | TF_FIN)) == 0)) {
       break;
     }
+#if LWIP_TCP_PACING
+    if ((tso_left == 0) && !tcp_pacing_can_send(pcb)) {
+      /* the pacing timer calls tcp_output() again; an ACK can't wait for it */
+      if (pcb->flags & TF_ACK_NOW) {
+        tcp_send_empty_ack(pcb);
+      }
+      break;
+    }
+#endif /* LWIP_TCP_PACING */
 #if TCP_CWND_DEBUG
     LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_output: snd_wnd %"TCPWNDSIZE_F", cwnd %"TCPWNDSIZE_F", wnd %"U32_F", effwnd %"U32_F", seq %"U32_F", ack %"U32_F", i %"S16_F"\n",
                                  pcb->snd_wnd, pcb->cwnd, wnd,
@@ -1367,22 +1475,53 @@ tcp_output(struct tcp_pcb *pcb)
       TCPH_SET_FLAG(seg->tcphdr, TCP_ACK);
     }
 
-    err = tcp_output_segment(seg, pcb, netif);
-    if (err != ERR_OK) {
-      /* segment could not be sent, for whatever reason */
-      tcp_set_flags(pcb, TF_NAGLEMEMERR);
-      return err;
+    if (tso_left > 0) {
+      /* this segment went out with the super-segment already */
+      tso_left--;
+    } else {
+#if LWIP_TCP_TSO
+      tso_left = tcp_tso_segs(pcb, seg, wnd, netif);
+#endif /* LWIP_TCP_TSO */
+      err = tcp_output_segment(seg, pcb, netif, tso_left);
+      if ((err == ERR_MEM) && (tso_left > 0)) {
+        /* no memory for the super-segment, try the segment on its own */
+        tso_left = 0;
+        err = tcp_output_segment(seg, pcb, netif, 0);
+      }
+      if (err != ERR_OK) {
+        /* segment could not be sent, for whatever reason */
+        tcp_set_flags(pcb, TF_NAGLEMEMERR);
+        return err;
+      }
     }
 #if TCP_OVERSIZE_DBGCHECK
     seg->oversize_left = 0;
 #endif /* TCP_OVERSIZE_DBGCHECK */
     pcb->unsent = seg->next;
+    if (pcb->unsent == NULL) {
+      pcb->last_unsent = NULL;
+    }
     if (pcb->state != SYN_SENT) {
       tcp_clear_flags(pcb, TF_ACK_DELAY | TF_ACK_NOW);
     }
+#if LWIP_TCP_PRR
+    if (pcb->flags & TF_INFR) {
+      pcb->prr_out += TCP_TCPLEN(seg);
+    }
+#endif /* LWIP_TCP_PRR */
+#if LWIP_TCP_UNDO
+    if ((pcb->undo_flags & TCP_UNDO_PENDING) &&
+        TCP_SEQ_LT(lwip_ntohl(seg->tcphdr->seqno), pcb->snd_nxt)) {
+      /* a retransmission: D-SACKs have to cover it to undo */
+      pcb->undo_retrans += TCP_TCPLEN(seg);
+    }
+#endif /* LWIP_TCP_UNDO */
     snd_nxt = lwip_ntohl(seg->tcphdr->seqno) + TCP_TCPLEN(seg);
     if (TCP_SEQ_LT(pcb->snd_nxt, snd_nxt)) {
       pcb->snd_nxt = snd_nxt;
+#if LWIP_TCP_RACK
+      sent_new = 1;
+#endif /* LWIP_TCP_RACK */
     }
     /* put segment on unacknowledged list if length > 0 */
     if (TCP_TCPLEN(seg) > 0) {
@@ -1393,28 +1532,50 @@ tcp_output(struct tcp_pcb *pcb)
         seg->snd_timestamp = pcb->lsndtime;
       }
       seg->snd_time++;
+#if LWIP_TCP_RACK || LWIP_TCP_RATE_SAMPLE
+      /* RACK orders deliveries by the time of the latest transmission */
+      seg->xmit_ts = pcb->lsndtime;
+#endif /* LWIP_TCP_RACK || LWIP_TCP_RATE_SAMPLE */
+#if LWIP_TCP_RACK
+      seg->flags &= (u8_t)~TF_SEG_LOST;
+#endif /* LWIP_TCP_RACK */
+#if LWIP_TCP_RATE_SAMPLE
+      tcp_rate_seg_sent(pcb, seg);
+#endif /* LWIP_TCP_RATE_SAMPLE */
+#if LWIP_TCP_PACING
+      tcp_pacing_sent(pcb, TCP_TCPLEN(seg));
+#endif /* LWIP_TCP_PACING */
       /* unacked list is empty? */
       if (pcb->unacked == NULL) {
         pcb->unacked = seg;
-        useg = seg;
+        TCP_UNACKED_LINK(pcb, seg);
+        pcb->last_unacked = seg;
         /* unacked list is not empty? */
       } else {
         /* In the case of fast retransmit, the packet should not go to the tail
          * of the unacked queue, but rather somewhere before it. We need to check for
          * this case. -STJ Jul 27, 2004 */
-        if (TCP_SEQ_LT(lwip_ntohl(seg->tcphdr->seqno), lwip_ntohl(useg->tcphdr->seqno))) {
+        if (TCP_SEQ_LT(lwip_ntohl(seg->tcphdr->seqno), lwip_ntohl(pcb->last_unacked->tcphdr->seqno))) {
           /* add segment to before tail of unacked list, keeping the list sorted */
           struct tcp_seg **cur_seg = &(pcb->unacked);
+#if TCP_UNACKED_TREE
+          struct tcp_seg *prev = tcp_seg_tree_find(pcb->unacked_tree, lwip_ntohl(seg->tcphdr->seqno));
+          if (prev != NULL) {
+            cur_seg = &prev->next;
+          }
+#endif /* TCP_UNACKED_TREE */
           while (*cur_seg &&
                  TCP_SEQ_LT(lwip_ntohl((*cur_seg)->tcphdr->seqno), lwip_ntohl(seg->tcphdr->seqno))) {
             cur_seg = &((*cur_seg)->next );
           }
           seg->next = (*cur_seg);
           (*cur_seg) = seg;
+          TCP_UNACKED_LINK(pcb, seg);
         } else {
           /* add segment to tail of unacked list */
-          useg->next = seg;
-          useg = useg->next;
+          pcb->last_unacked->next = seg;
+          TCP_UNACKED_LINK(pcb, seg);
+          pcb->last_unacked = seg;
         }
       }
       /* do not queue empty segments on the unacked list */
@@ -1432,11 +1593,55 @@ tcp_output(struct tcp_pcb *pcb)
 #endif /* TCP_OVERSIZE */
 
 output_done:
+#if LWIP_TCP_SACK_IN
+  pcb->is_cwnd_limited = (wnd == (u32_t)pcb->cwnd + pcb->sacked) && (pcb->unsent != NULL);
+#else /* LWIP_TCP_SACK_IN */
   pcb->is_cwnd_limited = (wnd == pcb->cwnd) && (pcb->unsent != NULL);
+#endif /* LWIP_TCP_SACK_IN */
+#if LWIP_TCP_RACK
+  if (sent_new) {
+    tcp_rack_arm_pto(pcb);
+  }
+#endif /* LWIP_TCP_RACK */
   tcp_clear_flags(pcb, TF_NAGLEMEMERR);
   return ERR_OK;
 }
 
+/**
+ * @ingroup tcp_raw
+ * Find out what we can send and send it
+ *
+ * @param pcb Protocol control block for the TCP connection to send data
+ * @return ERR_OK if data has been sent or nothing to send
+ *         another err_t on error
+ */
+err_t
+tcp_output(struct tcp_pcb *pcb)
+{
+  err_t err;
+
+  LWIP_ASSERT_CORE_LOCKED();
+
+  LWIP_ASSERT("tcp_output: invalid pcb", pcb != NULL);
+  /* pcb->state LISTEN not allowed here */
+  LWIP_ASSERT("don't call tcp_output for listen-pcbs",
+              pcb->state != LISTEN);
+
+  /* First, check if we are invoked by the TCP input processing
+     code. If so, we do not output anything. Instead, we rely on the
+     input processing code to call us when input processing is done
+     with. */
+  if (tcp_input_pcb == pcb) {
+    return ERR_OK;
+  }
+
+  TCP_TIMER_KICK(pcb);
+  err = tcp_output_unsent(pcb);
+  /* a started retransmission or persist timer, or data left to send */
+  TCP_TIMER_UPDATE(pcb);
+  return err;
+}
+
 /** Check if a segment's pbufs are used by someone else than TCP.
  * This can happen on retransmission if the pbuf of this segment is still
  * referenced by the netif driver due to deferred transmission.
@@ -1462,19 +1667,53 @@ tcp_output_segment_busy(const struct tcp_seg *seg)
   return 0;
 }
 
+#if LWIP_TCP_ECN
+/**
+ * Set the ECN bits of a segment that is about to be sent.
+ *
+ * @param pcb the tcp_pcb sending the segment
+ * @param seg the segment to send
+ * @return the IP TOS byte to send the segment with
+ */
+static u8_t
+tcp_ecn_output(struct tcp_pcb *pcb, struct tcp_seg *seg)
+{
+  if (!(pcb->ecn_flags & TCP_ECN_OK) || (TCPH_FLAGS(seg->tcphdr) & TCP_SYN)) {
+    /* SYNs carry the ECN setup flags from tcp_enqueue_flags() and are never ECT */
+    return pcb->tos;
+  }
+  TCPH_UNSET_FLAG(seg->tcphdr, TCP_ECE | TCP_CWR);
+  if (pcb->ecn_flags & TCP_ECN_DEMAND_CWR) {
+    TCPH_SET_FLAG(seg->tcphdr, TCP_ECE);
+  }
+  if ((seg->len == 0) || (seg->snd_time != 0)) {
+    /* pure ACKs, FINs and retransmissions must not be ECN-capable */
+    return pcb->tos;
+  }
+  if (pcb->ecn_flags & TCP_ECN_QUEUE_CWR) {
+    pcb->ecn_flags &= (u8_t)~TCP_ECN_QUEUE_CWR;
+    TCPH_SET_FLAG(seg->tcphdr, TCP_CWR);
+  }
+  return (u8_t)((pcb->tos & ~IP_ECN_MASK) | IP_ECN_ECT0);
+}
+#endif /* LWIP_TCP_ECN */
+
 /**
  * Called by tcp_output() to actually send a TCP segment over IP.
  *
  * @param seg the tcp_seg to send
  * @param pcb the tcp_pcb for the TCP connection used to send the segment
  * @param netif the netif used to send the segment
+ * @param tso_segs number of segments following seg to send with it as one
+ *        super-segment (LWIP_TCP_TSO), 0 to send seg alone
  */
 static err_t
-tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif)
+tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif, u16_t tso_segs)
 {
   err_t err;
   u16_t len;
   u32_t *opts;
+  u8_t tos;
 #if TCP_CHECKSUM_ON_COPY
   int seg_chksum_was_swapped = 0;
 #endif
@@ -1508,6 +1747,12 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif
 
   pcb->rcv_ann_right_edge = pcb->rcv_nxt + pcb->rcv_ann_wnd;
 
+#if LWIP_TCP_ECN
+  tos = tcp_ecn_output(pcb, seg);
+#else /* LWIP_TCP_ECN */
+  tos = pcb->tos;
+#endif /* LWIP_TCP_ECN */
+
   /* Add any requested options.  NB MSS option is only set on SYN
      packets, so ignore it here */
   /* cast through void* to get rid of alignment warnings */
@@ -1581,6 +1826,16 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif
 #endif
   LWIP_ASSERT("options not filled", (u8_t *)opts == ((u8_t *)(seg->tcphdr + 1)) + LWIP_TCP_OPT_LENGTH_SEGMENT(seg->flags, pcb));
 
+#if LWIP_TCP_TSO
+  if (tso_segs > 0) {
+    /* the checksums are computed per frame by the netif or by tcp_gso_output() */
+    TCP_STATS_INC(tcp.xmit);
+    return tcp_tso_output_segment(pcb, seg, tso_segs, tos, netif);
+  }
+#else /* LWIP_TCP_TSO */
+  LWIP_UNUSED_ARG(tso_segs);
+#endif /* LWIP_TCP_TSO */
+
 #if CHECKSUM_GEN_TCP
   IF__NETIF_CHECKSUM_ENABLED(netif, NETIF_CHECKSUM_GEN_TCP) {
 #if TCP_CHECKSUM_ON_COPY
@@ -1623,7 +1878,7 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif
 
   NETIF_SET_HINTS(netif, &(pcb->netif_hints));
   err = ip_output_if(seg->p, &pcb->local_ip, &pcb->remote_ip, pcb->ttl,
-                     pcb->tos, IP_PROTO_TCP, netif);
+                     tos, IP_PROTO_TCP, netif);
   NETIF_RESET_HINTS(netif);
 
 #if TCP_CHECKSUM_ON_COPY
@@ -1649,6 +1904,9 @@ err_t
 tcp_rexmit_rto_prepare(struct tcp_pcb *pcb)
 {
   struct tcp_seg *seg;
+#if LWIP_TCP_SACK_IN
+  struct tcp_seg *sseg;
+#endif /* LWIP_TCP_SACK_IN */
 
   LWIP_ASSERT("tcp_rexmit_rto_prepare: invalid pcb", pcb != NULL);
 
@@ -1670,6 +1928,20 @@ tcp_rexmit_rto_prepare(struct tcp_pcb *pcb)
     LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_rexmit_rto: segment busy\n"));
     return ERR_VAL;
   }
+#if LWIP_TCP_SACK_IN
+  /* The remote host may renege on SACKed data: after a timeout everything
+     is resent and loss recovery is over (RFC 6675, section 5.1). */
+  for (sseg = pcb->unacked; sseg != NULL; sseg = sseg->next) {
+    sseg->flags &= (u8_t)~(TF_SEG_SACKED | TF_SEG_LOST);
+  }
+  pcb->sacked = 0;
+  tcp_clear_flags(pcb, TF_INFR);
+#endif /* LWIP_TCP_SACK_IN */
+#if LWIP_TCP_RACK
+  /* the retransmission timeout ends a probe episode, the reordering timer
+     has nothing left to detect */
+  pcb->rack_flags &= (u8_t)~(TLP_PROBING | TLP_RXT | RACK_TMR_REO | RACK_TMR_PTO);
+#endif /* LWIP_TCP_RACK */
   /* concatenate unsent queue after unacked queue */
   seg->next = pcb->unsent;
 #if TCP_OVERSIZE_DBGCHECK
@@ -1678,10 +1950,15 @@ tcp_rexmit_rto_prepare(struct tcp_pcb *pcb)
     pcb->unsent_oversize = seg->oversize_left;
   }
 #endif /* TCP_OVERSIZE_DBGCHECK */
+  if (pcb->unsent == NULL) {
+    pcb->last_unsent = seg;
+  }
   /* unsent queue is the concatenated queue (of unacked, unsent) */
   pcb->unsent = pcb->unacked;
   /* unacked queue is now empty */
   pcb->unacked = NULL;
+  pcb->last_unacked = NULL;
+  TCP_UNACKED_CLEAR(pcb);
 
   /* Mark RTO in-progress */
   tcp_set_flags(pcb, TF_RTO);
@@ -1731,6 +2008,120 @@ tcp_rexmit_rto(struct tcp_pcb *pcb)
   }
 }
 
+#if LWIP_TCP_UNDO
+/**
+ * Put the segments that tcp_rexmit_rto_prepare() moved to the unsent queue
+ * and that have not been sent again back on the unacked queue: after a
+ * spurious timeout, they are still in flight.
+ *
+ * Called by tcp_receive() in RTO recovery only, where the unacked queue holds
+ * the segments retransmitted so far, all below the ones put back.
+ *
+ * @param pcb the tcp_pcb for which to stop retransmitting
+ */
+void
+tcp_rexmit_rto_cancel(struct tcp_pcb *pcb)
+{
+  struct tcp_seg *seg;
+
+  LWIP_ASSERT("tcp_rexmit_rto_cancel: invalid pcb", pcb != NULL);
+
+  while (((seg = pcb->unsent) != NULL) &&
+         TCP_SEQ_LT(lwip_ntohl(seg->tcphdr->seqno), pcb->snd_nxt)) {
+    pcb->unsent = seg->next;
+    seg->next = NULL;
+    if (pcb->unacked == NULL) {
+      pcb->unacked = seg;
+    } else {
+      pcb->last_unacked->next = seg;
+    }
+    TCP_UNACKED_LINK(pcb, seg);
+    pcb->last_unacked = seg;
+  }
+  if (pcb->unsent == NULL) {
+    pcb->last_unsent = NULL;
+#if TCP_OVERSIZE
+    pcb->unsent_oversize = 0;
+#endif /* TCP_OVERSIZE */
+  }
+}
+
+/**
+ * Save cwnd and ssthresh before they are reduced for a retransmission, so
+ * that tcp_receive() can go back to them if the retransmission turns out
+ * spurious. A reduction before everything outstanding at the previous one
+ * has been ACKed belongs to the same episode and keeps what was saved then.
+ *
+ * Called by tcp_slowtmr() and tcp_rexmit_fast() before cong_ops->ssthresh().
+ *
+ * @param pcb the tcp_pcb that is about to reduce cwnd
+ * @param rto 1 for a retransmission timeout, which F-RTO (RFC 5682) checks,
+ *        0 for fast retransmit
+ */
+void
+tcp_undo_init(struct tcp_pcb *pcb, u8_t rto)
+{
+  LWIP_ASSERT("tcp_undo_init: invalid pcb", pcb != NULL);
+
+  if (pcb->state < ESTABLISHED) {
+    return;
+  }
+  if ((pcb->undo_flags & TCP_UNDO_PENDING) && TCP_SEQ_LT(pcb->lastack, pcb->undo_high)) {
+    /* a timeout during F-RTO: the original segments were lost after all */
+    pcb->undo_flags &= (u8_t)~(TCP_FRTO_STEP2 | TCP_FRTO_STEP3);
+    return;
+  }
+  pcb->prior_cwnd = pcb->cwnd;
+  pcb->prior_ssthresh = pcb->ssthresh;
+  pcb->undo_marker = pcb->lastack;
+  pcb->undo_high = pcb->snd_nxt;
+  pcb->undo_retrans = 0;
+  pcb->retrans_stamp = sys_now();
+  pcb->undo_flags = TCP_UNDO_PENDING;
+#if LWIP_TCP_TIMESTAMPS
+  if (pcb->flags & TF_TIMESTAMP) {
+    pcb->undo_flags |= TCP_UNDO_EIFEL;
+  }
+#endif /* LWIP_TCP_TIMESTAMPS */
+  /* only the first timeout, not one in fast recovery, which has
+     retransmitted already, and only while new data may still be sent */
+  if (rto && (pcb->nrtx == 0) &&
+      ((pcb->state == ESTABLISHED) || (pcb->state == CLOSE_WAIT))) {
+    pcb->undo_flags |= TCP_FRTO_STEP2;
+  }
+}
+#endif /* LWIP_TCP_UNDO */
+
+/**
+ * Insert a segment taken off the unacked queue into the unsent queue,
+ * keeping the unsent queue sorted.
+ *
+ * @param pcb the tcp_pcb the segment belongs to
+ * @param seg the segment to retransmit
+ */
+static void
+tcp_rexmit_enqueue(struct tcp_pcb *pcb, struct tcp_seg *seg)
+{
+  struct tcp_seg **cur_seg;
+
+  cur_seg = &(pcb->unsent);
+  while (*cur_seg &&
+         TCP_SEQ_LT(lwip_ntohl((*cur_seg)->tcphdr->seqno), lwip_ntohl(seg->tcphdr->seqno))) {
+    cur_seg = &((*cur_seg)->next );
+  }
+  seg->next = *cur_seg;
+  *cur_seg = seg;
+  if (seg->next == NULL) {
+    pcb->last_unsent = seg;
+  }
+#if TCP_OVERSIZE
+  if (seg->next == NULL) {
+    /* the retransmitted segment is last in unsent, so reset unsent_oversize */
+    pcb->unsent_oversize = 0;
+  }
+#endif /* TCP_OVERSIZE */
+}
+
 /**
  * Requeue the first unacked segment for retransmission
  *
@@ -1742,7 +2133,6 @@ err_t
 tcp_rexmit(struct tcp_pcb *pcb)
 {
   struct tcp_seg *seg;
-  struct tcp_seg **cur_seg;
 
   LWIP_ASSERT("tcp_rexmit: invalid pcb", pcb != NULL);
 
@@ -1760,22 +2150,19 @@ tcp_rexmit(struct tcp_pcb *pcb)
   }
 
   /* Move the first unacked segment to the unsent queue */
-  /* Keep the unsent queue sorted. */
+  TCP_UNACKED_UNLINK(pcb, seg);
   pcb->unacked = seg->next;
-
-  cur_seg = &(pcb->unsent);
-  while (*cur_seg &&
-         TCP_SEQ_LT(lwip_ntohl((*cur_seg)->tcphdr->seqno), lwip_ntohl(seg->tcphdr->seqno))) {
-    cur_seg = &((*cur_seg)->next );
+  if (pcb->unacked == NULL) {
+    pcb->last_unacked = NULL;
   }
-  seg->next = *cur_seg;
-  *cur_seg = seg;
-#if TCP_OVERSIZE
-  if (seg->next == NULL) {
-    /* the retransmitted segment is last in unsent, so reset unsent_oversize */
-    pcb->unsent_oversize = 0;
+#if LWIP_TCP_SACK_IN
+  if (seg->flags & TF_SEG_SACKED) {
+    /* the remote host reneged on its SACK, take the segment off the scoreboard */
+    seg->flags &= (u8_t)~TF_SEG_SACKED;
+    pcb->sacked = (tcpwnd_size_t)(pcb->sacked - TCP_TCPLEN(seg));
   }
-#endif /* TCP_OVERSIZE */
+#endif /* LWIP_TCP_SACK_IN */
+  tcp_rexmit_enqueue(pcb, seg);
 
   if (pcb->nrtx < 0xFF) {
     ++pcb->nrtx;
@@ -1791,10 +2178,125 @@ tcp_rexmit(struct tcp_pcb *pcb)
   return ERR_OK;
 }
 
+#if LWIP_TCP_RACK
+/**
+ * Requeue one segment of the unacked queue for retransmission
+ *
+ * Called for the tail loss probe, which must not count as a retransmission
+ * timeout: pcb->nrtx is left alone.
+ *
+ * @param pcb the tcp_pcb for which to retransmit the segment
+ * @param seg the segment on pcb->unacked to retransmit
+ * @return ERR_OK if the segment was moved to the unsent queue,
+ *         ERR_VAL if it is not on the unacked queue or still in use
+ */
+err_t
+tcp_rexmit_seg(struct tcp_pcb *pcb, struct tcp_seg *seg)
+{
+  struct tcp_seg **pseg, *prev;
+
+  LWIP_ASSERT("tcp_rexmit_seg: invalid pcb", pcb != NULL);
+  LWIP_ASSERT("tcp_rexmit_seg: invalid seg", seg != NULL);
+
+#if TCP_UNACKED_TREE
+  LWIP_ERROR("tcp_rexmit_seg: segment not unacked",
+             tcp_seg_tree_find(pcb->unacked_tree, lwip_ntohl(seg->tcphdr->seqno)) == seg,
+             return ERR_VAL);
+  prev = tcp_seg_tree_prev(seg);
+  pseg = (prev != NULL) ? &prev->next : &pcb->unacked;
+#else /* TCP_UNACKED_TREE */
+  for (prev = NULL, pseg = &pcb->unacked; *pseg != NULL && *pseg != seg;
+       prev = *pseg, pseg = &(*pseg)->next);
+  LWIP_ERROR("tcp_rexmit_seg: segment not unacked", *pseg != NULL, return ERR_VAL);
+#endif /* TCP_UNACKED_TREE */
+
+  if (tcp_output_segment_busy(seg)) {
+    LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_rexmit_seg busy\n"));
+    return ERR_VAL;
+  }
+
+  TCP_UNACKED_UNLINK(pcb, seg);
+  *pseg = seg->next;
+  if (seg == pcb->last_unacked) {
+    pcb->last_unacked = prev;
+  }
+  if (seg->flags & TF_SEG_SACKED) {
+    seg->flags &= (u8_t)~TF_SEG_SACKED;
+    pcb->sacked = (tcpwnd_size_t)(pcb->sacked - TCP_TCPLEN(seg));
+  }
+  tcp_rexmit_enqueue(pcb, seg);
+
+  /* Don't take any rtt measurements after retransmitting. */
+  pcb->rttest = 0;
+
+  MIB2_STATS_INC(mib2.tcpretranssegs);
+  return ERR_OK;
+}
+#endif /* LWIP_TCP_RACK */
+
+
+#if LWIP_TCP_PRR
+/**
+ * Proportional Rate Reduction (RFC 6937): set cwnd so that sndcnt more bytes
+ * may be sent on this ACK.
+ *
+ * While pipe is above ssthresh, the bytes sent in recovery are kept at
+ * ssthresh / RecoverFS of the bytes delivered. Once losses have let pipe fall
+ * below ssthresh, it grows back to ssthresh by at most one MSS more than was
+ * delivered (slow start reduction bound).
+ *
+ * @param pcb the tcp_pcb in fast recovery
+ * @param pipe the bytes estimated to be in the network
+ * @param base the bytes cwnd is compared against before sending
+ */
+static void
+tcp_prr_update(struct tcp_pcb *pcb, u32_t pipe, u32_t base)
+{
+  u32_t sndcnt, limit;
+
+  if (pipe > pcb->ssthresh) {
+    sndcnt = (u32_t)(((u64_t)pcb->prr_delivered * pcb->ssthresh + pcb->recover_fs - 1) /
+                     pcb->recover_fs);
+    sndcnt = (sndcnt > pcb->prr_out) ? (sndcnt - pcb->prr_out) : 0;
+  } else {
+    limit = (pcb->prr_delivered > pcb->prr_out) ? (pcb->prr_delivered - pcb->prr_out) : 0;
+    limit = LWIP_MAX(limit, pcb->prr_acked) + pcb->mss;
+    sndcnt = LWIP_MIN(pcb->ssthresh - pipe, limit);
+  }
+  pcb->cwnd = (tcpwnd_size_t)LWIP_MIN(base + sndcnt, (tcpwnd_size_t)-1);
+  LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_prr_update: pipe %"U32_F", delivered %"U32_F
+                               ", out %"U32_F", cwnd %"TCPWNDSIZE_F"\n",
+                               pipe, pcb->prr_delivered, pcb->prr_out, pcb->cwnd));
+}
+
+/**
+ * PRR without SACK: every duplicate ACK stands for one MSS that has left the
+ * network. tcp_output() counts everything above lastack against cwnd.
+ */
+static void
+tcp_prr_dupack(struct tcp_pcb *pcb)
+{
+  u32_t outstanding = pcb->snd_nxt - pcb->lastack;
+  u32_t left = (u32_t)pcb->dupacks * pcb->mss;
+
+  tcp_prr_update(pcb, (outstanding > left) ? (outstanding - left) : 0, outstanding);
+}
+
+/** Start PRR when fast recovery is entered */
+static void
+tcp_prr_init(struct tcp_pcb *pcb)
+{
+  pcb->prr_out = 0;
+  pcb->recover_fs = pcb->snd_nxt - pcb->lastack;
+}
+#endif /* LWIP_TCP_PRR */
 
 /**
  * Handle retransmission after three dupacks received
  *
+ * With LWIP_TCP_PRR, tcp_receive() accounts the data delivered by the ACK in
+ * pcb->prr_delivered before calling this.
+ *
  * @param pcb the tcp_pcb for which to retransmit the first unacked segment
  */
 void
@@ -1802,6 +2304,39 @@ tcp_rexmit_fast(struct tcp_pcb *pcb)
 {
   LWIP_ASSERT("tcp_rexmit_fast: invalid pcb", pcb != NULL);
 
+#if LWIP_TCP_SACK_IN
+  if ((pcb->flags & TF_SACK) && pcb->unacked != NULL) {
+    if (!(pcb->flags & TF_INFR)) {
+      /* Enter loss recovery (RFC 6675, section 5): cwnd is not inflated by
+         dupacks since SACKed bytes are already counted out of the pipe */
+      LWIP_DEBUGF(TCP_FR_DEBUG,
+                  ("tcp_receive: dupacks %"U16_F" (%"U32_F
+                   "), SACK recovery, %"TCPWNDSIZE_F" bytes SACKed\n",
+                   (u16_t)pcb->dupacks, pcb->lastack, pcb->sacked));
+#if LWIP_TCP_UNDO
+      tcp_undo_init(pcb, 0);
+#endif /* LWIP_TCP_UNDO */
+      pcb->ssthresh = pcb->cong_ops->ssthresh(pcb);
+#if LWIP_TCP_PRR
+      /* tcp_rexmit_sack() sets cwnd */
+      tcp_prr_init(pcb);
+#else /* LWIP_TCP_PRR */
+      pcb->cwnd = pcb->ssthresh;
+#endif /* LWIP_TCP_PRR */
+      pcb->recover = pcb->snd_nxt;
+      pcb->high_rxt = pcb->lastack;
+      tcp_set_flags(pcb, TF_INFR);
+      tcp_rexmit_sack(pcb, 1);
+
+      /* Reset the retransmission timer to prevent immediate rto retransmissions */
+      pcb->rtime = 0;
+    } else {
+      tcp_rexmit_sack(pcb, 0);
+    }
+    return;
+  }
+#endif /* LWIP_TCP_SACK_IN */
+
   if (pcb->unacked != NULL && !(pcb->flags & TF_INFR)) {
     /* This is fast retransmit. Retransmit the first unacked segment. */
     LWIP_DEBUGF(TCP_FR_DEBUG,
@@ -1822,15 +2357,144 @@ tcp_rexmit_fast(struct tcp_pcb *pcb)
                      pcb->ssthresh, (u16_t)(2 * pcb->mss)));
         pcb->ssthresh = 2 * pcb->mss;
       } */
+#if LWIP_TCP_UNDO
+      tcp_undo_init(pcb, 0);
+#endif /* LWIP_TCP_UNDO */
       pcb->ssthresh = pcb->cong_ops->ssthresh(pcb);
+#if LWIP_TCP_PRR
+      tcp_prr_init(pcb);
+      tcp_prr_dupack(pcb);
+#else /* LWIP_TCP_PRR */
       pcb->cwnd = pcb->ssthresh + 3 * pcb->mss;
+#endif /* LWIP_TCP_PRR */
       tcp_set_flags(pcb, TF_INFR);
 
       /* Reset the retransmission timer to prevent immediate rto retransmissions */
       pcb->rtime = 0;
     }
+#if LWIP_TCP_PRR
+  } else if ((pcb->unacked != NULL) && (pcb->flags & TF_INFR)) {
+    /* instead of inflating cwnd by one MSS */
+    tcp_prr_dupack(pcb);
+#endif /* LWIP_TCP_PRR */
+  }
+}
+
+#if LWIP_TCP_SACK_IN
+#if LWIP_TCP_RACK
+#define TCP_SEG_RACK_LOST(seg)  ((seg)->flags & TF_SEG_LOST)
+#else /* LWIP_TCP_RACK */
+#define TCP_SEG_RACK_LOST(seg)  0
+#endif /* LWIP_TCP_RACK */
+
+/**
+ * Retransmit the missing ranges of the SACK scoreboard during loss recovery.
+ *
+ * Implements SetPipe() and NextSeg() of RFC 6675 over pcb->unacked: a segment
+ * that is not SACKed is lost once more than (DupThresh - 1) * SMSS bytes above
+ * it have been SACKed, or when RACK has marked it lost. Lost segments that were
+ * not yet retransmitted in this recovery are moved to the unsent queue as long
+ * as cwnd allows.
+ *
+ * Called by tcp_receive() for duplicate and partial ACKs, tcp_output() is
+ * invoked once input processing is done.
+ *
+ * @param pcb the tcp_pcb in loss recovery
+ * @param head_lost the first unacked segment is presumed lost even without
+ *        enough SACK information (entering recovery or partial ACK)
+ */
+void
+tcp_rexmit_sack(struct tcp_pcb *pcb, u8_t head_lost)
+{
+  struct tcp_seg *seg, **pseg, *prev;
+  u32_t pipe, sacked_below, seq, len, lost_thresh;
+  u8_t lost, sent = 0;
+
+  LWIP_ASSERT("tcp_rexmit_sack: invalid pcb", pcb != NULL);
+
+  lost_thresh = 2U * pcb->mss;
+
+  /* SetPipe(): bytes not SACKed and not lost, plus bytes retransmitted */
+  pipe = 0;
+  sacked_below = 0;
+  for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+    len = TCP_TCPLEN(seg);
+    if (seg->flags & TF_SEG_SACKED) {
+      sacked_below += len;
+      continue;
+    }
+    if ((pcb->sacked - sacked_below <= lost_thresh) && !TCP_SEG_RACK_LOST(seg)) {
+      pipe += len;
+    }
+    if (TCP_SEQ_LT(lwip_ntohl(seg->tcphdr->seqno), pcb->high_rxt) && !TCP_SEG_RACK_LOST(seg)) {
+      pipe += len;
+    }
+  }
+#if LWIP_TCP_PRR
+  /* cwnd = pipe + sndcnt, SACKed bytes are not counted against it */
+  tcp_prr_update(pcb, pipe, pipe);
+#endif /* LWIP_TCP_PRR */
+
+  /* NextSeg() rule 1: the lowest lost segment not retransmitted yet */
+  sacked_below = 0;
+  pseg = &pcb->unacked;
+  prev = NULL;
+  while ((seg = *pseg) != NULL) {
+    len = TCP_TCPLEN(seg);
+    seq = lwip_ntohl(seg->tcphdr->seqno);
+    if (seg->flags & TF_SEG_SACKED) {
+      sacked_below += len;
+    } else if (TCP_SEQ_GEQ(seq, pcb->high_rxt) || TCP_SEG_RACK_LOST(seg)) {
+      lost = (pcb->sacked - sacked_below > lost_thresh) ||
+             (head_lost && (seg == pcb->unacked)) || TCP_SEG_RACK_LOST(seg);
+      if (!lost) {
+#if LWIP_TCP_RACK
+        /* RACK may have marked segments above this one lost */
+        prev = seg;
+        pseg = &seg->next;
+        continue;
+#else /* LWIP_TCP_RACK */
+        /* nothing above this can be lost either */
+        break;
+#endif /* LWIP_TCP_RACK */
+      }
+      /* the first retransmission in recovery does not wait for cwnd */
+      if ((sent || !head_lost) && (pipe + len > pcb->cwnd)) {
+        break;
+      }
+      if (tcp_output_segment_busy(seg)) {
+        LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_rexmit_sack busy\n"));
+        break;
+      }
+      LWIP_DEBUGF(TCP_FR_DEBUG, ("tcp_rexmit_sack: retransmit %"U32_F":%"U32_F"\n",
+                                 seq, seq + len));
+      TCP_UNACKED_UNLINK(pcb, seg);
+      *pseg = seg->next;
+      if (seg == pcb->last_unacked) {
+        pcb->last_unacked = prev;
+      }
+      tcp_rexmit_enqueue(pcb, seg);
+      if (TCP_SEQ_GT(seq + len, pcb->high_rxt)) {
+        pcb->high_rxt = seq + len;
+      }
+      pipe += len;
+      sent = 1;
+      MIB2_STATS_INC(mib2.tcpretranssegs);
+      continue;
+    }
+    prev = seg;
+    pseg = &seg->next;
+  }
+
+  if (sent) {
+    if (pcb->nrtx < 0xFF) {
+      ++pcb->nrtx;
+    }
+    /* Don't take any rtt measurements after retransmitting. */
+    pcb->rttest = 0;
   }
 }
+#endif /* LWIP_TCP_SACK_IN */
 
 static struct pbuf *
 tcp_output_alloc_header_common(u32_t ackno, u16_t optlen, u16_t datalen,
@@ -1872,11 +2536,18 @@ tcp_output_alloc_header(struct tcp_pcb *pcb, u16_t optlen, u16_t datalen,
                         u32_t seqno_be /* already in network byte order */)
 {
   struct pbuf *p;
+  u8_t flags = TCP_ACK;
 
   LWIP_ASSERT("tcp_output_alloc_header: invalid pcb", pcb != NULL);
 
+#if LWIP_TCP_ECN
+  if (pcb->ecn_flags & TCP_ECN_DEMAND_CWR) {
+    /* keep echoing the congestion mark until the sender has reacted */
+    flags |= TCP_ECE;
+  }
+#endif /* LWIP_TCP_ECN */
   p = tcp_output_alloc_header_common(pcb->rcv_nxt, optlen, datalen,
-    seqno_be, pcb->local_port, pcb->remote_port, TCP_ACK,
+    seqno_be, pcb->local_port, pcb->remote_port, flags,
     TCPWND_MIN16(RCV_WND_SCALE(pcb, pcb->rcv_ann_wnd)));
   if (p != NULL) {
     /* If we're sending a packet, update the announced right window edge */
@@ -2091,6 +2762,144 @@ tcp_rst_netif(struct netif *netif, u32_t seqno, u32_t ackno,
   }
 }
 
+#if LWIP_TCP_SYNCOOKIES || LWIP_TCP_REQ_TABLE
+/**
+ * Send a SYN|ACK for a connection request that is kept in a SYN cookie or
+ * in the request table instead of a pcb.
+ *
+ * Called by tcp_listen_input() when the listen backlog is full or no pcb
+ * can be allocated, and for the requests in the request table.
+ *
+ * @param netif the netif on which to send the SYN|ACK (since we have no pcb)
+ * @param hs the connection request
+ * @param local_ip the local IP address to send the segment from
+ * @param remote_ip the remote IP address to send the segment to
+ * @param local_port the local TCP port to send the segment from
+ * @param remote_port the remote TCP port to send the segment to
+ */
+void
+tcp_synack_netif(struct netif *netif, const struct tcp_handshake *hs,
+                 const ip_addr_t *local_ip, const ip_addr_t *remote_ip,
+                 u16_t local_port, u16_t remote_port)
+{
+  struct pbuf *p;
+  u32_t *opts;
+  u16_t mss;
+  u8_t flags = TCP_SYN | TCP_ACK;
+
+  if (netif == NULL) {
+    LWIP_DEBUGF(TCP_OUTPUT_DEBUG, ("tcp_synack_netif: no netif given\n"));
+    return;
+  }
+#if LWIP_TCP_ECN
+  if (hs->ecn) {
+    /* ECN-setup SYN-ACK */
+    flags |= TCP_ECE;
+  }
+#endif /* LWIP_TCP_ECN */
+  /* the window in a SYN segment is never scaled */
+  p = tcp_output_alloc_header_common(hs->irs + 1, LWIP_TCP_OPT_LENGTH(hs->optflags), 0,
+    lwip_htonl(hs->iss), local_port, remote_port, flags, TCPWND_MIN16(TCP_RCV_WND_INIT));
+  if (p == NULL) {
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_synack_netif: could not allocate memory for pbuf\n"));
+    return;
+  }
+
+  /* same options in the same order as tcp_output_segment() */
+  opts = (u32_t *)(void *)((struct tcp_hdr *)p->payload + 1);
+#if TCP_CALCULATE_EFF_SEND_MSS
+  mss = tcp_eff_send_mss_netif(TCP_MSS, netif, remote_ip);
+#else /* TCP_CALCULATE_EFF_SEND_MSS */
+  mss = TCP_MSS;
+#endif /* TCP_CALCULATE_EFF_SEND_MSS */
+  *(opts++) = TCP_BUILD_MSS_OPTION(mss);
+#if LWIP_TCP_TIMESTAMPS
+  if (hs->optflags & TF_SEG_OPTS_TS) {
+    *(opts++) = PP_HTONL(0x0101080A);
+    *(opts++) = lwip_htonl(hs->ts_val);
+    *(opts++) = lwip_htonl(hs->ts_recent);
+  }
+#endif /* LWIP_TCP_TIMESTAMPS */
+#if LWIP_WND_SCALE
+  if (hs->optflags & TF_SEG_OPTS_WND_SCALE) {
+    tcp_build_wnd_scale_option(opts++);
+  }
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK_OUT
+  if (hs->optflags & TF_SEG_OPTS_SACK_PERM) {
+    *(opts++) = PP_HTONL(0x01010402);
+  }
+#endif /* LWIP_TCP_SACK_OUT */
+  LWIP_ASSERT("options not filled", (u8_t *)opts ==
+              (u8_t *)((struct tcp_hdr *)p->payload + 1) + LWIP_TCP_OPT_LENGTH(hs->optflags));
+  LWIP_UNUSED_ARG(opts); /* for LWIP_NOASSERT */
+
+  LWIP_DEBUGF(TCP_OUTPUT_DEBUG, ("tcp_synack_netif: iss %"U32_F" mss %"U16_F"\n", hs->iss, hs->mss));
+  tcp_output_control_segment_netif(NULL, p, local_ip, remote_ip, netif);
+}
+#endif /* LWIP_TCP_SYNCOOKIES || LWIP_TCP_REQ_TABLE */
+
+#if LWIP_TCP_TW_TABLE
+/**
+ * Send an ACK for a connection in TIME_WAIT that is kept in a record
+ * instead of a pcb, as tcp_send_empty_ack() would have for the pcb.
+ *
+ * Called by tcp_input() for segments that match a TIME_WAIT record.
+ *
+ * @param tw the TIME_WAIT record
+ */
+void
+tcp_tw_ack(const struct tcp_tw *tw)
+{
+  struct pbuf *p;
+  struct netif *netif;
+  u8_t optflags = 0;
+
+  if (tw->netif_idx != NETIF_NO_INDEX) {
+    netif = netif_get_by_index(tw->netif_idx);
+  } else {
+    netif = ip_route(&tw->local_ip, &tw->remote_ip);
+  }
+  if (netif == NULL) {
+    LWIP_DEBUGF(TCP_OUTPUT_DEBUG, ("tcp_tw_ack: no route\n"));
+    return;
+  }
+#if LWIP_TCP_TIMESTAMPS
+  if (tw->ts) {
+    optflags = TF_SEG_OPTS_TS;
+  }
+#endif /* LWIP_TCP_TIMESTAMPS */
+
+  p = tcp_output_alloc_header_common(tw->rcv_nxt, LWIP_TCP_OPT_LENGTH(optflags), 0,
+    lwip_htonl(tw->snd_nxt), tw->local_port, tw->remote_port, TCP_ACK, tw->wnd);
+  if (p == NULL) {
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_tw_ack: could not allocate memory for pbuf\n"));
+    return;
+  }
+#if LWIP_TCP_TIMESTAMPS
+  if (optflags & TF_SEG_OPTS_TS) {
+    u32_t *opts = (u32_t *)(void *)((struct tcp_hdr *)p->payload + 1);
+    opts[0] = PP_HTONL(0x0101080A);
+    opts[1] = lwip_htonl(sys_now());
+    opts[2] = lwip_htonl(tw->ts_recent);
+  }
+#endif /* LWIP_TCP_TIMESTAMPS */
+
+#if CHECKSUM_GEN_TCP
+  IF__NETIF_CHECKSUM_ENABLED(netif, NETIF_CHECKSUM_GEN_TCP) {
+    struct tcp_hdr *tcphdr = (struct tcp_hdr *)p->payload;
+    tcphdr->chksum = ip_chksum_pseudo(p, IP_PROTO_TCP, p->tot_len,
+                                      &tw->local_ip, &tw->remote_ip);
+  }
+#endif
+  LWIP_DEBUGF(TCP_OUTPUT_DEBUG, ("tcp_tw_ack: sending ACK for %"U32_F"\n", tw->rcv_nxt));
+  TCP_STATS_INC(tcp.xmit);
+  /* with the TTL and TOS of the pcb, which tcp_output_control_segment_netif() cannot take */
+  ip_output_if(p, &tw->local_ip, &tw->remote_ip, tw->ttl, tw->tos, IP_PROTO_TCP, netif);
+  pbuf_free(p);
+}
+#endif /* LWIP_TCP_TW_TABLE */
+
 /**
  * Send an ACK without data.
  *
@@ -2124,6 +2933,7 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
   if (p == NULL) {
     /* let tcp_fasttmr retry sending this ACK */
     tcp_set_flags(pcb, TF_ACK_DELAY | TF_ACK_NOW);
+    TCP_FASTTMR_PENDING(pcb);
     LWIP_DEBUGF(TCP_OUTPUT_DEBUG, ("tcp_output: (ACK) could not allocate pbuf\n"));
     return ERR_BUF;
   }
@@ -2139,6 +2949,7 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
   if (err != ERR_OK) {
     /* let tcp_fasttmr retry sending this ACK */
     tcp_set_flags(pcb, TF_ACK_DELAY | TF_ACK_NOW);
+    TCP_FASTTMR_PENDING(pcb);
   } else {
     /* remove ACK flags from the PCB, as we sent an empty ACK now */
     tcp_clear_flags(pcb, TF_ACK_DELAY | TF_ACK_NOW);
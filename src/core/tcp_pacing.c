@@ -0,0 +1,206 @@
+/**
+ * @file
+ * Packet pacing for TCP
+ *
+ * Without pacing, tcp_output() sends everything cwnd and the send window
+ * allow back to back, so a large window leaves as one burst that has to be
+ * buffered by the NIC and the switches on the path. With pacing every
+ * connection has a pacing rate and an earliest departure time for its next
+ * segment. tcp_output() stops at a segment that may not leave yet and a
+ * sys_timeout calls it again at the departure time. If that timeout could
+ * not be armed, tcp_fasttmr() sends once the departure time has passed.
+ *
+ * sys_now() counts milliseconds, so departure times are kept in microseconds
+ * (sys_now() * 1000) but segments are released once per millisecond: a
+ * connection sends up to one millisecond worth of data at once.
+ */
+
+#include "lwip/opt.h"
+
+#if LWIP_TCP && LWIP_TCP_PACING /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/timeouts.h"
+#include "lwip/sys.h"
+
+/** A segment may leave if its departure time is less than this ahead */
+#define TCP_PACING_SLACK_US  1000
+
+static void tcp_pacing_timeout(void *arg);
+
+/**
+ * @ingroup tcp_raw
+ * Enable or disable pacing for a connection.
+ *
+ * @param pcb the tcp_pcb to configure
+ * @param enable 1 to pace the segments of this connection, 0 to send bursts
+ */
+void
+tcp_set_pacing(struct tcp_pcb *pcb, u8_t enable)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+
+  LWIP_ERROR("tcp_set_pacing: invalid pcb", pcb != NULL, return);
+
+  /* the application decides from now on, not the congestion control */
+  pcb->pacing_flags &= (u8_t)~TCP_PACING_CA;
+  if (enable) {
+    pcb->pacing_flags |= TCP_PACING_ON;
+    tcp_pacing_update(pcb);
+  } else {
+    pcb->pacing_flags &= (u8_t)~TCP_PACING_ON;
+  }
+}
+
+/**
+ * Derive the pacing rate from cwnd and the smoothed RTT, unless the
+ * congestion control sets it. Called on every ACK.
+ *
+ * @param pcb the tcp_pcb to update
+ */
+void
+tcp_pacing_update(struct tcp_pcb *pcb)
+{
+  u32_t srtt = pcb->srtt; /* ms << 3 */
+  u32_t ratio, rate;
+
+  if (!(pcb->pacing_flags & TCP_PACING_ON)) {
+    return;
+  }
+#if LWIP_TCP_RATE_SAMPLE
+  if (pcb->cong_ops->cong_control != NULL) {
+    return;
+  }
+#endif /* LWIP_TCP_RATE_SAMPLE */
+  if (srtt == 0) {
+    /* no RTT sample yet: don't pace */
+    pcb->pacing_rate = 0;
+    return;
+  }
+  /* in slow start cwnd doubles every RTT, the rate must keep up with that */
+  ratio = (pcb->cwnd < pcb->ssthresh / 2) ? TCP_PACING_SS_RATIO : TCP_PACING_CA_RATIO;
+  /* cwnd * 8000 / srtt bytes per second, split up so it cannot overflow */
+  rate = (pcb->cwnd / srtt) * 8000 + ((pcb->cwnd % srtt) * 8000) / srtt;
+  if (rate / 100 > 0xffffffffUL / ratio) {
+    rate = 0xffffffffUL;
+  } else {
+    rate = (rate / 100) * ratio;
+  }
+  pcb->pacing_rate = LWIP_MAX(rate, 1);
+}
+
+/**
+ * Check if tcp_output() may send the next segment now. If not, arm the
+ * pacing timer to call tcp_output() again at the departure time.
+ *
+ * @param pcb the tcp_pcb to send on
+ * @return 1 if the segment may be sent, 0 if it has to wait
+ */
+u8_t
+tcp_pacing_can_send(struct tcp_pcb *pcb)
+{
+  s32_t ahead;
+
+  if (!(pcb->pacing_flags & TCP_PACING_ON) || (pcb->pacing_rate == 0)) {
+    return 1;
+  }
+  ahead = (s32_t)(pcb->pacing_next - sys_now() * 1000);
+  if (ahead < TCP_PACING_SLACK_US) {
+    return 1;
+  }
+  if (!(pcb->pacing_flags & TCP_PACING_TMR_ARMED)) {
+    /* the first millisecond at which ahead drops below the slack */
+    sys_timeout((u32_t)ahead / 1000, tcp_pacing_timeout, pcb);
+    pcb->pacing_flags |= TCP_PACING_TMR_ARMED;
+    /* in case MEMP_SYS_TIMEOUT was empty, see tcp_pacing_fasttmr() */
+    TCP_FASTTMR_PENDING(pcb);
+  }
+  return 0;
+}
+
+/**
+ * Advance the departure time by the time a segment takes at the pacing rate.
+ *
+ * @param pcb the tcp_pcb that sent the segment
+ * @param len length of the segment (TCP_TCPLEN)
+ */
+void
+tcp_pacing_sent(struct tcp_pcb *pcb, u32_t len)
+{
+  u32_t now = sys_now() * 1000;
+
+  if (!(pcb->pacing_flags & TCP_PACING_ON) || (pcb->pacing_rate == 0)) {
+    return;
+  }
+  if ((s32_t)(pcb->pacing_next - now) < 0) {
+    /* an idle connection does not save up credit for a burst */
+    pcb->pacing_next = now;
+  }
+  /* len * 10^6 / rate, with 10^6 = 15625 * 64 */
+  pcb->pacing_next += (len * 15625) / LWIP_MAX(pcb->pacing_rate >> 6, 1);
+}
+
+/** sys_timeout callback: send what the pacing rate allows by now */
+static void
+tcp_pacing_timeout(void *arg)
+{
+  struct tcp_pcb *pcb = (struct tcp_pcb *)arg;
+
+  pcb->pacing_flags &= (u8_t)~TCP_PACING_TMR_ARMED;
+  tcp_output(pcb);
+}
+
+/**
+ * Called by tcp_fasttmr(): if the departure time has passed but the pacing
+ * timer has not sent, because sys_timeout() found MEMP_SYS_TIMEOUT empty,
+ * send from here.
+ *
+ * @param pcb the tcp_pcb to check
+ */
+void
+tcp_pacing_fasttmr(struct tcp_pcb *pcb)
+{
+  if ((pcb->pacing_flags & TCP_PACING_TMR_ARMED) &&
+      ((s32_t)(pcb->pacing_next - sys_now() * 1000) < TCP_PACING_SLACK_US)) {
+    /* there must never be two timeouts for one pcb */
+    sys_untimeout(tcp_pacing_timeout, pcb);
+    pcb->pacing_flags &= (u8_t)~TCP_PACING_TMR_ARMED;
+    tcp_output(pcb);
+  }
+}
+
+/**
+ * Called by tcp_set_congestion_control() when the congestion control that set
+ * the pacing rate of a connection is replaced. Its rate and departure time
+ * are dropped. Pacing stays on only if the application enabled it, at the
+ * rate derived from cwnd.
+ *
+ * @param pcb the tcp_pcb whose congestion control changed
+ */
+void
+tcp_pacing_ca_release(struct tcp_pcb *pcb)
+{
+  pcb->pacing_rate = 0;
+  pcb->pacing_next = sys_now() * 1000;
+  if (pcb->pacing_flags & TCP_PACING_CA) {
+    pcb->pacing_flags &= (u8_t)~(TCP_PACING_ON | TCP_PACING_CA);
+  }
+  /* a pending timer only calls tcp_output() */
+  tcp_pacing_update(pcb);
+}
+
+/**
+ * Cancel the timer of a pcb that is being purged.
+ *
+ * @param pcb the tcp_pcb being purged
+ */
+void
+tcp_pacing_purge(struct tcp_pcb *pcb)
+{
+  if (pcb->pacing_flags & TCP_PACING_TMR_ARMED) {
+    sys_untimeout(tcp_pacing_timeout, pcb);
+  }
+  pcb->pacing_flags = 0;
+}
+
+#endif /* LWIP_TCP && LWIP_TCP_PACING */
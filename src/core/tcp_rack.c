@@ -0,0 +1,325 @@
+/**
+ * @file
+ * RACK-TLP loss detection for TCP (RFC 8985)
+ *
+ * RACK marks a segment lost once a segment that was sent sufficiently later
+ * has been delivered (cumulatively ACKed or SACKed), which does not depend on
+ * three duplicate ACKs arriving. The Tail Loss Probe sends one segment when
+ * ACKs stop arriving for about two round-trips, so that a lost tail triggers
+ * RACK or SACK recovery instead of waiting for the retransmission timeout.
+ *
+ * The reordering timer and the probe timeout share one sys_timeout per pcb.
+ * It is re-armed lazily: moving the deadline later only updates pcb->rack_due
+ * and the pending timeout re-arms itself for the remainder when it fires.
+ */
+
+#include "lwip/opt.h"
+
+#if LWIP_TCP && LWIP_TCP_RACK /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/timeouts.h"
+#include "lwip/sys.h"
+
+/** Worst case delayed ACK timer of the remote host, added to the probe
+ * timeout when only one segment is in flight */
+#define TCP_RACK_MAX_ACK_DELAY  (2 * TCP_FAST_INTERVAL)
+/** Probe timeout used until an RTT has been measured */
+#define TCP_RACK_PTO_INIT       1000
+/** Lower bound of the probe timeout, sys_now() is too coarse below */
+#define TCP_RACK_PTO_MIN        10
+
+/* is time a before time b? */
+#define RACK_TIME_BEFORE(a, b)  ((s32_t)((u32_t)(a) - (u32_t)(b)) < 0)
+
+static void tcp_rack_timeout(void *arg);
+
+/** Returns 1 if the transmission at (t1, seq1) happened after the one at (t2, seq2) */
+static int
+tcp_rack_sent_after(u32_t t1, u32_t seq1, u32_t t2, u32_t seq2)
+{
+  return RACK_TIME_BEFORE(t2, t1) || ((t1 == t2) && TCP_SEQ_GT(seq1, seq2));
+}
+
+/** Arm the reordering timer or the probe timeout */
+static void
+tcp_rack_set_timer(struct tcp_pcb *pcb, u8_t mode, u32_t delay)
+{
+  pcb->rack_flags = (u8_t)((pcb->rack_flags & ~(RACK_TMR_REO | RACK_TMR_PTO)) | mode);
+  pcb->rack_due = sys_now() + delay;
+  if (pcb->rack_flags & RACK_TMR_ARMED) {
+    if (!RACK_TIME_BEFORE(pcb->rack_due, pcb->rack_armed_due)) {
+      /* the pending timeout fires early and re-arms for the rest */
+      return;
+    }
+    sys_untimeout(tcp_rack_timeout, pcb);
+  }
+  sys_timeout(delay, tcp_rack_timeout, pcb);
+  pcb->rack_armed_due = pcb->rack_due;
+  pcb->rack_flags |= RACK_TMR_ARMED;
+}
+
+/** The reordering window: how much later than expected a segment may be
+ * delivered before it is considered lost (RFC 8985, section 6.2 step 4) */
+static u32_t
+tcp_rack_reo_wnd(struct tcp_pcb *pcb)
+{
+  if (!(pcb->rack_flags & RACK_REORDER_SEEN) &&
+      ((pcb->flags & TF_INFR) || (pcb->sacked >= 3U * pcb->mss))) {
+    return 0;
+  }
+  return LWIP_MIN(pcb->min_rtt / 4, pcb->srtt >> 3);
+}
+
+/**
+ * Update the RACK state for a segment that has just been delivered
+ * (cumulatively ACKed or newly SACKed).
+ *
+ * @param pcb the tcp_pcb the segment belongs to
+ * @param seg the delivered segment
+ * @param now current sys_now()
+ */
+void
+tcp_rack_update(struct tcp_pcb *pcb, struct tcp_seg *seg, u32_t now)
+{
+  u32_t end = lwip_ntohl(seg->tcphdr->seqno) + TCP_TCPLEN(seg);
+  u32_t rtt = now - seg->xmit_ts;
+
+  if (seg->snd_time > 1) {
+    /* The ACK may be for an earlier transmission: don't trust an RTT that
+       is shorter than the path allows (RFC 8985, section 6.2 step 2) */
+    if (rtt < pcb->min_rtt) {
+      return;
+    }
+  } else if ((pcb->rack_flags & RACK_VALID) && TCP_SEQ_LT(end, pcb->rack_fack)) {
+    /* delivered below a segment delivered by an earlier ACK, without
+       having been retransmitted */
+    pcb->rack_flags |= RACK_REORDER_SEEN;
+  }
+  if (!(pcb->rack_flags & RACK_VALID)) {
+    pcb->rack_fack = end;
+  }
+  if (!(pcb->rack_flags & RACK_VALID) ||
+      tcp_rack_sent_after(seg->xmit_ts, end, pcb->rack_xmit_ts, pcb->rack_end_seq)) {
+    pcb->rack_rtt = rtt;
+    pcb->rack_xmit_ts = seg->xmit_ts;
+    pcb->rack_end_seq = end;
+  }
+  pcb->rack_flags |= RACK_VALID;
+}
+
+/**
+ * Mark the segments on the unacked queue lost that were sent before the most
+ * recently delivered one and have not been delivered within rack_rtt plus the
+ * reordering window. Arms the reordering timer for the ones that may still
+ * arrive (RFC 8985, section 6.2 step 5).
+ *
+ * @return 1 if a segment was newly marked lost, 0 otherwise
+ */
+static u8_t
+tcp_rack_detect_loss(struct tcp_pcb *pcb, u32_t ackno, u32_t now)
+{
+  struct tcp_seg *seg;
+  u32_t reo_wnd, seq, end, timeout = 0;
+  s32_t remaining;
+  u8_t lost = 0;
+
+  pcb->rack_flags &= (u8_t)~RACK_TMR_REO;
+  if (!(pcb->rack_flags & RACK_VALID)) {
+    return 0;
+  }
+  reo_wnd = tcp_rack_reo_wnd(pcb);
+  if (TCP_SEQ_GT(ackno, pcb->rack_fack)) {
+    pcb->rack_fack = ackno;
+  }
+  for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+    seq = lwip_ntohl(seg->tcphdr->seqno);
+    end = seq + TCP_TCPLEN(seg);
+    if (seg->flags & TF_SEG_SACKED) {
+      if (TCP_SEQ_GT(end, pcb->rack_fack)) {
+        pcb->rack_fack = end;
+      }
+      continue;
+    }
+    if (TCP_SEQ_LEQ(end, ackno) || (seg->flags & TF_SEG_LOST)) {
+      continue;
+    }
+    if (!tcp_rack_sent_after(pcb->rack_xmit_ts, pcb->rack_end_seq, seg->xmit_ts, end)) {
+      /* sent after the most recently delivered segment: nothing known yet */
+      continue;
+    }
+    remaining = (s32_t)(seg->xmit_ts + pcb->rack_rtt + reo_wnd - now);
+    if (remaining <= 0) {
+      LWIP_DEBUGF(TCP_FR_DEBUG, ("tcp_rack: %"U32_F":%"U32_F" lost\n", seq, end));
+      seg->flags |= TF_SEG_LOST;
+      lost = 1;
+    } else if ((u32_t)remaining > timeout) {
+      timeout = (u32_t)remaining;
+    }
+  }
+  if (timeout != 0) {
+    tcp_rack_set_timer(pcb, RACK_TMR_REO, timeout);
+  }
+  return lost;
+}
+
+/**
+ * Called by tcp_receive() for every ACK, after the SACK scoreboard has been
+ * updated: feeds the cumulatively acknowledged segments into RACK, ends a
+ * tail loss probe episode and detects lost segments.
+ *
+ * @param pcb the tcp_pcb for which an ACK was received
+ * @param ackno the acknowledgement number of the ACK
+ * @param dsack 1 if the ACK reports a duplicate segment (D-SACK)
+ * @return 1 if a segment was newly marked lost, 0 otherwise
+ */
+u8_t
+tcp_rack_ack(struct tcp_pcb *pcb, u32_t ackno, u8_t dsack)
+{
+  struct tcp_seg *seg;
+  u32_t now;
+
+  if (!(pcb->flags & TF_SACK)) {
+    return 0;
+  }
+  now = sys_now();
+  if (TCP_SEQ_BETWEEN(ackno, pcb->lastack + 1, pcb->snd_nxt)) {
+    for (seg = pcb->unacked; seg != NULL &&
+         TCP_SEQ_LEQ(lwip_ntohl(seg->tcphdr->seqno) + TCP_TCPLEN(seg), ackno); seg = seg->next) {
+      if (!(seg->flags & TF_SEG_SACKED)) {
+        tcp_rack_update(pcb, seg, now);
+      }
+    }
+  }
+
+  if ((pcb->rack_flags & TLP_PROBING) && TCP_SEQ_GEQ(ackno, pcb->tlp_end_seq)) {
+    /* The probe was acknowledged. If it was a retransmission that the remote
+       host did not report as duplicate, it repaired a loss: respond as after
+       fast recovery (RFC 8985, section 7.4.2). */
+    if ((pcb->rack_flags & TLP_RXT) && !dsack && !(pcb->flags & TF_INFR)) {
+      LWIP_DEBUGF(TCP_FR_DEBUG, ("tcp_rack: loss repaired by tail loss probe\n"));
+      pcb->ssthresh = pcb->cong_ops->ssthresh(pcb);
+      pcb->cwnd = pcb->ssthresh;
+    }
+    pcb->rack_flags &= (u8_t)~(TLP_PROBING | TLP_RXT);
+  }
+
+  return tcp_rack_detect_loss(pcb, ackno, now);
+}
+
+/**
+ * (Re-)arm the tail loss probe timeout after new data has been sent or an
+ * ACK was received, or cancel it if no probe is needed (RFC 8985, section 7.2).
+ *
+ * @param pcb the tcp_pcb to arm the probe timeout for
+ */
+void
+tcp_rack_arm_pto(struct tcp_pcb *pcb)
+{
+  u32_t pto;
+
+  if (pcb->rack_flags & RACK_TMR_REO) {
+    /* the reordering timer takes precedence */
+    return;
+  }
+  if (!(pcb->flags & TF_SACK) || (pcb->flags & (TF_INFR | TF_RTO)) ||
+      (pcb->unacked == NULL) || (pcb->rack_flags & TLP_PROBING)) {
+    pcb->rack_flags &= (u8_t)~RACK_TMR_PTO;
+    return;
+  }
+  if (pcb->srtt != 0) {
+    pto = 2 * (pcb->srtt >> 3);
+    if (pcb->unacked->next == NULL && pcb->unsent == NULL) {
+      pto += TCP_RACK_MAX_ACK_DELAY;
+    }
+    pto = LWIP_MAX(pto, TCP_RACK_PTO_MIN);
+  } else {
+    pto = TCP_RACK_PTO_INIT;
+  }
+  /* never later than the retransmission timeout */
+  pto = LWIP_MIN(pto, (u32_t)LWIP_MAX(pcb->rto, 1) * TCP_SLOW_INTERVAL);
+  tcp_rack_set_timer(pcb, RACK_TMR_PTO, pto);
+}
+
+/** Send a tail loss probe: new data if the windows allow, the last segment otherwise */
+static void
+tcp_rack_send_probe(struct tcp_pcb *pcb)
+{
+  struct tcp_seg *seg;
+  u32_t snd_nxt = pcb->snd_nxt;
+
+  if (pcb->unacked == NULL) {
+    return;
+  }
+  /* prevent tcp_output() from arming another probe */
+  pcb->rack_flags |= TLP_PROBING;
+  pcb->rack_flags &= (u8_t)~TLP_RXT;
+  tcp_output(pcb);
+  if (pcb->snd_nxt == snd_nxt) {
+    seg = pcb->last_unacked;
+    LWIP_DEBUGF(TCP_FR_DEBUG, ("tcp_rack: tail loss probe %"U32_F"\n",
+                               lwip_ntohl(seg->tcphdr->seqno)));
+    if (tcp_rexmit_seg(pcb, seg) != ERR_OK) {
+      pcb->rack_flags &= (u8_t)~TLP_PROBING;
+      return;
+    }
+    pcb->rack_flags |= TLP_RXT;
+    tcp_output(pcb);
+  }
+  pcb->tlp_end_seq = pcb->snd_nxt;
+  /* the retransmission timer is the fallback if the probe is lost as well */
+  pcb->rtime = 0;
+}
+
+/** sys_timeout callback of the reordering timer and the probe timeout */
+static void
+tcp_rack_timeout(void *arg)
+{
+  struct tcp_pcb *pcb = (struct tcp_pcb *)arg;
+  u32_t now = sys_now();
+
+  pcb->rack_flags &= (u8_t)~RACK_TMR_ARMED;
+  if (!(pcb->rack_flags & (RACK_TMR_REO | RACK_TMR_PTO))) {
+    return;
+  }
+  if (RACK_TIME_BEFORE(now, pcb->rack_due)) {
+    sys_timeout(pcb->rack_due - now, tcp_rack_timeout, pcb);
+    pcb->rack_armed_due = pcb->rack_due;
+    pcb->rack_flags |= RACK_TMR_ARMED;
+    return;
+  }
+
+  if (pcb->rack_flags & RACK_TMR_REO) {
+    if (tcp_rack_detect_loss(pcb, pcb->lastack, now)) {
+#if LWIP_TCP_PRR
+      /* no data was delivered, PRR must not count the last ACK again */
+      if (!(pcb->flags & TF_INFR)) {
+        pcb->prr_delivered = 0;
+      }
+      pcb->prr_acked = 0;
+#endif /* LWIP_TCP_PRR */
+      /* enters loss recovery or retransmits the newly lost segments */
+      tcp_rexmit_fast(pcb);
+      tcp_output(pcb);
+    }
+  } else {
+    pcb->rack_flags &= (u8_t)~RACK_TMR_PTO;
+    tcp_rack_send_probe(pcb);
+  }
+}
+
+/**
+ * Cancel the timer of a pcb that is being purged.
+ *
+ * @param pcb the tcp_pcb being purged
+ */
+void
+tcp_rack_purge(struct tcp_pcb *pcb)
+{
+  if (pcb->rack_flags & RACK_TMR_ARMED) {
+    sys_untimeout(tcp_rack_timeout, pcb);
+  }
+  pcb->rack_flags = 0;
+}
+
+#endif /* LWIP_TCP && LWIP_TCP_RACK */
@@ -0,0 +1,138 @@
+/**
+ * @file
+ * Delivery rate estimation for TCP (draft-cheng-iccrg-delivery-rate-estimation)
+ *
+ * Every transmitted segment remembers how much data had been delivered when
+ * it was sent. When it is ACKed or SACKed, the data delivered since then
+ * divided by the time that passed gives a delivery rate sample. Taking the
+ * longer of the send and the ACK interval keeps the sample from
+ * overestimating the bottleneck bandwidth when ACKs arrive compressed.
+ *
+ * Samples taken while the application did not keep cwnd full are flagged, so
+ * that a congestion control does not mistake a slow sender for a slow path.
+ */
+
+#include "lwip/opt.h"
+
+#if LWIP_TCP && LWIP_TCP_RATE_SAMPLE /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/sys.h"
+
+/**
+ * Snapshot the delivery state into a segment that is (re)transmitted.
+ * Called by tcp_output() after seg->xmit_ts has been set.
+ *
+ * @param pcb the tcp_pcb sending the segment
+ * @param seg the segment being sent
+ */
+void
+tcp_rate_seg_sent(struct tcp_pcb *pcb, struct tcp_seg *seg)
+{
+  if (pcb->unacked == NULL) {
+    /* nothing in flight: start a new sampling interval now, so the idle
+       time before this send is not counted as delivery time */
+    pcb->first_tx_time = seg->xmit_ts;
+    pcb->delivered_time = seg->xmit_ts;
+  }
+  seg->tx_delivered = pcb->delivered;
+  seg->tx_delivered_time = pcb->delivered_time;
+  seg->tx_first_time = pcb->first_tx_time;
+  if (pcb->app_limited != 0) {
+    seg->flags |= TF_SEG_APP_LIMITED;
+  } else {
+    seg->flags &= (u8_t)~TF_SEG_APP_LIMITED;
+  }
+}
+
+/**
+ * Account a segment that has just been cumulatively ACKed or newly SACKed.
+ * The most recently sent of the delivered segments determines the
+ * sampling interval.
+ *
+ * @param pcb the tcp_pcb the segment belongs to
+ * @param seg the delivered segment
+ * @param rs the rate sample of the ACK being processed
+ */
+void
+tcp_rate_seg_delivered(struct tcp_pcb *pcb, struct tcp_seg *seg, struct tcp_rate_sample *rs)
+{
+  pcb->delivered += TCP_TCPLEN(seg);
+  rs->acked_sacked += TCP_TCPLEN(seg);
+
+  if (seg->snd_time == 0) {
+    /* never sent, e.g. moved back to unsent by an RTO before its first
+       transmission: there is no snapshot to sample from */
+    return;
+  }
+  if (!rs->has_prior || TCP_SEQ_GT(seg->tx_delivered, rs->prior_delivered)) {
+    rs->prior_delivered = seg->tx_delivered;
+    rs->prior_time = seg->tx_delivered_time;
+    rs->is_app_limited = (seg->flags & TF_SEG_APP_LIMITED) ? 1 : 0;
+    rs->has_prior = 1;
+    /* the send interval of this sample ends at this segment */
+    rs->interval = (s32_t)(seg->xmit_ts - seg->tx_first_time);
+    pcb->first_tx_time = seg->xmit_ts;
+  }
+}
+
+/**
+ * Complete the rate sample of an ACK after all delivered segments have been
+ * passed to tcp_rate_seg_delivered().
+ *
+ * @param pcb the tcp_pcb the ACK was received on
+ * @param rs the rate sample to complete
+ * @param rtt the RTT sample of this ACK in ms, (u32_t)-1 if there is none
+ */
+void
+tcp_rate_gen(struct tcp_pcb *pcb, struct tcp_rate_sample *rs, u32_t rtt)
+{
+  u32_t ack_interval;
+
+  /* the application limited phase ends once its data has been delivered */
+  if ((pcb->app_limited != 0) && TCP_SEQ_GT(pcb->delivered, pcb->app_limited)) {
+    pcb->app_limited = 0;
+  }
+  if (rs->acked_sacked != 0) {
+    pcb->delivered_time = sys_now();
+  }
+  rs->rtt = (rtt == (u32_t)-1) ? -1 : (s32_t)rtt;
+
+  if (!rs->has_prior) {
+    rs->delivered = -1;
+    rs->interval = -1;
+    return;
+  }
+  rs->delivered = (s32_t)(pcb->delivered - rs->prior_delivered);
+  ack_interval = pcb->delivered_time - rs->prior_time;
+  if ((rs->interval < 0) || (ack_interval > (u32_t)rs->interval)) {
+    rs->interval = (s32_t)ack_interval;
+  }
+  /* an interval shorter than the path RTT cannot have been measured
+     correctly (e.g. after a retransmission was ACKed): drop the sample */
+  if ((u32_t)rs->interval < pcb->min_rtt) {
+    rs->interval = -1;
+  }
+}
+
+/**
+ * Mark the connection application limited if it has too little data queued
+ * to fill cwnd. Called on every tcp_output().
+ *
+ * @param pcb the tcp_pcb to check
+ */
+void
+tcp_rate_check_app_limited(struct tcp_pcb *pcb)
+{
+  u32_t in_flight = TCP_BYTES_IN_FLIGHT(pcb);
+
+  if (((u32_t)(pcb->snd_lbb - pcb->snd_nxt) < pcb->mss) &&
+      (in_flight < pcb->cwnd)) {
+    pcb->app_limited = pcb->delivered + in_flight;
+    if (pcb->app_limited == 0) {
+      pcb->app_limited = 1;
+    }
+  }
+}
+
+#endif /* LWIP_TCP && LWIP_TCP_RATE_SAMPLE */
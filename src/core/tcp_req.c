@@ -0,0 +1,233 @@
+/**
+ * @file
+ * Table of TCP connection requests in SYN_RCVD
+ *
+ * A SYN received by a listener does not get a tcp_pcb, which is large and
+ * mostly unused until the handshake completes. It gets a struct tcp_req
+ * instead, which holds what is needed to retransmit the SYN|ACK and to
+ * validate the final ACK. The requests are found by their 4-tuple through
+ * a hash table. The final ACK promotes a request to a tcp_pcb.
+ *
+ * The requests are also linked in the order they arrived, so that
+ * tcp_req_tmr() only visits existing requests and the oldest request of a
+ * listener can be dropped to make room in its backlog.
+ */
+
+#include "lwip/opt.h"
+
+#if LWIP_TCP && LWIP_TCP_REQ_TABLE /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/memp.h"
+#include "lwip/sys.h"
+
+#include <string.h>
+
+/** The 4-tuple table */
+static struct tcp_req *tcp_req_table[TCP_REQ_HASH_SIZE];
+/** All requests, the oldest first */
+static struct tcp_req *tcp_req_oldest;
+static struct tcp_req **tcp_req_youngest = &tcp_req_oldest;
+
+/** The bucket of a 4-tuple */
+#define TCP_REQ_BUCKET(lip, lport, rip, rport) \
+  (&tcp_req_table[tcp_4tuple_hash(lip, lport, rip, rport) & (TCP_REQ_HASH_SIZE - 1)])
+
+/**
+ * Allocate a request for a SYN received by a listener and add it to the
+ * table. The handshake state is left to the caller.
+ *
+ * @param lpcb the listener that received the SYN
+ * @param local_ip the local IP address of the connection
+ * @param remote_ip the IP address of the remote host
+ * @param remote_port the TCP port of the remote host
+ * @param netif_idx the index of the netif the SYN arrived on
+ * @return the new request or NULL if the pool is empty
+ */
+struct tcp_req *
+tcp_req_alloc(struct tcp_pcb_listen *lpcb,
+              const ip_addr_t *local_ip, const ip_addr_t *remote_ip,
+              u16_t remote_port, u8_t netif_idx)
+{
+  struct tcp_req *req, **bucket;
+
+  LWIP_ASSERT("tcp_req_alloc: invalid listener", lpcb != NULL);
+
+  req = (struct tcp_req *)memp_malloc(MEMP_TCP_REQ);
+  if (req == NULL) {
+    return NULL;
+  }
+  memset(req, 0, sizeof(struct tcp_req));
+  req->listener = lpcb;
+  ip_addr_copy(req->local_ip, *local_ip);
+  ip_addr_copy(req->remote_ip, *remote_ip);
+  req->local_port = lpcb->local_port;
+  req->remote_port = remote_port;
+  req->tmr = tcp_ticks;
+  req->netif_idx = netif_idx;
+
+  bucket = TCP_REQ_BUCKET(local_ip, req->local_port, remote_ip, remote_port);
+  req->hash_next = *bucket;
+  *bucket = req;
+
+  TCP_AGE_LINK(tcp_req_youngest, req);
+  /* tcp_req_tmr() retransmits the SYN|ACK */
+  tcp_timer_needed();
+
+#if TCP_LISTEN_BACKLOG
+  lpcb->accepts_pending++;
+  LWIP_ASSERT("accepts_pending != 0", lpcb->accepts_pending != 0);
+#endif /* TCP_LISTEN_BACKLOG */
+  return req;
+}
+
+/**
+ * Remove a request from the table and free it.
+ *
+ * @param req the request to free
+ */
+void
+tcp_req_free(struct tcp_req *req)
+{
+  struct tcp_req **link;
+
+  link = TCP_REQ_BUCKET(&req->local_ip, req->local_port, &req->remote_ip, req->remote_port);
+  while (*link != req) {
+    LWIP_ASSERT("tcp_req_free: request not in table", *link != NULL);
+    link = &(*link)->hash_next;
+  }
+  *link = req->hash_next;
+
+  TCP_AGE_UNLINK(tcp_req_youngest, req);
+
+#if TCP_LISTEN_BACKLOG
+  LWIP_ASSERT("accepts_pending != 0", req->listener->accepts_pending != 0);
+  req->listener->accepts_pending--;
+#endif /* TCP_LISTEN_BACKLOG */
+  memp_free(MEMP_TCP_REQ, req);
+}
+
+/**
+ * Find the request of a listener for a 4-tuple.
+ *
+ * @param lpcb the listener
+ * @param local_ip the local IP address of the connection
+ * @param remote_ip the IP address of the remote host
+ * @param remote_port the TCP port of the remote host
+ * @return the request or NULL if there is none
+ */
+struct tcp_req *
+tcp_req_lookup(const struct tcp_pcb_listen *lpcb,
+               const ip_addr_t *local_ip, const ip_addr_t *remote_ip,
+               u16_t remote_port)
+{
+  struct tcp_req *req;
+
+  req = *TCP_REQ_BUCKET(local_ip, lpcb->local_port, remote_ip, remote_port);
+  for (; req != NULL; req = req->hash_next) {
+    if ((req->listener == lpcb) &&
+        (req->remote_port == remote_port) &&
+        (req->local_port == lpcb->local_port) &&
+        ip_addr_eq(&req->remote_ip, remote_ip) &&
+        ip_addr_eq(&req->local_ip, local_ip)) {
+      return req;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Send the SYN|ACK of a request (again).
+ *
+ * @param req the request
+ */
+void
+tcp_req_synack(struct tcp_req *req)
+{
+#if LWIP_TCP_TIMESTAMPS
+  req->hs.ts_val = sys_now();
+#endif /* LWIP_TCP_TIMESTAMPS */
+  req->rtime = 0;
+  tcp_synack_netif(netif_get_by_index(req->netif_idx), &req->hs,
+                   &req->local_ip, &req->remote_ip, req->local_port, req->remote_port);
+}
+
+/**
+ * Retransmit the SYN|ACKs that have not been acknowledged in time and drop
+ * the requests that stayed too long in SYN_RCVD. Called from tcp_slowtmr().
+ */
+void
+tcp_req_tmr(void)
+{
+  struct tcp_req *req, *next;
+
+  for (req = tcp_req_oldest; req != NULL; req = next) {
+    next = req->age_next;
+    if (((u32_t)(tcp_ticks - req->tmr) > TCP_SYN_RCVD_TIMEOUT / TCP_SLOW_INTERVAL) ||
+        (req->nrtx >= TCP_SYNMAXRTX) ||
+        (netif_get_by_index(req->netif_idx) == NULL)) {
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_req_tmr: removing request stuck in SYN-RCVD\n"));
+      tcp_req_free(req);
+      continue;
+    }
+    /* the same backoff as tcp_pcb starts with */
+    if (++req->rtime >= ((LWIP_TCP_RTO_TIME / TCP_SLOW_INTERVAL) << req->nrtx)) {
+      req->nrtx++;
+      tcp_req_synack(req);
+    }
+  }
+}
+
+/**
+ * Tell whether there are requests for tcp_req_tmr() to look after.
+ *
+ * @return 1 if the table is not empty
+ */
+u8_t
+tcp_req_pending(void)
+{
+  return tcp_req_oldest != NULL;
+}
+
+/**
+ * Drop the requests of a listener that is closed. Called from
+ * tcp_listen_closed().
+ *
+ * @param lpcb the listener
+ */
+void
+tcp_req_listen_closed(struct tcp_pcb_listen *lpcb)
+{
+  struct tcp_req *req, *next;
+
+  for (req = tcp_req_oldest; req != NULL; req = next) {
+    next = req->age_next;
+    if (req->listener == lpcb) {
+      tcp_req_free(req);
+    }
+  }
+}
+
+/**
+ * Drop the oldest request of a listener to make room in its backlog.
+ *
+ * @param lpcb the listener
+ * @return 1 if a request was dropped, 0 if the listener has none
+ */
+u8_t
+tcp_req_reclaim(struct tcp_pcb_listen *lpcb)
+{
+  struct tcp_req *req;
+
+  for (req = tcp_req_oldest; req != NULL; req = req->age_next) {
+    if (req->listener == lpcb) {
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_req_reclaim: dropping oldest request (%"U32_F")\n",
+                              (u32_t)(tcp_ticks - req->tmr)));
+      tcp_req_free(req);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+#endif /* LWIP_TCP && LWIP_TCP_REQ_TABLE */
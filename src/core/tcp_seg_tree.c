@@ -0,0 +1,335 @@
+/**
+ * @file
+ * Sequence number index of TCP segment queues
+ *
+ * The segment queues of a tcp_pcb are singly linked lists sorted by sequence
+ * number. With large windows they hold thousands of segments, and finding a
+ * segment by its sequence number by walking the list costs O(n). These
+ * functions link the segments of a queue into a red-black tree as well, so
+ * that the lookup costs O(log n):
+ *
+ * - with TCP_OOSEQ_TREE, pcb->ooseq_tree indexes pcb->ooseq, to find the
+ *   place of every segment received out of sequence
+ * - with TCP_UNACKED_TREE, pcb->unacked_tree indexes pcb->unacked, to find
+ *   the segments covered by a SACK block
+ *
+ * The lists stay the primary structure: the segments are sent, delivered,
+ * SACKed and freed in list order as before. A segment is never on pcb->ooseq
+ * and on pcb->unacked at the same time, so both trees use the same links.
+ *
+ * The segments on a queue never overlap and all lie within one window, so
+ * they are ordered by their sequence numbers with TCP_SEQ_LT() despite
+ * wrap-around.
+ */
+
+#include "lwip/opt.h"
+
+#if LWIP_TCP && (TCP_OOSEQ_TREE || TCP_UNACKED_TREE) /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/priv/tcp_priv.h"
+
+#define TREE_RED(seg) (((seg) != NULL) && (seg)->tree_red)
+
+/** Put 'to' in the place of 'from' below the parent of 'from' */
+static void
+tcp_seg_tree_replace(struct tcp_seg **root, struct tcp_seg *from, struct tcp_seg *to)
+{
+  struct tcp_seg *parent = from->tree_parent;
+
+  if (parent == NULL) {
+    *root = to;
+  } else if (parent->tree_left == from) {
+    parent->tree_left = to;
+  } else {
+    parent->tree_right = to;
+  }
+  if (to != NULL) {
+    to->tree_parent = parent;
+  }
+}
+
+static void
+tcp_seg_tree_rotate_left(struct tcp_seg **root, struct tcp_seg *seg)
+{
+  struct tcp_seg *right = seg->tree_right;
+
+  seg->tree_right = right->tree_left;
+  if (right->tree_left != NULL) {
+    right->tree_left->tree_parent = seg;
+  }
+  tcp_seg_tree_replace(root, seg, right);
+  right->tree_left = seg;
+  seg->tree_parent = right;
+}
+
+static void
+tcp_seg_tree_rotate_right(struct tcp_seg **root, struct tcp_seg *seg)
+{
+  struct tcp_seg *left = seg->tree_left;
+
+  seg->tree_left = left->tree_right;
+  if (left->tree_right != NULL) {
+    left->tree_right->tree_parent = seg;
+  }
+  tcp_seg_tree_replace(root, seg, left);
+  left->tree_right = seg;
+  seg->tree_parent = left;
+}
+
+/** Link seg as a red leaf below parent and restore the tree properties */
+static void
+tcp_seg_tree_link(struct tcp_seg **root, struct tcp_seg **link, struct tcp_seg *parent,
+                  struct tcp_seg *seg)
+{
+  struct tcp_seg *grandparent, *uncle;
+
+  seg->tree_parent = parent;
+  seg->tree_left = seg->tree_right = NULL;
+  seg->tree_red = 1;
+  *link = seg;
+
+  /* a red segment must not have a red parent */
+  while (((parent = seg->tree_parent) != NULL) && parent->tree_red) {
+    /* the root is black, so a red parent has a parent */
+    grandparent = parent->tree_parent;
+    if (parent == grandparent->tree_left) {
+      uncle = grandparent->tree_right;
+      if (TREE_RED(uncle)) {
+        parent->tree_red = uncle->tree_red = 0;
+        grandparent->tree_red = 1;
+        seg = grandparent;
+        continue;
+      }
+      if (seg == parent->tree_right) {
+        tcp_seg_tree_rotate_left(root, parent);
+        seg = parent;
+        parent = seg->tree_parent;
+      }
+      parent->tree_red = 0;
+      grandparent->tree_red = 1;
+      tcp_seg_tree_rotate_right(root, grandparent);
+    } else {
+      uncle = grandparent->tree_left;
+      if (TREE_RED(uncle)) {
+        parent->tree_red = uncle->tree_red = 0;
+        grandparent->tree_red = 1;
+        seg = grandparent;
+        continue;
+      }
+      if (seg == parent->tree_left) {
+        tcp_seg_tree_rotate_right(root, parent);
+        seg = parent;
+        parent = seg->tree_parent;
+      }
+      parent->tree_red = 0;
+      grandparent->tree_red = 1;
+      tcp_seg_tree_rotate_left(root, grandparent);
+    }
+  }
+  (*root)->tree_red = 0;
+}
+
+/**
+ * Add a segment that has just been put on a queue to the tree of the queue.
+ *
+ * @param root the root of the tree
+ * @param seg the segment
+ * @param seqno the sequence number of the segment in host byte order,
+ *        it must not be in the tree yet
+ */
+void
+tcp_seg_tree_insert(struct tcp_seg **root, struct tcp_seg *seg, u32_t seqno)
+{
+  struct tcp_seg **link = root;
+  struct tcp_seg *parent = NULL;
+
+  while (*link != NULL) {
+    parent = *link;
+    LWIP_ASSERT("tcp_seg_tree_insert: duplicate seqno", parent->tree_seqno != seqno);
+    link = TCP_SEQ_LT(seqno, parent->tree_seqno) ? &parent->tree_left : &parent->tree_right;
+  }
+  seg->tree_seqno = seqno;
+  tcp_seg_tree_link(root, link, parent, seg);
+}
+
+/**
+ * Add a segment that has just been put at the end of a queue to the tree
+ * of the queue. Does not need to search the tree.
+ *
+ * @param root the root of the tree
+ * @param last the segment that was the last one on the queue before seg,
+ *        NULL if the queue was empty
+ * @param seg the segment
+ * @param seqno the sequence number of the segment in host byte order
+ */
+void
+tcp_seg_tree_append(struct tcp_seg **root, struct tcp_seg *last, struct tcp_seg *seg, u32_t seqno)
+{
+  LWIP_ASSERT("tcp_seg_tree_append: not the last segment",
+              (last == NULL) ? (*root == NULL) : (last->tree_right == NULL));
+  LWIP_ASSERT("tcp_seg_tree_append: out of order",
+              (last == NULL) || TCP_SEQ_LT(last->tree_seqno, seqno));
+
+  seg->tree_seqno = seqno;
+  /* the last segment is the rightmost one */
+  tcp_seg_tree_link(root, (last == NULL) ? root : &last->tree_right, last, seg);
+}
+
+/** Restore the black height after a black segment has been removed above 'seg' */
+static void
+tcp_seg_tree_remove_fixup(struct tcp_seg **root, struct tcp_seg *seg, struct tcp_seg *parent)
+{
+  struct tcp_seg *sibling;
+
+  while ((seg != *root) && !TREE_RED(seg)) {
+    /* the side 'seg' is on is one black short, so the sibling is not NULL */
+    if (seg == parent->tree_left) {
+      sibling = parent->tree_right;
+      if (sibling->tree_red) {
+        sibling->tree_red = 0;
+        parent->tree_red = 1;
+        tcp_seg_tree_rotate_left(root, parent);
+        sibling = parent->tree_right;
+      }
+      if (!TREE_RED(sibling->tree_left) && !TREE_RED(sibling->tree_right)) {
+        sibling->tree_red = 1;
+        seg = parent;
+        parent = seg->tree_parent;
+      } else {
+        if (!TREE_RED(sibling->tree_right)) {
+          sibling->tree_left->tree_red = 0;
+          sibling->tree_red = 1;
+          tcp_seg_tree_rotate_right(root, sibling);
+          sibling = parent->tree_right;
+        }
+        sibling->tree_red = parent->tree_red;
+        parent->tree_red = 0;
+        sibling->tree_right->tree_red = 0;
+        tcp_seg_tree_rotate_left(root, parent);
+        seg = *root;
+      }
+    } else {
+      sibling = parent->tree_left;
+      if (sibling->tree_red) {
+        sibling->tree_red = 0;
+        parent->tree_red = 1;
+        tcp_seg_tree_rotate_right(root, parent);
+        sibling = parent->tree_left;
+      }
+      if (!TREE_RED(sibling->tree_left) && !TREE_RED(sibling->tree_right)) {
+        sibling->tree_red = 1;
+        seg = parent;
+        parent = seg->tree_parent;
+      } else {
+        if (!TREE_RED(sibling->tree_left)) {
+          sibling->tree_right->tree_red = 0;
+          sibling->tree_red = 1;
+          tcp_seg_tree_rotate_left(root, sibling);
+          sibling = parent->tree_left;
+        }
+        sibling->tree_red = parent->tree_red;
+        parent->tree_red = 0;
+        sibling->tree_left->tree_red = 0;
+        tcp_seg_tree_rotate_right(root, parent);
+        seg = *root;
+      }
+    }
+  }
+  if (seg != NULL) {
+    seg->tree_red = 0;
+  }
+}
+
+/**
+ * Remove a segment taken off a queue from the tree of the queue.
+ *
+ * @param root the root of the tree
+ * @param seg the segment to remove
+ */
+void
+tcp_seg_tree_remove(struct tcp_seg **root, struct tcp_seg *seg)
+{
+  struct tcp_seg *child, *parent;
+  u8_t removed_red = seg->tree_red;
+
+  if (seg->tree_left == NULL) {
+    child = seg->tree_right;
+    parent = seg->tree_parent;
+    tcp_seg_tree_replace(root, seg, child);
+  } else if (seg->tree_right == NULL) {
+    child = seg->tree_left;
+    parent = seg->tree_parent;
+    tcp_seg_tree_replace(root, seg, child);
+  } else {
+    /* move the successor, which has no left child, into the place of seg */
+    struct tcp_seg *next = seg->tree_right;
+    while (next->tree_left != NULL) {
+      next = next->tree_left;
+    }
+    removed_red = next->tree_red;
+    child = next->tree_right;
+    if (next->tree_parent == seg) {
+      parent = next;
+    } else {
+      parent = next->tree_parent;
+      tcp_seg_tree_replace(root, next, child);
+      next->tree_right = seg->tree_right;
+      next->tree_right->tree_parent = next;
+    }
+    tcp_seg_tree_replace(root, seg, next);
+    next->tree_left = seg->tree_left;
+    next->tree_left->tree_parent = next;
+    next->tree_red = seg->tree_red;
+  }
+  if (!removed_red) {
+    tcp_seg_tree_remove_fixup(root, child, parent);
+  }
+  seg->tree_parent = seg->tree_left = seg->tree_right = NULL;
+}
+
+/**
+ * Find the segment a sequence number is in or goes after.
+ *
+ * @param root the root of the tree to search
+ * @param seqno the sequence number to look up in host byte order
+ * @return the last segment starting at or before seqno or NULL if there is none
+ */
+struct tcp_seg *
+tcp_seg_tree_find(struct tcp_seg *root, u32_t seqno)
+{
+  struct tcp_seg *found = NULL;
+
+  while (root != NULL) {
+    if (TCP_SEQ_LT(seqno, root->tree_seqno)) {
+      root = root->tree_left;
+    } else {
+      found = root;
+      root = root->tree_right;
+    }
+  }
+  return found;
+}
+
+/**
+ * Get the segment before a segment on a queue, which cannot be found
+ * through the singly linked list.
+ *
+ * @param seg a segment in a tree
+ * @return the segment before it or NULL if it is the first one
+ */
+struct tcp_seg *
+tcp_seg_tree_prev(const struct tcp_seg *seg)
+{
+  struct tcp_seg *prev;
+
+  if (seg->tree_left != NULL) {
+    for (prev = seg->tree_left; prev->tree_right != NULL; prev = prev->tree_right);
+    return prev;
+  }
+  while ((seg->tree_parent != NULL) && (seg == seg->tree_parent->tree_left)) {
+    seg = seg->tree_parent;
+  }
+  return seg->tree_parent;
+}
+
+#endif /* LWIP_TCP && (TCP_OOSEQ_TREE || TCP_UNACKED_TREE) */
@@ -0,0 +1,309 @@
+/**
+ * @file
+ * SYN cookies for TCP (RFC 4987)
+ *
+ * When a listener cannot take another connection request, because its
+ * backlog is full or no tcp_pcb is left, tcp_listen_input() answers the SYN
+ * with a SYN|ACK whose sequence number encodes the request and allocates
+ * nothing. The final ACK of the handshake returns the cookie in its ACK
+ * number, and only then a pcb is set up for the connection.
+ *
+ * The 32 bits of the cookie hold:
+ * - bits 31-29: the index of the MSS of the remote host in a table
+ * - bits 28-0:  a keyed hash (HalfSipHash-2-4) of the addresses, the ports,
+ *               the initial sequence number of the remote host and the MSS
+ *               index
+ *
+ * The key is replaced by a new random one every period of 64 seconds
+ * and the keys of the last periods are kept to check cookies against. A
+ * cookie expires when its key is dropped.
+ *
+ * There is no room for the other SYN options. If the remote host uses TCP
+ * timestamps, its window scale and the SACK and ECN settings go into the low
+ * bits of our timestamp value, which it echoes in every segment. Otherwise
+ * these options are not offered in the SYN|ACK.
+ */
+
+#include "lwip/opt.h"
+
+#if LWIP_TCP && LWIP_TCP_SYNCOOKIES /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/sys.h"
+
+/** sys_now() is shifted by this to get the key period (65.5 seconds) */
+#define TCP_SYNCOOKIE_PERIOD_SHIFT  16
+/** Cookies keyed this many periods ago are still accepted */
+#define TCP_SYNCOOKIE_MAX_AGE       2
+/** Keys kept, a power of 2 above TCP_SYNCOOKIE_MAX_AGE */
+#define TCP_SYNCOOKIE_KEYS          4
+/** Period of a key slot that holds no key */
+#define TCP_SYNCOOKIE_NO_PERIOD     0xffffffffUL
+
+#define TCP_SYNCOOKIE_MSS_SHIFT     29
+#define TCP_SYNCOOKIE_HASH_MASK     0x1fffffffUL
+
+/* the options in the low bits of the timestamp value */
+#define TCP_SYNCOOKIE_TS_WS_MASK    0x0fUL
+#define TCP_SYNCOOKIE_TS_SACK       0x10UL
+#define TCP_SYNCOOKIE_TS_ECN        0x20UL
+#define TCP_SYNCOOKIE_TS_MASK       0x3fUL
+
+/** MSS values a cookie can hold, the MSS of the remote host is rounded down */
+static const u16_t tcp_syncookie_mss_tab[] = {
+  216, 536, 1220, 1300, 1400, 1440, 1460, 8960
+};
+
+/** A secret the cookies of one period are keyed with */
+struct tcp_syncookie_key {
+  u32_t period;
+  u32_t k[2];
+};
+
+static struct tcp_syncookie_key tcp_syncookie_keys[TCP_SYNCOOKIE_KEYS];
+
+/**
+ * Drop all keys, the first cookie picks a new one. Called from tcp_init().
+ */
+void
+tcp_syncookie_init(void)
+{
+  u8_t i;
+
+  for (i = 0; i < TCP_SYNCOOKIE_KEYS; i++) {
+    tcp_syncookie_keys[i].period = TCP_SYNCOOKIE_NO_PERIOD;
+  }
+}
+
+/**
+ * Get the key of a period.
+ *
+ * @param period the key period (sys_now() >> TCP_SYNCOOKIE_PERIOD_SHIFT)
+ * @param create 1 to pick a new key if the period has none yet
+ * @return the key or NULL if the period has none
+ */
+static const u32_t *
+tcp_syncookie_key(u32_t period, u8_t create)
+{
+  struct tcp_syncookie_key *key = &tcp_syncookie_keys[period & (TCP_SYNCOOKIE_KEYS - 1)];
+
+  if (key->period != period) {
+    if (!create) {
+      return NULL;
+    }
+    /* replaces the key of an expired period */
+    key->period = period;
+    key->k[0] = LWIP_RAND();
+    key->k[1] = LWIP_RAND();
+  }
+  return key->k;
+}
+
+#define TCP_SYNCOOKIE_ROTL(x, b)    (((x) << (b)) | ((x) >> (32 - (b))))
+
+/** One SipRound on the 32-bit state of HalfSipHash */
+static void
+tcp_syncookie_sipround(u32_t *v)
+{
+  v[0] += v[1];
+  v[1] = TCP_SYNCOOKIE_ROTL(v[1], 5);
+  v[1] ^= v[0];
+  v[0] = TCP_SYNCOOKIE_ROTL(v[0], 16);
+  v[2] += v[3];
+  v[3] = TCP_SYNCOOKIE_ROTL(v[3], 8);
+  v[3] ^= v[2];
+  v[0] += v[3];
+  v[3] = TCP_SYNCOOKIE_ROTL(v[3], 7);
+  v[3] ^= v[0];
+  v[2] += v[1];
+  v[1] = TCP_SYNCOOKIE_ROTL(v[1], 13);
+  v[1] ^= v[2];
+  v[2] = TCP_SYNCOOKIE_ROTL(v[2], 16);
+}
+
+/** HalfSipHash-2-4 of a message of whole 32-bit words */
+static u32_t
+tcp_syncookie_siphash(const u32_t *k, const u32_t *m, u8_t n)
+{
+  u32_t v[4];
+  u32_t b = (u32_t)n << 26; /* the length in bytes in the top byte */
+  u8_t i;
+
+  v[0] = k[0];
+  v[1] = k[1];
+  v[2] = k[0] ^ 0x6c796765UL;
+  v[3] = k[1] ^ 0x74656462UL;
+  for (i = 0; i < n; i++) {
+    v[3] ^= m[i];
+    tcp_syncookie_sipround(v);
+    tcp_syncookie_sipround(v);
+    v[0] ^= m[i];
+  }
+  v[3] ^= b;
+  tcp_syncookie_sipround(v);
+  tcp_syncookie_sipround(v);
+  v[0] ^= b;
+  v[2] ^= 0xff;
+  for (i = 0; i < 4; i++) {
+    tcp_syncookie_sipround(v);
+  }
+  return v[1] ^ v[3];
+}
+
+/** Append an address to the words to hash, return the number of words */
+static u8_t
+tcp_syncookie_addr_words(u32_t *m, const ip_addr_t *addr)
+{
+#if LWIP_IPV6
+  if (IP_IS_V6(addr)) {
+    const ip6_addr_t *ip6 = ip_2_ip6(addr);
+    m[0] = ip6->addr[0];
+    m[1] = ip6->addr[1];
+    m[2] = ip6->addr[2];
+    m[3] = ip6->addr[3];
+    return 4;
+  }
+#endif /* LWIP_IPV6 */
+#if LWIP_IPV4
+  m[0] = ip4_addr_get_u32(ip_2_ip4(addr));
+  return 1;
+#else /* LWIP_IPV4 */
+  LWIP_UNUSED_ARG(m);
+  return 0;
+#endif /* LWIP_IPV4 */
+}
+
+/** The hash part of a cookie */
+static u32_t
+tcp_syncookie_hash(const u32_t *key, const struct tcp_handshake *ck, u8_t idx,
+                   const ip_addr_t *local_ip, u16_t local_port,
+                   const ip_addr_t *remote_ip, u16_t remote_port)
+{
+  /* two IPv6 addresses, the ports, irs and the MSS index */
+  u32_t m[11];
+  u8_t n;
+
+  n = tcp_syncookie_addr_words(m, local_ip);
+  n += tcp_syncookie_addr_words(&m[n], remote_ip);
+  m[n++] = ((u32_t)local_port << 16) | remote_port;
+  m[n++] = ck->irs;
+  m[n++] = idx;
+  return tcp_syncookie_siphash(key, m, n) & TCP_SYNCOOKIE_HASH_MASK;
+}
+
+/**
+ * Encode a connection request in our initial sequence number.
+ *
+ * @param ck the request as received in the SYN: irs, mss, snd_scale, ecn,
+ *        the TF_SEG_OPTS_* options the remote host sent and its timestamp.
+ *        On return, iss holds the cookie, mss is rounded down to what the
+ *        cookie can hold and optflags are the options to send in the SYN|ACK.
+ * @param local_ip the local IP address of the connection
+ * @param local_port the local TCP port of the connection
+ * @param remote_ip the IP address of the remote host
+ * @param remote_port the TCP port of the remote host
+ */
+void
+tcp_syncookie_make(struct tcp_handshake *ck,
+                   const ip_addr_t *local_ip, u16_t local_port,
+                   const ip_addr_t *remote_ip, u16_t remote_port)
+{
+  const u32_t *key = tcp_syncookie_key(sys_now() >> TCP_SYNCOOKIE_PERIOD_SHIFT, 1);
+  u8_t idx;
+
+  for (idx = LWIP_ARRAYSIZE(tcp_syncookie_mss_tab) - 1; idx > 0; idx--) {
+    if (tcp_syncookie_mss_tab[idx] <= ck->mss) {
+      break;
+    }
+  }
+  ck->mss = tcp_syncookie_mss_tab[idx];
+  ck->iss = ((u32_t)idx << TCP_SYNCOOKIE_MSS_SHIFT) |
+            tcp_syncookie_hash(key, ck, idx, local_ip, local_port, remote_ip, remote_port);
+
+#if LWIP_TCP_TIMESTAMPS
+  if (ck->optflags & TF_SEG_OPTS_TS) {
+    u32_t opts = (ck->optflags & TF_SEG_OPTS_WND_SCALE) ? ck->snd_scale : TCP_SYNCOOKIE_TS_WS_MASK;
+
+    if (ck->optflags & TF_SEG_OPTS_SACK_PERM) {
+      opts |= TCP_SYNCOOKIE_TS_SACK;
+    }
+    if (ck->ecn) {
+      opts |= TCP_SYNCOOKIE_TS_ECN;
+    }
+    ck->ts_val = (sys_now() & ~TCP_SYNCOOKIE_TS_MASK) | opts;
+    ck->optflags |= TF_SEG_OPTS_MSS;
+    return;
+  }
+#endif /* LWIP_TCP_TIMESTAMPS */
+  /* without timestamps, the other options cannot be restored */
+  ck->optflags = TF_SEG_OPTS_MSS;
+  ck->ecn = 0;
+}
+
+/**
+ * Check if the ACK that completes a handshake carries a valid cookie and
+ * restore the connection request from it.
+ *
+ * @param ck iss (the ACK number - 1), irs (the sequence number - 1), and the
+ *        TF_SEG_OPTS_TS flag with the timestamps if the ACK carries them.
+ *        On success, mss, optflags, snd_scale and ecn are restored.
+ * @param local_ip the local IP address of the connection
+ * @param local_port the local TCP port of the connection
+ * @param remote_ip the IP address of the remote host
+ * @param remote_port the TCP port of the remote host
+ * @return 1 if the cookie is valid, 0 if not
+ */
+u8_t
+tcp_syncookie_check(struct tcp_handshake *ck,
+                    const ip_addr_t *local_ip, u16_t local_port,
+                    const ip_addr_t *remote_ip, u16_t remote_port)
+{
+  u32_t now = sys_now() >> TCP_SYNCOOKIE_PERIOD_SHIFT;
+  u8_t idx = (u8_t)(ck->iss >> TCP_SYNCOOKIE_MSS_SHIFT);
+  const u32_t *key;
+  u8_t age;
+
+  /* the cookie does not say which key it was made with, try all of them */
+  for (age = 0; age <= TCP_SYNCOOKIE_MAX_AGE; age++) {
+    key = tcp_syncookie_key(now - age, 0);
+    if ((key != NULL) &&
+        ((ck->iss & TCP_SYNCOOKIE_HASH_MASK) ==
+         tcp_syncookie_hash(key, ck, idx, local_ip, local_port, remote_ip, remote_port))) {
+      break;
+    }
+  }
+  if (age > TCP_SYNCOOKIE_MAX_AGE) {
+    return 0;
+  }
+  ck->mss = tcp_syncookie_mss_tab[idx];
+  ck->ecn = 0;
+
+#if LWIP_TCP_TIMESTAMPS
+  if (ck->optflags & TF_SEG_OPTS_TS) {
+    u32_t ws = ck->ts_val & TCP_SYNCOOKIE_TS_WS_MASK;
+
+    ck->optflags = TF_SEG_OPTS_MSS | TF_SEG_OPTS_TS;
+#if LWIP_WND_SCALE
+    if (ws <= 14) {
+      ck->optflags |= TF_SEG_OPTS_WND_SCALE;
+      ck->snd_scale = (u8_t)ws;
+    }
+#else /* LWIP_WND_SCALE */
+    LWIP_UNUSED_ARG(ws);
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK_OUT
+    if (ck->ts_val & TCP_SYNCOOKIE_TS_SACK) {
+      ck->optflags |= TF_SEG_OPTS_SACK_PERM;
+    }
+#endif /* LWIP_TCP_SACK_OUT */
+#if LWIP_TCP_ECN
+    ck->ecn = (ck->ts_val & TCP_SYNCOOKIE_TS_ECN) ? 1 : 0;
+#endif /* LWIP_TCP_ECN */
+    return 1;
+  }
+#endif /* LWIP_TCP_TIMESTAMPS */
+  ck->optflags = TF_SEG_OPTS_MSS;
+  return 1;
+}
+
+#endif /* LWIP_TCP && LWIP_TCP_SYNCOOKIES */
@@ -0,0 +1,402 @@
+/**
+ * @file
+ * TCP segmentation offload
+ *
+ * tcp_output() sends a run of full-sized segments as one super-segment: a
+ * copy of the TCP header of the first segment followed by pbufs referencing
+ * the data of all of them. It goes through the IP layer and ARP/ND once and
+ * has p->tso_segsz set to the size of the segments. A netif with
+ * NETIF_FLAG_TSO gets it as is and lets the hardware split it; for all other
+ * netifs, tcp_gso_output() splits it right before netif->output, so only the
+ * per-frame header updates are done for every frame.
+ *
+ * The segments stay separate on the unacked queue: retransmissions, SACK and
+ * RACK still work on the segments tcp_write() made.
+ */
+
+#include "lwip/opt.h"
+
+#if LWIP_TCP && LWIP_TCP_TSO /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/memp.h"
+#include "lwip/netif.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/stats.h"
+#include "lwip/prot/ip4.h"
+#include "lwip/prot/ip6.h"
+
+#include <string.h>
+
+/** Free a pbuf referencing segment data and release the segment pbuf */
+static void
+tcp_tso_pbuf_free(struct pbuf *p)
+{
+  struct pbuf_custom_ref *pcr = (struct pbuf_custom_ref *)p;
+
+  LWIP_ASSERT("tcp_tso_pbuf_free: invalid pbuf", p != NULL);
+  pbuf_free(pcr->original);
+  memp_free(MEMP_TCP_TSO_PBUF, pcr);
+}
+
+/**
+ * Append pbufs referencing len bytes of src, starting offset bytes into it,
+ * to the chain p. They hold a reference on src, so src stays in use (and
+ * tcp_output_segment_busy() sees it) until all of them have been freed.
+ *
+ * @param p the pbuf chain to append to
+ * @param src the pbuf chain holding the data
+ * @param offset where the data starts in src
+ * @param len number of bytes to reference
+ * @return ERR_OK or ERR_MEM if MEMP_NUM_TCP_TSO_PBUF is too small
+ */
+static err_t
+tcp_tso_ref_data(struct pbuf *p, struct pbuf *src, u16_t offset, u16_t len)
+{
+  struct pbuf *q = src;
+
+  while ((q != NULL) && (offset >= q->len)) {
+    offset = (u16_t)(offset - q->len);
+    q = q->next;
+  }
+  while (len > 0) {
+    struct pbuf_custom_ref *pcr;
+    struct pbuf *r;
+    u16_t chunk;
+
+    LWIP_ASSERT("tcp_tso_ref_data: data beyond the pbuf chain", q != NULL);
+    chunk = LWIP_MIN(len, (u16_t)(q->len - offset));
+    pcr = (struct pbuf_custom_ref *)memp_malloc(MEMP_TCP_TSO_PBUF);
+    if (pcr == NULL) {
+      return ERR_MEM;
+    }
+    r = pbuf_alloced_custom(PBUF_RAW, chunk, PBUF_REF, &pcr->pc,
+                            (u8_t *)q->payload + offset, chunk);
+    LWIP_ASSERT("tcp_tso_ref_data: pbuf_alloced_custom failed", r != NULL);
+    pbuf_ref(src);
+    pcr->original = src;
+    pcr->pc.custom_free_function = tcp_tso_pbuf_free;
+    pbuf_cat(p, r);
+    len = (u16_t)(len - chunk);
+    offset = 0;
+    q = q->next;
+  }
+  return ERR_OK;
+}
+
+#if ENABLE_LOOPBACK
+/**
+ * Check if the IP layer loops segments to the remote address of pcb back
+ * instead of handing them to the netif. Looped back packets are not split
+ * and get no TCP checksum, so they must not be super-segments.
+ */
+static int
+tcp_tso_dest_is_local(struct tcp_pcb *pcb, struct netif *netif)
+{
+#if LWIP_IPV6
+  if (IP_IS_V6(&pcb->remote_ip)) {
+    int i;
+#if !LWIP_HAVE_LOOPIF
+    if (ip6_addr_isloopback(ip_2_ip6(&pcb->remote_ip))) {
+      return 1;
+    }
+#endif /* !LWIP_HAVE_LOOPIF */
+    for (i = 0; i < LWIP_IPV6_NUM_ADDRESSES; i++) {
+      if (ip6_addr_isvalid(netif_ip6_addr_state(netif, i)) &&
+          ip6_addr_eq(ip_2_ip6(&pcb->remote_ip), netif_ip6_addr(netif, i))) {
+        return 1;
+      }
+    }
+    return 0;
+  }
+#endif /* LWIP_IPV6 */
+#if LWIP_IPV4
+  if (ip4_addr_eq(ip_2_ip4(&pcb->remote_ip), netif_ip4_addr(netif))
+#if !LWIP_HAVE_LOOPIF
+      || ip4_addr_isloopback(ip_2_ip4(&pcb->remote_ip))
+#endif /* !LWIP_HAVE_LOOPIF */
+     ) {
+    return 1;
+  }
+#endif /* LWIP_IPV4 */
+  return 0;
+}
+#endif /* ENABLE_LOOPBACK */
+
+/**
+ * Find out how many segments following seg on the unsent queue can be sent
+ * together with it as one super-segment.
+ *
+ * Segments are only batched if they are all as long as the first one (the
+ * last one may be shorter if nagle would let it go), carry data only, are
+ * contiguous, fit into the window and are all new or all retransmissions.
+ * Nothing is batched for a destination the IP layer loops back.
+ *
+ * @param pcb the tcp_pcb sending
+ * @param seg the first segment to send
+ * @param wnd the window tcp_output() sends into
+ * @param netif the netif the segments are sent on
+ * @return the number of segments after seg to send with it, 0 to send seg alone
+ */
+u16_t
+tcp_tso_segs(struct tcp_pcb *pcb, struct tcp_seg *seg, u32_t wnd, struct netif *netif)
+{
+  struct tcp_seg *next;
+  u32_t max_len, total, seqno;
+  u16_t nsegs = 0;
+  u16_t tcphlen, hdrlen;
+
+  if ((netif->gso_max_size == 0) || (seg->len < TCP_TSO_MIN_SEG_LEN) ||
+      (TCPH_FLAGS(seg->tcphdr) & (TCP_SYN | TCP_FIN | TCP_RST | TCP_URG))) {
+    return 0;
+  }
+#if ENABLE_LOOPBACK
+  if (tcp_tso_dest_is_local(pcb, netif)) {
+    return 0;
+  }
+#endif /* ENABLE_LOOPBACK */
+  tcphlen = TCPH_HDRLEN_BYTES(seg->tcphdr);
+  /* leave room for the link header: tot_len can't exceed 0xffff */
+  max_len = LWIP_MIN(netif->gso_max_size, 0xffffU - PBUF_LINK_ENCAPSULATION_HLEN - PBUF_LINK_HLEN);
+  hdrlen = (u16_t)(tcphlen + (IP_IS_V6(&pcb->remote_ip) ? IP6_HLEN : IP_HLEN));
+  if (max_len < hdrlen + 2U * seg->len) {
+    return 0;
+  }
+  max_len -= hdrlen;
+#if LWIP_TCP_PACING
+  if ((pcb->pacing_flags & TCP_PACING_ON) && (pcb->pacing_rate != 0)) {
+    /* don't send more than a millisecond worth at once, but at least two */
+    max_len = LWIP_MIN(max_len, LWIP_MAX(pcb->pacing_rate / 1000, 2U * seg->len));
+  }
+#endif /* LWIP_TCP_PACING */
+
+  total = seg->len;
+  seqno = lwip_ntohl(seg->tcphdr->seqno);
+  for (next = seg->next; next != NULL; next = next->next) {
+    if ((nsegs + 2U > MEMP_NUM_TCP_TSO_PBUF / 2) ||
+        /* leave the other half of the pool to the frames tcp_gso_output() makes */
+        (lwip_ntohl(next->tcphdr->seqno) != seqno + total) ||
+        (next->len == 0) || (next->len > seg->len) ||
+        (total + next->len > max_len) ||
+        (lwip_ntohl(next->tcphdr->seqno) - pcb->lastack + next->len > wnd) ||
+        (TCPH_HDRLEN_BYTES(next->tcphdr) != tcphlen) ||
+        (TCPH_FLAGS(next->tcphdr) & (TCP_SYN | TCP_FIN | TCP_RST | TCP_URG)) ||
+        ((next->snd_time == 0) != (seg->snd_time == 0)) ||
+        /* see tcp_output_segment_busy() */
+        (next->p->ref != 1)) {
+      break;
+    }
+    if (next->len < seg->len) {
+      /* the frames are cut at seg->len, so a short segment ends the run;
+         it is only sent now if nagle would send it on its own, too */
+      if ((next->next != NULL) ||
+          (pcb->flags & (TF_NODELAY | TF_INFR | TF_NAGLEMEMERR | TF_FIN))) {
+        nsegs++;
+      }
+      break;
+    }
+    total += next->len;
+    nsegs++;
+  }
+  return nsegs;
+}
+
+/**
+ * Send seg and the nsegs segments following it as one super-segment.
+ * tcp_output_segment() has filled in the TCP header of seg already; its
+ * checksum is left to the netif or to tcp_gso_output().
+ *
+ * @param pcb the tcp_pcb sending
+ * @param seg the first segment, with the TCP header to send
+ * @param nsegs number of segments after seg, from tcp_tso_segs()
+ * @param tos the type of service for the IP header
+ * @param netif the netif to send on
+ * @return ERR_OK or the error of allocating or sending the super-segment
+ */
+err_t
+tcp_tso_output_segment(struct tcp_pcb *pcb, struct tcp_seg *seg, u16_t nsegs,
+                       u8_t tos, struct netif *netif)
+{
+  struct tcp_seg *s = seg;
+  struct tcp_hdr *tcphdr;
+  struct pbuf *p;
+  u16_t hdrlen = TCPH_HDRLEN_BYTES(seg->tcphdr);
+  u16_t i;
+  err_t err;
+
+  p = pbuf_alloc(PBUF_IP, hdrlen, PBUF_RAM);
+  if (p == NULL) {
+    return ERR_MEM;
+  }
+  tcphdr = (struct tcp_hdr *)p->payload;
+  MEMCPY(tcphdr, seg->tcphdr, hdrlen);
+
+  for (i = 0; i <= nsegs; i++, s = s->next) {
+    u16_t offset;
+
+    LWIP_ASSERT("tcp_tso_output_segment: not enough segments", s != NULL);
+    offset = (u16_t)((u8_t *)s->tcphdr - (u8_t *)s->p->payload + TCPH_HDRLEN_BYTES(s->tcphdr));
+    if (tcp_tso_ref_data(p, s->p, offset, s->len) != ERR_OK) {
+      pbuf_free(p);
+      return ERR_MEM;
+    }
+    if (i > 0) {
+      TCP_STATS_INC(tcp.xmit);
+      if (s->snd_time == 0) {
+        MIB2_STATS_INC(mib2.tcpoutsegs);
+      }
+    }
+    if (i == nsegs) {
+      /* the last frame pushes if the last segment does */
+      if (TCPH_FLAGS(s->tcphdr) & TCP_PSH) {
+        TCPH_SET_FLAG(tcphdr, TCP_PSH);
+      } else {
+        TCPH_UNSET_FLAG(tcphdr, TCP_PSH);
+      }
+    }
+  }
+  tcphdr->chksum = 0;
+  p->tso_segsz = seg->len;
+
+  LWIP_DEBUGF(TCP_OUTPUT_DEBUG, ("tcp_tso_output_segment: %"U16_F" segments, %"U16_F" bytes\n",
+                                 (u16_t)(nsegs + 1), (u16_t)(p->tot_len - hdrlen)));
+  NETIF_SET_HINTS(netif, &(pcb->netif_hints));
+  err = ip_output_if(p, &pcb->local_ip, &pcb->remote_ip, pcb->ttl,
+                     tos, IP_PROTO_TCP, netif);
+  NETIF_RESET_HINTS(netif);
+  pbuf_free(p);
+  return err;
+}
+
+/**
+ * Split a super-segment into frames of p->tso_segsz bytes and send them with
+ * netif->output (or netif->output_ip6). Called by the IP layer for netifs
+ * without NETIF_FLAG_TSO. The headers are copied for every frame, the data
+ * is referenced.
+ *
+ * @param p the super-segment, with IP and TCP header in the first pbuf
+ * @param netif the netif to send on
+ * @param dest the next hop passed to netif->output
+ * @return ERR_OK or the first error of allocating or sending a frame
+ */
+err_t
+tcp_gso_output(struct pbuf *p, struct netif *netif, const ip_addr_t *dest)
+{
+  struct tcp_hdr *tcphdr;
+  u16_t iphlen, tcphlen, hdrlen, segsz, offset, len, i;
+  u32_t seqno;
+  err_t err = ERR_OK;
+#if LWIP_IPV4
+  u16_t id = 0;
+#endif /* LWIP_IPV4 */
+
+  LWIP_ASSERT("tcp_gso_output: not a super-segment", p->tso_segsz != 0);
+
+#if LWIP_IPV6
+  if (IP_IS_V6(dest)) {
+    iphlen = IP6_HLEN;
+  } else
+#endif /* LWIP_IPV6 */
+  {
+#if LWIP_IPV4
+    iphlen = IPH_HL_BYTES((struct ip_hdr *)p->payload);
+    id = lwip_ntohs(IPH_ID((struct ip_hdr *)p->payload));
+#else /* LWIP_IPV4 */
+    return ERR_VAL;
+#endif /* LWIP_IPV4 */
+  }
+  if (p->len < iphlen + TCP_HLEN) {
+    return ERR_VAL;
+  }
+  tcphdr = (struct tcp_hdr *)((u8_t *)p->payload + iphlen);
+  tcphlen = TCPH_HDRLEN_BYTES(tcphdr);
+  hdrlen = (u16_t)(iphlen + tcphlen);
+  if (p->len < hdrlen) {
+    return ERR_VAL;
+  }
+  seqno = lwip_ntohl(tcphdr->seqno);
+  segsz = p->tso_segsz;
+
+  for (offset = hdrlen, i = 0; (offset < p->tot_len) && (err == ERR_OK); offset = (u16_t)(offset + len), i++) {
+    struct tcp_hdr *th;
+    struct pbuf *q;
+
+    len = LWIP_MIN(segsz, (u16_t)(p->tot_len - offset));
+    q = pbuf_alloc(PBUF_IP, tcphlen, PBUF_RAM);
+    if (q == NULL) {
+      return ERR_MEM;
+    }
+    th = (struct tcp_hdr *)q->payload;
+    MEMCPY(th, tcphdr, tcphlen);
+    th->seqno = lwip_htonl(seqno + (u32_t)(offset - hdrlen));
+    if (i > 0) {
+      /* CWR goes with the first frame only */
+      TCPH_UNSET_FLAG(th, TCP_CWR);
+    }
+    if ((u32_t)offset + len < p->tot_len) {
+      /* PSH and FIN go with the last frame only */
+      TCPH_UNSET_FLAG(th, TCP_PSH | TCP_FIN);
+    }
+    if (tcp_tso_ref_data(q, p, offset, len) != ERR_OK) {
+      pbuf_free(q);
+      return ERR_MEM;
+    }
+    th->chksum = 0;
+
+#if LWIP_IPV6
+    if (IP_IS_V6(dest)) {
+      struct ip6_hdr *ip6hdr;
+      ip6_addr_t src6, dest6;
+
+      ip6_addr_copy_from_packed(src6, ((struct ip6_hdr *)p->payload)->src);
+      ip6_addr_copy_from_packed(dest6, ((struct ip6_hdr *)p->payload)->dest);
+#if CHECKSUM_GEN_TCP
+      IF__NETIF_CHECKSUM_ENABLED(netif, NETIF_CHECKSUM_GEN_TCP) {
+        th->chksum = ip6_chksum_pseudo(q, IP_PROTO_TCP, q->tot_len, &src6, &dest6);
+      }
+#endif /* CHECKSUM_GEN_TCP */
+      if (pbuf_add_header(q, IP6_HLEN)) {
+        pbuf_free(q);
+        return ERR_BUF;
+      }
+      ip6hdr = (struct ip6_hdr *)q->payload;
+      MEMCPY(ip6hdr, p->payload, IP6_HLEN);
+      IP6H_PLEN_SET(ip6hdr, (u16_t)(q->tot_len - IP6_HLEN));
+      err = netif->output_ip6(netif, q, ip_2_ip6(dest));
+    } else
+#endif /* LWIP_IPV6 */
+    {
+#if LWIP_IPV4
+      struct ip_hdr *iphdr;
+      ip4_addr_t src4, dest4;
+
+      ip4_addr_copy(src4, ((struct ip_hdr *)p->payload)->src);
+      ip4_addr_copy(dest4, ((struct ip_hdr *)p->payload)->dest);
+#if CHECKSUM_GEN_TCP
+      IF__NETIF_CHECKSUM_ENABLED(netif, NETIF_CHECKSUM_GEN_TCP) {
+        th->chksum = inet_chksum_pseudo(q, IP_PROTO_TCP, q->tot_len, &src4, &dest4);
+      }
+#endif /* CHECKSUM_GEN_TCP */
+      if (pbuf_add_header(q, iphlen)) {
+        pbuf_free(q);
+        return ERR_BUF;
+      }
+      iphdr = (struct ip_hdr *)q->payload;
+      MEMCPY(iphdr, p->payload, iphlen);
+      IPH_LEN_SET(iphdr, lwip_htons(q->tot_len));
+      IPH_ID_SET(iphdr, lwip_htons((u16_t)(id + i)));
+      IPH_CHKSUM_SET(iphdr, 0);
+#if CHECKSUM_GEN_IP
+      IF__NETIF_CHECKSUM_ENABLED(netif, NETIF_CHECKSUM_GEN_IP) {
+        IPH_CHKSUM_SET(iphdr, inet_chksum(iphdr, iphlen));
+      }
+#endif /* CHECKSUM_GEN_IP */
+      err = netif->output(netif, q, ip_2_ip4(dest));
+#endif /* LWIP_IPV4 */
+    }
+    pbuf_free(q);
+  }
+  return err;
+}
+
+#endif /* LWIP_TCP && LWIP_TCP_TSO */
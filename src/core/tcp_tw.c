@@ -0,0 +1,244 @@
+/**
+ * @file
+ * Table of TCP connections in TIME_WAIT
+ *
+ * A connection that the application has closed does not need its tcp_pcb
+ * any more once it enters TIME_WAIT: all that is left to do is to ACK
+ * retransmitted FINs and to keep the 4-tuple from being reused for
+ * 2*TCP_MSL. The pcb is then freed and a struct tcp_tw is kept instead.
+ * The records are found by their 4-tuple through one hash table and by
+ * their local port through another, for tcp_bind() and tcp_new_port().
+ *
+ * The records are also linked in the order TIME_WAIT was (re)started, so
+ * that tcp_tw_tmr() stops at the first record that has not expired and
+ * the oldest record can be dropped when the pool is empty.
+ */
+
+#include "lwip/opt.h"
+
+#if LWIP_TCP && LWIP_TCP_TW_TABLE /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/memp.h"
+
+#include <string.h>
+
+/** The 4-tuple table */
+static struct tcp_tw *tcp_tw_table[TCP_TW_HASH_SIZE];
+/** The local port table */
+static struct tcp_tw *tcp_tw_ports[TCP_TW_HASH_SIZE];
+/** All records, the oldest first */
+static struct tcp_tw *tcp_tw_oldest;
+static struct tcp_tw **tcp_tw_youngest = &tcp_tw_oldest;
+
+/** The bucket of a 4-tuple */
+#define TCP_TW_BUCKET(lip, lport, rip, rport) \
+  (&tcp_tw_table[tcp_4tuple_hash(lip, lport, rip, rport) & (TCP_TW_HASH_SIZE - 1)])
+/** The bucket of a local port */
+#define TCP_TW_PORT_BUCKET(port) (&tcp_tw_ports[(port) & (TCP_TW_HASH_SIZE - 1)])
+
+/**
+ * Replace a pcb that has entered TIME_WAIT by a record. The pcb is removed
+ * from tcp_tw_pcbs and freed. If no record can be allocated, even after
+ * dropping the oldest one, the pcb is left on tcp_tw_pcbs.
+ *
+ * TIME_WAIT is restarted for the record: this never makes it shorter and
+ * keeps the age list in order.
+ *
+ * @param pcb the pcb in TIME_WAIT; the application must not refer to it any
+ *        more
+ */
+void
+tcp_tw_enter(struct tcp_pcb *pcb)
+{
+  struct tcp_tw *tw, **bucket;
+
+  LWIP_ASSERT("tcp_tw_enter: invalid pcb", pcb != NULL);
+  LWIP_ASSERT("tcp_tw_enter: pcb->state == TIME_WAIT", pcb->state == TIME_WAIT);
+
+  tw = (struct tcp_tw *)memp_malloc(MEMP_TCP_TW);
+  if ((tw == NULL) && (tcp_tw_oldest != NULL)) {
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_tw_enter: dropping oldest record (%"U32_F")\n",
+                            (u32_t)(tcp_ticks - tcp_tw_oldest->tmr)));
+    tcp_tw_free(tcp_tw_oldest);
+    tw = (struct tcp_tw *)memp_malloc(MEMP_TCP_TW);
+  }
+  if (tw == NULL) {
+    return;
+  }
+  memset(tw, 0, sizeof(struct tcp_tw));
+  ip_addr_copy(tw->local_ip, pcb->local_ip);
+  ip_addr_copy(tw->remote_ip, pcb->remote_ip);
+  tw->local_port = pcb->local_port;
+  tw->remote_port = pcb->remote_port;
+  tw->snd_nxt = pcb->snd_nxt;
+  tw->rcv_nxt = pcb->rcv_nxt;
+  tw->rcv_wnd = pcb->rcv_wnd;
+  tw->tmr = tcp_ticks;
+  tw->wnd = TCPWND_MIN16(RCV_WND_SCALE(pcb, pcb->rcv_ann_wnd));
+  tw->netif_idx = pcb->netif_idx;
+  tw->so_options = pcb->so_options;
+  tw->ttl = pcb->ttl;
+  tw->tos = pcb->tos;
+#if LWIP_TCP_TIMESTAMPS
+  tw->ts = (pcb->flags & TF_TIMESTAMP) ? 1 : 0;
+  tw->ts_recent = pcb->ts_recent;
+#endif /* LWIP_TCP_TIMESTAMPS */
+
+  bucket = TCP_TW_BUCKET(&tw->local_ip, tw->local_port, &tw->remote_ip, tw->remote_port);
+  tw->hash_next = *bucket;
+  *bucket = tw;
+  bucket = TCP_TW_PORT_BUCKET(tw->local_port);
+  tw->port_next = *bucket;
+  *bucket = tw;
+  TCP_AGE_LINK(tcp_tw_youngest, tw);
+
+  tcp_pcb_remove(&tcp_tw_pcbs, pcb);
+  tcp_free(pcb);
+  /* tcp_tw_tmr() expires the record */
+  tcp_timer_needed();
+}
+
+/**
+ * Remove a record from the table and free it.
+ *
+ * @param tw the record to free
+ */
+void
+tcp_tw_free(struct tcp_tw *tw)
+{
+  struct tcp_tw **link;
+
+  link = TCP_TW_BUCKET(&tw->local_ip, tw->local_port, &tw->remote_ip, tw->remote_port);
+  while (*link != tw) {
+    LWIP_ASSERT("tcp_tw_free: record not in table", *link != NULL);
+    link = &(*link)->hash_next;
+  }
+  *link = tw->hash_next;
+
+  link = TCP_TW_PORT_BUCKET(tw->local_port);
+  while (*link != tw) {
+    LWIP_ASSERT("tcp_tw_free: record not in port table", *link != NULL);
+    link = &(*link)->port_next;
+  }
+  *link = tw->port_next;
+
+  TCP_AGE_UNLINK(tcp_tw_youngest, tw);
+  memp_free(MEMP_TCP_TW, tw);
+}
+
+/**
+ * Find the record of a 4-tuple.
+ *
+ * @param local_ip the local IP address of the connection
+ * @param local_port the local TCP port of the connection
+ * @param remote_ip the IP address of the remote host
+ * @param remote_port the TCP port of the remote host
+ * @param netif_idx the index of the netif a segment arrived on, records
+ *        bound to another netif do not match; NETIF_NO_INDEX matches all
+ * @return the record or NULL if there is none
+ */
+struct tcp_tw *
+tcp_tw_lookup(const ip_addr_t *local_ip, u16_t local_port,
+              const ip_addr_t *remote_ip, u16_t remote_port,
+              u8_t netif_idx)
+{
+  struct tcp_tw *tw;
+
+  tw = *TCP_TW_BUCKET(local_ip, local_port, remote_ip, remote_port);
+  for (; tw != NULL; tw = tw->hash_next) {
+    if ((tw->remote_port == remote_port) &&
+        (tw->local_port == local_port) &&
+        ((tw->netif_idx == NETIF_NO_INDEX) || (netif_idx == NETIF_NO_INDEX) ||
+         (tw->netif_idx == netif_idx)) &&
+        ip_addr_eq(&tw->remote_ip, remote_ip) &&
+        ip_addr_eq(&tw->local_ip, local_ip)) {
+      return tw;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Restart the 2*TCP_MSL timeout of a record, e.g. for a retransmitted FIN.
+ *
+ * @param tw the record
+ */
+void
+tcp_tw_restart(struct tcp_tw *tw)
+{
+  tw->tmr = tcp_ticks;
+  TCP_AGE_UNLINK(tcp_tw_youngest, tw);
+  TCP_AGE_LINK(tcp_tw_youngest, tw);
+}
+
+/**
+ * Check whether a local port is in use by a record, the same way
+ * tcp_bind() checks the pcbs in TIME_WAIT.
+ *
+ * @param local_ip the local IP address to bind to, or NULL to find any
+ *        record that uses the port
+ * @param local_port the local TCP port
+ * @param so_options the socket options of the pcb to bind
+ * @return 1 if the port is in use, 0 if not
+ */
+u8_t
+tcp_tw_port_used(const ip_addr_t *local_ip, u16_t local_port, u8_t so_options)
+{
+  struct tcp_tw *tw;
+
+  LWIP_UNUSED_ARG(so_options); /* without SO_REUSE */
+
+  for (tw = *TCP_TW_PORT_BUCKET(local_port); tw != NULL; tw = tw->port_next) {
+    if (tw->local_port != local_port) {
+      continue;
+    }
+    if (local_ip == NULL) {
+      return 1;
+    }
+#if LWIP_SO_REUSEPORT
+    /* all members of a group must have it set */
+    if ((so_options & SOF_REUSEPORT) && (tw->so_options & SOF_REUSEPORT)) {
+      continue;
+    }
+#endif /* LWIP_SO_REUSEPORT */
+    if ((IP_IS_V6(local_ip) == IP_IS_V6_VAL(tw->local_ip)) &&
+        (ip_addr_isany(&tw->local_ip) ||
+         ip_addr_isany(local_ip) ||
+         ip_addr_eq(&tw->local_ip, local_ip))) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Drop the records that have stayed 2*TCP_MSL in TIME_WAIT. Called from
+ * tcp_slowtmr().
+ */
+void
+tcp_tw_tmr(void)
+{
+  struct tcp_tw *tw;
+
+  while ((tw = tcp_tw_oldest) != NULL) {
+    if ((u32_t)(tcp_ticks - tw->tmr) <= 2 * TCP_MSL / TCP_SLOW_INTERVAL) {
+      /* the younger records have not expired either */
+      break;
+    }
+    tcp_tw_free(tw);
+  }
+}
+
+/**
+ * Tell whether there are records for tcp_tw_tmr() to look after.
+ *
+ * @return 1 if the table is not empty
+ */
+u8_t
+tcp_tw_pending(void)
+{
+  return tcp_tw_oldest != NULL;
+}
+
+#endif /* LWIP_TCP && LWIP_TCP_TW_TABLE */
@@ -60,6 +60,7 @@
 #include "lwip/dhcp6.h"
 #include "lwip/sys.h"
 #include "lwip/pbuf.h"
+#include "netif/ppp/ppp_opts.h" /* PPP_NUM_TIMEOUTS in the default LWIP_TIMERS_HASH_SIZE */
 
 #if LWIP_DEBUG_TIMERNAMES
 #define HANDLER(x) x, #x
@@ -118,11 +119,115 @@ const int lwip_num_cyclic_timers = LWIP_ARRAYSIZE(lwip_cyclic_timers);
 
 #if LWIP_TIMERS && !LWIP_TIMERS_CUSTOM
 
-/** The one and only timeout list */
+/** The one and only timeout list (or heap, see LWIP_TIMERS_HEAP) */
 static struct sys_timeo *next_timeout;
 
 static u32_t current_timeout_due_time;
 
+#if LWIP_TIMERS_HEAP
+/* With LWIP_TIMERS_HEAP, next_timeout is the root of a pairing heap ordered by
+   expiry time (and creation for equal times), and all pending timeouts are
+   also chained in a hash table on handler and argument for sys_untimeout(). */
+static struct sys_timeo *timeouts_hash[LWIP_TIMERS_HASH_SIZE];
+static u32_t timeouts_seq;
+
+#define TIMEOUTS_HASH(handler, arg) \
+  (((((u32_t)(mem_ptr_t)(arg) ^ ((u32_t)(mem_ptr_t)(handler) >> 2)) * 2654435761U) >> 16) & (LWIP_TIMERS_HASH_SIZE - 1))
+
+/* Check if timeout a expires before timeout b */
+#define TIMEOUT_BEFORE(a, b) (TIME_LESS_THAN((a)->time, (b)->time) || \
+                              (((a)->time == (b)->time) && ((s32_t)((a)->seq - (b)->seq) < 0)))
+
+/** Meld two pairing heaps, returns the new root */
+static struct sys_timeo *
+sys_timeo_meld(struct sys_timeo *a, struct sys_timeo *b)
+{
+  struct sys_timeo *t;
+
+  if (a == NULL) {
+    return b;
+  }
+  if (b == NULL) {
+    return a;
+  }
+  if (TIMEOUT_BEFORE(b, a)) {
+    t = a;
+    a = b;
+    b = t;
+  }
+  /* b becomes the leftmost child of a */
+  b->prev = a;
+  b->next = a->child;
+  if (a->child != NULL) {
+    a->child->prev = b;
+  }
+  a->child = b;
+  a->next = NULL;
+  a->prev = NULL;
+  return a;
+}
+
+/** Meld a list of sibling heaps into one (two-pass pairing) */
+static struct sys_timeo *
+sys_timeo_meld_siblings(struct sys_timeo *first)
+{
+  struct sys_timeo *pairs = NULL;
+  struct sys_timeo *root = NULL;
+
+  /* left to right: meld pairs, collecting them in reverse order */
+  while (first != NULL) {
+    struct sys_timeo *a = first;
+    struct sys_timeo *b = first->next;
+    first = (b != NULL) ? b->next : NULL;
+    a = sys_timeo_meld(a, b);
+    a->next = pairs;
+    pairs = a;
+  }
+  /* right to left: meld the pairs into one heap */
+  while (pairs != NULL) {
+    struct sys_timeo *next = pairs->next;
+    root = sys_timeo_meld(root, pairs);
+    pairs = next;
+  }
+  return root;
+}
+
+/** Remove a timeout from the heap */
+static void
+sys_timeo_heap_remove(struct sys_timeo *t)
+{
+  if (t == next_timeout) {
+    next_timeout = sys_timeo_meld_siblings(t->child);
+  } else {
+    /* unlink t from its parent or left sibling */
+    if (t->prev->child == t) {
+      t->prev->child = t->next;
+    } else {
+      t->prev->next = t->next;
+    }
+    if (t->next != NULL) {
+      t->next->prev = t->prev;
+    }
+    next_timeout = sys_timeo_meld(next_timeout, sys_timeo_meld_siblings(t->child));
+  }
+  t->child = NULL;
+}
+
+/** Remove a timeout from the heap and from its hash chain */
+static void
+sys_timeo_remove(struct sys_timeo *t)
+{
+  struct sys_timeo **pp = &timeouts_hash[TIMEOUTS_HASH(t->h, t->arg)];
+
+  while (*pp != t) {
+    LWIP_ASSERT("sys_timeo_remove: timeout not hashed", *pp != NULL);
+    pp = &(*pp)->hash_next;
+  }
+  *pp = t->hash_next;
+  sys_timeo_heap_remove(t);
+}
+#endif /* LWIP_TIMERS_HEAP */
+
 #if LWIP_TESTMODE
 struct sys_timeo**
 sys_timeouts_get_next_timeout(void)
@@ -148,7 +253,7 @@ tcpip_tcp_timer(void *arg)
   /* call TCP timer handler */
   tcp_tmr();
   /* timer still needed? */
-  if (tcp_active_pcbs || tcp_tw_pcbs) {
+  if (tcp_active_pcbs || tcp_tw_pcbs || tcp_req_pending() || tcp_tw_pending()) {
     /* restart timer */
     sys_timeout(TCP_TMR_INTERVAL, tcpip_tcp_timer, NULL);
   } else {
@@ -160,7 +265,8 @@ tcpip_tcp_timer(void *arg)
 /**
  * Called from TCP_REG when registering a new PCB:
  * the reason is to have the TCP timer only running when
- * there are active (or time-wait) PCBs.
+ * there are active (or time-wait) PCBs, pending connection requests or
+ * time-wait records.
  */
 void
 tcp_timer_needed(void)
@@ -168,7 +274,7 @@ tcp_timer_needed(void)
   LWIP_ASSERT_CORE_LOCKED();
 
   /* timer is off but needed again? */
-  if (!tcpip_tcp_timer_active && (tcp_active_pcbs || tcp_tw_pcbs)) {
+  if (!tcpip_tcp_timer_active && (tcp_active_pcbs || tcp_tw_pcbs || tcp_req_pending() || tcp_tw_pending())) {
     /* enable and start timer */
     tcpip_tcp_timer_active = 1;
     sys_timeout(TCP_TMR_INTERVAL, tcpip_tcp_timer, NULL);
@@ -183,7 +289,10 @@ sys_timeout_abs(u32_t abs_time, sys_timeout_handler handler, void *arg, const ch
 sys_timeout_abs(u32_t abs_time, sys_timeout_handler handler, void *arg)
 #endif
 {
-  struct sys_timeo *timeout, *t;
+  struct sys_timeo *timeout;
+#if !LWIP_TIMERS_HEAP
+  struct sys_timeo *t;
+#endif /* !LWIP_TIMERS_HEAP */
 
   timeout = (struct sys_timeo *)memp_malloc(MEMP_SYS_TIMEOUT);
   if (timeout == NULL) {
@@ -202,6 +311,14 @@ sys_timeout_abs(u32_t abs_time, sys_timeout_handler handler, void *arg)
                              (void *)timeout, abs_time, handler_name, (void *)arg));
 #endif /* LWIP_DEBUG_TIMERNAMES */
 
+#if LWIP_TIMERS_HEAP
+  timeout->child = NULL;
+  timeout->prev = NULL;
+  timeout->seq = timeouts_seq++;
+  timeout->hash_next = timeouts_hash[TIMEOUTS_HASH(handler, arg)];
+  timeouts_hash[TIMEOUTS_HASH(handler, arg)] = timeout;
+  next_timeout = sys_timeo_meld(next_timeout, timeout);
+#else /* LWIP_TIMERS_HEAP */
   if (next_timeout == NULL) {
     next_timeout = timeout;
     return;
@@ -218,6 +335,7 @@ sys_timeout_abs(u32_t abs_time, sys_timeout_handler handler, void *arg)
       }
     }
   }
+#endif /* LWIP_TIMERS_HEAP */
 }
 
 /**
@@ -316,7 +434,11 @@ sys_timeout(u32_t msecs, sys_timeout_handler handler, void *arg)
 void
 sys_untimeout(sys_timeout_handler handler, void *arg)
 {
+#if LWIP_TIMERS_HEAP
+  struct sys_timeo *first, *t;
+#else /* LWIP_TIMERS_HEAP */
   struct sys_timeo *prev_t, *t;
+#endif /* LWIP_TIMERS_HEAP */
 
   LWIP_ASSERT_CORE_LOCKED();
 
@@ -324,6 +446,20 @@ sys_untimeout(sys_timeout_handler handler, void *arg)
     return;
   }
 
+#if LWIP_TIMERS_HEAP
+  /* the first matching entry in list order is the one expiring first */
+  first = NULL;
+  for (t = timeouts_hash[TIMEOUTS_HASH(handler, arg)]; t != NULL; t = t->hash_next) {
+    if ((t->h == handler) && (t->arg == arg) &&
+        ((first == NULL) || TIMEOUT_BEFORE(t, first))) {
+      first = t;
+    }
+  }
+  if (first != NULL) {
+    sys_timeo_remove(first);
+    memp_free(MEMP_SYS_TIMEOUT, first);
+  }
+#else /* LWIP_TIMERS_HEAP */
   for (t = next_timeout, prev_t = NULL; t != NULL; prev_t = t, t = t->next) {
     if ((t->h == handler) && (t->arg == arg)) {
       /* We have a match */
@@ -337,7 +473,7 @@ sys_untimeout(sys_timeout_handler handler, void *arg)
       return;
     }
   }
-  return;
+#endif /* LWIP_TIMERS_HEAP */
 }
 
 /**
@@ -375,7 +511,11 @@ sys_check_timeouts(void)
     }
 
     /* Timeout has expired */
+#if LWIP_TIMERS_HEAP
+    sys_timeo_remove(tmptimeout);
+#else /* LWIP_TIMERS_HEAP */
     next_timeout = tmptimeout->next;
+#endif /* LWIP_TIMERS_HEAP */
     handler = tmptimeout->h;
     arg = tmptimeout->arg;
     current_timeout_due_time = tmptimeout->time;
@@ -414,9 +554,21 @@ sys_restart_timeouts(void)
   now = sys_now();
   base = next_timeout->time;
 
+#if LWIP_TIMERS_HEAP
+  {
+    /* shifting all timeouts by the same offset keeps the heap ordered */
+    size_t i;
+    for (i = 0; i < LWIP_TIMERS_HASH_SIZE; i++) {
+      for (t = timeouts_hash[i]; t != NULL; t = t->hash_next) {
+        t->time = (t->time - base) + now;
+      }
+    }
+  }
+#else /* LWIP_TIMERS_HEAP */
   for (t = next_timeout; t != NULL; t = t->next) {
     t->time = (t->time - base) + now;
   }
+#endif /* LWIP_TIMERS_HEAP */
 }
 
 /** Return the time left before the next timeout is due. If no timeouts are
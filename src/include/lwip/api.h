@@ -65,6 +65,7 @@ extern "C" {
 #define NETCONN_DONTBLOCK   0x04
 #define NETCONN_NOAUTORCVD  0x08 /* prevent netconn_recv_data_tcp() from updating the tcp window - must be done manually via netconn_tcp_recvd() */
 #define NETCONN_NOFIN       0x10 /* upper layer already received data, leave FIN in queue until called again */
+#define NETCONN_ZEROCOPY    0x20 /* don't copy, the data must not change until netconn_zerocopy_completed() reports the write */
 
 /* Flags for struct netconn.flags (u8_t) */
 /** This netconn had an error, don't block on recvmbox/acceptmbox any more */
@@ -280,6 +281,12 @@ struct netconn {
       this temporarily stores the message.
       Also used during connect and close. */
   struct api_msg *current_msg;
+#if LWIP_TCP_ZEROCOPY
+  /** TCP: number of zero-copy writes that have been ACKed */
+  u32_t zc_acked;
+  /** TCP: number of zero-copy writes reported by netconn_zerocopy_completed() */
+  u32_t zc_reported;
+#endif /* LWIP_TCP_ZEROCOPY */
 #endif /* LWIP_TCP */
   /** A callback function that is informed about events for this netconn */
   netconn_callback callback;
@@ -349,6 +356,9 @@ err_t   netconn_write_vectors_partly(struct netconn *conn, struct netvector *vec
           netconn_write_partly(conn, dataptr, size, apiflags, NULL)
 err_t   netconn_close(struct netconn *conn);
 err_t   netconn_shutdown(struct netconn *conn, u8_t shut_rx, u8_t shut_tx);
+#if LWIP_TCP && LWIP_TCP_ZEROCOPY
+err_t   netconn_zerocopy_completed(struct netconn *conn, u32_t *lo, u32_t *hi);
+#endif /* LWIP_TCP && LWIP_TCP_ZEROCOPY */
 
 #if LWIP_IGMP || (LWIP_IPV6 && LWIP_IPV6_MLD)
 err_t   netconn_join_leave_group(struct netconn *conn, const ip_addr_t *multiaddr,
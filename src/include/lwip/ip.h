@@ -98,6 +98,7 @@ struct ip_pcb {
  */
 #define SOF_REUSEADDR     0x04U  /* allow local address reuse */
 #define SOF_KEEPALIVE     0x08U  /* keep connections alive */
+#define SOF_REUSEPORT     0x10U  /* allow listeners to share a local address and port (see LWIP_SO_REUSEPORT) */
 #define SOF_BROADCAST     0x20U  /* permit to send and to receive broadcast messages (see IP_SOF_BROADCAST option) */
 
 /* These flags are inherited (e.g. from a listen-pcb to a connection-pcb): */
@@ -163,6 +164,10 @@ extern struct ip_globals ip_data;
 #define ip_current_header_proto() (ip_current_is_v6() ? \
                                    IP6H_NEXTH(ip6_current_header()) :\
                                    IPH_PROTO(ip4_current_header()))
+/** Get the TOS (IPv4) or traffic class (IPv6) byte */
+#define ip_current_header_tos()   (ip_current_is_v6() ? \
+                                   IP6H_TC(ip6_current_header()) :\
+                                   IPH_TOS(ip4_current_header()))
 /** Get the transport layer header */
 #define ip_next_header_ptr()     ((const void*)((ip_current_is_v6() ? \
   (const u8_t*)ip6_current_header() : (const u8_t*)ip4_current_header())  + ip_current_header_tot_len()))
@@ -182,6 +187,8 @@ extern struct ip_globals ip_data;
 #define ip_current_is_v6()        0
 /** Get the transport layer protocol */
 #define ip_current_header_proto() IPH_PROTO(ip4_current_header())
+/** Get the TOS byte */
+#define ip_current_header_tos()   IPH_TOS(ip4_current_header())
 /** Get the transport layer header */
 #define ip_next_header_ptr()     ((const void*)((const u8_t*)ip4_current_header() + ip_current_header_tot_len()))
 /** Source IP4 address of current_header */
@@ -199,6 +206,8 @@ extern struct ip_globals ip_data;
 #define ip_current_is_v6()        1
 /** Get the transport layer protocol */
 #define ip_current_header_proto() IP6H_NEXTH(ip6_current_header())
+/** Get the traffic class byte */
+#define ip_current_header_tos()   IP6H_TC(ip6_current_header())
 /** Get the transport layer header */
 #define ip_next_header_ptr()     ((const void*)(((const u8_t*)ip6_current_header()) + ip_current_header_tot_len()))
 /** Source IP6 address of current_header */
@@ -105,6 +105,10 @@ extern "C" {
 /** If set, the netif has MLD6 capability.
  * Set by the netif driver in its init function. */
 #define NETIF_FLAG_MLD6         0x40U
+/** If set, the netif splits TCP segments bigger than the MTU itself
+ * (TCP segmentation offload) and computes their TCP checksums.
+ * Set by the netif driver in its init function. */
+#define NETIF_FLAG_TSO          0x80U
 
 /**
  * @}
@@ -346,6 +350,18 @@ struct netif {
   /** maximum transfer unit (in bytes), updated by RA */
   u16_t mtu6;
 #endif /* LWIP_IPV6 && LWIP_ND6_ALLOW_RA_UPDATES */
+#if LWIP_TCP_TSO
+  /** maximum size (in bytes, IP header included) of a TCP segment that is
+   *  passed down as one pbuf and split into MTU sized frames by the netif
+   *  (NETIF_FLAG_TSO) or right before netif->output; 0 disables this */
+  u16_t gso_max_size;
+#endif /* LWIP_TCP_TSO */
+#if LWIP_TCP_GRO
+  /** maximum size (in bytes, IP header included) of the TCP segments GRO
+   *  merges received frames into; 0 disables GRO. A driver setting this must
+   *  call netif_gro_flush() after every burst of netif->input calls. */
+  u16_t gro_max_size;
+#endif /* LWIP_TCP_GRO */
   /** link level hardware address of this interface */
   u8_t hwaddr[NETIF_MAX_HWADDR_LEN];
   /** number of bytes used in hwaddr */
@@ -527,6 +543,9 @@ void netif_poll_all(void);
 #endif /* ENABLE_LOOPBACK */
 
 err_t netif_input(struct pbuf *p, struct netif *inp);
+#if LWIP_TCP_GRO
+void netif_gro_flush(struct netif *netif);
+#endif /* LWIP_TCP_GRO */
 
 #if LWIP_IPV6
 /** @ingroup netif_ip6 */
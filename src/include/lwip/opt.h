@@ -120,6 +120,30 @@
 #if !defined LWIP_TIMERS_CUSTOM || defined __DOXYGEN__
 #define LWIP_TIMERS_CUSTOM              0
 #endif
+
+/**
+ * LWIP_TIMERS_HEAP==1: Keep pending timeouts in a pairing heap instead of a
+ * sorted list, and index them by handler and argument in a hash table.
+ * sys_timeout() and sys_untimeout() then no longer walk all pending timeouts.
+ * Costs four more words per struct sys_timeo. Enable this if many timeouts are
+ * pending at once (large MEMP_NUM_SYS_TIMEOUT).
+ */
+#if !defined LWIP_TIMERS_HEAP || defined __DOXYGEN__
+#define LWIP_TIMERS_HEAP                0
+#endif
+
+/**
+ * LWIP_TIMERS_HASH_SIZE: Number of buckets of the handler/argument hash table
+ * used by sys_untimeout() when LWIP_TIMERS_HEAP is enabled. Must be a power of 2.
+ * The default is MEMP_NUM_SYS_TIMEOUT rounded up to a power of 4, at most
+ * 4096, so that a bucket holds about one pending timeout.
+ */
+#if !defined LWIP_TIMERS_HASH_SIZE || defined __DOXYGEN__
+#define LWIP_TIMERS_HASH_SIZE           ((MEMP_NUM_SYS_TIMEOUT) <= 16 ? 16 : \
+                                         (MEMP_NUM_SYS_TIMEOUT) <= 64 ? 64 : \
+                                         (MEMP_NUM_SYS_TIMEOUT) <= 256 ? 256 : \
+                                         (MEMP_NUM_SYS_TIMEOUT) <= 1024 ? 1024 : 4096)
+#endif
 /**
  * @}
  */
@@ -445,6 +469,25 @@
 #define MEMP_NUM_TCP_SEG                16
 #endif
 
+/**
+ * MEMP_NUM_TCP_REQ: the number of simultaneous TCP connection requests in
+ * SYN_RCVD.
+ * (requires the LWIP_TCP_REQ_TABLE option)
+ */
+#if !defined MEMP_NUM_TCP_REQ || defined __DOXYGEN__
+#define MEMP_NUM_TCP_REQ                MEMP_NUM_TCP_PCB
+#endif
+
+/**
+ * MEMP_NUM_TCP_TW: the number of simultaneous TCP connections in TIME_WAIT
+ * that are kept as records instead of pcbs. When the pool is empty, the
+ * oldest record is dropped.
+ * (requires the LWIP_TCP_TW_TABLE option)
+ */
+#if !defined MEMP_NUM_TCP_TW || defined __DOXYGEN__
+#define MEMP_NUM_TCP_TW                 MEMP_NUM_TCP_PCB
+#endif
+
 /**
  * MEMP_NUM_ALTCP_PCB: the number of simultaneously active altcp layer pcbs.
  * (requires the LWIP_ALTCP option)
@@ -474,6 +517,16 @@
 #define MEMP_NUM_FRAG_PBUF              15
 #endif
 
+/**
+ * MEMP_NUM_TCP_TSO_PBUF: the number of pbufs referencing the data of TCP
+ * segments for super-segments and their frames (LWIP_TCP_TSO).
+ * A super-segment needs one per segment it is built from (more if the data of
+ * a segment is chained), and its frames each need one while they are sent.
+ */
+#if !defined MEMP_NUM_TCP_TSO_PBUF || defined __DOXYGEN__
+#define MEMP_NUM_TCP_TSO_PBUF           64
+#endif
+
 /**
  * MEMP_NUM_ARP_QUEUE: the number of simultaneously queued outgoing
  * packets (pbufs) that are waiting for an ARP request (to resolve
@@ -498,7 +551,7 @@
  * The number of sys timeouts used by the core stack (not apps)
  * The default number of timeouts is calculated here for all enabled modules.
  */
-#define LWIP_NUM_SYS_TIMEOUT_INTERNAL   (LWIP_TCP + IP_REASSEMBLY + LWIP_ARP + (2*LWIP_DHCP) + LWIP_ACD + LWIP_IGMP + LWIP_DNS + PPP_NUM_TIMEOUTS + (LWIP_IPV6 * (1 + LWIP_IPV6_REASS + LWIP_IPV6_MLD + LWIP_IPV6_DHCP6)))
+#define LWIP_NUM_SYS_TIMEOUT_INTERNAL   (LWIP_TCP + (LWIP_TCP * LWIP_TCP_RACK * MEMP_NUM_TCP_PCB) + (LWIP_TCP * LWIP_TCP_PACING * MEMP_NUM_TCP_PCB) + IP_REASSEMBLY + LWIP_ARP + (2*LWIP_DHCP) + LWIP_ACD + LWIP_IGMP + LWIP_DNS + PPP_NUM_TIMEOUTS + (LWIP_IPV6 * (1 + LWIP_IPV6_REASS + LWIP_IPV6_MLD + LWIP_IPV6_DHCP6)))
 
 /**
  * MEMP_NUM_SYS_TIMEOUT: the number of simultaneously active timeouts.
@@ -1279,6 +1332,38 @@
 #define TCP_WND                         (4 * TCP_MSS)
 #endif
 
+/**
+ * LWIP_TCP_RCV_AUTOTUNE==1: Size the receive window of each connection by
+ * how fast the application reads (dynamic right-sizing). A connection starts
+ * with TCP_RCV_AUTOTUNE_INIT; every round-trip time, the bytes passed to
+ * tcp_recved() are measured and the window grows to twice that, so that a
+ * sender in slow start is not held back. TCP_WND is the limit, and the window
+ * scale offered in the SYN (TCP_RCV_SCALE) must cover it: the scale cannot
+ * change after the handshake. The window does not shrink.
+ */
+#if !defined LWIP_TCP_RCV_AUTOTUNE || defined __DOXYGEN__
+#define LWIP_TCP_RCV_AUTOTUNE           0
+#endif
+
+/**
+ * TCP_RCV_AUTOTUNE_INIT: The receive window a connection starts with when
+ * LWIP_TCP_RCV_AUTOTUNE is enabled. The default matches an initial window
+ * of 10 segments (RFC 6928).
+ */
+#if !defined TCP_RCV_AUTOTUNE_INIT || defined __DOXYGEN__
+#define TCP_RCV_AUTOTUNE_INIT           LWIP_MIN(10 * TCP_MSS, TCP_WND)
+#endif
+
+/**
+ * TCP_RCV_AUTOTUNE_BUDGET: The bytes by which the receive windows of all
+ * connections together may grow beyond TCP_RCV_AUTOTUNE_INIT. Once it is
+ * used up, windows only grow again after connections that have grown are
+ * freed. Size this to the pbufs that may hold received data.
+ */
+#if !defined TCP_RCV_AUTOTUNE_BUDGET || defined __DOXYGEN__
+#define TCP_RCV_AUTOTUNE_BUDGET         (4 * TCP_WND)
+#endif
+
 /**
  * TCP_MAXRTX: Maximum number of retransmissions of data segments.
  */
@@ -1301,6 +1386,17 @@
 #define TCP_QUEUE_OOSEQ                 LWIP_TCP
 #endif
 
+/**
+ * TCP_OOSEQ_TREE==1: Index the out-of-sequence queue with a red-black tree,
+ * so that a segment received out of sequence is queued in O(log n) instead
+ * of O(n) for n queued segments. Worth it with large receive windows and
+ * heavy reordering or loss; costs three pointers per TCP segment
+ * (shared with TCP_UNACKED_TREE). Only valid for TCP_QUEUE_OOSEQ==1.
+ */
+#if !defined TCP_OOSEQ_TREE || defined __DOXYGEN__
+#define TCP_OOSEQ_TREE                  0
+#endif
+
 /**
  * LWIP_TCP_SACK_OUT==1: TCP will support sending selective acknowledgements (SACKs).
  */
@@ -1322,6 +1418,57 @@
 #define LWIP_TCP_MAX_SACK_NUM           4
 #endif
 
+/**
+ * LWIP_TCP_SACK_IN==1: TCP will process SACK blocks received from the remote host.
+ * Segments on the unacked queue that have been SACKed are kept in a scoreboard,
+ * SACKed bytes are not counted as in flight and loss recovery retransmits only
+ * the missing ranges (RFC 6675) instead of one segment per round-trip.
+ * Requires LWIP_TCP_SACK_OUT, which negotiates SACK for the connection.
+ */
+#if !defined LWIP_TCP_SACK_IN || defined __DOXYGEN__
+#define LWIP_TCP_SACK_IN                0
+#endif
+
+/**
+ * LWIP_TCP_RACK==1: Detect lost segments by time (RACK, RFC 8985): a segment is
+ * lost once a segment sent sufficiently later has been delivered. A Tail Loss
+ * Probe is sent when ACKs stop arriving for about two round-trips, so a lost
+ * tail is repaired without waiting for the retransmission timeout.
+ * Requires LWIP_TCP_SACK_IN, LWIP_TCP_RTT_MS and LWIP_TIMERS: every connection
+ * may have one sys_timeout active (see MEMP_NUM_SYS_TIMEOUT).
+ */
+#if !defined LWIP_TCP_RACK || defined __DOXYGEN__
+#define LWIP_TCP_RACK                   0
+#endif
+
+/**
+ * LWIP_TCP_PRR==1: Reduce cwnd in fast recovery by Proportional Rate Reduction
+ * (RFC 6937) instead of setting it to ssthresh + 3 * MSS and inflating it by
+ * one MSS per duplicate ACK. What is sent during recovery follows what the
+ * remote host reports delivered, so that the reduction is spread over one
+ * round-trip and ends at the ssthresh chosen by the congestion control.
+ * Works with and without LWIP_TCP_SACK_IN.
+ */
+#if !defined LWIP_TCP_PRR || defined __DOXYGEN__
+#define LWIP_TCP_PRR                    0
+#endif
+
+/**
+ * LWIP_TCP_UNDO==1: Detect retransmissions that were not needed and undo the
+ * cwnd and ssthresh reduction that came with them. A delay spike that fires
+ * the retransmission timeout is told apart from a loss by F-RTO (RFC 5682):
+ * new data is sent instead of retransmissions until the second ACK shows
+ * whether the original segments arrived. With LWIP_TCP_TIMESTAMPS, an ACK
+ * that echoes the timestamp of an original transmission reveals a spurious
+ * retransmission at once (Eifel, RFC 3522), and with LWIP_TCP_SACK_IN so does
+ * a D-SACK for every retransmitted byte (RFC 3708). The congestion control
+ * chooses the cwnd to go back to with its undo_cwnd op; without it, nothing
+ * is undone.
+ */
+#if !defined LWIP_TCP_UNDO || defined __DOXYGEN__
+#define LWIP_TCP_UNDO                   0
+#endif
+
 /**
  * TCP_MSS: TCP Maximum segment size. (default is 536, a conservative default,
  * you might want to increase this.)
@@ -1355,6 +1502,199 @@
 #define LWIP_TCP_RTO_TIME               3000
 #endif
 
+/**
+ * LWIP_TCP_RTT_MS==1: Estimate the round-trip time in milliseconds of sys_now()
+ * instead of TCP_SLOW_INTERVAL ticks. Every ACK for data that was sent only once
+ * gives a sample for the smoothed RTT, the RTT variation and the minimum RTT
+ * (RFC 6298). The retransmission timeout and the congestion control are driven
+ * by these; the timeout is still checked by tcp_slowtmr(), so lower
+ * TCP_TMR_INTERVAL for timeouts shorter than TCP_SLOW_INTERVAL.
+ */
+#if !defined LWIP_TCP_RTT_MS || defined __DOXYGEN__
+#define LWIP_TCP_RTT_MS                 0
+#endif
+
+/**
+ * LWIP_TCP_RTO_MIN: Lower bound of the retransmission timeout (ms) calculated
+ * with LWIP_TCP_RTT_MS. RFC 6298 asks for 1 second, networks with a known
+ * small RTT may use a lower value.
+ */
+#if !defined LWIP_TCP_RTO_MIN || defined __DOXYGEN__
+#define LWIP_TCP_RTO_MIN                1000
+#endif
+
+/**
+ * LWIP_TCP_RATE_SAMPLE==1: Estimate the delivery rate of every connection from
+ * the ACKed and SACKed data (draft-cheng-iccrg-delivery-rate-estimation) and
+ * pass a rate sample to the cong_control hook of the congestion control on
+ * every ACK. Requires LWIP_TCP_RTT_MS.
+ */
+#if !defined LWIP_TCP_RATE_SAMPLE || defined __DOXYGEN__
+#define LWIP_TCP_RATE_SAMPLE            0
+#endif
+
+/**
+ * LWIP_TCP_BBR==1: Build the BBR congestion control (tcp_ca_bbr), which paces
+ * at the estimated bottleneck bandwidth instead of reacting to loss.
+ * Requires LWIP_TCP_RATE_SAMPLE.
+ */
+#if !defined LWIP_TCP_BBR || defined __DOXYGEN__
+#define LWIP_TCP_BBR                    0
+#endif
+
+/**
+ * LWIP_TCP_ECN==1: Negotiate Explicit Congestion Notification (RFC 3168) on
+ * active and passive opens. Data of ECN connections is sent ECN-capable,
+ * CE marks are echoed to the sender and an echoed mark reduces cwnd like a
+ * loss, at most once per window.
+ */
+#if !defined LWIP_TCP_ECN || defined __DOXYGEN__
+#define LWIP_TCP_ECN                    0
+#endif
+
+/**
+ * LWIP_TCP_DCTCP==1: Build the DCTCP congestion control (tcp_ca_dctcp,
+ * RFC 8257), which reduces cwnd in proportion to the fraction of CE marked
+ * bytes instead of halving it. Only meant for data center networks that mark
+ * CE at a low queue threshold. Requires LWIP_TCP_ECN.
+ */
+#if !defined LWIP_TCP_DCTCP || defined __DOXYGEN__
+#define LWIP_TCP_DCTCP                  0
+#endif
+
+/**
+ * LWIP_TCP_HYSTART_PP==1: Build "cubic_hspp", CUBIC with HyStart++ (RFC 9406)
+ * instead of HyStart. HyStart ends slow start on the first sign of a longer
+ * ACK train or RTT, which jitter easily fakes. HyStart++ only reacts to the
+ * minimum RTT of a round and goes on more slowly for a few rounds before
+ * ending slow start, so a spurious exit can still reach the capacity.
+ * Select it per connection with tcp_set_congestion_control() or the
+ * TCP_CONGESTION socket option, or for all connections with TCP_CA_DEFAULT.
+ */
+#if !defined LWIP_TCP_HYSTART_PP || defined __DOXYGEN__
+#define LWIP_TCP_HYSTART_PP             0
+#endif
+
+/**
+ * LWIP_TCP_PACING==1: Allow connections to spread the segments tcp_output()
+ * may send over the RTT instead of sending them in one burst. Pacing is
+ * enabled per connection with tcp_set_pacing(); BBR enables it itself.
+ * The pacing rate is set by the congestion control if it has a cong_control
+ * hook (BBR), otherwise it is derived from cwnd and the smoothed RTT.
+ * Segments held back are released by a sys_timeout, so the granularity is
+ * one millisecond: a connection sends up to one millisecond worth of data at
+ * once. Requires LWIP_TCP_RTT_MS.
+ */
+#if !defined LWIP_TCP_PACING || defined __DOXYGEN__
+#define LWIP_TCP_PACING                 0
+#endif
+
+/**
+ * TCP_PACING_SS_RATIO: pacing rate in percent of cwnd/SRTT in slow start,
+ * so that cwnd can still double every RTT.
+ */
+#if !defined TCP_PACING_SS_RATIO || defined __DOXYGEN__
+#define TCP_PACING_SS_RATIO             200
+#endif
+
+/**
+ * TCP_PACING_CA_RATIO: pacing rate in percent of cwnd/SRTT in congestion
+ * avoidance.
+ */
+#if !defined TCP_PACING_CA_RATIO || defined __DOXYGEN__
+#define TCP_PACING_CA_RATIO             120
+#endif
+
+/**
+ * TCP_CA_DEFAULT: the congestion control new connections start with, until
+ * tcp_set_default_congestion_control() changes it at runtime.
+ */
+#if !defined TCP_CA_DEFAULT || defined __DOXYGEN__
+#define TCP_CA_DEFAULT                  tcp_ca_cubic
+#endif
+
+/**
+ * TCP_CA_PRIV_SIZE: bytes reserved in every tcp_pcb for the private state of
+ * its congestion control. Must be at least the largest priv_size of the
+ * congestion controls in use: 60 for cubic (72 with LWIP_TCP_HYSTART_PP),
+ * 76 for BBR, 20 for DCTCP.
+ */
+#if !defined TCP_CA_PRIV_SIZE || defined __DOXYGEN__
+#if LWIP_TCP_BBR
+#define TCP_CA_PRIV_SIZE                76
+#elif LWIP_TCP_HYSTART_PP
+#define TCP_CA_PRIV_SIZE                72
+#else
+#define TCP_CA_PRIV_SIZE                64
+#endif
+#endif
+
+/**
+ * TCP_CA_NUM_EXTRA: number of congestion controls that can be added with
+ * tcp_register_congestion_control() next to the built-in ones.
+ */
+#if !defined TCP_CA_NUM_EXTRA || defined __DOXYGEN__
+#define TCP_CA_NUM_EXTRA                4
+#endif
+
+/**
+ * LWIP_TCP_TSO==1: Let tcp_output() pass runs of full-sized segments down as
+ * one super-segment of up to netif->gso_max_size bytes, so that the IP and
+ * link layer run once for all of them. Netifs with NETIF_FLAG_TSO split such
+ * segments into frames themselves; for all other netifs, the stack splits them
+ * right before netif->output (GSO). The segments stay separate on the
+ * unacked queue and are retransmitted one by one.
+ * Requires LWIP_NETIF_TX_SINGLE_PBUF==0.
+ */
+#if !defined LWIP_TCP_TSO || defined __DOXYGEN__
+#define LWIP_TCP_TSO                    0
+#endif
+
+/**
+ * TCP_TSO_MIN_SEG_LEN: segments shorter than this are always sent one by one:
+ * with small segments, the frames of a super-segment don't save enough to
+ * pay for building it.
+ */
+#if !defined TCP_TSO_MIN_SEG_LEN || defined __DOXYGEN__
+#define TCP_TSO_MIN_SEG_LEN             256
+#endif
+
+/**
+ * LWIP_TCP_GRO==1: Merge in-order TCP segments of the same connection that
+ * arrive in one receive burst into one segment before tcp_input(), so that
+ * TCP processes them, calls recv and ACKs once. Enabled per netif with
+ * netif->gro_max_size; the driver then has to call netif_gro_flush() after
+ * every burst.
+ */
+#if !defined LWIP_TCP_GRO || defined __DOXYGEN__
+#define LWIP_TCP_GRO                    0
+#endif
+
+/**
+ * TCP_GRO_MAX_FLOWS: number of connections GRO can merge segments for at
+ * the same time. Segments of further connections are passed on one by one.
+ */
+#if !defined TCP_GRO_MAX_FLOWS || defined __DOXYGEN__
+#define TCP_GRO_MAX_FLOWS               8
+#endif
+
+/**
+ * TCP_GRO_MAX_SEGS: maximum number of received segments merged into one.
+ */
+#if !defined TCP_GRO_MAX_SEGS || defined __DOXYGEN__
+#define TCP_GRO_MAX_SEGS                44
+#endif
+
+/**
+ * LWIP_TCP_ZEROCOPY==1: Support zero-copy writes (TCP_WRITE_FLAG_ZEROCOPY,
+ * NETCONN_ZEROCOPY, MSG_ZEROCOPY): the data is referenced instead of copied
+ * and the application is told when it has been ACKed, so that it knows when
+ * it may change the buffer again. Needs LWIP_CALLBACK_API.
+ */
+#if !defined LWIP_TCP_ZEROCOPY || defined __DOXYGEN__
+#define LWIP_TCP_ZEROCOPY               0
+#endif
+
 /**
  * TCP_SND_BUF: TCP sender buffer space (bytes).
  * To achieve good performance, this should be at least 2 * TCP_MSS.
@@ -1389,6 +1729,17 @@
 #define TCP_SNDQUEUELOWAT               LWIP_MAX(((TCP_SND_QUEUELEN)/2), 5)
 #endif
 
+/**
+ * TCP_UNACKED_TREE==1: Index the unacked queue with a red-black tree, so
+ * that the segments covered by a SACK block or retransmitted by RACK are
+ * found in O(log n) instead of O(n) for n segments in flight. Worth it with
+ * a large TCP_SND_QUEUELEN and SACK; costs three pointers per TCP segment
+ * (shared with TCP_OOSEQ_TREE).
+ */
+#if !defined TCP_UNACKED_TREE || defined __DOXYGEN__
+#define TCP_UNACKED_TREE                0
+#endif
+
 /**
  * TCP_OOSEQ_MAX_BYTES: The default maximum number of bytes queued on ooseq per
  * pcb if TCP_OOSEQ_BYTES_LIMIT is not defined. Default is 0 (no limit).
@@ -1451,6 +1802,62 @@
 #define TCP_DEFAULT_LISTEN_BACKLOG      0xff
 #endif
 
+/**
+ * LWIP_TCP_SYNCOOKIES==1: Answer connection requests with SYN cookies
+ * (RFC 4987) instead of dropping them when the listen backlog is full or no
+ * tcp_pcb can be allocated. The SYN|ACK carries the state of the request in
+ * its sequence number and no pcb is allocated before the final ACK of the
+ * handshake arrives. The cookie holds the MSS of the remote host, rounded
+ * down; window scaling, SACK and ECN are only kept if the remote host uses
+ * TCP timestamps (LWIP_TCP_TIMESTAMPS), otherwise they are turned off for
+ * these connections.
+ * The cookies are keyed with secrets taken from LWIP_RAND(), which must be
+ * defined. A new secret is picked every 64 seconds.
+ */
+#if !defined LWIP_TCP_SYNCOOKIES || defined __DOXYGEN__
+#define LWIP_TCP_SYNCOOKIES             0
+#endif
+
+/**
+ * LWIP_TCP_REQ_TABLE==1: Keep connection requests in SYN_RCVD in a table of
+ * small entries (MEMP_NUM_TCP_REQ) instead of allocating a tcp_pcb for every
+ * SYN. An entry holds what is needed to retransmit the SYN|ACK and to
+ * validate the final ACK of the handshake, which promotes it to a tcp_pcb.
+ * Half-open connections then no longer take tcp_pcbs from established ones.
+ */
+#if !defined LWIP_TCP_REQ_TABLE || defined __DOXYGEN__
+#define LWIP_TCP_REQ_TABLE              0
+#endif
+
+/**
+ * TCP_REQ_HASH_SIZE: Number of buckets in the 4-tuple hash table of the
+ * connection requests used when LWIP_TCP_REQ_TABLE is enabled. Must be a
+ * power of 2.
+ */
+#if !defined TCP_REQ_HASH_SIZE || defined __DOXYGEN__
+#define TCP_REQ_HASH_SIZE               64
+#endif
+
+/**
+ * LWIP_TCP_TW_TABLE==1: Once a connection closed by the application enters
+ * TIME_WAIT, free its tcp_pcb and keep a small record (MEMP_NUM_TCP_TW)
+ * instead. The record holds what is needed to ACK retransmitted FINs and to
+ * keep the 4-tuple from being reused for 2*TCP_MSL, so closed connections
+ * no longer take tcp_pcbs from new ones.
+ */
+#if !defined LWIP_TCP_TW_TABLE || defined __DOXYGEN__
+#define LWIP_TCP_TW_TABLE               0
+#endif
+
+/**
+ * TCP_TW_HASH_SIZE: Number of buckets in the 4-tuple and local port hash
+ * tables of the TIME_WAIT records used when LWIP_TCP_TW_TABLE is enabled.
+ * Must be a power of 2.
+ */
+#if !defined TCP_TW_HASH_SIZE || defined __DOXYGEN__
+#define TCP_TW_HASH_SIZE                64
+#endif
+
 /**
  * TCP_OVERSIZE: The maximum number of bytes that tcp_write may
  * allocate ahead of time in an attempt to create shorter pbuf chains
@@ -1487,6 +1894,36 @@
 #define TCP_WND_UPDATE_THRESHOLD        LWIP_MIN((TCP_WND / 4), (TCP_MSS * 4))
 #endif
 
+/**
+ * TCP_ACK_SEGS_DEFAULT: ACK data received in order at once when this many
+ * full-sized segments have not been ACKed yet, instead of waiting for the
+ * delayed ACK timer. RFC 5681 asks for an ACK for at least every second one.
+ * Bulk receivers can raise it per connection (tcp_set_ack_segs(),
+ * TCP_ACK_SEGS) to send fewer ACKs.
+ */
+#if !defined TCP_ACK_SEGS_DEFAULT || defined __DOXYGEN__
+#define TCP_ACK_SEGS_DEFAULT            2
+#endif
+
+/**
+ * TCP_ACK_SEGS_MAX: the highest value tcp_set_ack_segs() accepts. Whatever
+ * the setting, an ACK is sent as soon as half of the receive window has
+ * not been ACKed.
+ */
+#if !defined TCP_ACK_SEGS_MAX || defined __DOXYGEN__
+#define TCP_ACK_SEGS_MAX                16
+#endif
+
+/**
+ * TCP_QUICKACK_SEGS: number of data segments ACKed at once at the start of
+ * a connection and after an out-of-order segment was received, so that the
+ * sender is not held back by delayed ACKs in slow start and loss recovery.
+ * 0 disables this quick-ACK mode. Must be below 256.
+ */
+#if !defined TCP_QUICKACK_SEGS || defined __DOXYGEN__
+#define TCP_QUICKACK_SEGS               16
+#endif
+
 /**
  * LWIP_EVENT_API and LWIP_CALLBACK_API: Only one of these should be set to 1.
  *     LWIP_EVENT_API==1: The user defines lwip_tcp_event() to receive all
@@ -1519,6 +1956,57 @@
 #define TCP_RCV_SCALE                   0
 #endif
 
+/**
+ * LWIP_TCP_PCB_HASH==1: Demultiplex incoming segments for active and TIME-WAIT
+ * pcbs through a hash table keyed on the 4-tuple (local ip, local port,
+ * remote ip, remote port) instead of walking tcp_active_pcbs and tcp_tw_pcbs.
+ * Listening pcbs are kept in a second table keyed on the local port.
+ * Enable this if you have many connections (large MEMP_NUM_TCP_PCB and
+ * MEMP_NUM_TCP_PCB_LISTEN).
+ */
+#if !defined LWIP_TCP_PCB_HASH || defined __DOXYGEN__
+#define LWIP_TCP_PCB_HASH               0
+#endif
+
+/**
+ * TCP_PCB_HASH_SIZE: Number of buckets in the 4-tuple hash table used when
+ * LWIP_TCP_PCB_HASH is enabled. Must be a power of 2. Each bucket costs one
+ * pointer; something in the range of MEMP_NUM_TCP_PCB is a good choice.
+ */
+#if !defined TCP_PCB_HASH_SIZE || defined __DOXYGEN__
+#define TCP_PCB_HASH_SIZE               256
+#endif
+
+/**
+ * TCP_LISTEN_HASH_SIZE: Number of buckets in the local port hash table for
+ * listening pcbs used when LWIP_TCP_PCB_HASH is enabled. Must be a power of 2.
+ */
+#if !defined TCP_LISTEN_HASH_SIZE || defined __DOXYGEN__
+#define TCP_LISTEN_HASH_SIZE            64
+#endif
+
+/**
+ * LWIP_TCP_TIMER_WHEEL==1: Keep the per-pcb timers (retransmission, persist,
+ * keepalive, poll, FIN-WAIT-2, SYN-RCVD, LAST-ACK and TIME-WAIT) on a timer
+ * wheel so that tcp_slowtmr() only visits the pcbs whose timers are due, and
+ * keep pcbs with a delayed ACK, pending FIN or refused data on a separate list
+ * walked by tcp_fasttmr(). The pcb lists become doubly linked so pcbs can be
+ * removed without walking them.
+ * Enable this if you have many connections (large MEMP_NUM_TCP_PCB).
+ */
+#if !defined LWIP_TCP_TIMER_WHEEL || defined __DOXYGEN__
+#define LWIP_TCP_TIMER_WHEEL            0
+#endif
+
+/**
+ * TCP_TIMER_WHEEL_SIZE: Number of slots (slow timer ticks) of the timer wheel
+ * used when LWIP_TCP_TIMER_WHEEL is enabled. Must be a power of 2. Pcbs
+ * without a timer closer than this are still visited once per revolution.
+ */
+#if !defined TCP_TIMER_WHEEL_SIZE || defined __DOXYGEN__
+#define TCP_TIMER_WHEEL_SIZE            64
+#endif
+
 /**
  * LWIP_TCP_PCB_NUM_EXT_ARGS:
  * When this is > 0, every tcp pcb (including listen pcb) includes a number of
@@ -2114,6 +2602,17 @@
 #define SO_REUSE_RXTOALL                0
 #endif
 
+/**
+ * LWIP_SO_REUSEPORT==1: Enable the SO_REUSEPORT option for TCP. Listeners that
+ * all set SO_REUSEPORT may bind and listen on the same local address and port;
+ * incoming connections are spread across such a group by a hash of the
+ * connection's 4-tuple, so several accept loops can drain them in parallel.
+ * Requires LWIP_TCP_PCB_HASH.
+ */
+#if !defined LWIP_SO_REUSEPORT || defined __DOXYGEN__
+#define LWIP_SO_REUSEPORT               0
+#endif
+
 /**
  * LWIP_FIONREAD_LINUXMODE==0 (default): ioctl/FIONREAD returns the amount of
  * pending data in the network buffer. This is the way windows does it. It's
@@ -50,9 +50,10 @@ extern "C" {
  * pbuf_alloced_custom()) and when pbuf_free gives up their last reference, they
  * are freed by calling pbuf_custom->custom_free_function().
  * Currently, the pbuf_custom code is only needed for one specific configuration
- * of IP_FRAG, unless required by external driver/application code. */
+ * of IP_FRAG and for LWIP_TCP_TSO, unless required by external driver/application
+ * code. */
 #ifndef LWIP_SUPPORT_CUSTOM_PBUF
-#define LWIP_SUPPORT_CUSTOM_PBUF ((IP_FRAG && !LWIP_NETIF_TX_SINGLE_PBUF) || (LWIP_IPV6 && LWIP_IPV6_FRAG))
+#define LWIP_SUPPORT_CUSTOM_PBUF ((IP_FRAG && !LWIP_NETIF_TX_SINGLE_PBUF) || (LWIP_IPV6 && LWIP_IPV6_FRAG) || (LWIP_TCP && LWIP_TCP_TSO))
 #endif
 
 /** @ingroup pbuf
@@ -181,6 +182,9 @@ typedef enum {
 #define PBUF_FLAG_LLMCAST   0x10U
 /** indicates this pbuf includes a TCP FIN flag */
 #define PBUF_FLAG_TCP_FIN   0x20U
+/** indicates the TCP checksum of this packet has been checked already (GRO
+    checks the frames it merges one by one) */
+#define PBUF_FLAG_TCP_CHKSUM_OK 0x40U
 
 /** Main packet buffer struct */
 struct pbuf {
@@ -220,6 +224,12 @@ struct pbuf {
   /** For incoming packets, this contains the input netif's index */
   u8_t if_idx;
 
+#if LWIP_TCP_TSO
+  /** For outgoing TCP super-segments, the payload size of the frames they
+      are split into; 0 for everything else */
+  u16_t tso_segsz;
+#endif /* LWIP_TCP_TSO */
+
   /** In case the user needs to store data custom data on a pbuf */
   LWIP_PBUF_CUSTOM_DATA
 };
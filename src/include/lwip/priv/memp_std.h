@@ -50,6 +50,12 @@ LWIP_MEMPOOL(UDP_PCB,        MEMP_NUM_UDP_PCB,         sizeof(struct udp_pcb),
 LWIP_MEMPOOL(TCP_PCB,        MEMP_NUM_TCP_PCB,         sizeof(struct tcp_pcb),        "TCP_PCB")
 LWIP_MEMPOOL(TCP_PCB_LISTEN, MEMP_NUM_TCP_PCB_LISTEN,  sizeof(struct tcp_pcb_listen), "TCP_PCB_LISTEN")
 LWIP_MEMPOOL(TCP_SEG,        MEMP_NUM_TCP_SEG,         sizeof(struct tcp_seg),        "TCP_SEG")
+#if LWIP_TCP_REQ_TABLE
+LWIP_MEMPOOL(TCP_REQ,        MEMP_NUM_TCP_REQ,         sizeof(struct tcp_req),        "TCP_REQ")
+#endif /* LWIP_TCP_REQ_TABLE */
+#if LWIP_TCP_TW_TABLE
+LWIP_MEMPOOL(TCP_TW,         MEMP_NUM_TCP_TW,          sizeof(struct tcp_tw),         "TCP_TW")
+#endif /* LWIP_TCP_TW_TABLE */
 #endif /* LWIP_TCP */
 
 #if LWIP_ALTCP && LWIP_TCP
@@ -62,6 +68,9 @@ LWIP_MEMPOOL(REASSDATA,      MEMP_NUM_REASSDATA,       sizeof(struct ip_reassdat
 #if (IP_FRAG && !LWIP_NETIF_TX_SINGLE_PBUF) || (LWIP_IPV6 && LWIP_IPV6_FRAG)
 LWIP_MEMPOOL(FRAG_PBUF,      MEMP_NUM_FRAG_PBUF,       sizeof(struct pbuf_custom_ref),"FRAG_PBUF")
 #endif /* IP_FRAG && !LWIP_NETIF_TX_SINGLE_PBUF || (LWIP_IPV6 && LWIP_IPV6_FRAG) */
+#if LWIP_TCP && LWIP_TCP_TSO
+LWIP_MEMPOOL(TCP_TSO_PBUF,   MEMP_NUM_TCP_TSO_PBUF,    sizeof(struct pbuf_custom_ref),"TCP_TSO_PBUF")
+#endif /* LWIP_TCP && LWIP_TCP_TSO */
 
 #if LWIP_NETCONN || LWIP_SOCKET
 LWIP_MEMPOOL(NETBUF,         MEMP_NUM_NETBUF,          sizeof(struct netbuf),         "NETBUF")
@@ -66,9 +66,14 @@ enum tcp_ca_event {
 	CA_EVENT_ECN_NO_CE,	/* ECT set, but not CE marked */
 	CA_EVENT_ECN_IS_CE	/* received CE marked IP packet */
 };
+/* Flags passed to tcp_congestion_ops.in_ack_event */
+#define CA_ACK_ECE	0x01U	/* the ACK echoed a congestion mark */
+
 #define tcp_in_slow_start(pcb) (pcb->cwnd < pcb->ssthresh)
 
+void tcp_init_congestion_control(struct tcp_pcb *pcb);
 void tcp_cong_avoid_ai(struct tcp_pcb *pcb, u32_t w, u32_t acked);
+extern struct tcp_congestion_ops *tcp_ca_default;
 
 /* Lower layer interface to TCP: */
 void             tcp_init    (void);  /* Initialize this module. */
@@ -98,6 +103,90 @@ err_t            tcp_rexmit_rto_prepare(struct tcp_pcb *pcb);
 void             tcp_rexmit_rto_commit(struct tcp_pcb *pcb);
 void             tcp_rexmit_rto  (struct tcp_pcb *pcb);
 void             tcp_rexmit_fast (struct tcp_pcb *pcb);
+#if LWIP_TCP_SACK_IN
+void             tcp_rexmit_sack (struct tcp_pcb *pcb, u8_t head_lost);
+#endif /* LWIP_TCP_SACK_IN */
+#if LWIP_TCP_RATE_SAMPLE
+void             tcp_rate_seg_sent     (struct tcp_pcb *pcb, struct tcp_seg *seg);
+void             tcp_rate_seg_delivered(struct tcp_pcb *pcb, struct tcp_seg *seg, struct tcp_rate_sample *rs);
+void             tcp_rate_gen          (struct tcp_pcb *pcb, struct tcp_rate_sample *rs, u32_t rtt);
+void             tcp_rate_check_app_limited(struct tcp_pcb *pcb);
+#endif /* LWIP_TCP_RATE_SAMPLE */
+#if LWIP_TCP_RTT_MS
+s16_t            tcp_rto_calc    (const struct tcp_pcb *pcb);
+/** The retransmission timeout without backoff, in ticks of TCP_SLOW_INTERVAL */
+#define TCP_RTO_BASE(pcb) tcp_rto_calc(pcb)
+#else /* LWIP_TCP_RTT_MS */
+#define TCP_RTO_BASE(pcb) (((pcb)->sa >> 3) + (pcb)->sv)
+#endif /* LWIP_TCP_RTT_MS */
+#if LWIP_TCP_ECN
+/* pcb->ecn_flags */
+#define TCP_ECN_OK         0x01U /* ECN was negotiated for this connection */
+#define TCP_ECN_DEMAND_CWR 0x02U /* echo ECE until the remote host sends CWR */
+#define TCP_ECN_QUEUE_CWR  0x04U /* set CWR on the next new data segment */
+#define TCP_ECN_IN_CWR     0x08U /* cwnd was reduced for ECE, until ecn_recover is ACKed */
+#define TCP_ECN_REDUCE     0x10U /* cong_ops->ssthresh() is called for ECE, not for a loss */
+#endif /* LWIP_TCP_ECN */
+#if LWIP_TCP_RACK
+/* pcb->rack_flags */
+#define RACK_TMR_REO      0x01U /* rack_due is the reordering timer */
+#define RACK_TMR_PTO      0x02U /* rack_due is the tail loss probe timeout */
+#define RACK_TMR_ARMED    0x04U /* a sys_timeout is pending for this pcb */
+#define RACK_VALID        0x08U /* rack_xmit_ts and rack_rtt hold a sample */
+#define RACK_REORDER_SEEN 0x10U /* a segment was delivered out of order */
+#define TLP_PROBING       0x20U /* a tail loss probe is outstanding */
+#define TLP_RXT           0x40U /* the probe was a retransmission */
+
+void             tcp_rack_update (struct tcp_pcb *pcb, struct tcp_seg *seg, u32_t now);
+u8_t             tcp_rack_ack    (struct tcp_pcb *pcb, u32_t ackno, u8_t dsack);
+void             tcp_rack_arm_pto(struct tcp_pcb *pcb);
+void             tcp_rack_purge  (struct tcp_pcb *pcb);
+#endif /* LWIP_TCP_RACK */
+#if LWIP_TCP_UNDO
+/* pcb->undo_flags */
+#define TCP_UNDO_PENDING  0x01U /* cwnd was reduced, prior_cwnd and prior_ssthresh are valid */
+#define TCP_UNDO_EIFEL    0x02U /* the timestamp of the first ACK for new data is to be checked */
+#define TCP_FRTO_STEP2    0x04U /* F-RTO: waiting for the first ACK after the timeout */
+#define TCP_FRTO_STEP3    0x08U /* F-RTO: new data was sent, waiting for the second ACK */
+
+void             tcp_undo_init        (struct tcp_pcb *pcb, u8_t rto);
+void             tcp_rexmit_rto_cancel(struct tcp_pcb *pcb);
+#endif /* LWIP_TCP_UNDO */
+#if LWIP_TCP_PACING
+/* pcb->pacing_flags */
+#define TCP_PACING_ON        0x01U /* pacing is enabled for this pcb */
+#define TCP_PACING_TMR_ARMED 0x02U /* a sys_timeout is pending for this pcb */
+#define TCP_PACING_CA        0x04U /* enabled by the congestion control, not the application */
+
+void             tcp_pacing_update  (struct tcp_pcb *pcb);
+u8_t             tcp_pacing_can_send(struct tcp_pcb *pcb);
+void             tcp_pacing_sent    (struct tcp_pcb *pcb, u32_t len);
+void             tcp_pacing_fasttmr (struct tcp_pcb *pcb);
+void             tcp_pacing_purge   (struct tcp_pcb *pcb);
+void             tcp_pacing_ca_release(struct tcp_pcb *pcb);
+#endif /* LWIP_TCP_PACING */
+#if LWIP_TCP_TSO
+#ifndef LWIP_PBUF_CUSTOM_REF_DEFINED
+#define LWIP_PBUF_CUSTOM_REF_DEFINED
+/** A custom pbuf that holds a reference to another pbuf, which is freed
+ * when this custom pbuf is freed. This is used to create a custom PBUF_REF
+ * that points into the original pbuf. */
+struct pbuf_custom_ref {
+  /** 'base class' */
+  struct pbuf_custom pc;
+  /** pointer to the original pbuf that is referenced */
+  struct pbuf *original;
+};
+#endif /* LWIP_PBUF_CUSTOM_REF_DEFINED */
+
+u16_t            tcp_tso_segs          (struct tcp_pcb *pcb, struct tcp_seg *seg, u32_t wnd, struct netif *netif);
+err_t            tcp_tso_output_segment(struct tcp_pcb *pcb, struct tcp_seg *seg, u16_t nsegs, u8_t tos, struct netif *netif);
+err_t            tcp_gso_output        (struct pbuf *p, struct netif *netif, const ip_addr_t *dest);
+#endif /* LWIP_TCP_TSO */
+#if LWIP_TCP_GRO
+u8_t             tcp_gro_receive(struct pbuf *p, struct netif *inp);
+void             tcp_gro_flush  (struct netif *netif);
+#endif /* LWIP_TCP_GRO */
 u32_t            tcp_update_rcv_ann_wnd(struct tcp_pcb *pcb);
 err_t            tcp_process_refused_data(struct tcp_pcb *pcb);
 
@@ -143,10 +232,21 @@ err_t            tcp_process_refused_data(struct tcp_pcb *pcb);
 
 #define TCP_OOSEQ_TIMEOUT        6U /* x RTO */
 
+#ifndef TCP_MIN_RTT_WLEN
+#define TCP_MIN_RTT_WLEN 300000UL /* The window of the minimum RTT filter in milliseconds */
+#endif
+
 #ifndef TCP_MSL
 #define TCP_MSL 60000UL /* The maximum segment lifetime in milliseconds */
 #endif
 
+/* As initial send MSS, we use TCP_MSS but limit it to 536. */
+#if TCP_MSS > 536
+#define INITIAL_MSS 536
+#else
+#define INITIAL_MSS TCP_MSS
+#endif
+
 /* Keepalive values, compliant with RFC 1122. Don't change this unless you know what you're doing */
 #ifndef  TCP_KEEPIDLE_DEFAULT
 #define  TCP_KEEPIDLE_DEFAULT     7200000UL /* Default KEEPALIVE timer in milliseconds */
@@ -247,6 +347,15 @@ err_t            tcp_process_refused_data(struct tcp_pcb *pcb);
       (errf)((arg),(err));                                     \
   } while (0)
 
+#if LWIP_TCP_ZEROCOPY
+#define TCP_EVENT_ZEROCOPY(pcb,id,ret)                         \
+  do {                                                         \
+    if((pcb)->zerocopy != NULL)                                \
+      (ret) = (pcb)->zerocopy((pcb)->callback_arg,(pcb),(id)); \
+    else (ret) = ERR_OK;                                       \
+  } while (0)
+#endif /* LWIP_TCP_ZEROCOPY */
+
 #endif /* LWIP_EVENT_API */
 
 /** Enabled extra-check for TCP_OVERSIZE if LWIP_DEBUG is enabled */
@@ -266,6 +375,15 @@ struct tcp_seg {
   u16_t len;               /* the TCP length of this segment */
   u32_t snd_time;          /* how many times did this segment send*/
   u32_t snd_timestamp;     /* the send time of this segment*/
+#if LWIP_TCP_RACK || LWIP_TCP_RATE_SAMPLE
+  u32_t xmit_ts;           /* the time of the latest (re)transmission of this segment */
+#endif /* LWIP_TCP_RACK || LWIP_TCP_RATE_SAMPLE */
+#if LWIP_TCP_RATE_SAMPLE
+  /* connection state at the latest (re)transmission, for rate sampling */
+  u32_t tx_delivered;      /* pcb->delivered */
+  u32_t tx_delivered_time; /* pcb->delivered_time */
+  u32_t tx_first_time;     /* pcb->first_tx_time */
+#endif /* LWIP_TCP_RATE_SAMPLE */
 #if TCP_OVERSIZE_DBGCHECK
   u16_t oversize_left;     /* Extra bytes available at the end of the last
                               pbuf in unsent (used for asserting vs.
@@ -275,6 +393,17 @@ struct tcp_seg {
   u16_t chksum;
   u8_t  chksum_swapped;
 #endif /* TCP_CHECKSUM_ON_COPY */
+#if TCP_OOSEQ_TREE || TCP_UNACKED_TREE
+  /* links in pcb->ooseq_tree or pcb->unacked_tree, only used while on
+     pcb->ooseq or pcb->unacked */
+  struct tcp_seg *tree_parent, *tree_left, *tree_right;
+  u32_t tree_seqno;        /* the key: seqno in host byte order */
+  u8_t  tree_red;
+#endif /* TCP_OOSEQ_TREE || TCP_UNACKED_TREE */
+#if LWIP_TCP_ZEROCOPY
+  u8_t  zc_end;            /* a zero-copy write ends in this segment */
+  u32_t zc_id;             /* id of the last zero-copy write ending here */
+#endif /* LWIP_TCP_ZEROCOPY */
   u8_t  flags;
 #define TF_SEG_OPTS_MSS         (u8_t)0x01U /* Include MSS option (only used in SYN segments) */
 #define TF_SEG_OPTS_TS          (u8_t)0x02U /* Include timestamp option. */
@@ -282,6 +411,12 @@ struct tcp_seg {
                                                checksummed into 'chksum' */
 #define TF_SEG_OPTS_WND_SCALE   (u8_t)0x08U /* Include WND SCALE option (only used in SYN segments) */
 #define TF_SEG_OPTS_SACK_PERM   (u8_t)0x10U /* Include SACK Permitted option (only used in SYN segments) */
+#define TF_SEG_SACKED           (u8_t)0x20U /* Segment has been SACKed by the remote host
+                                               (only used on the unacked queue) */
+#define TF_SEG_LOST             (u8_t)0x40U /* Segment has been marked lost by RACK and
+                                               waits for retransmission */
+#define TF_SEG_APP_LIMITED      (u8_t)0x80U /* Segment was sent while the application
+                                               did not fill cwnd (rate sampling) */
   struct tcp_hdr *tcphdr;  /* the TCP header */
 };
 
@@ -290,6 +425,7 @@ struct tcp_seg {
 #define LWIP_TCP_OPT_MSS        2
 #define LWIP_TCP_OPT_WS         3
 #define LWIP_TCP_OPT_SACK_PERM  4
+#define LWIP_TCP_OPT_SACK       5
 #define LWIP_TCP_OPT_TS         8
 
 #define LWIP_TCP_OPT_LEN_MSS    4
@@ -334,6 +470,23 @@ struct tcp_seg {
 #define TCPWND_MIN16(x)    x
 #endif /* LWIP_WND_SCALE */
 
+/** The receive window a connection starts with */
+#if LWIP_TCP_RCV_AUTOTUNE
+#define TCP_RCV_WND_INIT   TCP_RCV_AUTOTUNE_INIT
+#else /* LWIP_TCP_RCV_AUTOTUNE */
+#define TCP_RCV_WND_INIT   TCP_WND
+#endif /* LWIP_TCP_RCV_AUTOTUNE */
+
+/** Initial CWND calculation as defined RFC 2581 */
+#define LWIP_TCP_CALC_INITIAL_CWND(mss) ((tcpwnd_size_t)LWIP_MIN((4U * (mss)), LWIP_MAX((2U * (mss)), 4380U)))
+
+/** Bytes sent but neither ACKed nor SACKed yet */
+#if LWIP_TCP_SACK_IN
+#define TCP_BYTES_IN_FLIGHT(pcb) ((u32_t)((pcb)->snd_nxt - (pcb)->lastack) - (pcb)->sacked)
+#else /* LWIP_TCP_SACK_IN */
+#define TCP_BYTES_IN_FLIGHT(pcb) ((u32_t)((pcb)->snd_nxt - (pcb)->lastack))
+#endif /* LWIP_TCP_SACK_IN */
+
 /* Global variables: */
 extern struct tcp_pcb *tcp_input_pcb;
 extern u32_t tcp_ticks;
@@ -361,6 +514,123 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
    3) All PCBs in the tcp_listen_pcbs list is in LISTEN state.
    4) All PCBs in the tcp_tw_pcbs list is in TIME-WAIT state.
 */
+#if LWIP_TCP_PCB_HASH || LWIP_TCP_REQ_TABLE || LWIP_TCP_TW_TABLE
+u32_t tcp_4tuple_hash(const ip_addr_t *local_ip, u16_t local_port,
+                      const ip_addr_t *remote_ip, u16_t remote_port);
+#endif /* LWIP_TCP_PCB_HASH || LWIP_TCP_REQ_TABLE || LWIP_TCP_TW_TABLE */
+#if LWIP_TCP_PCB_HASH
+/* The 4-tuple demux table mirrors tcp_active_pcbs and tcp_tw_pcbs,
+   the port table mirrors tcp_listen_pcbs. */
+void tcp_pcb_hash_insert(struct tcp_pcb *pcb);
+void tcp_pcb_hash_remove(struct tcp_pcb *pcb);
+struct tcp_pcb *tcp_pcb_hash_lookup(const ip_addr_t *local_ip, u16_t local_port,
+                                    const ip_addr_t *remote_ip, u16_t remote_port,
+                                    u8_t netif_idx);
+void tcp_listen_hash_insert(struct tcp_pcb_listen *lpcb);
+void tcp_listen_hash_remove(struct tcp_pcb_listen *lpcb);
+struct tcp_pcb_listen *tcp_listen_hash_lookup(const ip_addr_t *local_ip, u16_t local_port,
+                                              const ip_addr_t *remote_ip, u16_t remote_port,
+                                              u8_t netif_idx);
+#define TCP_PCB_HASH_LIST(list) (((list) == &tcp_active_pcbs) || ((list) == &tcp_tw_pcbs))
+#define TCP_HASH_REG(list, npcb)                   \
+  do {                                             \
+    if (TCP_PCB_HASH_LIST(list)) {                 \
+      tcp_pcb_hash_insert(npcb);                   \
+    } else if ((list) == &tcp_listen_pcbs.pcbs) {  \
+      tcp_listen_hash_insert((struct tcp_pcb_listen *)(npcb)); \
+    }                                              \
+  } while (0)
+#define TCP_HASH_RMV(list, npcb)                   \
+  do {                                             \
+    if (TCP_PCB_HASH_LIST(list)) {                 \
+      tcp_pcb_hash_remove(npcb);                   \
+    } else if ((list) == &tcp_listen_pcbs.pcbs) {  \
+      tcp_listen_hash_remove((struct tcp_pcb_listen *)(npcb)); \
+    }                                              \
+  } while (0)
+#else /* LWIP_TCP_PCB_HASH */
+#define TCP_HASH_REG(list, npcb)
+#define TCP_HASH_RMV(list, npcb)
+#endif /* LWIP_TCP_PCB_HASH */
+
+#if LWIP_TCP_TIMER_WHEEL
+/* Active and TIME-WAIT pcbs are kept on the slow timer wheel; active pcbs
+   with fast timer work pending are also kept on the fast timer list. */
+void tcp_timer_wheel_insert(struct tcp_pcb *pcb);
+void tcp_timer_wheel_remove(struct tcp_pcb *pcb);
+void tcp_timer_kick(struct tcp_pcb *pcb);
+void tcp_timer_update(struct tcp_pcb *pcb);
+void tcp_fasttmr_pending(struct tcp_pcb *pcb);
+#define TCP_TIMER_LIST(list) (((list) == &tcp_active_pcbs) || ((list) == &tcp_tw_pcbs))
+#define TCP_TIMER_REG(list, npcb)                  \
+  do {                                             \
+    if (TCP_TIMER_LIST(list)) {                    \
+      tcp_timer_wheel_insert(npcb);                \
+    }                                              \
+  } while (0)
+#define TCP_TIMER_RMV(list, npcb)                  \
+  do {                                             \
+    if (TCP_TIMER_LIST(list)) {                    \
+      tcp_timer_wheel_remove(npcb);                \
+    }                                              \
+  } while (0)
+/** Call before changing the timer state of a pcb outside tcp_slowtmr() */
+#define TCP_TIMER_KICK(pcb)      tcp_timer_kick(pcb)
+/** Call after changing the timer state of a pcb outside tcp_slowtmr() */
+#define TCP_TIMER_UPDATE(pcb)    tcp_timer_update(pcb)
+/** Call after setting TF_ACK_DELAY, TF_CLOSEPEND, refused_data or TCP_PACING_TMR_ARMED */
+#define TCP_FASTTMR_PENDING(pcb) tcp_fasttmr_pending(pcb)
+/* The pcb lists are doubly linked through pcb->pprev */
+#define TCP_LIST_INSERT(pcbs, npcb)                \
+  do {                                             \
+    (npcb)->next = *(pcbs);                        \
+    if ((npcb)->next != NULL) {                    \
+      (npcb)->next->pprev = &(npcb)->next;         \
+    }                                              \
+    *(pcbs) = (npcb);                              \
+    (npcb)->pprev = (pcbs);                        \
+  } while (0)
+#define TCP_LIST_REMOVE(pcbs, npcb)                \
+  do {                                             \
+    LWIP_UNUSED_ARG(pcbs);                         \
+    if ((npcb)->pprev != NULL) {                   \
+      *(npcb)->pprev = (npcb)->next;               \
+      if ((npcb)->next != NULL) {                  \
+        (npcb)->next->pprev = (npcb)->pprev;       \
+      }                                            \
+      (npcb)->pprev = NULL;                        \
+    }                                              \
+  } while (0)
+#else /* LWIP_TCP_TIMER_WHEEL */
+#define TCP_TIMER_REG(list, npcb)
+#define TCP_TIMER_RMV(list, npcb)
+#define TCP_TIMER_KICK(pcb)
+#define TCP_TIMER_UPDATE(pcb)
+#define TCP_FASTTMR_PENDING(pcb)
+#define TCP_LIST_INSERT(pcbs, npcb)                \
+  do {                                             \
+    (npcb)->next = *(pcbs);                        \
+    *(pcbs) = (npcb);                              \
+  } while (0)
+#define TCP_LIST_REMOVE(pcbs, npcb)                \
+  do {                                             \
+    if(*(pcbs) == (npcb)) {                        \
+      (*(pcbs)) = (*pcbs)->next;                   \
+    }                                              \
+    else {                                         \
+      struct tcp_pcb *tcp_tmp_pcb;                 \
+      for (tcp_tmp_pcb = *pcbs;                    \
+          tcp_tmp_pcb != NULL;                     \
+          tcp_tmp_pcb = tcp_tmp_pcb->next) {       \
+        if(tcp_tmp_pcb->next == (npcb)) {          \
+          tcp_tmp_pcb->next = (npcb)->next;        \
+          break;                                   \
+        }                                          \
+      }                                            \
+    }                                              \
+  } while (0)
+#endif /* LWIP_TCP_TIMER_WHEEL */
+
 /* Define two macros, TCP_REG and TCP_RMV that registers a TCP PCB
    with a PCB list or removes a PCB from a list, respectively. */
 #ifndef TCP_DEBUG_PCB_LISTS
@@ -376,25 +646,20 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
                                 LWIP_ASSERT("TCP_REG: already registered", tcp_tmp_pcb != (npcb)); \
                             } \
                             LWIP_ASSERT("TCP_REG: pcb->state != CLOSED", ((pcbs) == &tcp_bound_pcbs) || ((npcb)->state != CLOSED)); \
-                            (npcb)->next = *(pcbs); \
+                            TCP_LIST_INSERT(pcbs, npcb); \
                             LWIP_ASSERT("TCP_REG: npcb->next != npcb", (npcb)->next != (npcb)); \
-                            *(pcbs) = (npcb); \
+                            TCP_HASH_REG(pcbs, npcb); \
+                            TCP_TIMER_REG(pcbs, npcb); \
                             LWIP_ASSERT("TCP_REG: tcp_pcbs sane", tcp_pcbs_sane()); \
               tcp_timer_needed(); \
                             } while(0)
 #define TCP_RMV(pcbs, npcb) do { \
-                            struct tcp_pcb *tcp_tmp_pcb; \
                             LWIP_ASSERT("TCP_RMV: pcbs != NULL", *(pcbs) != NULL); \
                             LWIP_DEBUGF(TCP_DEBUG, ("TCP_RMV: removing %p from %p\n", (void *)(npcb), (void *)(*(pcbs)))); \
-                            if(*(pcbs) == (npcb)) { \
-                               *(pcbs) = (*pcbs)->next; \
-                            } else for (tcp_tmp_pcb = *(pcbs); tcp_tmp_pcb != NULL; tcp_tmp_pcb = tcp_tmp_pcb->next) { \
-                               if(tcp_tmp_pcb->next == (npcb)) { \
-                                  tcp_tmp_pcb->next = (npcb)->next; \
-                                  break; \
-                               } \
-                            } \
+                            TCP_LIST_REMOVE(pcbs, npcb); \
                             (npcb)->next = NULL; \
+                            TCP_HASH_RMV(pcbs, npcb); \
+                            TCP_TIMER_RMV(pcbs, npcb); \
                             LWIP_ASSERT("TCP_RMV: tcp_pcbs sane", tcp_pcbs_sane()); \
                             LWIP_DEBUGF(TCP_DEBUG, ("TCP_RMV: removed %p from %p\n", (void *)(npcb), (void *)(*(pcbs)))); \
                             } while(0)
@@ -403,28 +668,18 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
 
 #define TCP_REG(pcbs, npcb)                        \
   do {                                             \
-    (npcb)->next = *pcbs;                          \
-    *(pcbs) = (npcb);                              \
+    TCP_LIST_INSERT(pcbs, npcb);                   \
+    TCP_HASH_REG(pcbs, npcb);                      \
+    TCP_TIMER_REG(pcbs, npcb);                     \
     tcp_timer_needed();                            \
   } while (0)
 
 #define TCP_RMV(pcbs, npcb)                        \
   do {                                             \
-    if(*(pcbs) == (npcb)) {                        \
-      (*(pcbs)) = (*pcbs)->next;                   \
-    }                                              \
-    else {                                         \
-      struct tcp_pcb *tcp_tmp_pcb;                 \
-      for (tcp_tmp_pcb = *pcbs;                    \
-          tcp_tmp_pcb != NULL;                     \
-          tcp_tmp_pcb = tcp_tmp_pcb->next) {       \
-        if(tcp_tmp_pcb->next == (npcb)) {          \
-          tcp_tmp_pcb->next = (npcb)->next;        \
-          break;                                   \
-        }                                          \
-      }                                            \
-    }                                              \
+    TCP_LIST_REMOVE(pcbs, npcb);                   \
     (npcb)->next = NULL;                           \
+    TCP_HASH_RMV(pcbs, npcb);                      \
+    TCP_TIMER_RMV(pcbs, npcb);                     \
   } while(0)
 
 #endif /* LWIP_DEBUG */
@@ -457,24 +712,13 @@ void tcp_segs_free(struct tcp_seg *seg);
 void tcp_seg_free(struct tcp_seg *seg);
 struct tcp_seg *tcp_seg_copy(struct tcp_seg *seg);
 
-#define tcp_ack(pcb)                               \
-  do {                                             \
-    if((pcb)->flags & TF_ACK_DELAY) {              \
-      tcp_clear_flags(pcb, TF_ACK_DELAY);          \
-      tcp_ack_now(pcb);                            \
-    }                                              \
-    else {                                         \
-      tcp_set_flags(pcb, TF_ACK_DELAY);            \
-    }                                              \
-  } while (0)
-
 #define tcp_ack_now(pcb)                           \
   tcp_set_flags(pcb, TF_ACK_NOW)
 
 err_t tcp_send_fin(struct tcp_pcb *pcb);
 err_t tcp_enqueue_flags(struct tcp_pcb *pcb, u8_t flags);
 
-void tcp_rexmit_seg(struct tcp_pcb *pcb, struct tcp_seg *seg);
+err_t tcp_rexmit_seg(struct tcp_pcb *pcb, struct tcp_seg *seg);
 
 void tcp_rst(const struct tcp_pcb* pcb, u32_t seqno, u32_t ackno,
        const ip_addr_t *local_ip, const ip_addr_t *remote_ip,
@@ -483,7 +727,141 @@ void tcp_rst_netif(struct netif *netif, u32_t seqno, u32_t ackno,
                    const ip_addr_t *local_ip, const ip_addr_t *remote_ip,
                    u16_t local_port, u16_t remote_port);
 
+#if LWIP_TCP_SYNCOOKIES || LWIP_TCP_REQ_TABLE
+/** A passive open that is not backed by a tcp_pcb yet: what the SYN of the
+ * remote host carried and what our SYN|ACK sends */
+struct tcp_handshake {
+  u32_t irs;        /* initial sequence number of the remote host */
+  u32_t iss;        /* our initial sequence number */
+  u16_t mss;        /* MSS of the remote host */
+  u8_t  optflags;   /* TF_SEG_OPTS_* options of the handshake */
+  u8_t  snd_scale;  /* window scale of the remote host */
+  u8_t  ecn;        /* ECN-setup SYN received */
+#if LWIP_TCP_TIMESTAMPS
+  u32_t ts_val;     /* our timestamp value */
+  u32_t ts_recent;  /* timestamp value of the remote host */
+#endif /* LWIP_TCP_TIMESTAMPS */
+};
+
+void tcp_synack_netif(struct netif *netif, const struct tcp_handshake *hs,
+                      const ip_addr_t *local_ip, const ip_addr_t *remote_ip,
+                      u16_t local_port, u16_t remote_port);
+#if TCP_LISTEN_BACKLOG
+u8_t tcp_backlog_reclaim(struct tcp_pcb_listen *lpcb);
+#endif /* TCP_LISTEN_BACKLOG */
+#endif /* LWIP_TCP_SYNCOOKIES || LWIP_TCP_REQ_TABLE */
+
+#if LWIP_TCP_SYNCOOKIES
+void tcp_syncookie_init(void);
+void tcp_syncookie_make(struct tcp_handshake *ck,
+                        const ip_addr_t *local_ip, u16_t local_port,
+                        const ip_addr_t *remote_ip, u16_t remote_port);
+u8_t tcp_syncookie_check(struct tcp_handshake *ck,
+                         const ip_addr_t *local_ip, u16_t local_port,
+                         const ip_addr_t *remote_ip, u16_t remote_port);
+#endif /* LWIP_TCP_SYNCOOKIES */
+
+#if LWIP_TCP_REQ_TABLE || LWIP_TCP_TW_TABLE
+/* Age lists of the request and TIME_WAIT tables: entries are linked oldest
+   first through age_next and age_pprev, youngest points to the age_next
+   link of the last entry (or to the head if the list is empty). */
+#define TCP_AGE_LINK(youngest, entry)              \
+  do {                                             \
+    (entry)->age_next = NULL;                      \
+    (entry)->age_pprev = (youngest);               \
+    *(youngest) = (entry);                         \
+    (youngest) = &(entry)->age_next;               \
+  } while (0)
+#define TCP_AGE_UNLINK(youngest, entry)            \
+  do {                                             \
+    *(entry)->age_pprev = (entry)->age_next;       \
+    if ((entry)->age_next != NULL) {               \
+      (entry)->age_next->age_pprev = (entry)->age_pprev; \
+    } else {                                       \
+      (youngest) = (entry)->age_pprev;             \
+    }                                              \
+  } while (0)
+#endif /* LWIP_TCP_REQ_TABLE || LWIP_TCP_TW_TABLE */
+
+#if LWIP_TCP_REQ_TABLE
+/** A connection request in SYN_RCVD, kept in the request table until the
+ * final ACK of the handshake promotes it to a tcp_pcb */
+struct tcp_req {
+  struct tcp_req *hash_next;   /* next request in the same bucket */
+  struct tcp_req *age_next;    /* next younger request */
+  struct tcp_req **age_pprev;  /* link to this request in the age list */
+  struct tcp_pcb_listen *listener;
+  ip_addr_t local_ip;
+  ip_addr_t remote_ip;
+  u16_t local_port;
+  u16_t remote_port;
+  struct tcp_handshake hs;
+  u32_t tmr;        /* tcp_ticks when the SYN arrived */
+  u16_t rtime;      /* ticks since the last SYN|ACK */
+  u8_t  nrtx;       /* number of SYN|ACK retransmissions */
+  u8_t  netif_idx;  /* netif the SYN arrived on */
+};
+
+struct tcp_req *tcp_req_alloc(struct tcp_pcb_listen *lpcb,
+                              const ip_addr_t *local_ip, const ip_addr_t *remote_ip,
+                              u16_t remote_port, u8_t netif_idx);
+void tcp_req_free(struct tcp_req *req);
+struct tcp_req *tcp_req_lookup(const struct tcp_pcb_listen *lpcb,
+                               const ip_addr_t *local_ip, const ip_addr_t *remote_ip,
+                               u16_t remote_port);
+void tcp_req_synack(struct tcp_req *req);
+void tcp_req_tmr(void);
+void tcp_req_listen_closed(struct tcp_pcb_listen *lpcb);
+u8_t tcp_req_reclaim(struct tcp_pcb_listen *lpcb);
+u8_t tcp_req_pending(void);
+#else /* LWIP_TCP_REQ_TABLE */
+#define tcp_req_pending() 0
+#endif /* LWIP_TCP_REQ_TABLE */
+
+#if LWIP_TCP_TW_TABLE
+/** A connection in TIME_WAIT whose pcb has been freed, kept in the
+ * TIME_WAIT table until 2*TCP_MSL have passed */
+struct tcp_tw {
+  struct tcp_tw *hash_next;    /* next record in the same 4-tuple bucket */
+  struct tcp_tw *port_next;    /* next record in the same local port bucket */
+  struct tcp_tw *age_next;     /* next younger record */
+  struct tcp_tw **age_pprev;   /* link to this record in the age list */
+  ip_addr_t local_ip;
+  ip_addr_t remote_ip;
+  u16_t local_port;
+  u16_t remote_port;
+  u32_t snd_nxt;    /* sequence number of our ACKs */
+  u32_t rcv_nxt;    /* acknowledgement number of our ACKs */
+  tcpwnd_size_t rcv_wnd; /* a SYN in this window is answered with a RST */
+  u32_t tmr;        /* tcp_ticks when TIME_WAIT was (re)started */
+  u16_t wnd;        /* window field of our ACKs, already scaled */
+  u8_t  netif_idx;  /* netif the pcb was bound to */
+  u8_t  so_options;
+  u8_t  ttl;
+  u8_t  tos;
+#if LWIP_TCP_TIMESTAMPS
+  u8_t  ts;         /* timestamp option in use */
+  u32_t ts_recent;  /* timestamp value of the remote host */
+#endif /* LWIP_TCP_TIMESTAMPS */
+};
+
+void tcp_tw_enter(struct tcp_pcb *pcb);
+void tcp_tw_free(struct tcp_tw *tw);
+struct tcp_tw *tcp_tw_lookup(const ip_addr_t *local_ip, u16_t local_port,
+                             const ip_addr_t *remote_ip, u16_t remote_port,
+                             u8_t netif_idx);
+void tcp_tw_restart(struct tcp_tw *tw);
+u8_t tcp_tw_port_used(const ip_addr_t *local_ip, u16_t local_port, u8_t so_options);
+void tcp_tw_ack(const struct tcp_tw *tw);
+void tcp_tw_tmr(void);
+u8_t tcp_tw_pending(void);
+#else /* LWIP_TCP_TW_TABLE */
+#define tcp_tw_pending() 0
+#endif /* LWIP_TCP_TW_TABLE */
+
 u32_t tcp_next_iss(struct tcp_pcb *pcb);
+u32_t tcp_next_iss_addr(const ip_addr_t *local_ip, u16_t local_port,
+                        const ip_addr_t *remote_ip, u16_t remote_port);
 
 err_t tcp_keepalive(struct tcp_pcb *pcb);
 err_t tcp_split_unsent_seg(struct tcp_pcb *pcb, u16_t split);
@@ -516,13 +894,52 @@ s16_t tcp_pcbs_sane(void);
 #endif /* TCP_DEBUG */
 
 /** External function (implemented in timers.c), called when TCP detects
- * that a timer is needed (i.e. active- or time-wait-pcb found). */
+ * that a timer is needed (i.e. active- or time-wait-pcb, connection
+ * request or time-wait record found). */
 void tcp_timer_needed(void);
 
 void tcp_netif_ip_addr_changed(const ip_addr_t* old_addr, const ip_addr_t* new_addr);
 
+#if TCP_OOSEQ_TREE || TCP_UNACKED_TREE
+void tcp_seg_tree_insert(struct tcp_seg **root, struct tcp_seg *seg, u32_t seqno);
+void tcp_seg_tree_append(struct tcp_seg **root, struct tcp_seg *last, struct tcp_seg *seg, u32_t seqno);
+void tcp_seg_tree_remove(struct tcp_seg **root, struct tcp_seg *seg);
+struct tcp_seg *tcp_seg_tree_find(struct tcp_seg *root, u32_t seqno);
+struct tcp_seg *tcp_seg_tree_prev(const struct tcp_seg *seg);
+#endif /* TCP_OOSEQ_TREE || TCP_UNACKED_TREE */
+
+#if TCP_UNACKED_TREE
+/** Call after putting seg on pcb->unacked, before updating pcb->last_unacked */
+#define TCP_UNACKED_LINK(pcb, seg) do { \
+    if ((seg)->next == NULL) { \
+      tcp_seg_tree_append(&(pcb)->unacked_tree, (pcb)->last_unacked, seg, lwip_ntohl((seg)->tcphdr->seqno)); \
+    } else { \
+      tcp_seg_tree_insert(&(pcb)->unacked_tree, seg, lwip_ntohl((seg)->tcphdr->seqno)); \
+    } } while (0)
+/** Call before taking seg off pcb->unacked */
+#define TCP_UNACKED_UNLINK(pcb, seg) tcp_seg_tree_remove(&(pcb)->unacked_tree, seg)
+/** Call after emptying pcb->unacked */
+#define TCP_UNACKED_CLEAR(pcb)       ((pcb)->unacked_tree = NULL)
+#else /* TCP_UNACKED_TREE */
+#define TCP_UNACKED_LINK(pcb, seg)
+#define TCP_UNACKED_UNLINK(pcb, seg)
+#define TCP_UNACKED_CLEAR(pcb)
+#endif /* TCP_UNACKED_TREE */
+
 #if TCP_QUEUE_OOSEQ
 void tcp_free_ooseq(struct tcp_pcb *pcb);
+#if TCP_OOSEQ_TREE
+/** Call after putting seg on pcb->ooseq */
+#define TCP_OOSEQ_LINK(pcb, seg)   tcp_seg_tree_insert(&(pcb)->ooseq_tree, seg, (seg)->tcphdr->seqno)
+/** Call before taking seg off pcb->ooseq */
+#define TCP_OOSEQ_UNLINK(pcb, seg) tcp_seg_tree_remove(&(pcb)->ooseq_tree, seg)
+/** Call after emptying pcb->ooseq */
+#define TCP_OOSEQ_CLEAR(pcb)       ((pcb)->ooseq_tree = NULL)
+#else /* TCP_OOSEQ_TREE */
+#define TCP_OOSEQ_LINK(pcb, seg)
+#define TCP_OOSEQ_UNLINK(pcb, seg)
+#define TCP_OOSEQ_CLEAR(pcb)
+#endif /* TCP_OOSEQ_TREE */
 #endif
 
 #if LWIP_TCP_PCB_NUM_EXT_ARGS
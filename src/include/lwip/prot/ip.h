@@ -49,6 +49,13 @@ extern "C" {
 #define IP_PROTO_UDPLITE 136
 #define IP_PROTO_TCP     6
 
+/* ECN codepoints in the low two bits of the IPv4 TOS / IPv6 traffic class (RFC 3168) */
+#define IP_ECN_MASK      0x03U
+#define IP_ECN_NOT_ECT   0x00U
+#define IP_ECN_ECT1      0x01U
+#define IP_ECN_ECT0      0x02U
+#define IP_ECN_CE        0x03U
+
 /** This operates on a void* by loading the first byte */
 #define IP_HDR_GET_VERSION(ptr)   ((*(u8_t*)(ptr)) >> 4)
 
@@ -216,7 +216,7 @@ struct ifreq {
 #define SO_LINGER       0x0080 /* linger on close if data present */
 #define SO_DONTLINGER   ((int)(~SO_LINGER))
 #define SO_OOBINLINE    0x0100 /* Unimplemented: leave received OOB data in line */
-#define SO_REUSEPORT    0x0200 /* Unimplemented: allow local address & port reuse */
+#define SO_REUSEPORT    0x0200 /* allow local address & port reuse (TCP listeners, see LWIP_SO_REUSEPORT) */
 #define SO_SNDBUF       0x1001 /* Unimplemented: send buffer size */
 #define SO_RCVBUF       0x1002 /* receive buffer size */
 #define SO_SNDLOWAT     0x1003 /* Unimplemented: send low-water mark */
@@ -228,6 +228,7 @@ struct ifreq {
 #define SO_CONTIMEO     0x1009 /* Unimplemented: connect timeout */
 #define SO_NO_CHECK     0x100a /* don't create UDP checksum */
 #define SO_BINDTODEVICE 0x100b /* bind to device */
+#define SO_ZEROCOPY     0x100c /* allow MSG_ZEROCOPY (TCP, see LWIP_TCP_ZEROCOPY) */
 
 /*
  * Structure used for manipulating linger option.
@@ -272,6 +273,8 @@ struct linger {
 #define MSG_DONTWAIT   0x08    /* Nonblocking i/o for this operation only */
 #define MSG_MORE       0x10    /* Sender will send more */
 #define MSG_NOSIGNAL   0x20    /* Uninmplemented: Requests not to send the SIGPIPE signal if an attempt to send is made on a stream-oriented socket that is no longer connected. */
+#define MSG_ERRQUEUE   0x40    /* Fetch zero-copy send completions (recvmsg only) */
+#define MSG_ZEROCOPY   0x80    /* Don't copy the data: it must not change until its completion has been fetched with MSG_ERRQUEUE (TCP only) */
 
 
 /*
@@ -280,6 +283,7 @@ struct linger {
 #define IP_TOS             1
 #define IP_TTL             2
 #define IP_PKTINFO         8
+#define IP_RECVERR         11 /* cmsg type of zero-copy send completions */
 
 #if LWIP_TCP
 /*
@@ -290,6 +294,9 @@ struct linger {
 #define TCP_KEEPIDLE   0x03    /* set pcb->keep_idle  - Same as TCP_KEEPALIVE, but use seconds for get/setsockopt */
 #define TCP_KEEPINTVL  0x04    /* set pcb->keep_intvl - Use seconds for get/setsockopt */
 #define TCP_KEEPCNT    0x05    /* set pcb->keep_cnt   - Use number of probes sent for get/setsockopt */
+#define TCP_QUICKACK   0x0c    /* ACK every data segment at once (stays on until turned off) */
+#define TCP_CONGESTION 0x0d    /* set pcb->cong_ops   - Use the name of the congestion control (a string) for get/setsockopt */
+#define TCP_ACK_SEGS   0x100   /* set pcb->ack_segs   - ACK at once after this many full-sized segments */
 #endif /* LWIP_TCP */
 
 #if LWIP_IPV6
@@ -297,6 +304,7 @@ struct linger {
  * Options for level IPPROTO_IPV6
  */
 #define IPV6_CHECKSUM       7  /* RFC3542: calculate and insert the ICMPv6 checksum for raw sockets. */
+#define IPV6_RECVERR        25 /* cmsg type of zero-copy send completions */
 #define IPV6_V6ONLY         27 /* RFC3493: boolean control to restrict AF_INET6 sockets to IPv6 communications only. */
 #endif /* LWIP_IPV6 */
 
@@ -338,6 +346,20 @@ struct in_pktinfo {
 };
 #endif /* LWIP_IPV4 */
 
+#if LWIP_TCP && LWIP_TCP_ZEROCOPY
+/* cmsg data returned by recvmsg(MSG_ERRQUEUE) */
+struct sock_extended_err {
+  u32_t ee_errno;   /* always 0 */
+  u8_t  ee_origin;  /* SO_EE_ORIGIN_ZEROCOPY */
+  u8_t  ee_type;
+  u8_t  ee_code;
+  u8_t  ee_pad;
+  u32_t ee_info;    /* first MSG_ZEROCOPY send done */
+  u32_t ee_data;    /* last MSG_ZEROCOPY send done */
+};
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif /* LWIP_TCP && LWIP_TCP_ZEROCOPY */
+
 #if LWIP_IPV6_MLD
 /*
  * Options and types related to IPv6 multicast membership
@@ -134,16 +134,35 @@ typedef void  (*tcp_err_fn)(void *arg, err_t err);
  */
 typedef err_t (*tcp_connected_fn)(void *arg, struct tcp_pcb *tpcb, err_t err);
 
+#if LWIP_TCP_ZEROCOPY
+/** Function prototype for tcp zero-copy callback functions. Called when the
+ * data of zero-copy writes has been acknowledged by the remote side, so that
+ * the application may change or free the buffers it passed to tcp_write().
+ *
+ * @param arg Additional argument to pass to the callback function (@see tcp_arg())
+ * @param tpcb The connection pcb for which data has been acknowledged
+ * @param id The zero-copy writes up to and including this id are done
+ * @return ERR_OK or ERR_ABRT if you have called tcp_abort from within the
+ *            callback function!
+ */
+typedef err_t (*tcp_zerocopy_fn)(void *arg, struct tcp_pcb *tpcb, u32_t id);
+#endif /* LWIP_TCP_ZEROCOPY */
+
 #if LWIP_WND_SCALE
 #define RCV_WND_SCALE(pcb, wnd) (((wnd) >> (pcb)->rcv_scale))
 #define SND_WND_SCALE(pcb, wnd) (((wnd) << (pcb)->snd_scale))
 #define TCPWND16(x)             ((u16_t)LWIP_MIN((x), 0xFFFF))
-#define TCP_WND_MAX(pcb)        ((tcpwnd_size_t)(((pcb)->flags & TF_WND_SCALE) ? TCP_WND : TCPWND16(TCP_WND)))
+#define TCP_WND_MAX(pcb)        ((tcpwnd_size_t)(((pcb)->flags & TF_WND_SCALE) ? TCP_RCV_WND(pcb) : TCPWND16(TCP_RCV_WND(pcb))))
 #else
 #define RCV_WND_SCALE(pcb, wnd) (wnd)
 #define SND_WND_SCALE(pcb, wnd) (wnd)
 #define TCPWND16(x)             (x)
-#define TCP_WND_MAX(pcb)        TCP_WND
+#define TCP_WND_MAX(pcb)        TCP_RCV_WND(pcb)
+#endif
+#if LWIP_TCP_RCV_AUTOTUNE
+#define TCP_RCV_WND(pcb)        ((pcb)->rcv_wnd_max)
+#else
+#define TCP_RCV_WND(pcb)        TCP_WND
 #endif
 /* Increments a tcpwnd_size_t and holds at max value rather than rollover */
 #define TCP_WND_INC(wnd, inc)   do { \
@@ -190,6 +209,21 @@ struct tcp_ext_arg_callbacks {
   tcp_extarg_callback_passive_open_fn passive_open;
 };
 
+#if LWIP_TCP_RATE_SAMPLE
+/** Delivery rate sample passed to tcp_congestion_ops.cong_control on every ACK */
+struct tcp_rate_sample {
+  u32_t prior_delivered; /* pcb->delivered when the newest delivered segment was sent */
+  u32_t prior_time;      /* pcb->delivered_time at that time */
+  s32_t delivered;       /* bytes delivered over interval, -1 if there is no sample */
+  s32_t interval;        /* length of the sampling interval in ms, -1 if invalid */
+  u32_t acked_sacked;    /* bytes newly ACKed or SACKed by this ACK */
+  u32_t prior_in_flight; /* bytes in flight before this ACK */
+  s32_t rtt;             /* RTT sample of this ACK in ms, -1 if there is none */
+  u8_t is_app_limited;   /* the sample was taken while application limited */
+  u8_t has_prior;        /* prior_delivered and prior_time are set */
+};
+#endif /* LWIP_TCP_RATE_SAMPLE */
+
 #define TCP_CA_NAME_MAX 20
 struct tcp_congestion_ops {
 	/* return slow start threshold (required) */
@@ -208,9 +242,39 @@ struct tcp_congestion_ops {
 
 	/* initialize private data */
 	void (*init)(struct tcp_pcb *pcb);
+
+	/* bytes of pcb->tcp_congestion_priv used, up to TCP_CA_PRIV_SIZE */
+	u16_t priv_size;
+
+#if LWIP_TCP_RATE_SAMPLE
+	/* replaces cong_avoid: set cwnd and pacing_rate from a rate sample
+	   on every ACK (optional) */
+	void (*cong_control)(struct tcp_pcb *pcb, const struct tcp_rate_sample *rs);
+#endif /* LWIP_TCP_RATE_SAMPLE */
+
+#if LWIP_TCP_ECN
+	/* called on every ACK with the data bytes it acknowledged and
+	   CA_ACK_* flags (optional) */
+	void (*in_ack_event)(struct tcp_pcb *pcb, u32_t acked, u8_t flags);
+#endif /* LWIP_TCP_ECN */
+
+#if LWIP_TCP_UNDO
+	/* return the cwnd to go back to when the retransmission that reduced
+	   it (pcb->prior_cwnd before) turns out spurious (optional) */
+	tcpwnd_size_t (*undo_cwnd)(struct tcp_pcb *pcb);
+#endif /* LWIP_TCP_UNDO */
 };
 extern struct tcp_congestion_ops tcp_ca_reno;
 extern struct tcp_congestion_ops tcp_ca_cubic;
+#if LWIP_TCP_HYSTART_PP
+extern struct tcp_congestion_ops tcp_ca_cubic_hspp;
+#endif /* LWIP_TCP_HYSTART_PP */
+#if LWIP_TCP_BBR
+extern struct tcp_congestion_ops tcp_ca_bbr;
+#endif /* LWIP_TCP_BBR */
+#if LWIP_TCP_DCTCP
+extern struct tcp_congestion_ops tcp_ca_dctcp;
+#endif /* LWIP_TCP_DCTCP */
 
 #define LWIP_TCP_PCB_NUM_EXT_ARG_ID_INVALID 0xFF
 
@@ -226,6 +290,20 @@ struct tcp_pcb_ext_args {
 #define TCP_PCB_EXTARGS
 #endif
 
+#if LWIP_TCP_PCB_HASH
+/* link in the demux hash tables (4-tuple for connections, port for listeners) */
+#define TCP_PCB_HASH_LINK(type) type *hash_next; type **hash_pprev;
+#else
+#define TCP_PCB_HASH_LINK(type)
+#endif
+
+#if LWIP_TCP_TIMER_WHEEL
+/* back link into the pcb list, so pcbs can be removed without walking it */
+#define TCP_PCB_LIST_LINK(type) type **pprev;
+#else
+#define TCP_PCB_LIST_LINK(type)
+#endif
+
 typedef u16_t tcpflags_t;
 #define TCP_ALLFLAGS 0xffffU
 
@@ -234,10 +312,13 @@ typedef u16_t tcpflags_t;
  */
 #define TCP_PCB_COMMON(type) \
   type *next; /* for the linked list */ \
+  TCP_PCB_LIST_LINK(type) \
+  TCP_PCB_HASH_LINK(type) \
   void *callback_arg; \
   TCP_PCB_EXTARGS \
   enum tcp_state state; /* TCP state */ \
   u8_t prio; \
+  struct tcp_congestion_ops *cong_ops; \
   /* ports are in host byte order */ \
   u16_t local_port
 
@@ -292,6 +373,10 @@ struct tcp_pcb {
 #define TF_RTO         0x0800U /* RTO timer has fired, in-flight data moved to unsent and being retransmitted */
 #if LWIP_TCP_SACK_OUT
 #define TF_SACK        0x1000U /* Selective ACKs enabled */
+#endif
+#define TF_QUICKACK    0x2000U /* ACK every data segment at once */
+#if LWIP_TCP_TW_TABLE
+#define TF_APPCLOSED   0x4000U /* closed by tcp_close(), the application does not refer to the pcb any more */
 #endif
 
   /* the rest of the fields are in host byte order
@@ -301,12 +386,31 @@ struct tcp_pcb {
   u8_t polltmr, pollinterval;
   u8_t last_timer;
   u32_t tmr;
+#if LWIP_TCP_TIMER_WHEEL
+  /* timer wheel slot (or due list) and fast timer list links */
+  struct tcp_pcb *wheel_next;
+  struct tcp_pcb **wheel_pprev;
+  struct tcp_pcb *fast_next;
+  struct tcp_pcb **fast_pprev;
+  /* slow tick the pcb is due at, and up to which its tick counters are current */
+  u32_t wheel_due;
+  u32_t wheel_last;
+#endif /* LWIP_TCP_TIMER_WHEEL */
 
   /* receiver variables */
   u32_t rcv_nxt;   /* next seqno expected */
   tcpwnd_size_t rcv_wnd;   /* receiver window available */
   tcpwnd_size_t rcv_ann_wnd; /* receiver window to announce */
   u32_t rcv_ann_right_edge; /* announced right edge of window */
+  tcpwnd_size_t rcv_unacked; /* data received since the last ACK */
+  u16_t ack_segs;  /* ACK at once when this many full-sized segments are not ACKed */
+  u8_t quickack;   /* data segments left to ACK at once in quick-ACK mode */
+#if LWIP_TCP_RCV_AUTOTUNE
+  /* receive window auto-tuning */
+  tcpwnd_size_t rcv_wnd_max; /* receive window, grown by how fast the application reads */
+  u32_t rcv_space;       /* bytes read by the application since rcv_space_stamp */
+  u32_t rcv_space_stamp; /* sys_now() when the measurement started */
+#endif /* LWIP_TCP_RCV_AUTOTUNE */
 
 #if LWIP_TCP_SACK_OUT
   /* SACK ranges to include in ACK packets (entry is invalid if left==right) */
@@ -327,16 +431,74 @@ struct tcp_pcb {
   s16_t rto;    /* retransmission time-out (in ticks of TCP_SLOW_INTERVAL) */
   u8_t nrtx;    /* number of retransmissions */
 
+#if LWIP_TCP_RTT_MS
+  /* RTT estimation in sys_now() milliseconds (RFC 6298) */
+  u32_t srtt;          /* smoothed RTT, scaled by 8, 0 before the first sample */
+  u32_t rttvar;        /* RTT variation, scaled by 4 */
+  u32_t min_rtt;       /* lowest RTT within TCP_MIN_RTT_WLEN */
+  u32_t min_rtt_stamp; /* sys_now() when min_rtt was sampled */
+#endif /* LWIP_TCP_RTT_MS */
+
   /* fast retransmit/recovery */
   u8_t dupacks;
   u32_t lastack; /* Highest acknowledged seqno. */
+#if LWIP_TCP_SACK_IN
+  /* SACK scoreboard and loss recovery (RFC 6675) */
+  tcpwnd_size_t sacked; /* bytes on the unacked queue SACKed by the remote host */
+  u32_t recover;        /* snd_nxt when loss recovery was entered */
+  u32_t high_rxt;       /* end of the highest range retransmitted in recovery */
+#endif /* LWIP_TCP_SACK_IN */
+#if LWIP_TCP_PRR
+  /* Proportional Rate Reduction in fast recovery (RFC 6937) */
+  u32_t prr_delivered;  /* bytes delivered since recovery was entered */
+  u32_t prr_out;        /* bytes sent since recovery was entered */
+  u32_t prr_acked;      /* bytes delivered by the ACK being processed */
+  u32_t recover_fs;     /* bytes outstanding when recovery was entered */
+#endif /* LWIP_TCP_PRR */
+#if LWIP_TCP_UNDO
+  /* undoing a cwnd reduction for a spurious retransmission */
+  tcpwnd_size_t prior_cwnd;     /* cwnd before the reduction */
+  tcpwnd_size_t prior_ssthresh; /* ssthresh before the reduction */
+  u32_t undo_marker;    /* lastack when cwnd was reduced */
+  u32_t undo_high;      /* snd_nxt when cwnd was reduced */
+  u32_t undo_retrans;   /* bytes retransmitted and not reported duplicate since */
+  u32_t retrans_stamp;  /* sys_now() of the first retransmission */
+  u8_t undo_flags;
+#endif /* LWIP_TCP_UNDO */
+#if LWIP_TCP_RACK
+  /* RACK-TLP (RFC 8985), times in sys_now() milliseconds */
+  u32_t rack_xmit_ts;   /* send time of the most recently sent segment delivered */
+  u32_t rack_end_seq;   /* end of that segment */
+  u32_t rack_fack;      /* highest end of any delivered segment */
+  u32_t rack_rtt;       /* RTT of that segment */
+  u32_t rack_due;       /* expiry of the reordering timer or probe timeout */
+  u32_t rack_armed_due; /* expiry of the pending sys_timeout */
+  u32_t tlp_end_seq;    /* snd_nxt when the tail loss probe was sent */
+  u8_t rack_flags;
+#endif /* LWIP_TCP_RACK */
+#if LWIP_TCP_RATE_SAMPLE
+  /* delivery rate estimation, times in sys_now() milliseconds */
+  u32_t delivered;      /* bytes ACKed or SACKed so far */
+  u32_t delivered_time; /* when delivered was last updated */
+  u32_t first_tx_time;  /* send time of the segment starting the sampling interval */
+  u32_t app_limited;    /* delivered at the end of an application limited phase, 0 if none */
+#endif /* LWIP_TCP_RATE_SAMPLE */
+#if LWIP_TCP_RATE_SAMPLE || LWIP_TCP_PACING
+  u32_t pacing_rate;    /* sending rate requested by the congestion control (bytes/s) */
+#endif /* LWIP_TCP_RATE_SAMPLE || LWIP_TCP_PACING */
+#if LWIP_TCP_PACING
+  u32_t pacing_next;    /* earliest departure time of the next segment (sys_now() * 1000) */
+  u8_t pacing_flags;
+#endif /* LWIP_TCP_PACING */
+#if LWIP_TCP_ECN
+  u8_t ecn_flags;
+  u32_t ecn_recover;    /* snd_nxt when cwnd was last reduced for ECE */
+#endif /* LWIP_TCP_ECN */
 
   /* congestion avoidance/control variables */
   u32_t is_cwnd_limited;
   u32_t lsndtime; /* last segment send timestamp in ms*/
   u32_t lacktime; /* last segment ack timestamp in ms*/
-  struct tcp_congestion_ops *cong_ops;
-  u32_t tcp_congestion_priv[100];
   tcpwnd_size_t cwnd;
   tcpwnd_size_t ssthresh;
 
@@ -365,8 +527,16 @@ struct tcp_pcb {
   /* These are ordered by sequence number: */
   struct tcp_seg *unsent;   /* Unsent (queued) segments. */
   struct tcp_seg *unacked;  /* Sent but unacknowledged segments. */
+  struct tcp_seg *last_unsent;  /* The tail of unsent, to append in O(1). */
+  struct tcp_seg *last_unacked; /* The tail of unacked, to append in O(1). */
+#if TCP_UNACKED_TREE
+  struct tcp_seg *unacked_tree; /* The segments on unacked indexed by seqno. */
+#endif /* TCP_UNACKED_TREE */
 #if TCP_QUEUE_OOSEQ
   struct tcp_seg *ooseq;    /* Received out of sequence segments. */
+#if TCP_OOSEQ_TREE
+  struct tcp_seg *ooseq_tree; /* The segments on ooseq indexed by seqno. */
+#endif /* TCP_OOSEQ_TREE */
 #endif /* TCP_QUEUE_OOSEQ */
 
   struct pbuf *refused_data; /* Data previously received but not yet taken by upper layer */
@@ -386,8 +556,19 @@ struct tcp_pcb {
   tcp_poll_fn poll;
   /* Function to be called whenever a fatal error occurs. */
   tcp_err_fn errf;
+#if LWIP_TCP_ZEROCOPY
+  /* Function to be called when zero-copy writes have been ACKed. */
+  tcp_zerocopy_fn zerocopy;
+#endif /* LWIP_TCP_ZEROCOPY */
 #endif /* LWIP_CALLBACK_API */
 
+#if LWIP_TCP_ZEROCOPY
+  /* id of the current zero-copy write */
+  u32_t zc_id;
+  /* data has been written with zc_id already */
+  u8_t zc_open;
+#endif /* LWIP_TCP_ZEROCOPY */
+
 #if LWIP_TCP_TIMESTAMPS
   u32_t ts_lastacksent;
   u32_t ts_recent;
@@ -414,6 +595,9 @@ struct tcp_pcb {
   u8_t snd_scale;
   u8_t rcv_scale;
 #endif
+
+  /* private state of cong_ops, zeroed before cong_ops->init() */
+  u32_t tcp_congestion_priv[(TCP_CA_PRIV_SIZE + 3) / 4];
 };
 
 #if LWIP_EVENT_API
@@ -468,6 +652,10 @@ void             tcp_poll    (struct tcp_pcb *pcb, tcp_poll_fn poll, u8_t interv
 #define          tcp_nagle_enable(pcb)    tcp_clear_flags(pcb, TF_NODELAY)
 /** @ingroup tcp_raw */
 #define          tcp_nagle_disabled(pcb)  tcp_is_flag_set(pcb, TF_NODELAY)
+/** @ingroup tcp_raw */
+#define          tcp_quickack_enabled(pcb) tcp_is_flag_set(pcb, TF_QUICKACK)
+/** @ingroup tcp_raw */
+#define          tcp_get_ack_segs(pcb)     ((pcb)->ack_segs)
 
 #if TCP_LISTEN_BACKLOG
 #define          tcp_backlog_set(pcb, new_backlog) do { \
@@ -501,7 +689,25 @@ err_t            tcp_shutdown(struct tcp_pcb *pcb, int shut_rx, int shut_tx);
 err_t            tcp_write   (struct tcp_pcb *pcb, const void *dataptr, u16_t len,
                               u8_t apiflags);
 
+#if LWIP_TCP_ZEROCOPY
+void             tcp_zerocopy(struct tcp_pcb *pcb, tcp_zerocopy_fn zerocopy);
+void             tcp_zerocopy_end(struct tcp_pcb *pcb);
+#endif /* LWIP_TCP_ZEROCOPY */
+
 void             tcp_setprio (struct tcp_pcb *pcb, u8_t prio);
+err_t            tcp_set_ack_segs(struct tcp_pcb *pcb, u16_t segs);
+void             tcp_quickack(struct tcp_pcb *pcb, u8_t enable);
+void             tcp_keepalive_changed(struct tcp_pcb *pcb);
+#if LWIP_TCP_PACING
+void             tcp_set_pacing(struct tcp_pcb *pcb, u8_t enable);
+#endif /* LWIP_TCP_PACING */
+
+err_t            tcp_register_congestion_control(struct tcp_congestion_ops *ops);
+err_t            tcp_unregister_congestion_control(struct tcp_congestion_ops *ops);
+struct tcp_congestion_ops *tcp_ca_find(const char *name);
+err_t            tcp_set_default_congestion_control(const char *name);
+const char      *tcp_get_default_congestion_control(void);
+err_t            tcp_set_congestion_control(struct tcp_pcb *pcb, const char *name);
 
 err_t            tcp_output  (struct tcp_pcb *pcb);
 
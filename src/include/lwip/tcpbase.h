@@ -72,6 +72,8 @@ enum tcp_state {
 /* Flags for "apiflags" parameter in tcp_write */
 #define TCP_WRITE_FLAG_COPY 0x01
 #define TCP_WRITE_FLAG_MORE 0x02
+/* 0x04..0x10 are taken by the netconn flags passed on to tcp_write */
+#define TCP_WRITE_FLAG_ZEROCOPY 0x20
 
 #define TCP_PRIO_MIN    1
 #define TCP_PRIO_NORMAL 64
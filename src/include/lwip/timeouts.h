@@ -95,6 +95,15 @@ struct sys_timeo {
   u32_t time;
   sys_timeout_handler h;
   void *arg;
+#if LWIP_TIMERS_HEAP
+  /* pairing heap links ('next' is the right sibling) */
+  struct sys_timeo *child;
+  struct sys_timeo *prev;
+  /* handler/argument hash chain */
+  struct sys_timeo *hash_next;
+  /* orders timeouts with the same expiry time by creation */
+  u32_t seq;
+#endif /* LWIP_TIMERS_HEAP */
 #if LWIP_DEBUG_TIMERNAMES
   const char* handler_name;
 #endif /* LWIP_DEBUG_TIMERNAMES */
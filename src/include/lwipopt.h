@@ -52,6 +52,7 @@
 #define GAZELLE_TCP_PCB_HASH 1
 
 #define GAZELLE_TCP_MAX_DATA_ACK_NUM 256
+#define TCP_ACK_SEGS_MAX GAZELLE_TCP_MAX_DATA_ACK_NUM
 
 #define GAZELLE_TCP_MAX_PBUF_CHAIN_LEN 40
 
@@ -109,6 +110,10 @@
 #define LWIP_STATS_DISPLAY 1
 
 #define LWIP_TIMERS 1
+/* RACK and pacing arm one timeout per connection, which calls for the heap.
+   Without them only the few module timers are pending and the sorted list
+   is cheaper. */
+#define LWIP_TIMERS_HEAP (LWIP_TCP_RACK || LWIP_TCP_PACING)
 
 #define LWIP_TIMEVAL_PRIVATE 0
 
@@ -207,10 +212,37 @@
 
 #define TCP_LISTEN_BACKLOG 1
 #define TCP_DEFAULT_LISTEN_BACKLOG 0xff
+#define LWIP_TCP_SYNCOOKIES 1
+#define LWIP_TCP_REQ_TABLE 1
+#define TCP_REQ_HASH_SIZE 16384
+#define LWIP_TCP_TW_TABLE 1
+#define TCP_TW_HASH_SIZE 16384
 
 #define TCP_OVERSIZE 0
 #define LWIP_NETIF_TX_SINGLE_PBUF 0
 
+#define LWIP_TCP_PRR 1
+#define LWIP_TCP_HYSTART_PP 1
+#define LWIP_TCP_UNDO 1
+
+/* TCP_WND for each of tens of thousands of connections would be gigabytes:
+   start small and let the windows grow by up to 32 full windows in total */
+#define LWIP_TCP_RCV_AUTOTUNE 1
+#define TCP_RCV_AUTOTUNE_BUDGET (32 * TCP_WND)
+
+#define LWIP_TCP_TSO 1
+#define TCP_TSO_MIN_SEG_LEN GAZELLE_TCP_MIN_TSO_SEG_LEN
+#define MEMP_NUM_TCP_TSO_PBUF 1024
+
+#define LWIP_TCP_GRO 1
+#define TCP_GRO_MAX_SEGS GAZELLE_TCP_MAX_PBUF_CHAIN_LEN
+
+#define LWIP_TCP_ZEROCOPY 1
+
+/* a 2500 * TCP_MSS window holds thousands of segments out of sequence or in flight */
+#define TCP_OOSEQ_TREE 1
+#define TCP_UNACKED_TREE 1
+
 #define TCP_MSS (FRAME_MTU - IP_HLEN - TCP_HLEN)
 
 #define TCP_WND (2500 * TCP_MSS)
@@ -225,8 +257,17 @@
 
 #define LWIP_TCP_KEEPALIVE 1
 
+#define LWIP_TCP_PCB_HASH GAZELLE_TCP_PCB_HASH
+#define TCP_PCB_HASH_SIZE 16384
+
+/* tens of thousands of pcbs per thread: only visit the ones whose timers are due */
+#define LWIP_TCP_TIMER_WHEEL 1
+#define TCP_TIMER_WHEEL_SIZE 1024
+
 #define GAZELLE_TCP_MAX_CONN_PER_THREAD 65535
 #define GAZELLE_TCP_REUSE_IPPORT 1
+#define LWIP_SO_REUSEPORT GAZELLE_TCP_REUSE_IPPORT
+#define TCP_LISTEN_HASH_SIZE 4096
 
 
 /*
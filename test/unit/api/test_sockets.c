@@ -48,6 +48,13 @@ sockets_teardown(void)
     tcp_abort(tcp_tw_pcbs);
     tcpip_thread_poll_one();
   }
+#if LWIP_TCP_TW_TABLE
+  /* ... and let the TIME-WAIT records expire */
+  while (tcp_tw_pending()) {
+    tcp_ticks += 2 * TCP_MSL / TCP_SLOW_INTERVAL + 1;
+    tcp_tw_tmr();
+  }
+#endif /* LWIP_TCP_TW_TABLE */
   tcpip_thread_poll_one();
   /* ensure full free heap */
   lwip_check_ensure_no_alloc(SKIP_POOL(MEMP_SYS_TIMEOUT));
@@ -828,6 +835,147 @@ cleanup:
 }
 END_TEST
 
+/* Verify the congestion control can be selected per socket by name */
+START_TEST(test_sockets_tcp_congestion)
+{
+  int s, ret;
+  char name[TCP_CA_NAME_MAX];
+  socklen_t len;
+  struct sockaddr_in sa;
+  LWIP_UNUSED_ARG(_i);
+
+  s = lwip_socket(AF_INET, SOCK_STREAM, 0);
+  fail_unless(s >= 0);
+
+  len = sizeof(name);
+  ret = lwip_getsockopt(s, IPPROTO_TCP, TCP_CONGESTION, name, &len);
+  fail_unless(ret == 0);
+  fail_unless(strcmp(name, "cubic") == 0);
+
+  ret = lwip_setsockopt(s, IPPROTO_TCP, TCP_CONGESTION, "reno", 4);
+  fail_unless(ret == 0);
+  ret = lwip_setsockopt(s, IPPROTO_TCP, TCP_CONGESTION, "vegas", 5);
+  fail_unless(ret == -1);
+  fail_unless(errno == ENOENT);
+
+  /* listening sockets pass it on to the connections they accept */
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = PP_HTONL(INADDR_LOOPBACK);
+  ret = lwip_bind(s, (struct sockaddr *)&sa, sizeof(sa));
+  fail_unless(ret == 0);
+  ret = lwip_listen(s, 0);
+  fail_unless(ret == 0);
+  memset(name, 0, sizeof(name));
+  len = sizeof(name);
+  ret = lwip_getsockopt(s, IPPROTO_TCP, TCP_CONGESTION, name, &len);
+  fail_unless(ret == 0);
+  fail_unless(strcmp(name, "reno") == 0);
+  ret = lwip_setsockopt(s, IPPROTO_TCP, TCP_CONGESTION, "cubic", 5);
+  fail_unless(ret == 0);
+
+  ret = lwip_close(s);
+  fail_unless(ret == 0);
+}
+END_TEST
+
+/** MSG_ZEROCOPY sends are reported on the error queue once ACKed */
+START_TEST(test_sockets_tcp_zerocopy)
+{
+#if LWIP_TCP_ZEROCOPY
+  /* referenced until ACKed */
+  static const char txbuf[] = "zerocopy";
+  int listnr, s1, s2, i, ret, opt;
+  struct sockaddr_storage addr_storage;
+  socklen_t addr_size, len;
+  char rxbuf[2 * sizeof(txbuf)];
+  u8_t cmsg_buf[CMSG_SPACE(sizeof(struct sock_extended_err))];
+  struct msghdr msg;
+  struct cmsghdr *cmsg;
+  struct sock_extended_err ee;
+  LWIP_UNUSED_ARG(_i);
+
+  test_sockets_init_loopback_addr(AF_INET, &addr_storage, &addr_size);
+
+  listnr = test_sockets_alloc_socket_nonblocking(AF_INET, SOCK_STREAM);
+  fail_unless(listnr >= 0);
+  s1 = test_sockets_alloc_socket_nonblocking(AF_INET, SOCK_STREAM);
+  fail_unless(s1 >= 0);
+  ret = lwip_bind(listnr, (struct sockaddr*)&addr_storage, addr_size);
+  fail_unless(ret == 0);
+  ret = lwip_listen(listnr, 0);
+  fail_unless(ret == 0);
+  ret = lwip_getsockname(listnr, (struct sockaddr*)&addr_storage, &addr_size);
+  fail_unless(ret == 0);
+  ret = lwip_connect(s1, (struct sockaddr*)&addr_storage, addr_size);
+  fail_unless(ret == -1);
+  fail_unless(errno == EINPROGRESS);
+  while (tcpip_thread_poll_one());
+  s2 = lwip_accept(listnr, NULL, NULL);
+  fail_unless(s2 >= 0);
+  ret = lwip_close(listnr);
+  fail_unless(ret == 0);
+
+  opt = 1;
+  ret = lwip_setsockopt(s1, SOL_SOCKET, SO_ZEROCOPY, &opt, sizeof(opt));
+  fail_unless(ret == 0);
+  opt = 0;
+  len = sizeof(opt);
+  ret = lwip_getsockopt(s1, SOL_SOCKET, SO_ZEROCOPY, &opt, &len);
+  fail_unless(ret == 0);
+  fail_unless(opt == 1);
+
+  /* two sends: ids 0 and 1 */
+  ret = lwip_send(s1, txbuf, sizeof(txbuf), MSG_ZEROCOPY);
+  fail_unless(ret == sizeof(txbuf));
+  ret = lwip_send(s1, txbuf, sizeof(txbuf), MSG_ZEROCOPY);
+  fail_unless(ret == sizeof(txbuf));
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_control = cmsg_buf;
+  msg.msg_controllen = sizeof(cmsg_buf);
+  ret = lwip_recvmsg(s1, &msg, MSG_ERRQUEUE);
+  fail_unless(ret == -1);
+  fail_unless(errno == EWOULDBLOCK);
+
+  /* deliver the data and the delayed ACKs: Nagle holds back the second send
+     until the first one is ACKed */
+  for (i = 0; i < 2; i++) {
+    while (tcpip_thread_poll_one());
+    tcp_fasttmr();
+  }
+  while (tcpip_thread_poll_one());
+  ret = lwip_recv(s2, rxbuf, sizeof(rxbuf), 0);
+  fail_unless(ret == sizeof(rxbuf));
+
+  ret = lwip_recvmsg(s1, &msg, MSG_ERRQUEUE);
+  fail_unless(ret == 0);
+  fail_unless(msg.msg_flags == MSG_ERRQUEUE);
+  cmsg = CMSG_FIRSTHDR(&msg);
+  fail_unless(cmsg != NULL);
+  fail_unless(cmsg->cmsg_level == IPPROTO_IP);
+  fail_unless(cmsg->cmsg_type == IP_RECVERR);
+  memcpy(&ee, CMSG_DATA(cmsg), sizeof(ee));
+  fail_unless(ee.ee_origin == SO_EE_ORIGIN_ZEROCOPY);
+  fail_unless(ee.ee_info == 0);
+  fail_unless(ee.ee_data == 1);
+
+  /* reported once only */
+  msg.msg_controllen = sizeof(cmsg_buf);
+  ret = lwip_recvmsg(s1, &msg, MSG_ERRQUEUE);
+  fail_unless(ret == -1);
+  fail_unless(errno == EWOULDBLOCK);
+
+  ret = lwip_close(s1);
+  fail_unless(ret == 0);
+  ret = lwip_close(s2);
+  fail_unless(ret == 0);
+#else /* LWIP_TCP_ZEROCOPY */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_ZEROCOPY */
+}
+END_TEST
+
 /** Create the suite including all tests for this module */
 Suite *
 sockets_suite(void)
@@ -838,6 +986,8 @@ sockets_suite(void)
     TESTFUNC(test_sockets_msgapis),
     TESTFUNC(test_sockets_select),
     TESTFUNC(test_sockets_recv_after_rst),
+    TESTFUNC(test_sockets_tcp_congestion),
+    TESTFUNC(test_sockets_tcp_zerocopy),
   };
   return create_suite("SOCKETS", tests, sizeof(tests)/sizeof(testfunc), sockets_setup, sockets_teardown);
 }
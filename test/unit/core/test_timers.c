@@ -4,6 +4,8 @@
 #include "lwip/timeouts.h"
 #include "arch/sys_arch.h"
 
+#include <time.h>
+
 /* Setups/teardown functions */
 
 static struct sys_timeo* old_list_head;
@@ -140,8 +142,10 @@ do_test_timers(u32_t offset)
 
   /* linked list correctly sorted? */
   fail_unless((*list_head)->time             == (u32_t)(lwip_sys_now + 5));
+#if !LWIP_TIMERS_HEAP
   fail_unless((*list_head)->next->time       == (u32_t)(lwip_sys_now + 10));
   fail_unless((*list_head)->next->next->time == (u32_t)(lwip_sys_now + 20));
+#endif /* !LWIP_TIMERS_HEAP */
   
   /* check timers expire in correct order */
   memset(&fired, 0, sizeof(fired));
@@ -219,6 +223,70 @@ START_TEST(test_long_timer)
 }
 END_TEST
 
+#define TIMERS_MANY_NUM 10000
+static u32_t many_due[TIMERS_MANY_NUM];
+static u32_t many_last;
+static int many_fired;
+static int many_order_ok;
+static void
+many_handler(void* arg)
+{
+  u32_t index = LWIP_PTR_NUMERIC_CAST(u32_t, arg);
+  if (((index & 1) != 0) || ((s32_t)(many_due[index] - many_last) < 0)) {
+    many_order_ok = 0;
+  }
+  many_last = many_due[index];
+  many_fired++;
+}
+
+/* arm many timeouts with scattered expiry times, cancel every other one and
+   check that the rest fire in order. The time taken by each step is printed
+   to compare the list with LWIP_TIMERS_HEAP. */
+START_TEST(test_timers_many)
+{
+  u32_t i;
+  u32_t seed = 1;
+  clock_t start;
+  u32_t insert_usecs, cancel_usecs, expire_usecs;
+  LWIP_UNUSED_ARG(_i);
+
+  /* crosses the u32_t wraparound */
+  lwip_sys_now = 0xfffff000;
+  for (i = 0; i < TIMERS_MANY_NUM; i++) {
+    seed = seed * 1103515245 + 12345;
+    many_due[i] = (seed >> 8) % 100000 + 1;
+  }
+  start = clock();
+  for (i = 0; i < TIMERS_MANY_NUM; i++) {
+    sys_timeout(many_due[i], many_handler, LWIP_PTR_NUMERIC_CAST(void*, i));
+  }
+  insert_usecs = (u32_t)(((clock() - start) * 1000000) / CLOCKS_PER_SEC);
+  for (i = 0; i < TIMERS_MANY_NUM; i++) {
+    many_due[i] += lwip_sys_now;
+  }
+  start = clock();
+  for (i = 1; i < TIMERS_MANY_NUM; i += 2) {
+    sys_untimeout(many_handler, LWIP_PTR_NUMERIC_CAST(void*, i));
+  }
+  cancel_usecs = (u32_t)(((clock() - start) * 1000000) / CLOCKS_PER_SEC);
+
+  many_last = lwip_sys_now;
+  many_fired = 0;
+  many_order_ok = 1;
+  start = clock();
+  for (i = 0; i <= 100; i++) {
+    lwip_sys_now += 1000;
+    sys_check_timeouts();
+  }
+  expire_usecs = (u32_t)(((clock() - start) * 1000000) / CLOCKS_PER_SEC);
+  LWIP_PLATFORM_DIAG(("timers: %d timeouts inserted in %"U32_F" us, %d cancelled in %"U32_F" us, rest expired in %"U32_F" us\n",
+                      TIMERS_MANY_NUM, insert_usecs, TIMERS_MANY_NUM / 2, cancel_usecs, expire_usecs));
+  fail_unless(many_fired == TIMERS_MANY_NUM / 2);
+  fail_unless(many_order_ok);
+  fail_unless(sys_timeouts_sleeptime() == SYS_TIMEOUTS_SLEEPTIME_INFINITE);
+}
+END_TEST
+
 /** Create the suite including all tests for this module */
 Suite *
 timers_suite(void)
@@ -228,6 +296,7 @@ timers_suite(void)
     TESTFUNC(test_cyclic_timers),
     TESTFUNC(test_timers),
     TESTFUNC(test_long_timer),
+    TESTFUNC(test_timers_many),
   };
   return create_suite("TIMERS", tests, LWIP_ARRAYSIZE(tests), timers_setup, timers_teardown);
 }
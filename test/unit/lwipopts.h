@@ -61,12 +61,49 @@
 /* Minimal changes to opt.h required for tcp unit tests: */
 #define MEM_SIZE                        16000
 #define TCP_SND_QUEUELEN                44
-#define MEMP_NUM_TCP_SEG                TCP_SND_QUEUELEN
+/* test_tcp_recv_ooseq_many queues more segments than fit into the send queue */
+#define MEMP_NUM_TCP_SEG                256
 #define TCP_SND_BUF                     (22 * TCP_MSS)
 #define TCP_WND                         (20 * TCP_MSS)
 #define LWIP_WND_SCALE                  1
 #define TCP_RCV_SCALE                   0
 #define PBUF_POOL_SIZE                  400 /* pbuf tests need ~200KByte */
+/* small table to exercise bucket collisions */
+#define LWIP_TCP_PCB_HASH               1
+#define TCP_PCB_HASH_SIZE               4
+#define TCP_LISTEN_HASH_SIZE            4
+#define LWIP_SO_REUSEPORT               1
+#define LWIP_TCP_TIMER_WHEEL            1
+#define TCP_TIMER_WHEEL_SIZE            8
+#define LWIP_TCP_SACK_OUT               1
+#define LWIP_TCP_SACK_IN                1
+#define LWIP_TCP_RTT_MS                 1
+#define LWIP_TCP_RACK                   1
+#define LWIP_TCP_PRR                    1
+#define LWIP_TCP_RATE_SAMPLE            1
+#define LWIP_TCP_BBR                    1
+#define LWIP_TCP_ECN                    1
+#define LWIP_TCP_DCTCP                  1
+#define LWIP_TCP_PACING                 1
+#define LWIP_TCP_HYSTART_PP             1
+#define LWIP_TCP_TIMESTAMPS             1
+#define LWIP_TCP_UNDO                   1
+#define LWIP_TCP_RCV_AUTOTUNE           1
+/* test_tcp_ack_policy receives 12 segments without reading them */
+#define TCP_RCV_AUTOTUNE_INIT           (12 * TCP_MSS)
+/* room for one connection to grow to TCP_WND */
+#define TCP_RCV_AUTOTUNE_BUDGET         (TCP_WND - TCP_RCV_AUTOTUNE_INIT)
+#define LWIP_TCP_TSO                    1
+#define LWIP_TCP_GRO                    1
+#define LWIP_TCP_ZEROCOPY               1
+#define TCP_OOSEQ_TREE                  1
+#define TCP_UNACKED_TREE                1
+#define TCP_LISTEN_BACKLOG              1
+#define LWIP_TCP_SYNCOOKIES             1
+#define LWIP_TCP_REQ_TABLE              1
+#define TCP_REQ_HASH_SIZE               4
+#define LWIP_TCP_TW_TABLE               1
+#define TCP_TW_HASH_SIZE                4
 
 /* Enable IGMP and MDNS for MDNS tests */
 #define LWIP_IGMP                       1
@@ -80,7 +117,9 @@
 /* Minimal changes to opt.h required for etharp unit tests: */
 #define ETHARP_SUPPORT_STATIC_ENTRIES   1
 
-#define MEMP_NUM_SYS_TIMEOUT            (LWIP_NUM_SYS_TIMEOUT_INTERNAL + 8)
+/* test_timers_many arms 10000 timeouts */
+#define MEMP_NUM_SYS_TIMEOUT            (LWIP_NUM_SYS_TIMEOUT_INTERNAL + 10008)
+#define LWIP_TIMERS_HEAP                1
 
 /* MIB2 stats are required to check IPv4 reassembly results */
 #define MIB2_STATS                      1
@@ -3,8 +3,10 @@
 #include "lwip/priv/tcp_priv.h"
 #include "lwip/stats.h"
 #include "lwip/inet.h"
+#include "lwip/timeouts.h"
 #include "tcp_helper.h"
 #include "lwip/inet_chksum.h"
+#include "lwip/tcpip.h"
 
 #ifdef _MSC_VER
 #pragma warning(disable: 4307) /* we explicitly wrap around TCP seqnos */
@@ -38,6 +40,12 @@ struct cubictcp {
 	u32_t	end_seq;	/* end_seq of the round */
 	u32_t	last_ack;	/* last time when the ACK spacing is close */
 	u32_t	curr_rtt;	/* the minimum rtt of current round */
+#if LWIP_TCP_HYSTART_PP
+	u32_t	last_rtt;	/* the minimum rtt of the last round */
+	u32_t	css_baseline_rtt;	/* curr_rtt when CSS was entered */
+	u8_t	hspp;		/* HyStart++ state */
+	u8_t	css_rounds;	/* rounds started in CSS */
+#endif /* LWIP_TCP_HYSTART_PP */
 };
 
 /* used with check_seqnos() */
@@ -727,10 +735,18 @@ START_TEST(test_tcp_fast_rexmit_wraparound)
   p = tcp_create_rx_segment(pcb, NULL, 0, 0, 0, TCP_ACK);
   test_tcp_input(p, &netif);
   EXPECT(pcb->dupacks == 3);
+#if LWIP_TCP_PRR
+  /* the dupacks leave nothing in the pipe: one MSS more than was delivered */
+  EXPECT(txcounters.num_tx_calls == 3);
+  memset(&txcounters, 0, sizeof(txcounters));
+  check_seqnos(pcb->unsent, 1, &seqnos[5]);
+  check_seqnos(pcb->unacked, 4, &seqnos[1]);
+#else /* LWIP_TCP_PRR */
   EXPECT(txcounters.num_tx_calls == 4);
   memset(&txcounters, 0, sizeof(txcounters));
   EXPECT(pcb->unsent == NULL);
   check_seqnos(pcb->unacked, 5, &seqnos[1]);
+#endif /* LWIP_TCP_PRR */
 
   /* make sure the pcb is freed */
   EXPECT_RET(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 1);
@@ -1157,6 +1173,12 @@ START_TEST(test_tcp_rto_tracking)
   EXPECT(pcb->rto_end == pcb->snd_nxt);
   /* Check cwnd was reset */
   EXPECT(pcb->cwnd == pcb->mss);
+#if LWIP_TCP_UNDO
+  /* this test is about conventional RTO recovery, F-RTO would send the new
+     segment instead of retransmitting (see test_tcp_frto_spurious) */
+  EXPECT(pcb->undo_flags & TCP_FRTO_STEP2);
+  pcb->undo_flags &= (u8_t)~TCP_FRTO_STEP2;
+#endif /* LWIP_TCP_UNDO */
 
   /* Add another segment to send buffer which is outside of RTO */
   err = tcp_write(pcb, &tx_data[sent_total], TCP_MSS, TCP_WRITE_FLAG_COPY);
@@ -1725,8 +1747,7 @@ START_TEST(test_tcp_ca_cubic_slowstart)
   EXPECT_RET(pcb != NULL);
   tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
   ca = (struct cubictcp*) pcb->tcp_congestion_priv;
-  if(pcb->cong_ops->init != NULL)
-    pcb->cong_ops->init(pcb);
+  tcp_init_congestion_control(pcb);
   pcb->mss = TCP_MSS;
   /* Init congestion parameters */
   pcb->ssthresh = 3*TCP_MSS;
@@ -1847,8 +1868,7 @@ START_TEST(test_tcp_ca_cubic_hystart_ack_train)
   EXPECT_RET(pcb != NULL);
   tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
   ca = (struct cubictcp*) pcb->tcp_congestion_priv;
-  if(pcb->cong_ops->init != NULL)
-    pcb->cong_ops->init(pcb);
+  tcp_init_congestion_control(pcb);
   pcb->mss = TCP_MSS;
   /* Init congestion parameters */
   pcb->ssthresh = 32*TCP_MSS;
@@ -1949,8 +1969,7 @@ START_TEST(test_tcp_ca_cubic_hystart_delay)
   EXPECT_RET(pcb != NULL);
   tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
   ca = (struct cubictcp*) pcb->tcp_congestion_priv;
-  if(pcb->cong_ops->init != NULL)
-    pcb->cong_ops->init(pcb);
+  tcp_init_congestion_control(pcb);
   pcb->mss = TCP_MSS;
   /* Init congestion parameters */
   pcb->ssthresh = 32*TCP_MSS;
@@ -2025,6 +2044,136 @@ START_TEST(test_tcp_ca_cubic_hystart_delay)
 }
 END_TEST
 
+#if LWIP_TCP_HYSTART_PP
+/* HyStart++ states of tcp_ca_cubic.c */
+#define TEST_HSPP_SS   1
+#define TEST_HSPP_CSS  2
+#define TEST_HSPP_DONE 3
+
+/** One ACK for one MSS in slow start, with an RTT sample. The window is
+ * refilled afterwards, so a round is one cwnd of ACKs. */
+static void
+test_tcp_hspp_ack(struct tcp_pcb *pcb, u32_t rtt)
+{
+  pcb->lastack += TCP_MSS;
+  pcb->is_cwnd_limited = 1;
+  pcb->cong_ops->cong_avoid(pcb, TCP_MSS);
+  pcb->cong_ops->pkts_acked(pcb, rtt);
+  pcb->snd_nxt = pcb->lastack + pcb->cwnd;
+}
+
+/** ACK until the next round starts, return the number of ACKs */
+static int
+test_tcp_hspp_round(struct tcp_pcb *pcb, u32_t rtt)
+{
+  struct cubictcp *ca = (struct cubictcp *)pcb->tcp_congestion_priv;
+  int n = 0;
+
+  /* stop before the ACK that starts the next round, which then takes the
+     RTT of the next call */
+  do {
+    test_tcp_hspp_ack(pcb, rtt);
+    n++;
+  } while (TCP_SEQ_LT(pcb->lastack + TCP_MSS, ca->end_seq) && ca->hspp != TEST_HSPP_DONE);
+  return n;
+}
+#endif /* LWIP_TCP_HYSTART_PP */
+
+/** Check that HyStart++ takes a jittery RTT increase for Conservative Slow
+ * Start instead of ending slow start, returns to slow start when the RTT
+ * falls again, and ends slow start after CSS_ROUNDS rounds of a higher RTT */
+START_TEST(test_tcp_ca_cubic_hystart_pp)
+{
+#if LWIP_TCP_HYSTART_PP
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct cubictcp *ca;
+  tcpwnd_size_t cwnd;
+  err_t err;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  memset(&counters, 0, sizeof(counters));
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  pcb->mss = TCP_MSS;
+  pcb->cwnd = 10 * TCP_MSS;
+  pcb->ssthresh = 10000 * TCP_MSS;
+  pcb->snd_nxt = pcb->lastack + pcb->cwnd;
+  err = tcp_set_congestion_control(pcb, "cubic_hspp");
+  EXPECT_RET(err == ERR_OK);
+  EXPECT_RET(pcb->cong_ops == &tcp_ca_cubic_hspp);
+  ca = (struct cubictcp *)pcb->tcp_congestion_priv;
+  EXPECT(ca->hspp == TEST_HSPP_SS);
+  lwip_sys_now = 1000;
+
+  /* two rounds at 40 ms: cwnd grows by one MSS per ACK */
+  EXPECT(test_tcp_hspp_round(pcb, 40) == 9);
+  EXPECT(pcb->cwnd == 19 * TCP_MSS);
+  EXPECT(test_tcp_hspp_round(pcb, 40) == 18);
+  EXPECT(pcb->cwnd == 37 * TCP_MSS);
+  EXPECT(ca->last_rtt == 40);
+  EXPECT(ca->hspp == TEST_HSPP_SS);
+
+  /* +4 ms is below the threshold of 40/8 ms */
+  EXPECT(test_tcp_hspp_round(pcb, 44) == 36);
+  EXPECT(pcb->cwnd == 73 * TCP_MSS);
+  EXPECT(ca->hspp == TEST_HSPP_SS);
+
+  /* +5 ms after 8 samples: cwnd only grows by a quarter MSS per ACK */
+  for (i = 0; i < 8; i++) {
+    test_tcp_hspp_ack(pcb, 49);
+  }
+  EXPECT(ca->last_rtt == 44);
+  EXPECT(ca->hspp == TEST_HSPP_CSS);
+  EXPECT(ca->css_baseline_rtt == 49);
+  EXPECT(!ca->found);
+  cwnd = pcb->cwnd;
+  test_tcp_hspp_ack(pcb, 49);
+  EXPECT(pcb->cwnd == cwnd + TCP_MSS / 4);
+
+  /* the RTT falls below the baseline in the next round: back to slow start */
+  test_tcp_hspp_round(pcb, 49);
+  for (i = 0; i < 8; i++) {
+    test_tcp_hspp_ack(pcb, 45);
+  }
+  EXPECT(ca->hspp == TEST_HSPP_SS);
+  cwnd = pcb->cwnd;
+  test_tcp_hspp_ack(pcb, 45);
+  EXPECT(pcb->cwnd == cwnd + TCP_MSS);
+
+  /* the RTT rises for good: slow start ends after 5 rounds of CSS */
+  test_tcp_hspp_round(pcb, 45);
+  for (i = 0; i < 8; i++) {
+    test_tcp_hspp_ack(pcb, 60);
+  }
+  EXPECT(ca->hspp == TEST_HSPP_CSS);
+  for (i = 0; i < 5; i++) {
+    test_tcp_hspp_round(pcb, 60);
+    EXPECT(ca->hspp == TEST_HSPP_CSS);
+    EXPECT(tcp_in_slow_start(pcb));
+  }
+  EXPECT(test_tcp_hspp_round(pcb, 60) == 1);
+  EXPECT(ca->hspp == TEST_HSPP_DONE);
+  EXPECT(pcb->ssthresh == pcb->cwnd);
+  EXPECT(!tcp_in_slow_start(pcb));
+
+  /* a loss ends HyStart++ for good, later slow starts are the standard one */
+  pcb->ssthresh = pcb->cong_ops->ssthresh(pcb);
+  EXPECT(ca->hspp == TEST_HSPP_DONE);
+
+  tcp_abort(pcb);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+#else /* LWIP_TCP_HYSTART_PP */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_HYSTART_PP */
+}
+END_TEST
+
 START_TEST(test_tcp_ca_cubic)
 {
   struct netif netif;
@@ -2052,8 +2201,7 @@ START_TEST(test_tcp_ca_cubic)
   EXPECT_RET(pcb != NULL);
   tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
   ca = (struct cubictcp*) pcb->tcp_congestion_priv;
-  if(pcb->cong_ops->init != NULL)
-    pcb->cong_ops->init(pcb);
+  tcp_init_congestion_control(pcb);
   pcb->mss = TCP_MSS;
   /* Init congestion parameters */
   pcb->ssthresh = 10*TCP_MSS;
@@ -2166,7 +2314,12 @@ START_TEST(test_tcp_ca_cubic)
   EXPECT(ca->epoch_start == 0);
   EXPECT(ca->last_max_cwnd == 11);
   EXPECT(pcb->ssthresh == 7 * TCP_MSS);
+#if LWIP_TCP_PRR
+  /* 11 MSS outstanding, 1 MSS delivered: send 7/11 of it */
+  EXPECT(pcb->cwnd == 11 * TCP_MSS + (7 * TCP_MSS + 10) / 11);
+#else /* LWIP_TCP_PRR */
   EXPECT(pcb->cwnd == 10 * TCP_MSS);
+#endif /* LWIP_TCP_PRR */
 
   /* ACK next segment, recover from fast retransmit*/
   lwip_sys_now += 1000;
@@ -2221,7 +2374,12 @@ START_TEST(test_tcp_ca_cubic)
   EXPECT(ca->epoch_start == 0);
   EXPECT(ca->last_max_cwnd == 6);
   EXPECT(pcb->ssthresh == 5 * TCP_MSS);
+#if LWIP_TCP_PRR
+  /* 9 MSS outstanding, 1 MSS delivered: send 5/9 of it */
+  EXPECT(pcb->cwnd == 9 * TCP_MSS + (5 * TCP_MSS + 8) / 9);
+#else /* LWIP_TCP_PRR */
   EXPECT(pcb->cwnd == 8 * TCP_MSS);
+#endif /* LWIP_TCP_PRR */
 
   /* make sure the pcb is freed */
   EXPECT_RET(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 1);
@@ -2257,8 +2415,7 @@ START_TEST(test_tcp_ca_cubic_rto)
   EXPECT_RET(pcb != NULL);
   tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
   ca = (struct cubictcp*) pcb->tcp_congestion_priv;
-  if(pcb->cong_ops->init != NULL)
-    pcb->cong_ops->init(pcb);
+  tcp_init_congestion_control(pcb);
   pcb->mss = TCP_MSS;
   /* Init congestion parameters */
   pcb->ssthresh = 10*TCP_MSS;
@@ -2395,8 +2552,7 @@ START_TEST(test_tcp_ca_cubic_tcp_friendliness)
   EXPECT_RET(pcb != NULL);
   tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
   ca = (struct cubictcp*) pcb->tcp_congestion_priv;
-  if(pcb->cong_ops->init != NULL)
-    pcb->cong_ops->init(pcb);
+  tcp_init_congestion_control(pcb);
   pcb->mss = TCP_MSS;
   /* Init congestion parameters */
   pcb->ssthresh = 4*TCP_MSS;
@@ -2491,6 +2647,2224 @@ START_TEST(test_tcp_ca_cubic_tcp_friendliness)
 }
 END_TEST
 
+/** Create several connections differing only in the remote port and check
+ * that segments are demultiplexed to the right pcb, also after some of them
+ * went to TIME-WAIT or were removed */
+START_TEST(test_tcp_demux_many)
+{
+  struct test_tcp_counters counters[3];
+  struct tcp_pcb *pcbs[3];
+  struct tcp_pcb *twpcb;
+  struct pbuf *p;
+  char data[] = {1, 2, 3, 4};
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+
+  for (i = 0; i < 3; i++) {
+    memset(&counters[i], 0, sizeof(counters[i]));
+    counters[i].expected_data_len = sizeof(data);
+    counters[i].expected_data = data;
+    pcbs[i] = test_tcp_new_counters_pcb(&counters[i]);
+    EXPECT_RET(pcbs[i] != NULL);
+    tcp_set_state(pcbs[i], ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT,
+                  (u16_t)(TEST_REMOTE_PORT + i));
+  }
+  twpcb = tcp_new();
+  EXPECT_RET(twpcb != NULL);
+  tcp_set_state(twpcb, TIME_WAIT, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT,
+                TEST_REMOTE_PORT + 3);
+
+#if LWIP_TCP_PCB_HASH
+  for (i = 0; i < 3; i++) {
+    EXPECT(tcp_pcb_hash_lookup(&test_local_ip, TEST_LOCAL_PORT, &test_remote_ip,
+                               (u16_t)(TEST_REMOTE_PORT + i), NETIF_NO_INDEX) == pcbs[i]);
+  }
+  EXPECT(tcp_pcb_hash_lookup(&test_local_ip, TEST_LOCAL_PORT, &test_remote_ip,
+                             TEST_REMOTE_PORT + 3, NETIF_NO_INDEX) == twpcb);
+  EXPECT(tcp_pcb_hash_lookup(&test_local_ip, TEST_LOCAL_PORT, &test_remote_ip,
+                             TEST_REMOTE_PORT + 4, NETIF_NO_INDEX) == NULL);
+#endif /* LWIP_TCP_PCB_HASH */
+
+  /* deliver in reverse order so the first match in list order is not used */
+  for (i = 2; i >= 0; i--) {
+    p = tcp_create_rx_segment(pcbs[i], data, sizeof(data), 0, 0, 0);
+    EXPECT_RET(p != NULL);
+    test_tcp_input(p, &netif);
+    EXPECT(counters[i].recv_calls == 1);
+    EXPECT(counters[i].recved_bytes == sizeof(data));
+  }
+  EXPECT(counters[0].err_calls == 0);
+  EXPECT(counters[1].err_calls == 0);
+  EXPECT(counters[2].err_calls == 0);
+
+  /* a removed pcb must not be found any more */
+  tcp_abort(pcbs[1]);
+  EXPECT(counters[1].err_calls == 1);
+#if LWIP_TCP_PCB_HASH
+  EXPECT(tcp_pcb_hash_lookup(&test_local_ip, TEST_LOCAL_PORT, &test_remote_ip,
+                             TEST_REMOTE_PORT + 1, NETIF_NO_INDEX) == NULL);
+  EXPECT(tcp_pcb_hash_lookup(&test_local_ip, TEST_LOCAL_PORT, &test_remote_ip,
+                             TEST_REMOTE_PORT + 2, NETIF_NO_INDEX) == pcbs[2]);
+#endif /* LWIP_TCP_PCB_HASH */
+  counters[2].recved_bytes = 0;
+  p = tcp_create_rx_segment(pcbs[2], data, sizeof(data), 0, 0, 0);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(counters[2].recv_calls == 2);
+
+  /* TIME-WAIT pcbs are reaped by the slow timer */
+  for (i = 0; i <= (int)(2 * TCP_MSL / TCP_SLOW_INTERVAL); i++) {
+    tcp_slowtmr();
+  }
+  EXPECT(tcp_tw_pcbs == NULL);
+#if LWIP_TCP_PCB_HASH
+  EXPECT(tcp_pcb_hash_lookup(&test_local_ip, TEST_LOCAL_PORT, &test_remote_ip,
+                             TEST_REMOTE_PORT + 3, NETIF_NO_INDEX) == NULL);
+#endif /* LWIP_TCP_PCB_HASH */
+
+  tcp_abort(pcbs[0]);
+  tcp_abort(pcbs[2]);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+}
+END_TEST
+
+/** Check that per-pcb timers fire on the right slow tick and, with the timer
+ * wheel, that idle pcbs are not visited on every tick */
+START_TEST(test_tcp_timer_wheel)
+{
+  struct test_tcp_counters counters;
+  struct tcp_pcb *kpcb, *rpcb, *ipcb;
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  char data[] = {1, 2, 3, 4};
+  u8_t idle_timer;
+  err_t err;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  memset(&counters, 0, sizeof(counters));
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+
+  /* one pcb with a keepalive timer, one with data in flight, one idle */
+  kpcb = test_tcp_new_counters_pcb(&counters);
+  rpcb = test_tcp_new_counters_pcb(&counters);
+  ipcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET((kpcb != NULL) && (rpcb != NULL) && (ipcb != NULL));
+  tcp_set_state(kpcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  tcp_set_state(rpcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT + 1);
+  tcp_set_state(ipcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT + 2);
+  ip_set_option(kpcb, SOF_KEEPALIVE);
+  kpcb->keep_idle = 4 * TCP_SLOW_INTERVAL;
+  rpcb->rto = 6;
+  rpcb->cwnd = rpcb->snd_wnd;
+
+  err = tcp_write(rpcb, data, sizeof(data), TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_output(rpcb);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT_RET(txcounters.num_tx_calls == 1);
+  memset(&txcounters, 0, sizeof(txcounters));
+
+  tcp_slowtmr();
+  idle_timer = ipcb->last_timer;
+  /* keepalive is sent once idle for more than 4 ticks, the RTO fires after 6 */
+  for (i = 2; i <= 6; i++) {
+    tcp_slowtmr();
+    EXPECT(txcounters.num_tx_calls == (u16_t)(i < 5 ? 0 : i - 4));
+  }
+  EXPECT(kpcb->keep_cnt_sent == 1);
+  EXPECT(rpcb->nrtx == 1);
+#if LWIP_TCP_TIMER_WHEEL
+  EXPECT(ipcb->last_timer == idle_timer);
+#else
+  LWIP_UNUSED_ARG(idle_timer);
+#endif /* LWIP_TCP_TIMER_WHEEL */
+
+  /* an idle pcb is still looked at once per wheel revolution */
+  for (i = 0; i < 2 * TCP_TIMER_WHEEL_SIZE; i++) {
+    tcp_slowtmr();
+  }
+  EXPECT(ipcb->last_timer != idle_timer);
+  EXPECT(counters.err_calls == 0);
+
+  tcp_abort(kpcb);
+  tcp_abort(rpcb);
+  tcp_abort(ipcb);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+}
+END_TEST
+
+#if LWIP_TCP_SACK_IN
+/** Return the seqno of the single segment captured by the tx counters and reset them */
+static u32_t
+test_tcp_sack_tx_seqno(struct test_tcp_txcounters *txcounters)
+{
+  struct tcp_hdr tcphdr;
+  u32_t seqno = 0;
+  if (txcounters->tx_packets != NULL) {
+    pbuf_copy_partial(txcounters->tx_packets, &tcphdr, sizeof(tcphdr), IP_HLEN);
+    seqno = lwip_ntohl(tcphdr.seqno);
+    pbuf_free(txcounters->tx_packets);
+  }
+  memset(txcounters, 0, sizeof(*txcounters));
+  txcounters->copy_tx_packets = 1;
+  return seqno;
+}
+#endif /* LWIP_TCP_SACK_IN */
+
+/** Lose two segments of a flight and check that SACK recovery retransmits
+ * exactly these holes, without resending SACKed data */
+START_TEST(test_tcp_sack_recovery)
+{
+#if LWIP_TCP_SACK_IN
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+  char data[TCP_MSS];
+  u32_t seg[11], sacks[4];
+  err_t err;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  memset(data, 0x55, sizeof(data));
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  memset(&counters, 0, sizeof(counters));
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  tcp_set_flags(pcb, TF_SACK | TF_NODELAY);
+  pcb->mss = TCP_MSS;
+  pcb->cwnd = pcb->snd_wnd;
+#if LWIP_TCP_RACK
+  /* let RACK wait a reordering window so that the SACK rules decide */
+  pcb->rack_flags |= RACK_REORDER_SEEN;
+#endif /* LWIP_TCP_RACK */
+
+  /* send a flight of 10 segments */
+  for (i = 0; i <= 10; i++) {
+    seg[i] = pcb->snd_nxt + (u32_t)(i * TCP_MSS);
+  }
+  for (i = 0; i < 10; i++) {
+    err = tcp_write(pcb, data, sizeof(data), TCP_WRITE_FLAG_COPY);
+    EXPECT_RET(err == ERR_OK);
+  }
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT_RET(txcounters.num_tx_calls == 10);
+  test_tcp_sack_tx_seqno(&txcounters);
+  lwip_sys_now += 100;
+
+  /* segment 0 arrives, 1 and 4 are lost */
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, TCP_MSS, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT_RET(pcb->lastack == seg[1]);
+
+  /* the first two dupacks SACK 2 and 3: not enough for loss recovery */
+  sacks[0] = seg[2];
+  sacks[1] = seg[3];
+  p = tcp_create_rx_segment_sack(pcb, 0, sacks, 1);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  sacks[1] = seg[4];
+  p = tcp_create_rx_segment_sack(pcb, 0, sacks, 1);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->dupacks == 2);
+  EXPECT(pcb->sacked == 2 * TCP_MSS);
+  EXPECT(!(pcb->flags & TF_INFR));
+  EXPECT(txcounters.num_tx_calls == 0);
+
+  /* third dupack: only segment 1 is lost so far (1 MSS SACKed above 4) */
+  sacks[2] = seg[5];
+  sacks[3] = seg[6];
+  p = tcp_create_rx_segment_sack(pcb, 0, sacks, 2);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->flags & TF_INFR);
+  EXPECT(pcb->sacked == 3 * TCP_MSS);
+  EXPECT(pcb->recover == seg[10]);
+  EXPECT(txcounters.num_tx_calls == 1);
+  EXPECT(test_tcp_sack_tx_seqno(&txcounters) == seg[1]);
+
+  /* 6 and 7 SACKed: segment 4 is lost as well, 2, 3 and 5 are not resent */
+  sacks[3] = seg[8];
+  p = tcp_create_rx_segment_sack(pcb, 0, sacks, 2);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->sacked == 5 * TCP_MSS);
+  EXPECT(txcounters.num_tx_calls == 1);
+  EXPECT(test_tcp_sack_tx_seqno(&txcounters) == seg[4]);
+
+  /* partial ACK up to the second hole: still in recovery, nothing to resend */
+  sacks[0] = seg[5];
+  sacks[1] = seg[8];
+  p = tcp_create_rx_segment_sack(pcb, seg[4] - seg[1], sacks, 1);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->lastack == seg[4]);
+  EXPECT(pcb->flags & TF_INFR);
+  EXPECT(pcb->sacked == 3 * TCP_MSS);
+  EXPECT(txcounters.num_tx_calls == 0);
+
+  /* everything acknowledged: recovery is over */
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, seg[10] - seg[4], TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(!(pcb->flags & TF_INFR));
+  EXPECT(pcb->sacked == 0);
+  EXPECT(pcb->unacked == NULL);
+  EXPECT(pcb->cwnd == pcb->ssthresh);
+  EXPECT(txcounters.num_tx_calls == 0);
+
+  EXPECT(counters.err_calls == 0);
+  test_tcp_sack_tx_seqno(&txcounters);
+  txcounters.copy_tx_packets = 0;
+  tcp_abort(pcb);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+#else /* LWIP_TCP_SACK_IN */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_SACK_IN */
+}
+END_TEST
+
+/** Lose the first segment of a flight without SACK and check that PRR sends
+ * in proportion to the duplicate ACKs instead of bursting, and leaves
+ * recovery with cwnd at ssthresh */
+START_TEST(test_tcp_prr)
+{
+#if LWIP_TCP_PRR
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+  char data[TCP_MSS];
+  u32_t iss;
+  err_t err;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  memset(data, 0x55, sizeof(data));
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  memset(&counters, 0, sizeof(counters));
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  tcp_set_flags(pcb, TF_NODELAY);
+  pcb->mss = TCP_MSS;
+  pcb->cong_ops = &tcp_ca_reno;
+  pcb->cwnd = 10 * TCP_MSS;
+  iss = pcb->snd_nxt;
+
+  /* a flight of 10 segments, 10 more are queued */
+  for (i = 0; i < 20; i++) {
+    err = tcp_write(pcb, data, sizeof(data), TCP_WRITE_FLAG_COPY);
+    EXPECT_RET(err == ERR_OK);
+  }
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT_RET(txcounters.num_tx_calls == 10);
+  memset(&txcounters, 0, sizeof(txcounters));
+
+  /* the first segment is lost, the third dupack retransmits it */
+  for (i = 1; i <= 3; i++) {
+    p = tcp_create_rx_segment(pcb, NULL, 0, 0, 0, TCP_ACK);
+    EXPECT_RET(p != NULL);
+    test_tcp_input(p, &netif);
+  }
+  EXPECT(pcb->flags & TF_INFR);
+  EXPECT(pcb->ssthresh == 5 * TCP_MSS);
+  EXPECT(pcb->recover_fs == 10 * TCP_MSS);
+  EXPECT(txcounters.num_tx_calls == 1);
+  EXPECT(pcb->prr_out == TCP_MSS);
+  memset(&txcounters, 0, sizeof(txcounters));
+
+  /* one dupack per segment that arrived: 5/10 of them are sent until pipe
+     is down to ssthresh, then one segment per dupack keeps it there */
+  for (i = 4; i <= 9; i++) {
+    p = tcp_create_rx_segment(pcb, NULL, 0, 0, 0, TCP_ACK);
+    EXPECT_RET(p != NULL);
+    test_tcp_input(p, &netif);
+    EXPECT(txcounters.num_tx_calls == ((i <= 5) ? 0 : 1));
+    EXPECT(pcb->cwnd <= pcb->snd_nxt - pcb->lastack + TCP_MSS);
+    memset(&txcounters, 0, sizeof(txcounters));
+  }
+  EXPECT(pcb->prr_delivered == 7 * TCP_MSS);
+  EXPECT(pcb->prr_out == 5 * TCP_MSS);
+  EXPECT(pcb->snd_nxt == iss + 14 * TCP_MSS);
+
+  /* the whole flight is ACKed: cwnd is back at ssthresh, congestion
+     avoidance adds 2 MSS for the 10 MSS ACKed and 4 segments are still out */
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, 10 * TCP_MSS, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(!(pcb->flags & TF_INFR));
+  EXPECT(pcb->cwnd == pcb->ssthresh + 2 * TCP_MSS);
+  EXPECT(txcounters.num_tx_calls == 3);
+  EXPECT(pcb->snd_nxt == iss + 17 * TCP_MSS);
+
+  EXPECT(counters.err_calls == 0);
+  tcp_abort(pcb);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+#else /* LWIP_TCP_PRR */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_PRR */
+}
+END_TEST
+
+#if LWIP_TCP_SACK_IN
+/** Check that the tail pointers and the seqno index of the send queues
+ * match the lists */
+static void
+test_tcp_check_send_queues(struct tcp_pcb *pcb)
+{
+  struct tcp_seg *seg, *last = NULL;
+
+  for (seg = pcb->unsent; seg != NULL; seg = seg->next) {
+    last = seg;
+  }
+  EXPECT(pcb->last_unsent == last);
+  last = NULL;
+  for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+#if TCP_UNACKED_TREE
+    EXPECT(tcp_seg_tree_find(pcb->unacked_tree, lwip_ntohl(seg->tcphdr->seqno)) == seg);
+    EXPECT(tcp_seg_tree_prev(seg) == last);
+#endif /* TCP_UNACKED_TREE */
+    last = seg;
+  }
+  EXPECT(pcb->last_unacked == last);
+#if TCP_UNACKED_TREE
+  EXPECT((pcb->unacked_tree == NULL) == (pcb->unacked == NULL));
+#endif /* TCP_UNACKED_TREE */
+}
+#endif /* LWIP_TCP_SACK_IN */
+
+/** SACK every other segment of a large flight, recover and time out, and
+ * check that the send queue index follows every change of the queues */
+START_TEST(test_tcp_sack_send_queue_index)
+{
+#if LWIP_TCP_SACK_IN
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+  char data[TCP_MSS];
+  u32_t seg[21], sacks[6];
+  err_t err;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  memset(data, 0x55, sizeof(data));
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  memset(&counters, 0, sizeof(counters));
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  tcp_set_flags(pcb, TF_SACK | TF_NODELAY);
+  pcb->mss = TCP_MSS;
+  pcb->cwnd = 16 * TCP_MSS;
+#if LWIP_TCP_RACK
+  /* let RACK wait a reordering window so that the SACK rules decide */
+  pcb->rack_flags |= RACK_REORDER_SEEN;
+#endif /* LWIP_TCP_RACK */
+
+  /* 16 segments in flight, 4 left unsent */
+  for (i = 0; i <= 20; i++) {
+    seg[i] = pcb->snd_nxt + (u32_t)(i * TCP_MSS);
+  }
+  for (i = 0; i < 20; i++) {
+    err = tcp_write(pcb, data, sizeof(data), TCP_WRITE_FLAG_COPY);
+    EXPECT_RET(err == ERR_OK);
+    test_tcp_check_send_queues(pcb);
+  }
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT_RET(txcounters.num_tx_calls == 16);
+  test_tcp_check_send_queues(pcb);
+  lwip_sys_now += 100;
+
+  /* SACK 2, 4, 6, ... from the top: the lookups land in the middle of unacked */
+  for (i = 0; i < 3; i++) {
+    sacks[2 * i] = seg[14 - 4 * i];
+    sacks[2 * i + 1] = seg[15 - 4 * i];
+    p = tcp_create_rx_segment_sack(pcb, 0, sacks, (u8_t)(i + 1));
+    EXPECT_RET(p != NULL);
+    test_tcp_input(p, &netif);
+    test_tcp_check_send_queues(pcb);
+  }
+  EXPECT(pcb->sacked == 3 * TCP_MSS);
+  EXPECT(pcb->flags & TF_INFR);
+  /* the holes below the SACKed segments went back through unsent */
+  EXPECT(txcounters.num_tx_calls > 16);
+
+  /* a timeout moves everything back to unsent, one segment is resent */
+  txcounters.num_tx_calls = 0;
+  pcb->cwnd = pcb->mss;
+  tcp_rexmit_rto(pcb);
+  EXPECT(txcounters.num_tx_calls == 1);
+  EXPECT(pcb->sacked == 0);
+  test_tcp_check_send_queues(pcb);
+
+  /* acknowledge all that is sent until the queues are empty */
+  for (i = 0; (i < 20) && (pcb->unacked != NULL); i++) {
+    p = tcp_create_rx_segment(pcb, NULL, 0, 0, pcb->snd_nxt - pcb->lastack, TCP_ACK);
+    EXPECT_RET(p != NULL);
+    test_tcp_input(p, &netif);
+    test_tcp_check_send_queues(pcb);
+  }
+  EXPECT(pcb->unacked == NULL);
+  EXPECT(pcb->unsent == NULL);
+  EXPECT(pcb->lastack == seg[20]);
+
+  EXPECT(counters.err_calls == 0);
+  tcp_abort(pcb);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+#else /* LWIP_TCP_SACK_IN */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_SACK_IN */
+}
+END_TEST
+
+/** Check the millisecond RTT estimator: SRTT, RTTVAR, minimum RTT and RTO
+ * follow RFC 6298 and retransmitted segments give no sample */
+START_TEST(test_tcp_rtt_estimator)
+{
+#if LWIP_TCP_RTT_MS
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+  char data[TCP_MSS];
+  err_t err;
+  LWIP_UNUSED_ARG(_i);
+
+  memset(data, 0x55, sizeof(data));
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  memset(&counters, 0, sizeof(counters));
+  lwip_sys_now = 1000;
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  pcb->mss = TCP_MSS;
+  pcb->cwnd = pcb->snd_wnd;
+  EXPECT(pcb->srtt == 0);
+  EXPECT(pcb->rto == LWIP_TCP_RTO_TIME / TCP_SLOW_INTERVAL);
+
+  /* first sample: srtt = rtt, rttvar = rtt / 2 */
+  err = tcp_write(pcb, data, sizeof(data), TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  lwip_sys_now += 40;
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, TCP_MSS, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->unacked == NULL);
+  EXPECT((pcb->srtt >> 3) == 40);
+  EXPECT((pcb->rttvar >> 2) == 20);
+  EXPECT(pcb->min_rtt == 40);
+  EXPECT(pcb->rto == (LWIP_MAX(40 + 4 * 20, LWIP_TCP_RTO_MIN) + TCP_SLOW_INTERVAL - 1) / TCP_SLOW_INTERVAL);
+
+  /* second sample: srtt = 7/8 * 40 + 1/8 * 20, rttvar = 3/4 * 20 + 1/4 * 20 */
+  err = tcp_write(pcb, data, sizeof(data), TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  lwip_sys_now += 20;
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, TCP_MSS, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->srtt == 300);
+  EXPECT((pcb->rttvar >> 2) == 20);
+  EXPECT(pcb->min_rtt == 20);
+
+  /* an ACK for a retransmitted segment is ambiguous (Karn) */
+  err = tcp_write(pcb, data, sizeof(data), TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  lwip_sys_now += 1000;
+  tcp_rexmit_rto(pcb);
+  EXPECT_RET(pcb->unacked != NULL);
+  EXPECT(pcb->unacked->snd_time == 2);
+  lwip_sys_now += 5;
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, TCP_MSS, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->unacked == NULL);
+  EXPECT(pcb->srtt == 300);
+  EXPECT(pcb->min_rtt == 20);
+  EXPECT(pcb->rto == (LWIP_MAX(37 + 4 * 20, LWIP_TCP_RTO_MIN) + TCP_SLOW_INTERVAL - 1) / TCP_SLOW_INTERVAL);
+
+  EXPECT(counters.err_calls == 0);
+  tcp_abort(pcb);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+#else /* LWIP_TCP_RTT_MS */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_RTT_MS */
+}
+END_TEST
+
+/** Lose the tail of a flight and check that the tail loss probe resends it
+ * long before the retransmission timeout, then lose a single segment and
+ * check that the RACK reordering timer recovers it after one duplicate ACK */
+START_TEST(test_tcp_rack_tlp)
+{
+#if LWIP_TCP_RACK
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+  char data[TCP_MSS];
+  u32_t seg[8], sacks[2];
+  tcpwnd_size_t cwnd;
+  struct sys_timeo **timeouts = sys_timeouts_get_next_timeout();
+  struct sys_timeo *old_timeouts;
+  err_t err;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  memset(data, 0x55, sizeof(data));
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  memset(&counters, 0, sizeof(counters));
+  lwip_sys_now = 1000;
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  /* only run the RACK timer in sys_check_timeouts(): registering the pcb
+     may have started the TCP timer */
+  old_timeouts = *timeouts;
+  *timeouts = NULL;
+  tcp_set_flags(pcb, TF_SACK | TF_NODELAY);
+  pcb->mss = TCP_MSS;
+  pcb->cwnd = pcb->snd_wnd;
+
+  for (i = 0; i < 8; i++) {
+    seg[i] = pcb->snd_nxt + (u32_t)(i * TCP_MSS);
+  }
+  for (i = 0; i < 4; i++) {
+    err = tcp_write(pcb, data, sizeof(data), TCP_WRITE_FLAG_COPY);
+    EXPECT_RET(err == ERR_OK);
+  }
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT_RET(txcounters.num_tx_calls == 4);
+  test_tcp_sack_tx_seqno(&txcounters);
+
+  /* segments 0-2 arrive after 100ms, the tail is lost */
+  lwip_sys_now += 100;
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, seg[3] - seg[0], TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT_RET(pcb->lastack == seg[3]);
+  EXPECT((pcb->srtt >> 3) == 100);
+  EXPECT(pcb->rack_flags & RACK_TMR_PTO);
+
+  /* no ACK for a while: the tail is probed without a retransmission timeout */
+  lwip_sys_now += 100;
+  sys_check_timeouts();
+  EXPECT(txcounters.num_tx_calls == 0);
+  lwip_sys_now += 900;
+  sys_check_timeouts();
+  EXPECT(txcounters.num_tx_calls == 1);
+  EXPECT(test_tcp_sack_tx_seqno(&txcounters) == seg[3]);
+  EXPECT(pcb->rack_flags & TLP_PROBING);
+  EXPECT(pcb->nrtx == 0);
+
+  /* the probe repaired a loss: cwnd is reduced as after fast recovery */
+  cwnd = pcb->cwnd;
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, seg[4] - seg[3], TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->unacked == NULL);
+  EXPECT(!(pcb->rack_flags & TLP_PROBING));
+  EXPECT(pcb->cwnd == pcb->ssthresh);
+  EXPECT(pcb->cwnd < cwnd);
+
+  /* send three more, only segment 4 is lost */
+  pcb->cwnd = pcb->snd_wnd;
+  for (i = 0; i < 3; i++) {
+    err = tcp_write(pcb, data, sizeof(data), TCP_WRITE_FLAG_COPY);
+    EXPECT_RET(err == ERR_OK);
+  }
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT_RET(txcounters.num_tx_calls == 3);
+  test_tcp_sack_tx_seqno(&txcounters);
+
+  /* one dupack SACKing segment 5: segment 4 may still be reordered */
+  lwip_sys_now += 100;
+  sacks[0] = seg[5];
+  sacks[1] = seg[6];
+  p = tcp_create_rx_segment_sack(pcb, 0, sacks, 1);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->dupacks == 1);
+  EXPECT(pcb->rack_flags & RACK_TMR_REO);
+  EXPECT(txcounters.num_tx_calls == 0);
+
+  /* a quarter RTT later segment 4 is declared lost and resent */
+  lwip_sys_now += 30;
+  sys_check_timeouts();
+  EXPECT(pcb->flags & TF_INFR);
+  EXPECT(txcounters.num_tx_calls == 1);
+  EXPECT(test_tcp_sack_tx_seqno(&txcounters) == seg[4]);
+
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, seg[7] - seg[4], TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(!(pcb->flags & TF_INFR));
+  EXPECT(pcb->unacked == NULL);
+
+  EXPECT(counters.err_calls == 0);
+  test_tcp_sack_tx_seqno(&txcounters);
+  txcounters.copy_tx_packets = 0;
+  tcp_abort(pcb);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+  EXPECT(*timeouts == NULL);
+  *timeouts = old_timeouts;
+#else /* LWIP_TCP_RACK */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_RACK */
+}
+END_TEST
+
+#if LWIP_TCP_UNDO
+/** Send a flight of 5 segments with 2 more queued and let the retransmission
+ * timeout fire, which retransmits the first segment and starts F-RTO */
+static struct tcp_pcb *
+test_tcp_undo_rto(struct netif *netif, struct test_tcp_txcounters *txcounters,
+                  struct test_tcp_counters *counters)
+{
+  struct tcp_pcb *pcb;
+  char data[TCP_MSS];
+  err_t err;
+  int i;
+
+  memset(data, 0x55, sizeof(data));
+  test_tcp_init_netif(netif, txcounters, &test_local_ip, &test_netmask);
+  memset(counters, 0, sizeof(*counters));
+
+  pcb = test_tcp_new_counters_pcb(counters);
+  EXPECT_RETNULL(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  tcp_set_flags(pcb, TF_NODELAY);
+  pcb->mss = TCP_MSS;
+  pcb->cong_ops = &tcp_ca_reno;
+  pcb->cwnd = 5 * TCP_MSS;
+  pcb->ssthresh = 10 * TCP_MSS;
+
+  for (i = 0; i < 7; i++) {
+    err = tcp_write(pcb, data, sizeof(data), TCP_WRITE_FLAG_COPY);
+    EXPECT_RETNULL(err == ERR_OK);
+  }
+  err = tcp_output(pcb);
+  EXPECT_RETNULL(err == ERR_OK);
+  EXPECT_RETNULL(txcounters->num_tx_calls == 5);
+  memset(txcounters, 0, sizeof(*txcounters));
+
+  while (!(pcb->flags & TF_RTO)) {
+    test_tcp_tmr();
+  }
+  EXPECT(txcounters->num_tx_calls == 1);
+  EXPECT(pcb->cwnd == TCP_MSS);
+  EXPECT(pcb->prior_cwnd == 5 * TCP_MSS);
+  EXPECT(pcb->prior_ssthresh == 10 * TCP_MSS);
+  EXPECT(pcb->undo_flags == (TCP_UNDO_PENDING | TCP_FRTO_STEP2));
+  memset(txcounters, 0, sizeof(*txcounters));
+  return pcb;
+}
+#endif /* LWIP_TCP_UNDO */
+
+/** Delay the ACKs of a flight past the retransmission timeout and check that
+ * F-RTO sends new data instead of retransmissions, then finds the timeout
+ * spurious and restores cwnd and ssthresh */
+START_TEST(test_tcp_frto_spurious)
+{
+#if LWIP_TCP_UNDO
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+  u32_t una;
+  LWIP_UNUSED_ARG(_i);
+
+  pcb = test_tcp_undo_rto(&netif, &txcounters, &counters);
+  EXPECT_RET(pcb != NULL);
+  una = pcb->lastack;
+
+  /* the first ACK covers the retransmission: the two queued segments are
+     sent, the other three of the flight are not retransmitted */
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, TCP_MSS, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(txcounters.num_tx_calls == 2);
+  EXPECT(pcb->undo_flags == (TCP_UNDO_PENDING | TCP_FRTO_STEP3));
+  EXPECT(pcb->unsent == NULL);
+  EXPECT(pcb->snd_nxt == una + 7 * TCP_MSS);
+  EXPECT_RET(pcb->unacked != NULL);
+  EXPECT(lwip_ntohl(pcb->unacked->tcphdr->seqno) == una + TCP_MSS);
+  EXPECT(pcb->flags & TF_RTO);
+  memset(&txcounters, 0, sizeof(txcounters));
+
+  /* the second ACK covers a segment that was only sent once */
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, TCP_MSS, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->undo_flags == 0);
+  EXPECT(!(pcb->flags & TF_RTO));
+  EXPECT(pcb->ssthresh == 10 * TCP_MSS);
+  /* back to 5 MSS, slow start adds one */
+  EXPECT(pcb->cwnd == 6 * TCP_MSS);
+  EXPECT(txcounters.num_tx_calls == 0);
+  EXPECT(pcb->unsent == NULL);
+
+  EXPECT(counters.err_calls == 0);
+  tcp_abort(pcb);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+#else /* LWIP_TCP_UNDO */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_UNDO */
+}
+END_TEST
+
+/** Lose a flight and check that F-RTO goes back to retransmitting in slow
+ * start when the ACK after the new data is a duplicate */
+START_TEST(test_tcp_frto_lost)
+{
+#if LWIP_TCP_UNDO
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+  u32_t una;
+  LWIP_UNUSED_ARG(_i);
+
+  pcb = test_tcp_undo_rto(&netif, &txcounters, &counters);
+  EXPECT_RET(pcb != NULL);
+  una = pcb->lastack;
+
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, TCP_MSS, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(txcounters.num_tx_calls == 2);
+  EXPECT(pcb->cwnd == 2 * TCP_MSS);
+  memset(&txcounters, 0, sizeof(txcounters));
+
+  /* a new segment arrived, the rest of the flight did not */
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, 0, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->undo_flags == TCP_UNDO_PENDING);
+  EXPECT(pcb->flags & TF_RTO);
+  EXPECT(pcb->ssthresh < 10 * TCP_MSS);
+  EXPECT(pcb->cwnd == 2 * TCP_MSS);
+  /* retransmitted from the first unacked segment on */
+  EXPECT(txcounters.num_tx_calls == 2);
+  EXPECT_RET(pcb->unacked != NULL);
+  EXPECT(lwip_ntohl(pcb->unacked->tcphdr->seqno) == una + TCP_MSS);
+  EXPECT_RET(pcb->unsent != NULL);
+  EXPECT(lwip_ntohl(pcb->unsent->tcphdr->seqno) == una + 3 * TCP_MSS);
+
+  EXPECT(counters.err_calls == 0);
+  tcp_abort(pcb);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+#else /* LWIP_TCP_UNDO */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_UNDO */
+}
+END_TEST
+
+/** Check that an ACK echoing the timestamp of the original transmission
+ * undoes a timeout at once (Eifel) */
+START_TEST(test_tcp_undo_eifel)
+{
+#if LWIP_TCP_UNDO && LWIP_TCP_TIMESTAMPS
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+  char data[TCP_MSS - 12];
+  u8_t opts[12];
+  u32_t val;
+  err_t err;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  memset(data, 0x55, sizeof(data));
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  memset(&counters, 0, sizeof(counters));
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  tcp_set_flags(pcb, TF_NODELAY | TF_TIMESTAMP);
+  pcb->mss = TCP_MSS;
+  pcb->cong_ops = &tcp_ca_reno;
+  pcb->cwnd = 4 * TCP_MSS;
+  pcb->ssthresh = 10 * TCP_MSS;
+
+  lwip_sys_now = 1000;
+  for (i = 0; i < 4; i++) {
+    err = tcp_write(pcb, data, sizeof(data), TCP_WRITE_FLAG_COPY);
+    EXPECT_RET(err == ERR_OK);
+  }
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT_RET(txcounters.num_tx_calls == 4);
+
+  lwip_sys_now = 3000;
+  while (!(pcb->flags & TF_RTO)) {
+    test_tcp_tmr();
+  }
+  EXPECT(pcb->cwnd == TCP_MSS);
+  EXPECT(pcb->retrans_stamp == 3000);
+  EXPECT(pcb->undo_flags & TCP_UNDO_EIFEL);
+  memset(&txcounters, 0, sizeof(txcounters));
+
+  /* the ACK of the first segment echoes the time it was first sent */
+  opts[0] = LWIP_TCP_OPT_NOP;
+  opts[1] = LWIP_TCP_OPT_NOP;
+  opts[2] = LWIP_TCP_OPT_TS;
+  opts[3] = LWIP_TCP_OPT_LEN_TS;
+  val = lwip_htonl(500);
+  memcpy(&opts[4], &val, sizeof(val));
+  val = lwip_htonl(1000);
+  memcpy(&opts[8], &val, sizeof(val));
+  p = tcp_create_segment_opts(&pcb->remote_ip, &pcb->local_ip, pcb->remote_port, pcb->local_port,
+                              NULL, 0, pcb->rcv_nxt, pcb->lastack + sizeof(data), TCP_ACK, TCP_WND,
+                              opts, sizeof(opts));
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->undo_flags == 0);
+  EXPECT(!(pcb->flags & TF_RTO));
+  EXPECT(pcb->ssthresh == 10 * TCP_MSS);
+  /* back to 4 MSS, slow start adds the segment ACKed */
+  EXPECT(pcb->cwnd == 4 * TCP_MSS + sizeof(data));
+  /* the rest of the flight is still in flight, not retransmitted */
+  EXPECT(txcounters.num_tx_calls == 0);
+  EXPECT(pcb->unsent == NULL);
+  EXPECT(pcb->unacked != NULL);
+
+  EXPECT(counters.err_calls == 0);
+  tcp_abort(pcb);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+#else /* LWIP_TCP_UNDO && LWIP_TCP_TIMESTAMPS */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_UNDO && LWIP_TCP_TIMESTAMPS */
+}
+END_TEST
+
+/** Reorder the first segment of a flight so that it is fast retransmitted,
+ * and check that the D-SACK for the retransmission undoes the reduction */
+START_TEST(test_tcp_undo_dsack)
+{
+#if LWIP_TCP_UNDO && LWIP_TCP_SACK_IN
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+  char data[TCP_MSS];
+  u32_t una, sacks[2];
+  err_t err;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  memset(data, 0x55, sizeof(data));
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  memset(&counters, 0, sizeof(counters));
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  tcp_set_flags(pcb, TF_SACK | TF_NODELAY);
+  pcb->mss = TCP_MSS;
+  pcb->cong_ops = &tcp_ca_reno;
+  pcb->cwnd = 10 * TCP_MSS;
+  pcb->ssthresh = 20 * TCP_MSS;
+#if LWIP_TCP_RACK
+  /* let RACK wait a reordering window so that the SACK rules decide */
+  pcb->rack_flags |= RACK_REORDER_SEEN;
+#endif /* LWIP_TCP_RACK */
+  una = pcb->lastack;
+
+  for (i = 0; i < 6; i++) {
+    err = tcp_write(pcb, data, sizeof(data), TCP_WRITE_FLAG_COPY);
+    EXPECT_RET(err == ERR_OK);
+  }
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT_RET(txcounters.num_tx_calls == 6);
+  memset(&txcounters, 0, sizeof(txcounters));
+  lwip_sys_now += 100;
+
+  /* segments 1 to 3 overtake segment 0: fast retransmit */
+  sacks[0] = una + TCP_MSS;
+  for (i = 2; i <= 4; i++) {
+    sacks[1] = una + (u32_t)i * TCP_MSS;
+    p = tcp_create_rx_segment_sack(pcb, 0, sacks, 1);
+    EXPECT_RET(p != NULL);
+    test_tcp_input(p, &netif);
+  }
+  EXPECT(pcb->flags & TF_INFR);
+  EXPECT(pcb->ssthresh == 5 * TCP_MSS);
+  EXPECT(txcounters.num_tx_calls == 1);
+  EXPECT(pcb->undo_retrans == TCP_MSS);
+
+  /* segment 0 arrives late, the whole flight is ACKed */
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, 6 * TCP_MSS, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(!(pcb->flags & TF_INFR));
+  EXPECT(pcb->cwnd < 10 * TCP_MSS);
+  EXPECT(pcb->undo_flags == TCP_UNDO_PENDING);
+
+  /* then its retransmission, which is reported as duplicate */
+  sacks[0] = una;
+  sacks[1] = una + TCP_MSS;
+  p = tcp_create_rx_segment_sack(pcb, 0, sacks, 1);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->undo_flags == 0);
+  EXPECT(pcb->cwnd == 10 * TCP_MSS);
+  EXPECT(pcb->ssthresh == 20 * TCP_MSS);
+
+  EXPECT(counters.err_calls == 0);
+  tcp_abort(pcb);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+#else /* LWIP_TCP_UNDO && LWIP_TCP_SACK_IN */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_UNDO && LWIP_TCP_SACK_IN */
+}
+END_TEST
+
+/** Check that input only moves a pcb on the timer wheel if it makes a timer
+ * due earlier, and that polling without a callback or work arms nothing */
+START_TEST(test_tcp_timer_wheel_lazy)
+{
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct pbuf *p;
+  char data[] = {1, 2, 3, 4};
+  u32_t due;
+  err_t err;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  memset(&counters, 0, sizeof(counters));
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  pcb->rto = 3;
+  pcb->cwnd = pcb->snd_wnd;
+  tcp_poll(pcb, NULL, 1);
+  tcp_slowtmr();
+#if LWIP_TCP_TIMER_WHEEL
+  /* nothing to do but look at options once per revolution */
+  EXPECT(pcb->wheel_due == tcp_ticks + TCP_TIMER_WHEEL_SIZE);
+#endif /* LWIP_TCP_TIMER_WHEEL */
+  due = tcp_ticks + TCP_TIMER_WHEEL_SIZE;
+
+  /* in-sequence data leaves the pcb where it is */
+  for (i = 0; i < 4; i++) {
+    p = tcp_create_rx_segment(pcb, data, sizeof(data), 0, 0, TCP_ACK);
+    EXPECT_RET(p != NULL);
+    test_tcp_input(p, &netif);
+#if LWIP_TCP_TIMER_WHEEL
+    EXPECT(pcb->wheel_due == due);
+#endif /* LWIP_TCP_TIMER_WHEEL */
+  }
+  EXPECT(counters.recved_bytes == 4 * sizeof(data));
+
+  /* sending starts the retransmission timer, which pulls the pcb in */
+  err = tcp_write(pcb, data, sizeof(data), TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+#if LWIP_TCP_TIMER_WHEEL
+  EXPECT(pcb->wheel_due == tcp_ticks + 3);
+#endif /* LWIP_TCP_TIMER_WHEEL */
+  due = tcp_ticks + 3;
+
+  /* the ACK stops it again; the pcb is recomputed when its slot comes up */
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, sizeof(data), TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->unacked == NULL);
+#if LWIP_TCP_TIMER_WHEEL
+  EXPECT(pcb->wheel_due == due);
+#endif /* LWIP_TCP_TIMER_WHEEL */
+  memset(&txcounters, 0, sizeof(txcounters));
+  for (i = 0; i < 3; i++) {
+    tcp_slowtmr();
+  }
+  EXPECT(txcounters.num_tx_calls == 0);
+  EXPECT(pcb->nrtx == 0);
+#if LWIP_TCP_TIMER_WHEEL
+  EXPECT(pcb->wheel_due == tcp_ticks + TCP_TIMER_WHEEL_SIZE);
+#else
+  LWIP_UNUSED_ARG(due);
+#endif /* LWIP_TCP_TIMER_WHEEL */
+  EXPECT(counters.err_calls == 0);
+
+  tcp_abort(pcb);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+}
+END_TEST
+
+/** Check that turning on keepalive for an idle pcb sends the first probe on
+ * time, not when the timer wheel next gets to the pcb */
+START_TEST(test_tcp_timer_wheel_keepalive)
+{
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  memset(&counters, 0, sizeof(counters));
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  /* idle, so it is filed a whole revolution ahead */
+  tcp_slowtmr();
+  pcb->tmr = tcp_ticks;
+
+  ip_set_option(pcb, SOF_KEEPALIVE);
+  pcb->keep_idle = 2 * TCP_SLOW_INTERVAL;
+  tcp_keepalive_changed(pcb);
+  memset(&txcounters, 0, sizeof(txcounters));
+  /* the probe goes out once idle for more than 2 ticks */
+  for (i = 1; i <= 3; i++) {
+    tcp_slowtmr();
+    EXPECT(txcounters.num_tx_calls == (u16_t)(i < 3 ? 0 : 1));
+  }
+  EXPECT(pcb->keep_cnt_sent == 1);
+  EXPECT(counters.err_calls == 0);
+
+  tcp_abort(pcb);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+}
+END_TEST
+
+/** Let several listeners share a port with SO_REUSEPORT and check that
+ * incoming connections are spread over all of them, deterministically per flow */
+START_TEST(test_tcp_listen_reuseport)
+{
+#if LWIP_SO_REUSEPORT
+  struct tcp_pcb *pcb, *other;
+  struct tcp_pcb_listen *lpcbs[3];
+  u32_t hits[3];
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct pbuf *p;
+  ip_addr_t src_addr;
+  u16_t port;
+  err_t err;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  ip_addr_copy(src_addr, test_remote_ip);
+
+  for (i = 0; i < 3; i++) {
+    pcb = tcp_new();
+    EXPECT_RET(pcb != NULL);
+    ip_set_option(pcb, SOF_REUSEPORT);
+    err = tcp_bind(pcb, &netif.ip_addr, 1234);
+    EXPECT(err == ERR_OK);
+    lpcbs[i] = (struct tcp_pcb_listen *)tcp_listen(pcb);
+    EXPECT_RET(lpcbs[i] != NULL);
+    hits[i] = 0;
+  }
+
+  /* a pcb without SO_REUSEPORT must not join the group */
+  other = tcp_new();
+  EXPECT_RET(other != NULL);
+  err = tcp_bind(other, &netif.ip_addr, 1234);
+  EXPECT(err == ERR_USE);
+  tcp_abort(other);
+
+  for (port = 40000; port < 40064; port++) {
+    struct tcp_pcb_listen *lpcb = tcp_listen_hash_lookup(&test_local_ip, 1234, &src_addr, port,
+                                                         netif_get_index(&netif));
+    EXPECT_RET(lpcb != NULL);
+    /* same flow, same listener */
+    EXPECT(lpcb == tcp_listen_hash_lookup(&test_local_ip, 1234, &src_addr, port,
+                                          netif_get_index(&netif)));
+    for (i = 0; i < 3; i++) {
+      if (lpcb == lpcbs[i]) {
+        hits[i]++;
+      }
+    }
+  }
+  EXPECT(hits[0] + hits[1] + hits[2] == 64);
+  EXPECT(hits[0] > 0);
+  EXPECT(hits[1] > 0);
+  EXPECT(hits[2] > 0);
+
+  /* a SYN creates a connection on the selected listener */
+  p = tcp_create_segment(&src_addr, &netif.ip_addr, 40000, 1234, NULL, 0, 12345, 0, TCP_SYN);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(txcounters.num_tx_calls == 1);
+#if LWIP_TCP_REQ_TABLE
+  {
+    struct tcp_pcb_listen *lpcb = tcp_listen_hash_lookup(&test_local_ip, 1234, &src_addr, 40000,
+                                                         netif_get_index(&netif));
+    EXPECT_RET(lpcb != NULL);
+    EXPECT(tcp_active_pcbs == NULL);
+    EXPECT(tcp_req_lookup(lpcb, &test_local_ip, &src_addr, 40000) != NULL);
+  }
+#else /* LWIP_TCP_REQ_TABLE */
+  EXPECT_RET(tcp_active_pcbs != NULL);
+  EXPECT(tcp_active_pcbs->state == SYN_RCVD);
+#if LWIP_CALLBACK_API || TCP_LISTEN_BACKLOG
+  EXPECT(tcp_active_pcbs->listener == tcp_listen_hash_lookup(&test_local_ip, 1234, &src_addr, 40000,
+                                                             netif_get_index(&netif)));
+#endif /* LWIP_CALLBACK_API || TCP_LISTEN_BACKLOG */
+#endif /* LWIP_TCP_REQ_TABLE */
+
+  /* closing a listener shrinks the group */
+  tcp_close((struct tcp_pcb *)lpcbs[1]);
+  for (port = 40000; port < 40064; port++) {
+    struct tcp_pcb_listen *lpcb = tcp_listen_hash_lookup(&test_local_ip, 1234, &src_addr, port,
+                                                         netif_get_index(&netif));
+    EXPECT(lpcb != NULL);
+    EXPECT(lpcb != lpcbs[1]);
+  }
+  tcp_close((struct tcp_pcb *)lpcbs[0]);
+  tcp_close((struct tcp_pcb *)lpcbs[2]);
+  EXPECT(tcp_listen_hash_lookup(&test_local_ip, 1234, &src_addr, 40000,
+                                netif_get_index(&netif)) == NULL);
+#else /* LWIP_SO_REUSEPORT */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_SO_REUSEPORT */
+}
+END_TEST
+
+#if LWIP_TCP_SYNCOOKIES && TCP_LISTEN_BACKLOG
+static u32_t test_tcp_syncookie_accepts;
+
+/** Count the connections in SYN_RCVD */
+static u32_t
+test_tcp_syncookie_half_open(void)
+{
+#if LWIP_TCP_REQ_TABLE
+  /* held by requests, not pcbs */
+  return MEMP_STATS_GET(used, MEMP_TCP_REQ);
+#else /* LWIP_TCP_REQ_TABLE */
+  struct tcp_pcb *pcb;
+  u32_t n = 0;
+
+  for (pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
+    if (pcb->state == SYN_RCVD) {
+      n++;
+    }
+  }
+  return n;
+#endif /* LWIP_TCP_REQ_TABLE */
+}
+
+static err_t
+test_tcp_syncookie_accept(void *arg, struct tcp_pcb *newpcb, err_t err)
+{
+  LWIP_UNUSED_ARG(arg);
+  EXPECT(err == ERR_OK);
+  EXPECT(newpcb != NULL);
+  test_tcp_syncookie_accepts++;
+  return ERR_OK;
+}
+
+/** Return the TCP header of the only packet sent since the last call */
+static void
+test_tcp_syncookie_tx(struct test_tcp_txcounters *txcounters, struct tcp_hdr *tcphdr)
+{
+  memset(tcphdr, 0, sizeof(*tcphdr));
+  EXPECT_RET(txcounters->num_tx_calls == 1);
+  EXPECT_RET(txcounters->tx_packets != NULL);
+  pbuf_copy_partial(txcounters->tx_packets, tcphdr, sizeof(*tcphdr), IP_HLEN);
+  pbuf_free(txcounters->tx_packets);
+  txcounters->tx_packets = NULL;
+  txcounters->num_tx_calls = 0;
+}
+#endif /* LWIP_TCP_SYNCOOKIES && TCP_LISTEN_BACKLOG */
+
+/** Answer a SYN with a cookie when the listen backlog is full and set up
+ * the connection from the ACK that returns it */
+START_TEST(test_tcp_listen_syncookies)
+{
+#if LWIP_TCP_SYNCOOKIES && TCP_LISTEN_BACKLOG
+  struct tcp_pcb *pcb;
+  struct tcp_pcb_listen *lpcb;
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct tcp_hdr tcphdr;
+  struct pbuf *p;
+  ip_addr_t src_addr;
+  u32_t cookie, old_cookie;
+  err_t err;
+  LWIP_UNUSED_ARG(_i);
+
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  ip_addr_copy(src_addr, test_remote_ip);
+  test_tcp_syncookie_accepts = 0;
+  pcb = tcp_new();
+  EXPECT_RET(pcb != NULL);
+  err = tcp_bind(pcb, &netif.ip_addr, 1234);
+  EXPECT_RET(err == ERR_OK);
+  lpcb = (struct tcp_pcb_listen *)tcp_listen_with_backlog(pcb, 1);
+  EXPECT_RET(lpcb != NULL);
+  tcp_accept((struct tcp_pcb *)lpcb, test_tcp_syncookie_accept);
+  txcounters.copy_tx_packets = 1;
+
+  /* the first SYN takes the backlog */
+  p = tcp_create_segment(&src_addr, &netif.ip_addr, 40000, 1234, NULL, 0, 1000, 0, TCP_SYN);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+#if LWIP_TCP_REQ_TABLE
+  EXPECT(tcp_active_pcbs == NULL);
+  EXPECT(tcp_req_lookup(lpcb, &netif.ip_addr, &src_addr, 40000) != NULL);
+#else /* LWIP_TCP_REQ_TABLE */
+  EXPECT_RET(tcp_active_pcbs != NULL);
+  EXPECT(tcp_active_pcbs->state == SYN_RCVD);
+#endif /* LWIP_TCP_REQ_TABLE */
+  EXPECT(lpcb->accepts_pending == 1);
+  test_tcp_syncookie_tx(&txcounters, &tcphdr);
+  EXPECT(test_tcp_syncookie_half_open() == 1);
+
+  /* the second one is answered with a cookie and allocates nothing */
+  p = tcp_create_segment(&src_addr, &netif.ip_addr, 40001, 1234, NULL, 0, 2000, 0, TCP_SYN);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(test_tcp_syncookie_half_open() == 1);
+  EXPECT(lpcb->accepts_pending == 1);
+  test_tcp_syncookie_tx(&txcounters, &tcphdr);
+  EXPECT(TCPH_FLAGS(&tcphdr) == (TCP_SYN | TCP_ACK));
+  EXPECT(lwip_ntohs(tcphdr.src) == 1234);
+  EXPECT(lwip_ntohs(tcphdr.dest) == 40001);
+  EXPECT(lwip_ntohl(tcphdr.ackno) == 2001);
+  /* only the MSS option */
+  EXPECT(TCPH_HDRLEN_BYTES(&tcphdr) == TCP_HLEN + LWIP_TCP_OPT_LEN_MSS);
+  cookie = lwip_ntohl(tcphdr.seqno);
+
+  /* an ACK with a wrong cookie is reset */
+  p = tcp_create_segment(&src_addr, &netif.ip_addr, 40001, 1234, NULL, 0, 2001, cookie + 2, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(test_tcp_syncookie_half_open() == 1);
+  test_tcp_syncookie_tx(&txcounters, &tcphdr);
+  EXPECT(TCPH_FLAGS(&tcphdr) & TCP_RST);
+
+  /* so is one from another port */
+  p = tcp_create_segment(&src_addr, &netif.ip_addr, 40002, 1234, NULL, 0, 2001, cookie + 1, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(test_tcp_syncookie_half_open() == 1);
+  test_tcp_syncookie_tx(&txcounters, &tcphdr);
+  EXPECT(TCPH_FLAGS(&tcphdr) & TCP_RST);
+
+  /* another cookie, to let it expire */
+  p = tcp_create_segment(&src_addr, &netif.ip_addr, 40004, 1234, NULL, 0, 5000, 0, TCP_SYN);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  test_tcp_syncookie_tx(&txcounters, &tcphdr);
+  old_cookie = lwip_ntohl(tcphdr.seqno);
+
+  /* the right ACK establishes the connection in place of the half-open one,
+     also after the key was replaced */
+  lwip_sys_now += 0x10000;
+  p = tcp_create_segment(&src_addr, &netif.ip_addr, 40001, 1234, NULL, 0, 2001, cookie + 1, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(test_tcp_syncookie_half_open() == 0);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 1);
+  EXPECT_RET(tcp_active_pcbs != NULL);
+  EXPECT(tcp_active_pcbs->next == NULL);
+  EXPECT(tcp_active_pcbs->state == ESTABLISHED);
+  EXPECT(tcp_active_pcbs->remote_port == 40001);
+  EXPECT(tcp_active_pcbs->rcv_nxt == 2001);
+  EXPECT(tcp_active_pcbs->snd_nxt == cookie + 1);
+  EXPECT(tcp_active_pcbs->lastack == cookie + 1);
+  EXPECT(tcp_active_pcbs->mss == 536);
+  EXPECT(test_tcp_syncookie_accepts == 1);
+  EXPECT(lpcb->accepts_pending == 0);
+
+  /* a cookie whose key was dropped is reset */
+  lwip_sys_now += 3 * 0x10000;
+  p = tcp_create_segment(&src_addr, &netif.ip_addr, 40004, 1234, NULL, 0, 5001, old_cookie + 1, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 1);
+  test_tcp_syncookie_tx(&txcounters, &tcphdr);
+  EXPECT(TCPH_FLAGS(&tcphdr) & TCP_RST);
+
+#if LWIP_TCP_TIMESTAMPS
+  {
+    /* window scale and SACK survive in the timestamp */
+    u8_t synopts[] = {
+      LWIP_TCP_OPT_MSS, LWIP_TCP_OPT_LEN_MSS, 0x05, 0xb4,
+      LWIP_TCP_OPT_NOP, LWIP_TCP_OPT_WS, 3, 7,
+      LWIP_TCP_OPT_NOP, LWIP_TCP_OPT_NOP, LWIP_TCP_OPT_SACK_PERM, 2,
+      LWIP_TCP_OPT_NOP, LWIP_TCP_OPT_NOP, LWIP_TCP_OPT_TS, LWIP_TCP_OPT_LEN_TS,
+      0, 0, 0, 100, 0, 0, 0, 0
+    };
+    u8_t ackopts[] = {
+      LWIP_TCP_OPT_NOP, LWIP_TCP_OPT_NOP, LWIP_TCP_OPT_TS, LWIP_TCP_OPT_LEN_TS,
+      0, 0, 0, 101, 0, 0, 0, 0
+    };
+    struct tcp_pcb *cpcb;
+
+    /* fill the backlog again */
+    p = tcp_create_segment(&src_addr, &netif.ip_addr, 40002, 1234, NULL, 0, 3000, 0, TCP_SYN);
+    EXPECT_RET(p != NULL);
+    test_tcp_input(p, &netif);
+    test_tcp_syncookie_tx(&txcounters, &tcphdr);
+    EXPECT(lpcb->accepts_pending == 1);
+
+    p = tcp_create_segment_opts(&src_addr, &netif.ip_addr, 40003, 1234, NULL, 0, 4000, 0, TCP_SYN,
+                                TCP_WND, synopts, sizeof(synopts));
+    EXPECT_RET(p != NULL);
+    test_tcp_input(p, &netif);
+    EXPECT(test_tcp_syncookie_half_open() == 1);
+    EXPECT_RET(txcounters.tx_packets != NULL);
+    /* MSS, timestamps, window scale, SACK permitted */
+    EXPECT(pbuf_copy_partial(txcounters.tx_packets, &ackopts[8], 4, IP_HLEN + TCP_HLEN + 8) == 4);
+    test_tcp_syncookie_tx(&txcounters, &tcphdr);
+    EXPECT(TCPH_HDRLEN_BYTES(&tcphdr) == TCP_HLEN + LWIP_TCP_OPT_LEN_MSS + LWIP_TCP_OPT_LEN_TS_OUT +
+                                         LWIP_TCP_OPT_LEN_WS_OUT + LWIP_TCP_OPT_LEN_SACK_PERM_OUT);
+    cookie = lwip_ntohl(tcphdr.seqno);
+
+    p = tcp_create_segment_opts(&src_addr, &netif.ip_addr, 40003, 1234, NULL, 0, 4001, cookie + 1, TCP_ACK,
+                                TCP_WND >> 7, ackopts, sizeof(ackopts));
+    EXPECT_RET(p != NULL);
+    test_tcp_input(p, &netif);
+    EXPECT(test_tcp_syncookie_half_open() == 0);
+    EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 2);
+    EXPECT(test_tcp_syncookie_accepts == 2);
+    cpcb = tcp_active_pcbs;
+    EXPECT_RET(cpcb != NULL);
+    EXPECT(cpcb->remote_port == 40003);
+    EXPECT(cpcb->state == ESTABLISHED);
+    EXPECT(cpcb->flags & TF_TIMESTAMP);
+    EXPECT(cpcb->ts_recent == 101);
+#if LWIP_WND_SCALE
+    EXPECT(cpcb->flags & TF_WND_SCALE);
+    EXPECT(cpcb->snd_scale == 7);
+    EXPECT(cpcb->snd_wnd == ((TCP_WND >> 7) << 7));
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK_OUT
+    EXPECT(cpcb->flags & TF_SACK);
+#endif /* LWIP_TCP_SACK_OUT */
+    tcp_abort(cpcb);
+  }
+#endif /* LWIP_TCP_TIMESTAMPS */
+
+  txcounters.copy_tx_packets = 0;
+  if (txcounters.tx_packets != NULL) {
+    pbuf_free(txcounters.tx_packets);
+    txcounters.tx_packets = NULL;
+  }
+  tcp_abort(tcp_active_pcbs);
+  tcp_close((struct tcp_pcb *)lpcb);
+#else /* LWIP_TCP_SYNCOOKIES && TCP_LISTEN_BACKLOG */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_SYNCOOKIES && TCP_LISTEN_BACKLOG */
+}
+END_TEST
+
+#if LWIP_TCP_REQ_TABLE
+static struct tcp_pcb *test_tcp_req_accepted;
+
+static err_t
+test_tcp_req_accept(void *arg, struct tcp_pcb *newpcb, err_t err)
+{
+  LWIP_UNUSED_ARG(arg);
+  EXPECT(err == ERR_OK);
+  test_tcp_req_accepted = newpcb;
+  return ERR_OK;
+}
+
+/** Return the TCP header of the last packet sent and free the copies */
+static void
+test_tcp_req_tx(struct test_tcp_txcounters *txcounters, struct tcp_hdr *tcphdr)
+{
+  struct pbuf *q;
+
+  memset(tcphdr, 0, sizeof(*tcphdr));
+  EXPECT_RET(txcounters->tx_packets != NULL);
+  for (q = txcounters->tx_packets; q->next != NULL; q = q->next);
+  pbuf_copy_partial(q, tcphdr, sizeof(*tcphdr), IP_HLEN);
+  pbuf_free(txcounters->tx_packets);
+  txcounters->tx_packets = NULL;
+  txcounters->num_tx_calls = 0;
+}
+#endif /* LWIP_TCP_REQ_TABLE */
+
+/** Connections in SYN_RCVD are kept in the request table, not in pcbs */
+START_TEST(test_tcp_listen_req_table)
+{
+#if LWIP_TCP_REQ_TABLE
+  struct tcp_pcb *pcb;
+  struct tcp_pcb_listen *lpcb;
+  struct tcp_pcb *pcbs[MEMP_NUM_TCP_PCB];
+  struct tcp_req *req;
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct tcp_hdr tcphdr;
+  struct pbuf *p;
+  ip_addr_t src_addr;
+  u32_t iss;
+  err_t err;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  ip_addr_copy(src_addr, test_remote_ip);
+  test_tcp_req_accepted = NULL;
+
+  pcb = tcp_new();
+  EXPECT_RET(pcb != NULL);
+  err = tcp_bind(pcb, &netif.ip_addr, 1234);
+  EXPECT_RET(err == ERR_OK);
+  lpcb = (struct tcp_pcb_listen *)tcp_listen(pcb);
+  EXPECT_RET(lpcb != NULL);
+  tcp_accept((struct tcp_pcb *)lpcb, test_tcp_req_accept);
+  txcounters.copy_tx_packets = 1;
+
+  /* a SYN is answered and allocates a request, not a pcb */
+  p = tcp_create_segment(&src_addr, &netif.ip_addr, 40000, 1234, NULL, 0, 1000, 0, TCP_SYN);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_REQ) == 1);
+  EXPECT(txcounters.num_tx_calls == 1);
+  test_tcp_req_tx(&txcounters, &tcphdr);
+  EXPECT(TCPH_FLAGS(&tcphdr) == (TCP_SYN | TCP_ACK));
+  EXPECT(lwip_ntohl(tcphdr.ackno) == 1001);
+  iss = lwip_ntohl(tcphdr.seqno);
+  req = tcp_req_lookup(lpcb, &netif.ip_addr, &src_addr, 40000);
+  EXPECT_RET(req != NULL);
+  EXPECT(req->hs.iss == iss);
+#if TCP_LISTEN_BACKLOG
+  EXPECT(lpcb->accepts_pending == 1);
+#endif /* TCP_LISTEN_BACKLOG */
+
+  /* a copy of the SYN gets the same SYN|ACK */
+  p = tcp_create_segment(&src_addr, &netif.ip_addr, 40000, 1234, NULL, 0, 1000, 0, TCP_SYN);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_REQ) == 1);
+  EXPECT(txcounters.num_tx_calls == 1);
+  test_tcp_req_tx(&txcounters, &tcphdr);
+  EXPECT(TCPH_FLAGS(&tcphdr) == (TCP_SYN | TCP_ACK));
+  EXPECT(lwip_ntohl(tcphdr.seqno) == iss);
+
+  /* an ACK of something else is reset and the request stays */
+  p = tcp_create_segment(&src_addr, &netif.ip_addr, 40000, 1234, NULL, 0, 1001, iss + 2, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_REQ) == 1);
+  EXPECT(txcounters.num_tx_calls == 1);
+  test_tcp_req_tx(&txcounters, &tcphdr);
+  EXPECT(TCPH_FLAGS(&tcphdr) & TCP_RST);
+
+  /* the SYN|ACK is retransmitted after the initial RTO */
+  for (i = 0; i < LWIP_TCP_RTO_TIME / TCP_SLOW_INTERVAL; i++) {
+    EXPECT(txcounters.num_tx_calls == 0);
+    tcp_slowtmr();
+  }
+  EXPECT(txcounters.num_tx_calls == 1);
+  EXPECT(req->nrtx == 1);
+  test_tcp_req_tx(&txcounters, &tcphdr);
+  EXPECT(TCPH_FLAGS(&tcphdr) == (TCP_SYN | TCP_ACK));
+  EXPECT(lwip_ntohl(tcphdr.seqno) == iss);
+
+  /* without a free pcb, the final ACK is dropped and the request stays */
+  for (i = 0; i < MEMP_NUM_TCP_PCB; i++) {
+    pcbs[i] = tcp_new();
+    EXPECT_RET(pcbs[i] != NULL);
+  }
+  p = tcp_create_segment(&src_addr, &netif.ip_addr, 40000, 1234, NULL, 0, 1001, iss + 1, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_REQ) == 1);
+  EXPECT(tcp_req_lookup(lpcb, &netif.ip_addr, &src_addr, 40000) == req);
+  EXPECT(test_tcp_req_accepted == NULL);
+  EXPECT(txcounters.num_tx_calls == 0);
+#if TCP_LISTEN_BACKLOG
+  EXPECT(lpcb->accepts_pending == 1);
+#endif /* TCP_LISTEN_BACKLOG */
+  for (i = 0; i < MEMP_NUM_TCP_PCB; i++) {
+    tcp_abort(pcbs[i]);
+  }
+
+  /* the next final ACK promotes the request to an established pcb */
+  p = tcp_create_segment(&src_addr, &netif.ip_addr, 40000, 1234, NULL, 0, 1001, iss + 1, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_REQ) == 0);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 1);
+  EXPECT_RET(test_tcp_req_accepted != NULL);
+  EXPECT(test_tcp_req_accepted == tcp_active_pcbs);
+  EXPECT(test_tcp_req_accepted->state == ESTABLISHED);
+  EXPECT(test_tcp_req_accepted->rcv_nxt == 1001);
+  EXPECT(test_tcp_req_accepted->snd_nxt == iss + 1);
+  EXPECT(test_tcp_req_accepted->lastack == iss + 1);
+#if TCP_LISTEN_BACKLOG
+  EXPECT(lpcb->accepts_pending == 0);
+#endif /* TCP_LISTEN_BACKLOG */
+  tcp_abort(test_tcp_req_accepted);
+  if (txcounters.tx_packets != NULL) {
+    pbuf_free(txcounters.tx_packets);
+    txcounters.tx_packets = NULL;
+  }
+  txcounters.num_tx_calls = 0;
+
+  /* a RST with the right sequence number drops a request */
+  p = tcp_create_segment(&src_addr, &netif.ip_addr, 40001, 1234, NULL, 0, 2000, 0, TCP_SYN);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  test_tcp_req_tx(&txcounters, &tcphdr);
+  p = tcp_create_segment(&src_addr, &netif.ip_addr, 40001, 1234, NULL, 0, 2002, 0, TCP_RST);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_REQ) == 1);
+  p = tcp_create_segment(&src_addr, &netif.ip_addr, 40001, 1234, NULL, 0, 2001, 0, TCP_RST);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_REQ) == 0);
+  EXPECT(txcounters.num_tx_calls == 0);
+
+  /* a request that is never acknowledged times out */
+  p = tcp_create_segment(&src_addr, &netif.ip_addr, 40002, 1234, NULL, 0, 3000, 0, TCP_SYN);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  test_tcp_req_tx(&txcounters, &tcphdr);
+  for (i = 0; i <= TCP_SYN_RCVD_TIMEOUT / TCP_SLOW_INTERVAL; i++) {
+    EXPECT(MEMP_STATS_GET(used, MEMP_TCP_REQ) == 1);
+    tcp_slowtmr();
+  }
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_REQ) == 0);
+  EXPECT(txcounters.num_tx_calls > 1);
+  if (txcounters.tx_packets != NULL) {
+    pbuf_free(txcounters.tx_packets);
+    txcounters.tx_packets = NULL;
+  }
+  txcounters.num_tx_calls = 0;
+
+  /* closing the listener drops its requests */
+  p = tcp_create_segment(&src_addr, &netif.ip_addr, 40003, 1234, NULL, 0, 4000, 0, TCP_SYN);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  test_tcp_req_tx(&txcounters, &tcphdr);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_REQ) == 1);
+  txcounters.copy_tx_packets = 0;
+  tcp_close((struct tcp_pcb *)lpcb);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_REQ) == 0);
+#else /* LWIP_TCP_REQ_TABLE */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_REQ_TABLE */
+}
+END_TEST
+
+#if LWIP_TCP_TSO
+static netif_output_fn test_tcp_tso_next_output;
+static u16_t test_tcp_tso_segsz;
+static u16_t test_tcp_tso_tot_len;
+
+/** Record the super-segment a netif with NETIF_FLAG_TSO gets */
+static err_t
+test_tcp_tso_output(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+  test_tcp_tso_segsz = p->tso_segsz;
+  test_tcp_tso_tot_len = p->tot_len;
+  return test_tcp_tso_next_output(netif, p, ipaddr);
+}
+
+/** Queue ten full segments in one write and send them */
+static struct tcp_pcb *
+test_tcp_tso_send(struct netif *netif, struct test_tcp_counters *counters)
+{
+  struct tcp_pcb *pcb;
+  struct tcp_seg *seg;
+  int n = 0;
+  err_t err;
+
+  memset(tx_data, 0x5a, 10 * TCP_MSS);
+  netif->gso_max_size = 0xffff;
+  memset(counters, 0, sizeof(*counters));
+  pcb = test_tcp_new_counters_pcb(counters);
+  EXPECT_RETNULL(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  tcp_nagle_disable(pcb);
+  pcb->mss = TCP_MSS;
+  pcb->cwnd = pcb->snd_wnd;
+
+  err = tcp_write(pcb, tx_data, 10 * TCP_MSS, TCP_WRITE_FLAG_COPY);
+  EXPECT_RETNULL(err == ERR_OK);
+  err = tcp_output(pcb);
+  EXPECT_RETNULL(err == ERR_OK);
+  EXPECT(pcb->unsent == NULL);
+  for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+    n++;
+  }
+  /* the segments stay separate for retransmission */
+  EXPECT(n == 10);
+  EXPECT(pcb->snd_nxt == pcb->lastack + 10 * TCP_MSS);
+  return pcb;
+}
+
+/** ACK everything sent and check the data pbufs are released */
+static void
+test_tcp_tso_ack(struct netif *netif, struct tcp_pcb *pcb)
+{
+  struct pbuf *p;
+  struct tcp_seg *seg;
+
+  for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+    EXPECT(seg->p->ref == 1);
+  }
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_TSO_PBUF) == 0);
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, pcb->snd_nxt - pcb->lastack, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, netif);
+  EXPECT(pcb->unacked == NULL);
+  tcp_abort(pcb);
+}
+#endif /* LWIP_TCP_TSO */
+
+/** A netif with NETIF_FLAG_TSO gets ten segments as one super-segment */
+START_TEST(test_tcp_tso)
+{
+#if LWIP_TCP_TSO
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  LWIP_UNUSED_ARG(_i);
+
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  netif.flags |= NETIF_FLAG_TSO;
+  test_tcp_tso_next_output = netif.output;
+  netif.output = test_tcp_tso_output;
+  test_tcp_tso_segsz = 0;
+
+  pcb = test_tcp_tso_send(&netif, &counters);
+  EXPECT_RET(pcb != NULL);
+  EXPECT(txcounters.num_tx_calls == 1);
+  EXPECT(test_tcp_tso_segsz == TCP_MSS);
+  EXPECT(test_tcp_tso_tot_len == IP_HLEN + TCP_HLEN + 10 * TCP_MSS);
+
+  /* too short for batching: sent one by one */
+  txcounters.num_tx_calls = 0;
+  netif.gso_max_size = IP_HLEN + TCP_HLEN + TCP_MSS;
+  tcp_write(pcb, tx_data, 2 * TCP_MSS, TCP_WRITE_FLAG_COPY);
+  tcp_output(pcb);
+  EXPECT(txcounters.num_tx_calls == 2);
+  EXPECT(test_tcp_tso_segsz == 0);
+  test_tcp_tso_ack(&netif, pcb);
+#else /* LWIP_TCP_TSO */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_TSO */
+}
+END_TEST
+
+/** Without NETIF_FLAG_TSO, the stack splits the super-segment into frames
+ * with their own sequence numbers and checksums */
+START_TEST(test_tcp_gso)
+{
+#if LWIP_TCP_TSO
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *q;
+  u32_t seqno;
+  int i = 0;
+  LWIP_UNUSED_ARG(_i);
+
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  txcounters.copy_tx_packets = 1;
+
+  pcb = test_tcp_tso_send(&netif, &counters);
+  EXPECT_RET(pcb != NULL);
+  EXPECT_RET(txcounters.num_tx_calls == 10);
+  EXPECT(txcounters.num_tx_bytes == 10 * (IP_HLEN + TCP_HLEN + TCP_MSS));
+
+  /* every copied frame is one pbuf of the chain */
+  seqno = pcb->lastack;
+  for (q = txcounters.tx_packets; q != NULL; q = q->next, i++) {
+    struct ip_hdr *iphdr = (struct ip_hdr *)q->payload;
+    struct tcp_hdr *tcphdr = (struct tcp_hdr *)((u8_t *)q->payload + IP_HLEN);
+    struct pbuf *r;
+
+    EXPECT(q->len == IP_HLEN + TCP_HLEN + TCP_MSS);
+    EXPECT(lwip_ntohs(IPH_LEN(iphdr)) == q->len);
+    EXPECT(inet_chksum(iphdr, IP_HLEN) == 0);
+    EXPECT(lwip_ntohl(tcphdr->seqno) == seqno);
+    EXPECT(((TCPH_FLAGS(tcphdr) & TCP_PSH) != 0) == (i == 9));
+    r = pbuf_alloc_reference(tcphdr, (u16_t)(q->len - IP_HLEN), PBUF_REF);
+    EXPECT_RET(r != NULL);
+    EXPECT(ip_chksum_pseudo(r, IP_PROTO_TCP, r->tot_len, &test_local_ip, &test_remote_ip) == 0);
+    pbuf_free(r);
+    seqno += TCP_MSS;
+  }
+  EXPECT(i == 10);
+  pbuf_free(txcounters.tx_packets);
+  txcounters.tx_packets = NULL;
+  txcounters.copy_tx_packets = 0;
+  test_tcp_tso_ack(&netif, pcb);
+#else /* LWIP_TCP_TSO */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_TSO */
+}
+END_TEST
+
+/** Segments to the netif's own address are looped back, so they are sent
+ * one by one even on a netif with NETIF_FLAG_TSO */
+START_TEST(test_tcp_tso_loopback)
+{
+#if LWIP_TCP_TSO && ENABLE_LOOPBACK
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *q;
+  u32_t seqno;
+  err_t err;
+  int i = 0;
+  LWIP_UNUSED_ARG(_i);
+
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  netif.flags |= NETIF_FLAG_TSO;
+  netif.gso_max_size = 0xffff;
+  memset(tx_data, 0x5a, 10 * TCP_MSS);
+  memset(&counters, 0, sizeof(counters));
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_local_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  tcp_nagle_disable(pcb);
+  pcb->mss = TCP_MSS;
+  pcb->cwnd = pcb->snd_wnd;
+
+  err = tcp_write(pcb, tx_data, 10 * TCP_MSS, TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT(txcounters.num_tx_calls == 0);
+
+  /* every looped back packet is a single pbuf on netif.loop_first */
+  seqno = pcb->lastack;
+  for (q = netif.loop_first; q != NULL; q = q->next, i++) {
+    struct tcp_hdr *tcphdr = (struct tcp_hdr *)((u8_t *)q->payload + IP_HLEN);
+    struct pbuf *r;
+
+    EXPECT_RET(q->len == q->tot_len);
+    EXPECT(q->len == IP_HLEN + TCP_HLEN + TCP_MSS);
+    EXPECT(lwip_ntohl(tcphdr->seqno) == seqno);
+    r = pbuf_alloc_reference(tcphdr, (u16_t)(q->len - IP_HLEN), PBUF_REF);
+    EXPECT_RET(r != NULL);
+    EXPECT(ip_chksum_pseudo(r, IP_PROTO_TCP, r->tot_len, &test_local_ip, &test_local_ip) == 0);
+    pbuf_free(r);
+    seqno += TCP_MSS;
+  }
+  EXPECT(i == 10);
+
+  /* the RST is looped back as well */
+  tcp_abort(pcb);
+  pbuf_free(netif.loop_first);
+  netif.loop_first = NULL;
+  netif.loop_last = NULL;
+#if LWIP_LOOPBACK_MAX_PBUFS
+  netif.loop_cnt_current = 0;
+#endif /* LWIP_LOOPBACK_MAX_PBUFS */
+#if LWIP_NETIF_LOOPBACK_MULTITHREADING && defined TCPIP_THREAD_TEST
+  /* run the netif_poll() that was scheduled, on the empty queue now */
+  while (tcpip_thread_poll_one());
+#endif /* LWIP_NETIF_LOOPBACK_MULTITHREADING && TCPIP_THREAD_TEST */
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_TSO_PBUF) == 0);
+#else /* LWIP_TCP_TSO && ENABLE_LOOPBACK */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_TSO && ENABLE_LOOPBACK */
+}
+END_TEST
+
+#if LWIP_TCP_GRO
+/** Pass a segment from tcp_create_rx_segment() to ip_input() */
+static void
+test_tcp_gro_input(struct pbuf *p, struct netif *netif)
+{
+  struct ip_hdr *iphdr = (struct ip_hdr *)p->payload;
+
+  IPH_PROTO_SET(iphdr, IP_PROTO_TCP);
+  IPH_TTL_SET(iphdr, 64);
+  IPH_CHKSUM_SET(iphdr, 0);
+  IPH_CHKSUM_SET(iphdr, inet_chksum(iphdr, IP_HLEN));
+  ip_input(p, netif);
+}
+#endif /* LWIP_TCP_GRO */
+
+/** Segments of one burst reach TCP as one, in the order they arrived */
+START_TEST(test_tcp_gro)
+{
+#if LWIP_TCP_GRO
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+  char data[TCP_MSS];
+  u32_t rcv_nxt;
+#if IP_STATS
+  STAT_COUNTER ip_recv = lwip_stats.ip.recv;
+#endif /* IP_STATS */
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  memset(data, 0x33, sizeof(data));
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  netif.gro_max_size = 0xffff;
+  memset(&counters, 0, sizeof(counters));
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  rcv_nxt = pcb->rcv_nxt;
+
+  /* a burst of four segments is held back until the flush */
+  for (i = 0; i < 4; i++) {
+    p = tcp_create_rx_segment(pcb, data, TCP_MSS, (u32_t)(i * TCP_MSS), 0, TCP_ACK);
+    EXPECT_RET(p != NULL);
+    test_tcp_gro_input(p, &netif);
+  }
+  EXPECT(counters.recv_calls == 0);
+  EXPECT(pcb->rcv_nxt == rcv_nxt);
+  netif_gro_flush(&netif);
+  EXPECT(counters.recv_calls == 1);
+  EXPECT(counters.recved_bytes == 4 * TCP_MSS);
+  EXPECT(pcb->rcv_nxt == rcv_nxt + 4 * TCP_MSS);
+#if IP_STATS
+  /* the merged segment does not go through IP input again */
+  EXPECT(lwip_stats.ip.recv == (STAT_COUNTER)(ip_recv + 4));
+#endif /* IP_STATS */
+
+  /* a pushed segment ends the run without waiting for the flush */
+  p = tcp_create_rx_segment(pcb, data, TCP_MSS, 0, 0, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_gro_input(p, &netif);
+  p = tcp_create_rx_segment(pcb, data, TCP_MSS / 2, TCP_MSS, 0, TCP_ACK | TCP_PSH);
+  EXPECT_RET(p != NULL);
+  test_tcp_gro_input(p, &netif);
+  EXPECT(counters.recv_calls == 2);
+  EXPECT(counters.recved_bytes == 5 * TCP_MSS + TCP_MSS / 2);
+
+  /* a segment that does not continue the run passes the held one first */
+  rcv_nxt = pcb->rcv_nxt;
+  p = tcp_create_rx_segment(pcb, data, TCP_MSS, 0, 0, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_gro_input(p, &netif);
+  p = tcp_create_rx_segment(pcb, data, TCP_MSS, 2 * TCP_MSS, 0, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_gro_input(p, &netif);
+  EXPECT(counters.recv_calls == 3);
+  EXPECT(pcb->rcv_nxt == rcv_nxt + TCP_MSS);
+  netif_gro_flush(&netif);
+  EXPECT(counters.recv_calls == 3);
+#if TCP_QUEUE_OOSEQ
+  EXPECT(pcb->ooseq != NULL);
+
+  /* filling the hole */
+  p = tcp_create_rx_segment(pcb, data, TCP_MSS, 0, 0, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_gro_input(p, &netif);
+  EXPECT(counters.recv_calls == 3);
+  netif_gro_flush(&netif);
+  EXPECT(counters.recv_calls == 4);
+  EXPECT(pcb->rcv_nxt == rcv_nxt + 3 * TCP_MSS);
+  EXPECT(counters.recved_bytes == 8 * TCP_MSS + TCP_MSS / 2);
+#endif /* TCP_QUEUE_OOSEQ */
+  tcp_abort(pcb);
+#else /* LWIP_TCP_GRO */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_GRO */
+}
+END_TEST
+
+#if LWIP_TCP_ZEROCOPY
+static u32_t test_tcp_zc_id;
+static int test_tcp_zc_calls;
+
+static err_t
+test_tcp_zc_done(void *arg, struct tcp_pcb *pcb, u32_t id)
+{
+  LWIP_UNUSED_ARG(arg);
+  LWIP_UNUSED_ARG(pcb);
+  test_tcp_zc_id = id;
+  test_tcp_zc_calls++;
+  return ERR_OK;
+}
+#endif /* LWIP_TCP_ZEROCOPY */
+
+/** Zero-copy writes reference the data and are reported once ACKed */
+START_TEST(test_tcp_zerocopy)
+{
+#if LWIP_TCP_ZEROCOPY
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+  err_t err;
+  LWIP_UNUSED_ARG(_i);
+
+  memset(tx_data, 0x5a, 4 * TCP_MSS);
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  memset(&counters, 0, sizeof(counters));
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  tcp_nagle_disable(pcb);
+  pcb->mss = TCP_MSS;
+  pcb->cwnd = pcb->snd_wnd;
+  tcp_zerocopy(pcb, test_tcp_zc_done);
+  test_tcp_zc_calls = 0;
+
+  /* id 0 ends in the second segment */
+  err = tcp_write(pcb, tx_data, TCP_MSS + TCP_MSS / 2, TCP_WRITE_FLAG_ZEROCOPY);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT_RET(pcb->unsent != NULL && pcb->unsent->p->next != NULL);
+  EXPECT(pcb->unsent->p->next->type_internal == PBUF_REF);
+  EXPECT(pcb->unsent->p->next->payload == tx_data);
+  /* id 1 continues in the second segment and ends in the third */
+  err = tcp_write(pcb, tx_data + TCP_MSS + TCP_MSS / 2, TCP_MSS / 2,
+                  TCP_WRITE_FLAG_ZEROCOPY | TCP_WRITE_FLAG_MORE);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_write(pcb, tx_data + 2 * TCP_MSS, TCP_MSS, TCP_WRITE_FLAG_ZEROCOPY);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT(pcb->snd_nxt == pcb->lastack + 3 * TCP_MSS);
+
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, TCP_MSS, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(test_tcp_zc_calls == 0);
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, TCP_MSS, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(test_tcp_zc_calls == 1);
+  EXPECT(test_tcp_zc_id == 0);
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, TCP_MSS, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(test_tcp_zc_calls == 2);
+  EXPECT(test_tcp_zc_id == 1);
+  EXPECT(pcb->unacked == NULL);
+
+  /* id 2 is ACKed before it is ended: tcp_zerocopy_end() reports it */
+  err = tcp_write(pcb, tx_data, TCP_MSS, TCP_WRITE_FLAG_ZEROCOPY | TCP_WRITE_FLAG_MORE);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, TCP_MSS, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(test_tcp_zc_calls == 2);
+  tcp_zerocopy_end(pcb);
+  EXPECT(test_tcp_zc_calls == 3);
+  EXPECT(test_tcp_zc_id == 2);
+  tcp_zerocopy_end(pcb);
+  EXPECT(test_tcp_zc_calls == 3);
+  tcp_abort(pcb);
+#else /* LWIP_TCP_ZEROCOPY */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_ZEROCOPY */
+}
+END_TEST
+
+/** Receive one full-sized segment in order */
+static void
+test_tcp_ack_rx(struct tcp_pcb *pcb, struct netif *netif)
+{
+  struct pbuf *p = tcp_create_rx_segment(pcb, tx_data, TCP_MSS, 0, 0, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, netif);
+}
+
+/** Quick-ACK mode, ACK every N segments and tcp_quickack() */
+START_TEST(test_tcp_ack_policy)
+{
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  memset(&counters, 0, sizeof(counters));
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  pcb->mss = TCP_MSS;
+
+  /* a new connection ACKs every segment at first (shortened here, the
+     window is not opened again) */
+  EXPECT(pcb->quickack == TCP_QUICKACK_SEGS);
+  pcb->quickack = 2;
+  test_tcp_ack_rx(pcb, &netif);
+  test_tcp_ack_rx(pcb, &netif);
+  EXPECT(txcounters.num_tx_calls == 2);
+  EXPECT(pcb->quickack == 0);
+
+  /* then every second one */
+  txcounters.num_tx_calls = 0;
+  test_tcp_ack_rx(pcb, &netif);
+  EXPECT(txcounters.num_tx_calls == 0);
+  EXPECT(pcb->flags & TF_ACK_DELAY);
+  test_tcp_ack_rx(pcb, &netif);
+  EXPECT(txcounters.num_tx_calls == 1);
+
+  /* a bulk receiver ACKs every fourth one */
+  EXPECT(tcp_set_ack_segs(pcb, 0) == ERR_VAL);
+  EXPECT(tcp_set_ack_segs(pcb, TCP_ACK_SEGS_MAX + 1) == ERR_VAL);
+  EXPECT(tcp_set_ack_segs(pcb, 4) == ERR_OK);
+  txcounters.num_tx_calls = 0;
+  for (i = 0; i < 3; i++) {
+    test_tcp_ack_rx(pcb, &netif);
+  }
+  EXPECT(txcounters.num_tx_calls == 0);
+  test_tcp_ack_rx(pcb, &netif);
+  EXPECT(txcounters.num_tx_calls == 1);
+
+  /* tcp_quickack() sends the ACK delayed already and ACKs every segment */
+  test_tcp_ack_rx(pcb, &netif);
+  EXPECT(txcounters.num_tx_calls == 1);
+  tcp_quickack(pcb, 1);
+  EXPECT(txcounters.num_tx_calls == 2);
+  EXPECT(!(pcb->flags & TF_ACK_DELAY));
+  test_tcp_ack_rx(pcb, &netif);
+  EXPECT(txcounters.num_tx_calls == 3);
+  tcp_quickack(pcb, 0);
+
+  /* a hole in the data starts quick-ACK mode again */
+  p = tcp_create_rx_segment(pcb, tx_data, TCP_MSS, TCP_MSS, 0, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(txcounters.num_tx_calls == 4);
+  EXPECT(pcb->quickack == TCP_QUICKACK_SEGS);
+  test_tcp_ack_rx(pcb, &netif);
+  EXPECT(txcounters.num_tx_calls == 5);
+  tcp_abort(pcb);
+}
+END_TEST
+
+#if LWIP_TCP_RCV_AUTOTUNE && LWIP_TCP_RTT_MS
+/** Receive full-sized segments in order, then read them one round-trip
+ * time (100 ms) after the last read */
+static void
+test_tcp_autotune_rx(struct tcp_pcb *pcb, struct netif *netif, int segs)
+{
+  int i;
+
+  for (i = 0; i < segs; i++) {
+    struct pbuf *p = tcp_create_rx_segment(pcb, tx_data, TCP_MSS, 0, 0, TCP_ACK);
+    EXPECT_RET(p != NULL);
+    test_tcp_input(p, netif);
+  }
+  lwip_sys_now += 100;
+  tcp_recved(pcb, (u16_t)(segs * TCP_MSS));
+}
+#endif /* LWIP_TCP_RCV_AUTOTUNE && LWIP_TCP_RTT_MS */
+
+/** Check that the receive window stays small for a slow reader, grows to
+ * TCP_WND for a fast one, and only grows within the budget */
+START_TEST(test_tcp_rcv_autotune)
+{
+#if LWIP_TCP_RCV_AUTOTUNE && LWIP_TCP_RTT_MS
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb, *pcb2;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  memset(&counters, 0, sizeof(counters));
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  pcb->srtt = 100 << 3;
+  pcb2 = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb2 != NULL);
+  tcp_set_state(pcb2, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT + 1, TEST_REMOTE_PORT);
+  pcb2->srtt = 100 << 3;
+  EXPECT(pcb->rcv_wnd_max == TCP_RCV_AUTOTUNE_INIT);
+  EXPECT(pcb->rcv_wnd == TCP_RCV_AUTOTUNE_INIT);
+
+  /* the first read starts the measurement */
+  test_tcp_autotune_rx(pcb, &netif, 1);
+  test_tcp_autotune_rx(pcb2, &netif, 1);
+
+  /* 2 segments per round-trip time are not worth a larger window */
+  for (i = 0; i < 4; i++) {
+    test_tcp_autotune_rx(pcb, &netif, 2);
+  }
+  EXPECT(pcb->rcv_wnd_max == TCP_RCV_AUTOTUNE_INIT);
+
+  /* reading the whole window per round-trip time lets it grow to TCP_WND */
+  test_tcp_autotune_rx(pcb, &netif, TCP_RCV_AUTOTUNE_INIT / TCP_MSS);
+  EXPECT(pcb->rcv_wnd_max == TCP_WND);
+  EXPECT(pcb->rcv_wnd == TCP_WND);
+  EXPECT(pcb->rcv_ann_wnd == TCP_WND);
+
+  /* that took the whole budget */
+  test_tcp_autotune_rx(pcb2, &netif, TCP_RCV_AUTOTUNE_INIT / TCP_MSS);
+  EXPECT(pcb2->rcv_wnd_max == TCP_RCV_AUTOTUNE_INIT);
+  EXPECT(pcb2->rcv_wnd == TCP_RCV_AUTOTUNE_INIT);
+
+  /* until the first connection is freed */
+  tcp_abort(pcb);
+  test_tcp_autotune_rx(pcb2, &netif, TCP_RCV_AUTOTUNE_INIT / TCP_MSS);
+  EXPECT(pcb2->rcv_wnd_max == TCP_WND);
+  EXPECT(pcb2->rcv_wnd == TCP_WND);
+
+  EXPECT(counters.err_calls == 1);
+  tcp_abort(pcb2);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+#else /* LWIP_TCP_RCV_AUTOTUNE && LWIP_TCP_RTT_MS */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_RCV_AUTOTUNE && LWIP_TCP_RTT_MS */
+}
+END_TEST
+
 /** Create the suite including all tests for this module */
 Suite *
 tcp_suite(void)
@@ -2520,9 +4894,33 @@ tcp_suite(void)
     TESTFUNC(test_tcp_ca_cubic_slowstart),
     TESTFUNC(test_tcp_ca_cubic_hystart_ack_train),
     TESTFUNC(test_tcp_ca_cubic_hystart_delay),
+    TESTFUNC(test_tcp_ca_cubic_hystart_pp),
     TESTFUNC(test_tcp_ca_cubic),
     TESTFUNC(test_tcp_ca_cubic_rto),
-    TESTFUNC(test_tcp_ca_cubic_tcp_friendliness)
+    TESTFUNC(test_tcp_ca_cubic_tcp_friendliness),
+    TESTFUNC(test_tcp_demux_many),
+    TESTFUNC(test_tcp_listen_reuseport),
+    TESTFUNC(test_tcp_listen_syncookies),
+    TESTFUNC(test_tcp_listen_req_table),
+    TESTFUNC(test_tcp_timer_wheel),
+    TESTFUNC(test_tcp_timer_wheel_lazy),
+    TESTFUNC(test_tcp_timer_wheel_keepalive),
+    TESTFUNC(test_tcp_sack_recovery),
+    TESTFUNC(test_tcp_prr),
+    TESTFUNC(test_tcp_sack_send_queue_index),
+    TESTFUNC(test_tcp_rtt_estimator),
+    TESTFUNC(test_tcp_rack_tlp),
+    TESTFUNC(test_tcp_frto_spurious),
+    TESTFUNC(test_tcp_frto_lost),
+    TESTFUNC(test_tcp_undo_eifel),
+    TESTFUNC(test_tcp_undo_dsack),
+    TESTFUNC(test_tcp_tso),
+    TESTFUNC(test_tcp_gso),
+    TESTFUNC(test_tcp_tso_loopback),
+    TESTFUNC(test_tcp_gro),
+    TESTFUNC(test_tcp_zerocopy),
+    TESTFUNC(test_tcp_ack_policy),
+    TESTFUNC(test_tcp_rcv_autotune)
   };
   return create_suite("TCP", tests, sizeof(tests)/sizeof(testfunc), tcp_setup, tcp_teardown);
 }
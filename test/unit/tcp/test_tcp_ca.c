@@ -0,0 +1,1059 @@
+#include "test_tcp_ca.h"
+
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/stats.h"
+#include "lwip/timeouts.h"
+#include "tcp_helper.h"
+
+#if !LWIP_STATS || !TCP_STATS || !MEMP_STATS
+#error "This tests needs TCP- and MEMP-statistics enabled"
+#endif
+
+/* Setups/teardown functions */
+static struct netif *old_netif_list;
+static struct netif *old_netif_default;
+
+static void
+tcp_ca_setup(void)
+{
+  old_netif_list = netif_list;
+  old_netif_default = netif_default;
+  netif_list = NULL;
+  netif_default = NULL;
+  tcp_remove_all();
+  lwip_check_ensure_no_alloc(SKIP_POOL(MEMP_SYS_TIMEOUT));
+}
+
+static void
+tcp_ca_teardown(void)
+{
+  netif_list = NULL;
+  netif_default = NULL;
+  tcp_remove_all();
+  netif_list = old_netif_list;
+  netif_default = old_netif_default;
+  lwip_check_ensure_no_alloc(SKIP_POOL(MEMP_SYS_TIMEOUT));
+}
+
+#if LWIP_TCP_BBR || LWIP_TCP_ECN || LWIP_TCP_PACING
+static char test_ca_data[TCP_MSS];
+#endif /* LWIP_TCP_BBR || LWIP_TCP_ECN || LWIP_TCP_PACING */
+
+#if LWIP_TCP_BBR || LWIP_TCP_DCTCP
+/* Emulated path: the sender's netif feeds a drop-tail bottleneck queue that
+ * forwards one full segment every TEST_CA_LINK_MS ms, data and ACKs then take
+ * TEST_CA_DELAY_MS ms in each direction. The queue can CE mark ECN-capable
+ * segments above a threshold. The receiver ACKs every segment, echoes its CE
+ * mark like a DCTCP receiver and reports the out-of-order run a segment falls
+ * into as a SACK block. */
+#define TEST_CA_LINK_MS   2
+#define TEST_CA_DELAY_MS  2
+#define TEST_CA_RUN_MS    4000
+/* queueing delay and goodput are measured after the startup phase */
+#define TEST_CA_WARMUP_MS 1000
+#define TEST_CA_RING      256
+#define TEST_CA_MAX_SEGS  4096
+
+/* a data segment in the bottleneck queue or on its way to the receiver */
+struct test_ca_seg {
+  u32_t seqno;
+  u16_t len;
+  u8_t ce;
+  u32_t time;  /* enqueue time in the queue, arrival time on the wire */
+};
+
+/* an ACK on its way to the sender */
+struct test_ca_ack {
+  u32_t ackno;
+  u32_t sack[2];
+  u8_t num_sacks;
+  u8_t ece;
+  u32_t due;
+};
+
+struct test_ca_link {
+  u32_t queue_limit;  /* bottleneck buffer in segments */
+  u32_t mark_limit;   /* CE mark above this queue length, 0 to never mark */
+  struct test_ca_seg queue[TEST_CA_RING];
+  u16_t queue_head, queue_len;
+  struct test_ca_seg wire[TEST_CA_RING];
+  u16_t wire_head, wire_len;
+  struct test_ca_ack acks[TEST_CA_RING];
+  u16_t acks_head, acks_len;
+  u32_t now;
+  u32_t next_tx;  /* the bottleneck is busy until then */
+  u32_t iss;
+  u32_t rcv_nxt;
+  u8_t rcvd[TEST_CA_MAX_SEGS];
+  /* results */
+  u32_t drops;
+  u32_t marks;
+  u32_t dequeued;
+  u32_t queue_delay;  /* sum over the dequeued segments */
+  u32_t goodput;      /* bytes delivered in order to the receiver */
+};
+
+struct test_ca_result {
+  u32_t rate;         /* bytes per second */
+  u32_t queue_delay;  /* average in 1/100 ms */
+  u32_t drops;
+  u32_t marks;
+};
+
+static struct test_ca_link test_ca_link;
+
+/* helper functions */
+
+/** netif output: put data segments into the bottleneck queue, drop when full */
+static err_t
+test_ca_netif_output(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+  struct test_ca_link *link = (struct test_ca_link *)netif->state;
+  struct ip_hdr iphdr;
+  struct tcp_hdr tcphdr;
+  struct test_ca_seg *seg;
+  u16_t len;
+  LWIP_UNUSED_ARG(ipaddr);
+
+  pbuf_copy_partial(p, &iphdr, sizeof(iphdr), 0);
+  pbuf_copy_partial(p, &tcphdr, sizeof(tcphdr), IPH_HL_BYTES(&iphdr));
+  len = (u16_t)(lwip_ntohs(IPH_LEN(&iphdr)) - IPH_HL_BYTES(&iphdr) - TCPH_HDRLEN_BYTES(&tcphdr));
+  if (len == 0) {
+    /* pure ACK or RST */
+    return ERR_OK;
+  }
+  if (link->queue_len >= link->queue_limit) {
+    link->drops++;
+    return ERR_OK;
+  }
+  seg = &link->queue[(link->queue_head + link->queue_len) % TEST_CA_RING];
+  seg->seqno = lwip_ntohl(tcphdr.seqno);
+  seg->len = len;
+  seg->ce = 0;
+  seg->time = link->now;
+  if ((link->mark_limit != 0) && (link->queue_len >= link->mark_limit) &&
+      ((IPH_TOS(&iphdr) & IP_ECN_MASK) != IP_ECN_NOT_ECT)) {
+    seg->ce = 1;
+    link->marks++;
+  }
+  link->queue_len++;
+  return ERR_OK;
+}
+
+/** Set ECE on an ACK created by the tcp_helper functions */
+static void
+test_ca_set_ece(struct pbuf *p)
+{
+  struct tcp_hdr *tcphdr;
+
+  pbuf_header(p, -(s16_t)sizeof(struct ip_hdr));
+  tcphdr = (struct tcp_hdr *)p->payload;
+  TCPH_SET_FLAG(tcphdr, TCP_ECE);
+  tcphdr->chksum = 0;
+  tcphdr->chksum = ip_chksum_pseudo(p, IP_PROTO_TCP, p->tot_len, &test_remote_ip, &test_local_ip);
+  pbuf_header(p, sizeof(struct ip_hdr));
+}
+
+/** A segment reaches the receiver: ACK it, SACKing the run it falls into */
+static void
+test_ca_receive(struct test_ca_link *link, const struct test_ca_seg *seg)
+{
+  struct test_ca_ack *ack;
+  u32_t idx = (seg->seqno - link->iss) / TCP_MSS;
+  u32_t left, right;
+
+  fail_unless(seg->len == TCP_MSS);
+  fail_unless(idx < TEST_CA_MAX_SEGS - 1);
+  link->rcvd[idx] = 1;
+  while (link->rcvd[(link->rcv_nxt - link->iss) / TCP_MSS]) {
+    link->rcv_nxt += TCP_MSS;
+    if (link->now >= TEST_CA_WARMUP_MS) {
+      link->goodput += TCP_MSS;
+    }
+  }
+
+  fail_unless(link->acks_len < TEST_CA_RING);
+  ack = &link->acks[(link->acks_head + link->acks_len++) % TEST_CA_RING];
+  ack->ackno = link->rcv_nxt;
+  ack->num_sacks = 0;
+  ack->ece = seg->ce;
+  ack->due = link->now + TEST_CA_DELAY_MS;
+  if (TCP_SEQ_GT(seg->seqno, link->rcv_nxt)) {
+    left = seg->seqno;
+    while (link->rcvd[(left - link->iss) / TCP_MSS - 1]) {
+      left -= TCP_MSS;
+    }
+    right = seg->seqno + TCP_MSS;
+    while (link->rcvd[(right - link->iss) / TCP_MSS]) {
+      right += TCP_MSS;
+    }
+    ack->sack[0] = left;
+    ack->sack[1] = right;
+    ack->num_sacks = 1;
+  }
+}
+
+/** Advance the emulated path and the sender by one millisecond */
+static void
+test_ca_step(struct test_ca_link *link, struct tcp_pcb *pcb, struct netif *netif)
+{
+  struct pbuf *p;
+  err_t err;
+
+  /* ACKs reaching the sender */
+  while (link->acks_len > 0 && link->acks[link->acks_head].due <= link->now) {
+    struct test_ca_ack *ack = &link->acks[link->acks_head];
+    link->acks_head = (u16_t)((link->acks_head + 1) % TEST_CA_RING);
+    link->acks_len--;
+    if (ack->num_sacks > 0) {
+      p = tcp_create_rx_segment_sack(pcb, ack->ackno - pcb->lastack, ack->sack, ack->num_sacks);
+    } else {
+      p = tcp_create_rx_segment(pcb, NULL, 0, 0, ack->ackno - pcb->lastack, TCP_ACK);
+    }
+    fail_unless(p != NULL);
+    if (ack->ece) {
+      test_ca_set_ece(p);
+    }
+    test_tcp_input(p, netif);
+  }
+
+  /* the bottleneck forwards one segment at a time */
+  if (link->queue_len > 0 && link->now >= link->next_tx) {
+    struct test_ca_seg *seg = &link->queue[link->queue_head];
+    link->queue_head = (u16_t)((link->queue_head + 1) % TEST_CA_RING);
+    link->queue_len--;
+    if (seg->time >= TEST_CA_WARMUP_MS) {
+      link->queue_delay += link->now - seg->time;
+      link->dequeued++;
+    }
+    link->next_tx = link->now + TEST_CA_LINK_MS;
+    fail_unless(link->wire_len < TEST_CA_RING);
+    link->wire[(link->wire_head + link->wire_len++) % TEST_CA_RING] = *seg;
+    link->wire[(link->wire_head + link->wire_len - 1) % TEST_CA_RING].time =
+      link->now + TEST_CA_LINK_MS + TEST_CA_DELAY_MS;
+  }
+
+  /* segments reaching the receiver */
+  while (link->wire_len > 0 && link->wire[link->wire_head].time <= link->now) {
+    test_ca_receive(link, &link->wire[link->wire_head]);
+    link->wire_head = (u16_t)((link->wire_head + 1) % TEST_CA_RING);
+    link->wire_len--;
+  }
+
+  /* the application always has data to send */
+  while (tcp_sndbuf(pcb) >= TCP_MSS && tcp_sndqueuelen(pcb) < TCP_SND_QUEUELEN - 1) {
+    err = tcp_write(pcb, test_ca_data, TCP_MSS, TCP_WRITE_FLAG_COPY);
+    fail_unless(err == ERR_OK);
+  }
+  err = tcp_output(pcb);
+  fail_unless(err == ERR_OK);
+
+  sys_check_timeouts();
+  if ((link->now % TCP_TMR_INTERVAL) == 0) {
+    tcp_tmr();
+  }
+}
+
+/** Run one bulk transfer with the given congestion control over the path,
+ * with ECN if mark_limit is not 0 */
+static void
+test_ca_run(struct tcp_congestion_ops *ops, u32_t queue_limit, u32_t mark_limit,
+            struct test_ca_result *res)
+{
+  struct test_ca_link *link = &test_ca_link;
+  struct netif netif;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct sys_timeo **timeouts = sys_timeouts_get_next_timeout();
+  struct sys_timeo *old_timeouts;
+  u32_t start = lwip_sys_now;
+
+  memset(link, 0, sizeof(*link));
+  link->queue_limit = queue_limit;
+  link->mark_limit = mark_limit;
+  test_tcp_init_netif(&netif, NULL, &test_local_ip, &test_netmask);
+  netif.state = link;
+  netif.output = test_ca_netif_output;
+  memset(&counters, 0, sizeof(counters));
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  fail_unless(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+#if LWIP_TCP_SACK_OUT
+  tcp_set_flags(pcb, TF_SACK);
+#endif /* LWIP_TCP_SACK_OUT */
+  tcp_set_flags(pcb, TF_NODELAY);
+  /* only the timeouts of this connection may fire */
+  old_timeouts = *timeouts;
+  *timeouts = NULL;
+  pcb->mss = TCP_MSS;
+  pcb->cwnd = LWIP_TCP_CALC_INITIAL_CWND(pcb->mss);
+  pcb->cong_ops = ops;
+  tcp_init_congestion_control(pcb);
+#if LWIP_TCP_ECN
+  if (mark_limit != 0) {
+    pcb->ecn_flags = TCP_ECN_OK;
+  }
+#endif /* LWIP_TCP_ECN */
+  link->iss = pcb->snd_nxt;
+  link->rcv_nxt = pcb->snd_nxt;
+
+  for (link->now = 0; link->now < TEST_CA_RUN_MS; link->now++) {
+    lwip_sys_now = start + link->now;
+    test_ca_step(link, pcb, &netif);
+  }
+
+  res->rate = link->goodput / ((TEST_CA_RUN_MS - TEST_CA_WARMUP_MS) / 1000);
+  res->queue_delay = link->dequeued ? (100 * link->queue_delay) / link->dequeued : 0;
+  res->drops = link->drops;
+  res->marks = link->marks;
+  LWIP_PLATFORM_DIAG(("%s, %"U32_F" segment buffer: %"U32_F" bytes/s, queueing delay %"U32_F".%02"U32_F" ms, %"U32_F" drops, %"U32_F" marks\n",
+                      ops->name, queue_limit, res->rate, res->queue_delay / 100, res->queue_delay % 100, res->drops, res->marks));
+
+  tcp_abort(pcb);
+  fail_unless(*timeouts == NULL);
+  *timeouts = old_timeouts;
+}
+#endif /* LWIP_TCP_BBR || LWIP_TCP_DCTCP */
+
+#if LWIP_TCP_ECN
+/** Return the TOS and the TCP flags of the first packet sent since the last
+ * call and forget about all packets sent */
+static void
+test_ca_tx_packet(struct test_tcp_txcounters *txcounters, u8_t *tos, u8_t *tcpflags)
+{
+  struct ip_hdr iphdr;
+  struct tcp_hdr tcphdr;
+
+  *tos = 0xff;
+  *tcpflags = 0xff;
+  EXPECT_RET(txcounters->tx_packets != NULL);
+  pbuf_copy_partial(txcounters->tx_packets, &iphdr, sizeof(iphdr), 0);
+  pbuf_copy_partial(txcounters->tx_packets, &tcphdr, sizeof(tcphdr), IPH_HL_BYTES(&iphdr));
+  *tos = IPH_TOS(&iphdr);
+  *tcpflags = (u8_t)(TCPH_FLAGS(&tcphdr) | TCPH_ECN_FLAGS(&tcphdr));
+  pbuf_free(txcounters->tx_packets);
+  txcounters->tx_packets = NULL;
+  txcounters->num_tx_calls = 0;
+}
+
+/** Create a data segment from the remote host with the given ECN codepoint */
+static struct pbuf *
+test_ca_rx_data(struct tcp_pcb *pcb, u8_t ecn, u8_t tcpflags)
+{
+  static char data[4] = {1, 2, 3, 4};
+  struct pbuf *p = tcp_create_rx_segment(pcb, data, sizeof(data), 0, 0, tcpflags);
+  if (p != NULL) {
+    /* the IP header checksum is not checked by tcp_input */
+    IPH_TOS_SET((struct ip_hdr *)p->payload, ecn);
+  }
+  return p;
+}
+#endif /* LWIP_TCP_ECN */
+
+/* Test functions */
+
+/** BBR fills the same bottleneck as cubic, but without filling its buffer */
+START_TEST(test_tcp_ca_bbr_vs_cubic)
+{
+#if LWIP_TCP_BBR
+  struct test_ca_result cubic, bbr;
+  u32_t link_rate = TCP_MSS * 1000 / TEST_CA_LINK_MS;
+  LWIP_UNUSED_ARG(_i);
+
+  /* deep buffer: cubic is only limited by the receive window */
+  test_ca_run(&tcp_ca_cubic, 64, 0, &cubic);
+  test_ca_run(&tcp_ca_bbr, 64, 0, &bbr);
+  EXPECT(cubic.rate >= link_rate * 9 / 10);
+  EXPECT(bbr.rate >= link_rate * 9 / 10);
+  EXPECT(2 * bbr.queue_delay < cubic.queue_delay);
+
+  /* shallow buffer: cubic overflows it, BBR does not once it has a model */
+  test_ca_run(&tcp_ca_cubic, 12, 0, &cubic);
+  test_ca_run(&tcp_ca_bbr, 12, 0, &bbr);
+  EXPECT(bbr.rate >= link_rate * 9 / 10);
+  EXPECT(bbr.drops < cubic.drops);
+#else /* LWIP_TCP_BBR */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_BBR */
+}
+END_TEST
+
+/** ECN is requested in active open SYNs and agreed to in SYN-ACKs, only data
+ * segments of an ECN connection are ECN-capable */
+START_TEST(test_tcp_ecn_negotiation)
+{
+#if LWIP_TCP_ECN
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb, *pcbl;
+  struct pbuf *p;
+  ip_addr_t src_addr;
+  char data = 0x0f;
+  u8_t tos, tcpflags;
+  err_t err;
+  LWIP_UNUSED_ARG(_i);
+
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  txcounters.copy_tx_packets = 1;
+  memset(&counters, 0, sizeof(counters));
+
+  /* active open */
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  err = tcp_connect(pcb, &netif.gw, TEST_REMOTE_PORT, NULL);
+  EXPECT_RET(err == ERR_OK);
+  test_ca_tx_packet(&txcounters, &tos, &tcpflags);
+  EXPECT(tcpflags == (TCP_SYN | TCP_ECE | TCP_CWR));
+  EXPECT((tos & IP_ECN_MASK) == IP_ECN_NOT_ECT);
+
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, 1, TCP_SYN | TCP_ACK | TCP_ECE);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT_RET(pcb->state == ESTABLISHED);
+  EXPECT(pcb->ecn_flags == TCP_ECN_OK);
+  test_ca_tx_packet(&txcounters, &tos, &tcpflags);
+  EXPECT(tcpflags == TCP_ACK);
+  EXPECT((tos & IP_ECN_MASK) == IP_ECN_NOT_ECT);
+
+  err = tcp_write(pcb, &data, 1, TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  test_ca_tx_packet(&txcounters, &tos, &tcpflags);
+  EXPECT((tcpflags & (TCP_ECE | TCP_CWR)) == 0);
+  EXPECT((tos & IP_ECN_MASK) == IP_ECN_ECT0);
+  txcounters.copy_tx_packets = 0;
+  tcp_abort(pcb);
+  txcounters.copy_tx_packets = 1;
+
+  /* passive open */
+  pcb = tcp_new();
+  EXPECT_RET(pcb != NULL);
+  err = tcp_bind(pcb, &netif.ip_addr, 1234);
+  EXPECT_RET(err == ERR_OK);
+  pcbl = tcp_listen(pcb);
+  EXPECT_RET(pcbl != NULL);
+  ip_addr_copy(src_addr, test_remote_ip);
+
+  p = tcp_create_segment(&src_addr, &netif.ip_addr, 12345, 1234, NULL, 0, 12345, 0,
+                         TCP_SYN | TCP_ECE | TCP_CWR);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+#if LWIP_TCP_REQ_TABLE
+  {
+    struct tcp_req *req = tcp_req_lookup((struct tcp_pcb_listen *)pcbl, &netif.ip_addr, &src_addr, 12345);
+    EXPECT_RET(req != NULL);
+    EXPECT(req->hs.ecn);
+  }
+#else /* LWIP_TCP_REQ_TABLE */
+  EXPECT_RET(tcp_active_pcbs != NULL);
+  EXPECT(tcp_active_pcbs->state == SYN_RCVD);
+  EXPECT(tcp_active_pcbs->ecn_flags == TCP_ECN_OK);
+#endif /* LWIP_TCP_REQ_TABLE */
+  test_ca_tx_packet(&txcounters, &tos, &tcpflags);
+  EXPECT(tcpflags == (TCP_SYN | TCP_ACK | TCP_ECE));
+  EXPECT((tos & IP_ECN_MASK) == IP_ECN_NOT_ECT);
+
+  /* a SYN without ECE and CWR does not request ECN */
+  p = tcp_create_segment(&src_addr, &netif.ip_addr, 12346, 1234, NULL, 0, 12345, 0, TCP_SYN);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+#if LWIP_TCP_REQ_TABLE
+  {
+    struct tcp_req *req = tcp_req_lookup((struct tcp_pcb_listen *)pcbl, &netif.ip_addr, &src_addr, 12346);
+    EXPECT_RET(req != NULL);
+    EXPECT(!req->hs.ecn);
+  }
+#else /* LWIP_TCP_REQ_TABLE */
+  EXPECT_RET(tcp_active_pcbs != NULL);
+  EXPECT(tcp_active_pcbs->remote_port == 12346);
+  EXPECT(tcp_active_pcbs->ecn_flags == 0);
+#endif /* LWIP_TCP_REQ_TABLE */
+  test_ca_tx_packet(&txcounters, &tos, &tcpflags);
+  EXPECT(tcpflags == (TCP_SYN | TCP_ACK));
+
+  txcounters.copy_tx_packets = 0;
+  tcp_remove_all();
+#else /* LWIP_TCP_ECN */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_ECN */
+}
+END_TEST
+
+/** A CE mark is echoed with ECE right away and on every ACK until the sender
+ * confirms with CWR */
+START_TEST(test_tcp_ecn_ce_echo)
+{
+#if LWIP_TCP_ECN
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+  u8_t tos, tcpflags;
+  LWIP_UNUSED_ARG(_i);
+
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  txcounters.copy_tx_packets = 1;
+  memset(&counters, 0, sizeof(counters));
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  pcb->cong_ops = &tcp_ca_cubic;
+  tcp_init_congestion_control(pcb);
+  pcb->ecn_flags = TCP_ECN_OK;
+
+  p = test_ca_rx_data(pcb, IP_ECN_CE, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(counters.recv_calls == 1);
+  EXPECT(txcounters.num_tx_calls == 1);
+  test_ca_tx_packet(&txcounters, &tos, &tcpflags);
+  EXPECT(tcpflags == (TCP_ACK | TCP_ECE));
+  EXPECT((tos & IP_ECN_MASK) == IP_ECN_NOT_ECT);
+
+  /* not marked, but the sender has not reacted yet */
+  p = test_ca_rx_data(pcb, IP_ECN_ECT0, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->ecn_flags & TCP_ECN_DEMAND_CWR);
+  tcp_send_empty_ack(pcb);
+  test_ca_tx_packet(&txcounters, &tos, &tcpflags);
+  EXPECT(tcpflags == (TCP_ACK | TCP_ECE));
+
+  p = test_ca_rx_data(pcb, IP_ECN_ECT0, TCP_ACK | TCP_CWR);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(!(pcb->ecn_flags & TCP_ECN_DEMAND_CWR));
+  tcp_send_empty_ack(pcb);
+  test_ca_tx_packet(&txcounters, &tos, &tcpflags);
+  EXPECT(tcpflags == TCP_ACK);
+  EXPECT(counters.recv_calls == 3);
+
+  txcounters.copy_tx_packets = 0;
+  tcp_abort(pcb);
+#else /* LWIP_TCP_ECN */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_ECN */
+}
+END_TEST
+
+/** ECE reduces cwnd once per window and the reduction is confirmed with CWR
+ * on the next new data segment */
+START_TEST(test_tcp_ecn_ece_reduces_cwnd)
+{
+#if LWIP_TCP_ECN
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+  tcpwnd_size_t cwnd;
+  u8_t tos, tcpflags;
+  err_t err;
+  LWIP_UNUSED_ARG(_i);
+
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  memset(&counters, 0, sizeof(counters));
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  pcb->mss = TCP_MSS;
+  pcb->cong_ops = &tcp_ca_cubic;
+  tcp_init_congestion_control(pcb);
+  pcb->ecn_flags = TCP_ECN_OK;
+  pcb->cwnd = 10 * TCP_MSS;
+  pcb->ssthresh = 10 * TCP_MSS;
+
+  err = tcp_write(pcb, test_ca_data, TCP_MSS, TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_write(pcb, test_ca_data, TCP_MSS, TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  txcounters.copy_tx_packets = 1;
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT(txcounters.num_tx_calls == 2);
+  test_ca_tx_packet(&txcounters, &tos, &tcpflags);
+  EXPECT((tcpflags & (TCP_ECE | TCP_CWR)) == 0);
+  EXPECT((tos & IP_ECN_MASK) == IP_ECN_ECT0);
+
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, TCP_MSS, TCP_ACK | TCP_ECE);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->cwnd < 10 * TCP_MSS);
+  EXPECT(pcb->cwnd == pcb->ssthresh);
+  EXPECT(pcb->ecn_flags == (TCP_ECN_OK | TCP_ECN_IN_CWR | TCP_ECN_QUEUE_CWR));
+  cwnd = pcb->cwnd;
+
+  /* the rest of the window was marked by the same congestion event */
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, TCP_MSS, TCP_ACK | TCP_ECE);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->cwnd >= cwnd);
+
+  err = tcp_write(pcb, test_ca_data, TCP_MSS, TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  test_ca_tx_packet(&txcounters, &tos, &tcpflags);
+  EXPECT((tcpflags & (TCP_ECE | TCP_CWR)) == TCP_CWR);
+  EXPECT((tos & IP_ECN_MASK) == IP_ECN_ECT0);
+  EXPECT(pcb->ecn_flags == (TCP_ECN_OK | TCP_ECN_IN_CWR));
+
+  /* a mark in the next window reduces cwnd again */
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, TCP_MSS, TCP_ACK | TCP_ECE);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->cwnd < cwnd);
+  EXPECT(pcb->ecn_flags == (TCP_ECN_OK | TCP_ECN_IN_CWR | TCP_ECN_QUEUE_CWR));
+
+  txcounters.copy_tx_packets = 0;
+  tcp_abort(pcb);
+#else /* LWIP_TCP_ECN */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_ECN */
+}
+END_TEST
+
+/** DCTCP cuts cwnd by the fraction of marked bytes and echoes the CE state of
+ * every segment */
+START_TEST(test_tcp_dctcp)
+{
+#if LWIP_TCP_DCTCP
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct pbuf *p;
+  tcpwnd_size_t cwnd;
+  u8_t tos, tcpflags;
+  u32_t i;
+  err_t err;
+  LWIP_UNUSED_ARG(_i);
+
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  memset(&counters, 0, sizeof(counters));
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  pcb->mss = TCP_MSS;
+  pcb->cong_ops = &tcp_ca_dctcp;
+  tcp_init_congestion_control(pcb);
+  pcb->ecn_flags = TCP_ECN_OK;
+  pcb->cwnd = 20 * TCP_MSS;
+  pcb->ssthresh = 20 * TCP_MSS;
+
+  /* alpha starts at 1: the first mark halves cwnd */
+  err = tcp_write(pcb, test_ca_data, TCP_MSS, TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, TCP_MSS, TCP_ACK | TCP_ECE);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->cwnd == 10 * TCP_MSS);
+
+  /* alpha decays over unmarked windows... */
+  for (i = 0; i < 100; i++) {
+    err = tcp_write(pcb, test_ca_data, TCP_MSS, TCP_WRITE_FLAG_COPY);
+    EXPECT_RET(err == ERR_OK);
+    err = tcp_output(pcb);
+    EXPECT_RET(err == ERR_OK);
+    p = tcp_create_rx_segment(pcb, NULL, 0, 0, TCP_MSS, TCP_ACK);
+    EXPECT_RET(p != NULL);
+    test_tcp_input(p, &netif);
+  }
+  EXPECT(!(pcb->ecn_flags & TCP_ECN_IN_CWR));
+  cwnd = pcb->cwnd;
+
+  /* ...so that a single mark only costs a few percent */
+  err = tcp_write(pcb, test_ca_data, TCP_MSS, TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, TCP_MSS, TCP_ACK | TCP_ECE);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(pcb->ecn_flags & TCP_ECN_IN_CWR);
+  EXPECT(pcb->cwnd < cwnd);
+  EXPECT(pcb->cwnd > cwnd - cwnd / 10);
+
+  /* receiver: every change of the CE state is ACKed right away... */
+  pcb->quickack = 0; /* past the quick-ACK phase of a new connection */
+  txcounters.num_tx_calls = 0;
+  txcounters.copy_tx_packets = 1;
+  p = test_ca_rx_data(pcb, IP_ECN_CE, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(txcounters.num_tx_calls == 1);
+  test_ca_tx_packet(&txcounters, &tos, &tcpflags);
+  EXPECT((tcpflags & TCP_ECE) != 0);
+
+  p = test_ca_rx_data(pcb, IP_ECN_ECT0, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(txcounters.num_tx_calls == 1);
+  test_ca_tx_packet(&txcounters, &tos, &tcpflags);
+  EXPECT((tcpflags & TCP_ECE) == 0);
+
+  /* ...after a delayed ACK for the data received before the change */
+  p = test_ca_rx_data(pcb, IP_ECN_ECT0, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(txcounters.num_tx_calls == 0);
+  p = test_ca_rx_data(pcb, IP_ECN_CE, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+  EXPECT(txcounters.num_tx_calls == 2);
+  test_ca_tx_packet(&txcounters, &tos, &tcpflags);
+  EXPECT((tcpflags & TCP_ECE) == 0);
+  EXPECT(pcb->ecn_flags & TCP_ECN_DEMAND_CWR);
+
+  txcounters.copy_tx_packets = 0;
+  tcp_abort(pcb);
+#else /* LWIP_TCP_DCTCP */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_DCTCP */
+}
+END_TEST
+
+/** With CE marks at a low queue threshold, DCTCP fills the bottleneck with a
+ * fraction of the queue cubic builds up */
+START_TEST(test_tcp_ca_dctcp_vs_cubic)
+{
+#if LWIP_TCP_DCTCP
+  struct test_ca_result cubic, dctcp;
+  u32_t link_rate = TCP_MSS * 1000 / TEST_CA_LINK_MS;
+  LWIP_UNUSED_ARG(_i);
+
+  test_ca_run(&tcp_ca_cubic, 64, 0, &cubic);
+  test_ca_run(&tcp_ca_dctcp, 64, 8, &dctcp);
+  EXPECT(dctcp.rate >= link_rate * 9 / 10);
+  EXPECT(dctcp.drops == 0);
+  EXPECT(dctcp.marks > 0);
+  EXPECT(2 * dctcp.queue_delay < cubic.queue_delay);
+#else /* LWIP_TCP_DCTCP */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_DCTCP */
+}
+END_TEST
+
+/** A paced connection sends one segment per departure time and the pacing
+ * timer releases the next one */
+START_TEST(test_tcp_pacing)
+{
+#if LWIP_TCP_PACING
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct sys_timeo **timeouts = sys_timeouts_get_next_timeout();
+  struct sys_timeo *old_timeouts;
+  u32_t start = lwip_sys_now;
+  u32_t gap;
+  int i;
+  err_t err;
+  LWIP_UNUSED_ARG(_i);
+
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  memset(&counters, 0, sizeof(counters));
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  tcp_set_flags(pcb, TF_NODELAY);
+  old_timeouts = *timeouts;
+  *timeouts = NULL;
+  pcb->mss = TCP_MSS;
+  pcb->cong_ops = &tcp_ca_cubic;
+  tcp_init_congestion_control(pcb);
+  pcb->cwnd = 10 * TCP_MSS;
+  pcb->ssthresh = 10 * TCP_MSS;
+  pcb->srtt = 100 << 3;
+  tcp_set_pacing(pcb, 1);
+  /* cwnd per srtt, with TCP_PACING_CA_RATIO on top */
+  EXPECT(pcb->pacing_rate == (10 * TCP_MSS * 10 / 100) * TCP_PACING_CA_RATIO);
+  gap = TCP_MSS * 1000 / pcb->pacing_rate;
+
+  for (i = 0; i < 4; i++) {
+    err = tcp_write(pcb, test_ca_data, TCP_MSS, TCP_WRITE_FLAG_COPY);
+    EXPECT_RET(err == ERR_OK);
+  }
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT(txcounters.num_tx_calls == 1);
+
+  /* the next segment leaves at the departure time, not before */
+  lwip_sys_now = start + gap - 1;
+  sys_check_timeouts();
+  EXPECT(txcounters.num_tx_calls == 1);
+  lwip_sys_now = start + gap;
+  sys_check_timeouts();
+  EXPECT(txcounters.num_tx_calls == 2);
+  lwip_sys_now = start + 2 * gap;
+  sys_check_timeouts();
+  EXPECT(txcounters.num_tx_calls == 3);
+
+  /* without pacing the rest goes out at once */
+  tcp_set_pacing(pcb, 0);
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT(txcounters.num_tx_calls == 4);
+
+  tcp_abort(pcb);
+  EXPECT(*timeouts == NULL);
+  *timeouts = old_timeouts;
+  lwip_sys_now = start;
+#else /* LWIP_TCP_PACING */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_PACING */
+}
+END_TEST
+
+/** If the pacing timer does not send (MEMP_SYS_TIMEOUT was empty when it
+ * should have been armed), tcp_fasttmr() sends once the departure time passed */
+START_TEST(test_tcp_pacing_fasttmr)
+{
+#if LWIP_TCP_PACING
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb;
+  struct sys_timeo **timeouts = sys_timeouts_get_next_timeout();
+  struct sys_timeo *old_timeouts;
+  u32_t start = lwip_sys_now;
+  u32_t gap;
+  err_t err;
+  LWIP_UNUSED_ARG(_i);
+
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  memset(&counters, 0, sizeof(counters));
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  tcp_set_flags(pcb, TF_NODELAY);
+  old_timeouts = *timeouts;
+  *timeouts = NULL;
+  pcb->mss = TCP_MSS;
+  pcb->cong_ops = &tcp_ca_cubic;
+  tcp_init_congestion_control(pcb);
+  pcb->cwnd = 10 * TCP_MSS;
+  pcb->ssthresh = 10 * TCP_MSS;
+  pcb->srtt = 100 << 3;
+  tcp_set_pacing(pcb, 1);
+  gap = TCP_MSS * 1000 / pcb->pacing_rate;
+
+  err = tcp_write(pcb, test_ca_data, TCP_MSS, TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_write(pcb, test_ca_data, TCP_MSS, TCP_WRITE_FLAG_COPY);
+  EXPECT_RET(err == ERR_OK);
+  err = tcp_output(pcb);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT(txcounters.num_tx_calls == 1);
+  EXPECT(*timeouts != NULL);
+
+  /* nothing before the departure time */
+  lwip_sys_now = start + gap - 1;
+  tcp_fasttmr();
+  EXPECT(txcounters.num_tx_calls == 1);
+  /* the timer did not run: tcp_fasttmr() sends and cancels it */
+  lwip_sys_now = start + gap;
+  tcp_fasttmr();
+  EXPECT(txcounters.num_tx_calls == 2);
+  EXPECT(*timeouts == NULL);
+  EXPECT(!(pcb->pacing_flags & TCP_PACING_TMR_ARMED));
+
+  tcp_abort(pcb);
+  *timeouts = old_timeouts;
+  lwip_sys_now = start;
+#else /* LWIP_TCP_PACING */
+  LWIP_UNUSED_ARG(_i);
+#endif /* LWIP_TCP_PACING */
+}
+END_TEST
+
+
+#if LWIP_TCP_REQ_TABLE
+static err_t
+test_tcp_ca_accept(void *arg, struct tcp_pcb *newpcb, err_t err)
+{
+  LWIP_UNUSED_ARG(arg);
+  LWIP_UNUSED_ARG(newpcb);
+  EXPECT(err == ERR_OK);
+  return ERR_OK;
+}
+#endif /* LWIP_TCP_REQ_TABLE */
+
+/** Congestion controls are looked up by name, new connections start with the
+ * default and connections accepted by a listener inherit its choice */
+START_TEST(test_tcp_ca_registry)
+{
+  static struct tcp_congestion_ops custom, extra[TCP_CA_NUM_EXTRA + 1];
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb, *pcbl;
+  struct pbuf *p;
+  ip_addr_t src_addr;
+  tcpwnd_size_t cwnd;
+  err_t err;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  EXPECT(tcp_ca_find("cubic") == &tcp_ca_cubic);
+  EXPECT(tcp_ca_find("reno") == &tcp_ca_reno);
+#if LWIP_TCP_HYSTART_PP
+  EXPECT(tcp_ca_find("cubic_hspp") == &tcp_ca_cubic_hspp);
+  EXPECT(tcp_ca_cubic_hspp.priv_size <= TCP_CA_PRIV_SIZE);
+#endif /* LWIP_TCP_HYSTART_PP */
+#if LWIP_TCP_BBR
+  EXPECT(tcp_ca_find("bbr") == &tcp_ca_bbr);
+#endif /* LWIP_TCP_BBR */
+  EXPECT(tcp_ca_find("vegas") == NULL);
+  EXPECT(tcp_ca_cubic.priv_size <= TCP_CA_PRIV_SIZE);
+#if LWIP_TCP_BBR
+  EXPECT(tcp_ca_bbr.priv_size <= TCP_CA_PRIV_SIZE);
+#endif /* LWIP_TCP_BBR */
+#if LWIP_TCP_DCTCP
+  EXPECT(tcp_ca_dctcp.priv_size <= TCP_CA_PRIV_SIZE);
+#endif /* LWIP_TCP_DCTCP */
+  EXPECT(strcmp(tcp_get_default_congestion_control(), "cubic") == 0);
+
+  custom = tcp_ca_reno;
+  strcpy(custom.name, "cubic");
+  EXPECT(tcp_register_congestion_control(&custom) == ERR_VAL);
+  strcpy(custom.name, "custom");
+  /* the private state must fit into the pcb */
+  custom.priv_size = TCP_CA_PRIV_SIZE + 4;
+  EXPECT(tcp_register_congestion_control(&custom) == ERR_ARG);
+  custom.priv_size = 0;
+#if TCP_CA_NUM_EXTRA
+  EXPECT(tcp_register_congestion_control(&custom) == ERR_OK);
+  EXPECT(tcp_register_congestion_control(&custom) == ERR_VAL);
+  EXPECT(tcp_ca_find("custom") == &custom);
+
+  EXPECT(tcp_set_default_congestion_control("vegas") == ERR_VAL);
+  /* the ops are referenced, so the size is checked again when selected */
+  custom.priv_size = TCP_CA_PRIV_SIZE + 4;
+  EXPECT(tcp_set_default_congestion_control("custom") == ERR_VAL);
+  pcb = tcp_new();
+  EXPECT_RET(pcb != NULL);
+  EXPECT(tcp_set_congestion_control(pcb, "custom") == ERR_VAL);
+  EXPECT(pcb->cong_ops == &tcp_ca_cubic);
+  tcp_abort(pcb);
+  custom.priv_size = 0;
+  EXPECT(tcp_set_default_congestion_control("custom") == ERR_OK);
+  pcb = tcp_new();
+  EXPECT_RET(pcb != NULL);
+  EXPECT(pcb->cong_ops == &custom);
+  tcp_abort(pcb);
+  /* the default does not outlive its congestion control */
+  EXPECT(tcp_unregister_congestion_control(&custom) == ERR_OK);
+  EXPECT(tcp_unregister_congestion_control(&custom) == ERR_VAL);
+  EXPECT(tcp_ca_find("custom") == NULL);
+  EXPECT(strcmp(tcp_get_default_congestion_control(), "cubic") == 0);
+
+  /* the number of extra congestion controls is limited */
+  for (i = 0; i < TCP_CA_NUM_EXTRA; i++) {
+    extra[i] = tcp_ca_reno;
+    extra[i].name[0] = (char)('a' + i);
+    extra[i].name[1] = 0;
+    EXPECT(tcp_register_congestion_control(&extra[i]) == ERR_OK);
+  }
+  EXPECT(tcp_register_congestion_control(&custom) == ERR_MEM);
+  for (i = 0; i < TCP_CA_NUM_EXTRA; i++) {
+    EXPECT(tcp_unregister_congestion_control(&extra[i]) == ERR_OK);
+  }
+#else /* TCP_CA_NUM_EXTRA */
+  EXPECT(tcp_register_congestion_control(&custom) == ERR_MEM);
+  LWIP_UNUSED_ARG(extra);
+  LWIP_UNUSED_ARG(i);
+#endif /* TCP_CA_NUM_EXTRA */
+
+  /* switching an open connection keeps its window */
+  test_tcp_init_netif(&netif, &txcounters, &test_local_ip, &test_netmask);
+  memset(&counters, 0, sizeof(counters));
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  pcb->cwnd = 10 * TCP_MSS;
+  cwnd = pcb->cwnd;
+  EXPECT(tcp_set_congestion_control(pcb, "vegas") == ERR_VAL);
+  EXPECT(pcb->cong_ops == &tcp_ca_cubic);
+  EXPECT(tcp_set_congestion_control(pcb, "reno") == ERR_OK);
+  EXPECT(pcb->cong_ops == &tcp_ca_reno);
+  EXPECT(pcb->cwnd == cwnd);
+  tcp_abort(pcb);
+
+#if LWIP_TCP_BBR && LWIP_TCP_PACING
+  /* the pacing BBR turned on ends with it */
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  pcb->srtt = 100 << 3;
+  EXPECT(tcp_set_congestion_control(pcb, "bbr") == ERR_OK);
+  EXPECT(pcb->pacing_flags & TCP_PACING_ON);
+  EXPECT(pcb->pacing_rate != 0);
+  EXPECT(tcp_set_congestion_control(pcb, "cubic") == ERR_OK);
+  EXPECT(!(pcb->pacing_flags & TCP_PACING_ON));
+  EXPECT(pcb->pacing_rate == 0);
+  /* pacing the application turned on stays, at the rate derived from cwnd */
+  tcp_set_pacing(pcb, 1);
+  EXPECT(tcp_set_congestion_control(pcb, "bbr") == ERR_OK);
+  pcb->pacing_rate = 0xffffffffUL;
+  EXPECT(tcp_set_congestion_control(pcb, "cubic") == ERR_OK);
+  EXPECT(pcb->pacing_flags & TCP_PACING_ON);
+  EXPECT(pcb->pacing_rate != 0xffffffffUL);
+  EXPECT(pcb->pacing_rate != 0);
+  tcp_abort(pcb);
+#endif /* LWIP_TCP_BBR && LWIP_TCP_PACING */
+
+  /* connections accepted by a listener use its congestion control */
+  pcb = tcp_new();
+  EXPECT_RET(pcb != NULL);
+  EXPECT(tcp_set_congestion_control(pcb, "reno") == ERR_OK);
+  err = tcp_bind(pcb, &netif.ip_addr, 1234);
+  EXPECT_RET(err == ERR_OK);
+  pcbl = tcp_listen(pcb);
+  EXPECT_RET(pcbl != NULL);
+  EXPECT(pcbl->cong_ops == &tcp_ca_reno);
+  ip_addr_copy(src_addr, test_remote_ip);
+  p = tcp_create_segment(&src_addr, &netif.ip_addr, 12345, 1234, NULL, 0, 12345, 0, TCP_SYN);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &netif);
+#if LWIP_TCP_REQ_TABLE
+  {
+    /* the pcb is set up by the ACK that completes the handshake */
+    struct tcp_req *req = tcp_req_lookup((struct tcp_pcb_listen *)pcbl, &netif.ip_addr, &src_addr, 12345);
+    EXPECT_RET(req != NULL);
+    tcp_accept(pcbl, test_tcp_ca_accept);
+    p = tcp_create_segment(&src_addr, &netif.ip_addr, 12345, 1234, NULL, 0, 12346, req->hs.iss + 1, TCP_ACK);
+    EXPECT_RET(p != NULL);
+    test_tcp_input(p, &netif);
+  }
+#endif /* LWIP_TCP_REQ_TABLE */
+  EXPECT_RET(tcp_active_pcbs != NULL);
+  EXPECT(tcp_active_pcbs->cong_ops == &tcp_ca_reno);
+  tcp_remove_all();
+}
+END_TEST
+
+/** Create the suite including all tests for this module */
+Suite *
+tcp_ca_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_tcp_ca_bbr_vs_cubic),
+    TESTFUNC(test_tcp_ecn_negotiation),
+    TESTFUNC(test_tcp_ecn_ce_echo),
+    TESTFUNC(test_tcp_ecn_ece_reduces_cwnd),
+    TESTFUNC(test_tcp_dctcp),
+    TESTFUNC(test_tcp_ca_dctcp_vs_cubic),
+    TESTFUNC(test_tcp_pacing),
+    TESTFUNC(test_tcp_pacing_fasttmr),
+    TESTFUNC(test_tcp_ca_registry)
+  };
+  return create_suite("TCP_CA", tests, sizeof(tests)/sizeof(testfunc), tcp_ca_setup, tcp_ca_teardown);
+}
@@ -0,0 +1,8 @@
+#ifndef LWIP_HDR_TEST_TCP_CA_H
+#define LWIP_HDR_TEST_TCP_CA_H
+
+#include "../lwip_check.h"
+
+Suite *tcp_ca_suite(void);
+
+#endif
@@ -467,6 +467,7 @@ START_TEST(test_tcp_recv_ooseq_overrun_rxwin)
   struct netif netif;
   int datalen = 0;
   int datalen2;
+  int wnd;
 
   for(i = 0; i < (int)sizeof(data_full_wnd); i++) {
     data_full_wnd[i] = (char)i;
@@ -476,20 +477,22 @@ START_TEST(test_tcp_recv_ooseq_overrun_rxwin)
   test_tcp_init_netif(&netif, NULL, &test_local_ip, &test_netmask);
   /* initialize counter struct */
   memset(&counters, 0, sizeof(counters));
-  counters.expected_data_len = TCP_WND;
   counters.expected_data = data_full_wnd;
 
   /* create and initialize the pcb */
   pcb = test_tcp_new_counters_pcb(&counters);
   EXPECT_RET(pcb != NULL);
   tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  /* the receive window the connection starts with */
+  wnd = (int)pcb->rcv_wnd;
+  counters.expected_data_len = wnd;
   pcb->rcv_nxt = 0x8000;
 
   /* create segments */
   /* pinseq is sent as last segment! */
   pinseq = tcp_create_rx_segment(pcb, &data_full_wnd[0],  TCP_MSS, 0, 0, TCP_ACK);
 
-  for(i = TCP_MSS, k = 0; i < TCP_WND; i += TCP_MSS, k++) {
+  for(i = TCP_MSS, k = 0; i < wnd; i += TCP_MSS, k++) {
     int count, expected_datalen;
     struct pbuf *p = tcp_create_rx_segment(pcb, &data_full_wnd[TCP_MSS*(k+1)],
                                            TCP_MSS, TCP_MSS*(k+1), 0, TCP_ACK);
@@ -505,10 +508,10 @@ START_TEST(test_tcp_recv_ooseq_overrun_rxwin)
     count = tcp_oos_count(pcb);
     EXPECT_OOSEQ(count == k+1);
     datalen = tcp_oos_tcplen(pcb);
-    if (i + TCP_MSS < TCP_WND) {
+    if (i + TCP_MSS < wnd) {
       expected_datalen = (k+1)*TCP_MSS;
     } else {
-      expected_datalen = TCP_WND - TCP_MSS;
+      expected_datalen = wnd - TCP_MSS;
     }
     if (datalen != expected_datalen) {
       EXPECT_OOSEQ(datalen == expected_datalen);
@@ -554,6 +557,7 @@ START_TEST(test_tcp_recv_ooseq_overrun_rxwin_edge)
   struct netif netif;
   int datalen = 0;
   int datalen2;
+  int wnd;
 
   for(i = 0; i < (int)sizeof(data_full_wnd); i++) {
     data_full_wnd[i] = (char)i;
@@ -563,20 +567,22 @@ START_TEST(test_tcp_recv_ooseq_overrun_rxwin_edge)
   test_tcp_init_netif(&netif, NULL, &test_local_ip, &test_netmask);
   /* initialize counter struct */
   memset(&counters, 0, sizeof(counters));
-  counters.expected_data_len = TCP_WND;
   counters.expected_data = data_full_wnd;
 
   /* create and initialize the pcb */
   pcb = test_tcp_new_counters_pcb(&counters);
   EXPECT_RET(pcb != NULL);
   tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
-  pcb->rcv_nxt = 0xffffffff - (TCP_WND / 2);
+  /* the receive window the connection starts with */
+  wnd = (int)pcb->rcv_wnd;
+  counters.expected_data_len = wnd;
+  pcb->rcv_nxt = 0xffffffff - (wnd / 2);
 
   /* create segments */
   /* pinseq is sent as last segment! */
   pinseq = tcp_create_rx_segment(pcb, &data_full_wnd[0],  TCP_MSS, 0, 0, TCP_ACK);
 
-  for(i = TCP_MSS, k = 0; i < TCP_WND; i += TCP_MSS, k++) {
+  for(i = TCP_MSS, k = 0; i < wnd; i += TCP_MSS, k++) {
     int count, expected_datalen;
     struct pbuf *p = tcp_create_rx_segment(pcb, &data_full_wnd[TCP_MSS*(k+1)],
                                            TCP_MSS, TCP_MSS*(k+1), 0, TCP_ACK);
@@ -592,10 +598,10 @@ START_TEST(test_tcp_recv_ooseq_overrun_rxwin_edge)
     count = tcp_oos_count(pcb);
     EXPECT_OOSEQ(count == k+1);
     datalen = tcp_oos_tcplen(pcb);
-    if (i + TCP_MSS < TCP_WND) {
+    if (i + TCP_MSS < wnd) {
       expected_datalen = (k+1)*TCP_MSS;
     } else {
-      expected_datalen = TCP_WND - TCP_MSS;
+      expected_datalen = wnd - TCP_MSS;
     }
     if (datalen != expected_datalen) {
       EXPECT_OOSEQ(datalen == expected_datalen);
@@ -985,6 +991,112 @@ FIN_TEST(test_tcp_recv_ooseq_double_FIN_13, 13)
 FIN_TEST(test_tcp_recv_ooseq_double_FIN_14, 14)
 FIN_TEST(test_tcp_recv_ooseq_double_FIN_15, 15)
 
+#if LWIP_TCP_SACK_OUT
+/** Get the contiguous range of data on the ooseq list around seqno */
+static void
+tcp_oos_range(struct tcp_pcb* pcb, u32_t seqno, u32_t* left, u32_t* right)
+{
+  struct tcp_seg* seg;
+
+  *left = *right = 0;
+  for (seg = pcb->ooseq; seg != NULL; seg = seg->next) {
+    if ((seg == pcb->ooseq) || (seg->tcphdr->seqno != *right)) {
+      if (TCP_SEQ_GT(seg->tcphdr->seqno, seqno)) {
+        break;
+      }
+      *left = seg->tcphdr->seqno;
+    }
+    *right = seg->tcphdr->seqno + seg->len;
+  }
+}
+#endif /* LWIP_TCP_SACK_OUT */
+
+/* every other one of 2 * OOSEQ_MANY_SEGS slots is queued first */
+#define OOSEQ_MANY_SEGS  ((MEMP_NUM_TCP_SEG - 4) / 2)
+#define OOSEQ_MANY_LEN   (TCP_RCV_WND_INIT / (2 * OOSEQ_MANY_SEGS + 2))
+#define OOSEQ_MANY_ROUNDS 8
+
+/** Pass one small segment of the test_tcp_recv_ooseq_many() pattern */
+static void
+tcp_oos_many_input(struct tcp_pcb* pcb, struct netif* netif, int slot)
+{
+  u32_t seqno = pcb->rcv_nxt + (u32_t)(slot * OOSEQ_MANY_LEN);
+  struct pbuf *p = tcp_create_rx_segment(pcb, &data_full_wnd[slot * OOSEQ_MANY_LEN],
+                                         OOSEQ_MANY_LEN, (u32_t)(slot * OOSEQ_MANY_LEN), 0, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, netif);
+#if LWIP_TCP_SACK_OUT
+  if (slot != 0) {
+    /* the newest SACK has to describe the range the segment went into */
+    u32_t left, right;
+    tcp_oos_range(pcb, seqno, &left, &right);
+    EXPECT(pcb->rcv_sacks[0].left == left);
+    EXPECT(pcb->rcv_sacks[0].right == right);
+  }
+#else /* LWIP_TCP_SACK_OUT */
+  LWIP_UNUSED_ARG(seqno);
+#endif /* LWIP_TCP_SACK_OUT */
+}
+
+/** Queue many small segments with every other one missing, then fill the
+ * holes. Most segments go to the end of a long ooseq queue or somewhere
+ * in its middle, which is where finding their place used to cost most. */
+START_TEST(test_tcp_recv_ooseq_many)
+{
+  struct test_tcp_counters counters;
+  struct tcp_pcb* pcb;
+  struct netif netif;
+  int i, round;
+  LWIP_UNUSED_ARG(_i);
+
+  for(i = 0; i < (int)sizeof(data_full_wnd); i++) {
+    data_full_wnd[i] = (char)i;
+  }
+
+  test_tcp_init_netif(&netif, NULL, &test_local_ip, &test_netmask);
+  memset(&counters, 0, sizeof(counters));
+  counters.expected_data_len = (2 * OOSEQ_MANY_SEGS + 1) * OOSEQ_MANY_LEN;
+  counters.expected_data = data_full_wnd;
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+#if LWIP_TCP_SACK_OUT
+  tcp_set_flags(pcb, TF_SACK);
+#endif /* LWIP_TCP_SACK_OUT */
+  pcb->rcv_nxt = 0xffff0000UL;
+
+  for (round = 0; round < OOSEQ_MANY_ROUNDS; round++) {
+    /* the odd slots go to the end of the queue, one after another */
+    for (i = 1; i < 2 * OOSEQ_MANY_SEGS; i += 2) {
+      tcp_oos_many_input(pcb, &netif, i);
+    }
+    EXPECT(tcp_oos_count(pcb) == OOSEQ_MANY_SEGS);
+    /* the even slots but the first one join their neighbours */
+    for (i = 2; i < 2 * OOSEQ_MANY_SEGS; i += 2) {
+      tcp_oos_many_input(pcb, &netif, i);
+    }
+    EXPECT(tcp_oos_count(pcb) == 2 * OOSEQ_MANY_SEGS - 1);
+    EXPECT(counters.recved_bytes == 0);
+
+    /* the first slot is in sequence and takes everything off the queue */
+    tcp_oos_many_input(pcb, &netif, 0);
+    EXPECT(pcb->ooseq == NULL);
+#if TCP_OOSEQ_TREE
+    EXPECT(pcb->ooseq_tree == NULL);
+#endif /* TCP_OOSEQ_TREE */
+    EXPECT(counters.recved_bytes == (u32_t)(2 * OOSEQ_MANY_SEGS) * OOSEQ_MANY_LEN);
+    EXPECT(counters.err_calls == 0);
+    tcp_recved(pcb, (u16_t)counters.recved_bytes);
+    counters.recved_bytes = 0;
+  }
+
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 1);
+  tcp_abort(pcb);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+}
+END_TEST
+
 
 /** Create the suite including all tests for this module */
 Suite *
@@ -1012,7 +1124,8 @@ tcp_oos_suite(void)
     TESTFUNC(test_tcp_recv_ooseq_double_FIN_12),
     TESTFUNC(test_tcp_recv_ooseq_double_FIN_13),
     TESTFUNC(test_tcp_recv_ooseq_double_FIN_14),
-    TESTFUNC(test_tcp_recv_ooseq_double_FIN_15)
+    TESTFUNC(test_tcp_recv_ooseq_double_FIN_15),
+    TESTFUNC(test_tcp_recv_ooseq_many)
   };
   return create_suite("TCP_OOS", tests, sizeof(tests)/sizeof(testfunc), tcp_oos_setup, tcp_oos_teardown);
 }
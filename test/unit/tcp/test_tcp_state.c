@@ -18,6 +18,13 @@ static struct test_tcp_txcounters test_txcounters = {0};
 
 #define SEQNO1 (0xFFFFFF00 - TCP_MSS)
 #define ISS    6510
+
+/* the pool that holds connections in SYN_RCVD */
+#if LWIP_TCP_REQ_TABLE
+#define MEMP_TCP_SYN_RCVD MEMP_TCP_REQ
+#else /* LWIP_TCP_REQ_TABLE */
+#define MEMP_TCP_SYN_RCVD MEMP_TCP_PCB
+#endif /* LWIP_TCP_REQ_TABLE */
 static u8_t test_tcp_timer;
 
 /* our own version of tcp_tmr so we can reset fast/slow timer state */
@@ -318,12 +325,21 @@ START_TEST(test_tcp_active_close)
   p = tcp_create_rx_segment(pcb, NULL, 0, 0, 0, TCP_FIN);
   EXPECT_RET(p != NULL);
   test_tcp_input(p, &test_netif);
+#if LWIP_TCP_TW_TABLE
+  /* the closed pcb has been replaced by a TIME_WAIT record */
+  EXPECT_RET(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+  EXPECT_RET(MEMP_STATS_GET(used, MEMP_TCP_TW) == 1);
+#else /* LWIP_TCP_TW_TABLE */
   EXPECT_RET(pcb->state == TIME_WAIT);
   EXPECT_RET(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 1);
+#endif /* LWIP_TCP_TW_TABLE */
   for (i = 0; i < 2 * TCP_MSL / TCP_TMR_INTERVAL + 1; i++) {
     test_tcp_tmr();
   }
   EXPECT_RET(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+#if LWIP_TCP_TW_TABLE
+  EXPECT_RET(MEMP_STATS_GET(used, MEMP_TCP_TW) == 0);
+#endif /* LWIP_TCP_TW_TABLE */
 }
 END_TEST
 
@@ -362,11 +378,20 @@ START_TEST(test_tcp_imultaneous_close)
   if (p != NULL) {
     test_tcp_input(p, &test_netif);
   }
+#if LWIP_TCP_TW_TABLE
+  /* the closed pcb has been replaced by a TIME_WAIT record */
+  EXPECT_RET(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+  EXPECT_RET(MEMP_STATS_GET(used, MEMP_TCP_TW) == 1);
+#else /* LWIP_TCP_TW_TABLE */
   EXPECT_RET(pcb->state == TIME_WAIT);
+#endif /* LWIP_TCP_TW_TABLE */
   for (i = 0; i < 2 * TCP_MSL / TCP_TMR_INTERVAL + 1; i++) {
     test_tcp_tmr();
   }
   EXPECT_RET(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+#if LWIP_TCP_TW_TABLE
+  EXPECT_RET(MEMP_STATS_GET(used, MEMP_TCP_TW) == 0);
+#endif /* LWIP_TCP_TW_TABLE */
 }
 END_TEST
 
@@ -444,6 +469,102 @@ START_TEST(test_tcp_gen_rst_in_TIME_WAIT)
 }
 END_TEST
 
+#if LWIP_TCP_TW_TABLE
+/* Get the TCP header of a packet sent */
+static void
+get_tcp_hdr_from_packet(struct pbuf *p, struct tcp_hdr *tcphdr)
+{
+  u16_t ret = pbuf_copy_partial(p, tcphdr, sizeof(struct tcp_hdr), 20);
+  EXPECT(ret == sizeof(struct tcp_hdr));
+}
+
+/* a pcb closed by the application is replaced by a record in TIME_WAIT */
+START_TEST(test_tcp_tw_table)
+{
+  struct test_tcp_counters counters;
+  struct tcp_pcb *pcb, *pcb2;
+  struct pbuf *p;
+  struct tcp_hdr tcphdr;
+  ip_addr_t local_ip = test_local_ip, remote_ip = test_remote_ip;
+  u32_t seqno, ackno, i;
+  err_t err;
+  LWIP_UNUSED_ARG(_i);
+
+  /* a pcb that the application still refers to stays a pcb */
+  memset(&counters, 0, sizeof(counters));
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &test_local_ip, &test_remote_ip, TEST_LOCAL_PORT, TEST_REMOTE_PORT);
+  err = tcp_shutdown(pcb, 0, 1);
+  EXPECT_RET(err == ERR_OK);
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, 1, TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &test_netif);
+  p = tcp_create_rx_segment(pcb, NULL, 0, 0, 0, TCP_FIN);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &test_netif);
+  EXPECT_RET(pcb->state == TIME_WAIT);
+  EXPECT(counters.close_calls == 1);
+  EXPECT_RET(MEMP_STATS_GET(used, MEMP_TCP_TW) == 0);
+  /* ... until it is closed */
+  seqno = pcb->rcv_nxt;
+  ackno = pcb->snd_nxt;
+  err = tcp_close(pcb);
+  EXPECT_RET(err == ERR_OK);
+  EXPECT_RET(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+  EXPECT_RET(MEMP_STATS_GET(used, MEMP_TCP_TW) == 1);
+
+  /* the record keeps the port in use */
+  pcb2 = tcp_new();
+  EXPECT_RET(pcb2 != NULL);
+  err = tcp_bind(pcb2, &test_local_ip, TEST_LOCAL_PORT);
+  EXPECT(err == ERR_USE);
+
+  /* a retransmitted FIN is ACKed from the record */
+  memset(&test_txcounters, 0, sizeof(test_txcounters));
+  test_txcounters.copy_tx_packets = 1;
+  p = tcp_create_segment(&remote_ip, &local_ip, TEST_REMOTE_PORT, TEST_LOCAL_PORT,
+                         NULL, 0, seqno - 1, ackno, TCP_FIN | TCP_ACK);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &test_netif);
+  test_txcounters.copy_tx_packets = 0;
+  EXPECT(test_txcounters.num_tx_calls == 1);
+  EXPECT_RET(test_txcounters.tx_packets != NULL);
+  get_tcp_hdr_from_packet(test_txcounters.tx_packets, &tcphdr);
+  EXPECT(TCPH_FLAGS(&tcphdr) == TCP_ACK);
+  EXPECT(lwip_ntohl(tcphdr.seqno) == ackno);
+  EXPECT(lwip_ntohl(tcphdr.ackno) == seqno);
+  pbuf_free(test_txcounters.tx_packets);
+  test_txcounters.tx_packets = NULL;
+
+  /* a RST is ignored */
+  memset(&test_txcounters, 0, sizeof(test_txcounters));
+  p = tcp_create_segment(&remote_ip, &local_ip, TEST_REMOTE_PORT, TEST_LOCAL_PORT,
+                         NULL, 0, seqno, ackno, TCP_RST);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &test_netif);
+  EXPECT(test_txcounters.num_tx_calls == 0);
+  EXPECT_RET(MEMP_STATS_GET(used, MEMP_TCP_TW) == 1);
+
+  /* a SYN in the window is answered with a RST */
+  p = tcp_create_segment(&remote_ip, &local_ip, TEST_REMOTE_PORT, TEST_LOCAL_PORT,
+                         NULL, 0, seqno, 0, TCP_SYN);
+  test_rst_generation_with_incoming_packet(p, &test_netif, &test_txcounters);
+  EXPECT(test_txcounters.num_tx_calls == 1);
+  EXPECT_RET(MEMP_STATS_GET(used, MEMP_TCP_TW) == 1);
+
+  /* the record expires after 2*TCP_MSL */
+  for (i = 0; i < 2 * TCP_MSL / TCP_TMR_INTERVAL + 1; i++) {
+    test_tcp_tmr();
+  }
+  EXPECT_RET(MEMP_STATS_GET(used, MEMP_TCP_TW) == 0);
+  err = tcp_bind(pcb2, &test_local_ip, TEST_LOCAL_PORT);
+  EXPECT(err == ERR_OK);
+  tcp_abort(pcb2);
+}
+END_TEST
+#endif /* LWIP_TCP_TW_TABLE */
+
 /* receive TCP_RST with different seqno */
 START_TEST(test_tcp_process_rst_seqno)
 {
@@ -575,10 +696,18 @@ START_TEST(test_tcp_gen_rst_in_SYN_RCVD)
   memset(&test_txcounters, 0, sizeof(struct test_tcp_txcounters));
   test_tcp_input(p, &test_netif);
   EXPECT(test_txcounters.num_tx_calls == 1);
-  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 1);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_SYN_RCVD) == 1);
+#if LWIP_TCP_REQ_TABLE
+  {
+    struct tcp_req *req = tcp_req_lookup(lpcb, &lpcb->local_ip, &src_addr, TEST_REMOTE_PORT);
+    EXPECT_RET(req != NULL);
+    ack_seqno = req->hs.iss;
+  }
+#else /* LWIP_TCP_REQ_TABLE */
   if (MEMP_STATS_GET(used, MEMP_TCP_PCB) == 1) {
     ack_seqno = tcp_active_pcbs[0].lastack;
   }
+#endif /* LWIP_TCP_REQ_TABLE */
 
   /* create a ACK segment with incorrect seqno */
   p = tcp_create_segment(&src_addr, &lpcb->local_ip, TEST_REMOTE_PORT,
@@ -588,7 +717,7 @@ START_TEST(test_tcp_gen_rst_in_SYN_RCVD)
   EXPECT(test_txcounters.num_tx_calls == 1);
 
   /* the active pcb still exists */
-  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 1);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_SYN_RCVD) == 1);
   EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB_LISTEN) == 1);
   if (MEMP_STATS_GET(used, MEMP_TCP_PCB_LISTEN) != 0) {
     /* can not use tcp_abort() */
@@ -625,14 +754,14 @@ START_TEST(test_tcp_receive_rst_SYN_RCVD_to_LISTEN)
   pbuf_free(test_txcounters.tx_packets);
   test_txcounters.tx_packets = NULL;
   EXPECT((tcp_flags & TCP_SYN) && (tcp_flags & TCP_ACK));
-  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 1);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_SYN_RCVD) == 1);
 
   /* create a RST segment */
   p = tcp_create_segment(&src_addr, &lpcb->local_ip, TEST_REMOTE_PORT,
     lpcb->local_port, NULL, 0, 1001, 54321, TCP_RST);
   EXPECT(p != NULL);
   test_tcp_input(p, &test_netif);
-  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_SYN_RCVD) == 0);
   EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB_LISTEN) == 1);
 
   if (MEMP_STATS_GET(used, MEMP_TCP_PCB_LISTEN) != 0) {
@@ -655,6 +784,9 @@ tcp_state_suite(void)
     TESTFUNC(test_tcp_gen_rst_in_CLOSED),
     TESTFUNC(test_tcp_gen_rst_in_LISTEN),
     TESTFUNC(test_tcp_gen_rst_in_TIME_WAIT),
+#if LWIP_TCP_TW_TABLE
+    TESTFUNC(test_tcp_tw_table),
+#endif /* LWIP_TCP_TW_TABLE */
     TESTFUNC(test_tcp_process_rst_seqno),
     TESTFUNC(test_tcp_gen_rst_in_SYN_SENT_ackseq),
     TESTFUNC(test_tcp_gen_rst_in_SYN_SENT_non_syn_ack),